@@ -9,6 +9,8 @@ namespace pumipic {
                                                   MTVs new_particle_info) {
     const auto btime = prebarrier();
     Kokkos::Profiling::pushRegion("scs_migrate");
+    //The phases and the rebuild are recorded below the migration
+    ScopedTimer migrate_timer(name + " particle migration", btime);
     Kokkos::Timer timer;
 
     //Distributor size & rank for performing migration
@@ -19,7 +21,6 @@ namespace pumipic {
     //If serial, skip migration
     if (comm_size == 1) {
       rebuild(new_element, new_particle_elements, new_particle_info);
-      RecordTime(name + " particle migration", timer.seconds(), btime);
       Kokkos::Profiling::popRegion();
       return;
     }
@@ -59,6 +60,9 @@ namespace pumipic {
       }
     }
 
+    RecordTime("count", timer.seconds());
+    timer.reset();
+
     //Gather sending particle data
     //Perform an ex-sum on num_send_particles & num_recv_particles
     kkLidView offset_send_particles("offset_send_particles", comm_size+1);
@@ -92,6 +96,9 @@ namespace pumipic {
                                                                     new_process,
                                                                     send_index);
 
+    RecordTime("pack", timer.seconds());
+    timer.reset();
+
     //Wait until all counts are received
     PS_Comm_Waitall<device_type>(num_recv_ranks, count_recv_requests, MPI_STATUSES_IGNORE);
     delete [] count_recv_requests;
@@ -110,7 +117,6 @@ namespace pumipic {
     //If no particles are being sent or received, perform rebuild
     if (num_sending_to == 0 && num_receiving_from == 0) {
       rebuild(new_element, new_particle_elements, new_particle_info);
-      RecordTime(name +" particle migration", timer.seconds(), btime);
       Kokkos::Profiling::popRegion();
       return;
     }
@@ -181,6 +187,8 @@ namespace pumipic {
         recv_element(i) = element_gid_to_lid_local.value_at(index);
       });
 
+    RecordTime("exchange", timer.seconds());
+
     /********** Set particles that were sent to non existent on this process *********/
     auto removeSentParticles = PS_LAMBDA(lid_t element_id, lid_t particle_id, lid_t mask) {
       const bool sent = new_process(particle_id) != comm_rank;
@@ -208,8 +216,6 @@ namespace pumipic {
     destroyViews<DataTypes, memory_space>(send_particle);
     destroyViews<DataTypes, memory_space>(recv_particle);
 
-    RecordTime(name +" particle migration", timer.seconds(), btime);
-
     Kokkos::Profiling::popRegion();
   }
 }
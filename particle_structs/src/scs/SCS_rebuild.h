@@ -125,6 +125,8 @@ namespace pumipic {
                                                  MTVs new_particles) {
     const auto btime = prebarrier();
     Kokkos::Profiling::pushRegion("scs_rebuild");
+    //The phases are recorded below the rebuild
+    ScopedTimer rebuild_timer(name + " rebuild", btime);
     Kokkos::Timer timer;
     int comm_rank, comm_size;
     MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
@@ -159,15 +161,17 @@ namespace pumipic {
       };
       parallel_for(resetMask, "resetMask");
 
-      RecordTime(name +" rebuild", timer.seconds(), btime);
       Kokkos::Profiling::popRegion();
 
       return;
     }
 
+    RecordTime("count", timer.seconds());
+    timer.reset();
+
     //If tryShuffling is on and shuffling works then rebuild is complete
     if (tryShuffling && reshuffle(new_element, new_particle_elements, new_particles)) {
-      RecordTime(name + " rebuild", timer.seconds(), btime);
+      RecordTime("shuffle", timer.seconds());
       Kokkos::Profiling::popRegion();
       return;
     }
@@ -198,6 +202,9 @@ namespace pumipic {
     constructOffsets(new_nchunks, new_num_slices, chunk_widths, new_offsets, new_slice_to_chunk,
                      new_capacity);
 
+    RecordTime("sort", timer.seconds());
+    timer.reset();
+
     //Allocate the SCS
     lid_t new_cap = getLastValue<lid_t>(new_offsets);
     kkLidView new_particle_mask("new_particle_mask", new_cap);
@@ -275,7 +282,7 @@ namespace pumipic {
     current_size = swap_size;
     swap_size = tmp_size;
 
-    RecordTime(name +" rebuild", timer.seconds(), btime);
+    RecordTime("copy", timer.seconds());
     Kokkos::Profiling::popRegion();
   }
 
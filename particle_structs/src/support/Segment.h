@@ -19,6 +19,9 @@ namespace pumipic {
     Segment() {}
     Segment(ViewType v) : view(v){}
 
+    //Returns false for a default constructed segment
+    bool exists() const {return view.data() != NULL;}
+
     template <typename U, std::size_t N>
     using checkRank = typename std::enable_if<std::rank<Type>::value == N &&
                                               std::is_same<Type, U>::value,
@@ -0,0 +1,100 @@
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_build.hpp>
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_deposit.hpp"
+#include "pumipic_mesh.hpp"
+
+/* Times the atomic scatter and the comm array reduction of deposit_to_vertices.
+   Contention on the vertex atomics grows with the number of particles per element,
+   other scatter strategies should be compared against these times.
+*/
+
+namespace o = Omega_h;
+namespace p = pumipic;
+namespace ps = particle_structs;
+
+typedef ps::MemberTypes<p::Vector3d> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+void setPtclPositions(o::Mesh& mesh, PS* ptcls) {
+  const int dim = mesh.dim();
+  const auto elm2verts = mesh.ask_elem_verts();
+  const auto coords = mesh.coords();
+  auto x_ps_d = ptcls->get<0>();
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      //pseudo random barycentric weights per particle
+      double w[4];
+      double wsum = 0;
+      for(int v=0; v<dim+1; v++) {
+        w[v] = 1 + ((pid * 2654435761u + v * 40503u) % 1000);
+        wsum += w[v];
+      }
+      for(int j=0; j<3; j++) {
+        double c = 0;
+        if(j < dim)
+          for(int v=0; v<dim+1; v++)
+            c += w[v] * coords[elm2verts[e*(dim+1)+v]*dim+j];
+        x_ps_d(pid,j) = c / wsum;
+      }
+    }
+  };
+  ps::parallel_for(ptcls, lamb, "setPtclPositions");
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  if (argc != 4) {
+    fprintf(stderr, "Usage: %s <dim> <elements per side> <ptcls per elem>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const int dim = atoi(argv[1]);
+  const int n = atoi(argv[2]);
+  const int ppe = atoi(argv[3]);
+  p::SetTimingVerbosity(0);
+
+  auto full_mesh = o::build_box(lib.world(), OMEGA_H_SIMPLEX, 1, 1, (dim == 3),
+                                n, n, (dim == 3) ? n : 0);
+  o::Write<o::LO> owner(full_mesh.nelems(), 0);
+  p::Mesh picparts(full_mesh, owner);
+  o::Mesh* mesh = picparts.mesh();
+  const o::LO ne = mesh->nelems();
+  const int numPtcls = ne * ppe;
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  o::GOs mesh_element_gids = picparts.globalIds(picparts.dim());
+  o::parallel_for(ne, OMEGA_H_LAMBDA(const int& i) {
+    ptcls_per_elem(i) = ppe;
+    element_gids(i) = mesh_element_gids[i];
+  });
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new ps::SellCSigma<Particle>(policy, INT_MAX, 1024, ne, numPtcls,
+                                           ptcls_per_elem, element_gids);
+  setPtclPositions(*mesh, ptcls);
+  printf("dim %d elements %d vertices %d particles %d\n",
+         dim, ne, mesh->nverts(), numPtcls);
+
+  auto x = ptcls->get<0>();
+  const int ITERS = 20;
+  double time = 0;
+  o::Write<o::Real> field;
+  for(int i = 0; i < ITERS; i++) {
+    Kokkos::fence();
+    Kokkos::Timer timer;
+    field = p::deposit_to_vertices(picparts, ptcls, x);
+    Kokkos::fence();
+    time += timer.seconds();
+  }
+  const double deposited = o::get_sum(o::Reals(field));
+  if(fabs(deposited - numPtcls) > 1e-8 * numPtcls) {
+    fprintf(stderr, "deposited charge %f does not match %d particles\n", deposited, numPtcls);
+    return EXIT_FAILURE;
+  }
+  printf("atomic deposit %f seconds per deposit\n", time / ITERS);
+  delete ptcls;
+  p::SummarizeTime();
+  return 0;
+}
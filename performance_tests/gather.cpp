@@ -0,0 +1,128 @@
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_build.hpp>
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_adjacency.hpp"
+#include "pumipic_gather.hpp"
+#include "pumipic_mesh.hpp"
+
+/* Compares gather_from_vertices of a three component field with weights
+   computed from the particle positions against weights cached by the search.
+   The bytes moved per particle are estimated without cache reuse of the
+   element and vertex data, so the reported bandwidth is an upper bound.
+*/
+
+namespace o = Omega_h;
+namespace p = pumipic;
+namespace ps = particle_structs;
+
+//position, vertex weights, field
+typedef ps::MemberTypes<p::Vector3d, p::Vector4d, p::Vector3d> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+const int NCOMP = 3;
+
+void setPtclPositions(o::Mesh& mesh, PS* ptcls, o::Write<o::LO> elem_ids) {
+  const int dim = mesh.dim();
+  const auto elm2verts = mesh.ask_elem_verts();
+  const auto coords = mesh.coords();
+  auto x_ps_d = ptcls->get<0>();
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      //pseudo random barycentric weights per particle
+      double w[4];
+      double wsum = 0;
+      for(int v=0; v<dim+1; v++) {
+        w[v] = 1 + ((pid * 2654435761u + v * 40503u) % 1000);
+        wsum += w[v];
+      }
+      for(int j=0; j<3; j++) {
+        double c = 0;
+        if(j < dim)
+          for(int v=0; v<dim+1; v++)
+            c += w[v] * coords[elm2verts[e*(dim+1)+v]*dim+j];
+        x_ps_d(pid,j) = c / wsum;
+      }
+      elem_ids[pid] = e;
+    }
+  };
+  ps::parallel_for(ptcls, lamb, "setPtclPositions");
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  if (argc != 4) {
+    fprintf(stderr, "Usage: %s <dim> <elements per side> <ptcls per elem>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const int dim = atoi(argv[1]);
+  const int n = atoi(argv[2]);
+  const int ppe = atoi(argv[3]);
+  p::SetTimingVerbosity(0);
+
+  auto full_mesh = o::build_box(lib.world(), OMEGA_H_SIMPLEX, 1, 1, (dim == 3),
+                                n, n, (dim == 3) ? n : 0);
+  o::Write<o::LO> owner(full_mesh.nelems(), 0);
+  p::Mesh picparts(full_mesh, owner);
+  o::Mesh* mesh = picparts.mesh();
+  const o::LO ne = mesh->nelems();
+  const int numPtcls = ne * ppe;
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  o::GOs mesh_element_gids = picparts.globalIds(picparts.dim());
+  o::parallel_for(ne, OMEGA_H_LAMBDA(const int& i) {
+    ptcls_per_elem(i) = ppe;
+    element_gids(i) = mesh_element_gids[i];
+  });
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new ps::SellCSigma<Particle>(policy, INT_MAX, 1024, ne, numPtcls,
+                                           ptcls_per_elem, element_gids);
+  o::Write<o::LO> elem_ids(ptcls->capacity(), -1);
+  setPtclPositions(*mesh, ptcls, elem_ids);
+  auto x = ptcls->get<0>();
+  auto weights = ptcls->get<1>();
+  auto field = ptcls->get<2>();
+  //the weights a search with the vtx_weights argument stores
+  if (dim == 3)
+    p::storeVertexWeights<3>(*mesh, ptcls, x, o::LOs(elem_ids), weights);
+  else
+    p::storeVertexWeights<2>(*mesh, ptcls, x, o::LOs(elem_ids), weights);
+  o::Write<o::Real> vtxField(mesh->nverts() * NCOMP, 1.0);
+  printf("dim %d elements %d vertices %d particles %d\n",
+         dim, ne, mesh->nverts(), numPtcls);
+
+  //estimated bytes per particle: mask, element vertex ids, vertex field values
+  //and the gathered field, plus the position and vertex coordinates or the
+  //cached weights
+  const int nv = dim + 1;
+  const double common = sizeof(lid_t) + nv * sizeof(o::LO) +
+                        nv * NCOMP * sizeof(o::Real) + NCOMP * sizeof(p::fp_t);
+  const double bytes[2] = {common + dim * sizeof(p::fp_t) + nv * dim * sizeof(o::Real),
+                           common + nv * sizeof(p::fp_t)};
+  const int ITERS = 20;
+  const char* names[2] = {"gather computed weights", "gather cached weights"};
+  double times[2] = {0, 0};
+  for(int c = 0; c < 2; c++) {
+    for(int i = 0; i < ITERS; i++) {
+      Kokkos::fence();
+      Kokkos::Timer timer;
+      if(c)
+        p::gather_from_vertices(*mesh, ptcls, x, o::Reals(vtxField), field, weights);
+      else
+        p::gather_from_vertices(*mesh, ptcls, x, o::Reals(vtxField), field);
+      Kokkos::fence();
+      const double t = timer.seconds();
+      times[c] += t;
+      p::RecordTime(names[c], t);
+    }
+    const double t = times[c] / ITERS;
+    printf("%s: %f seconds, %.0f bytes/ptcl, %.2f GB/s\n", names[c], t, bytes[c],
+           bytes[c] * numPtcls / t / 1e9);
+  }
+  printf("speedup of cached weights %.2f\n", times[0] / times[1]);
+  delete ptcls;
+  p::SummarizeTime();
+  return 0;
+}
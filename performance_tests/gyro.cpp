@@ -0,0 +1,112 @@
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_build.hpp>
+#include <Kokkos_Core.hpp>
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_library.hpp"
+#include "pumipic_mesh.hpp"
+#include "pumipic_gyro.hpp"
+
+/* Scaling of the GyroAverager map build, scatter and gather with the number
+   of rings and the points per ring on a box of n x n squares split into
+   triangles.
+*/
+
+namespace o = Omega_h;
+namespace p = pumipic;
+namespace ps = particle_structs;
+
+typedef ps::MemberTypes<p::Vector3d> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+struct ConstantRadius {
+  o::Real radius;
+  OMEGA_H_INLINE o::Real operator()(const int&) const {return radius;}
+};
+
+//Places the particles at the element centroids
+void setPtcls(o::Mesh& mesh, PS* ptcls) {
+  const auto coords = mesh.coords();
+  const auto elm2verts = mesh.ask_elem_verts();
+  auto x = ptcls->get<0>();
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      for(int j=0; j<2; j++) {
+        double c = 0;
+        for(int i=0; i<3; i++)
+          c += coords[elm2verts[e*3+i]*2+j];
+        x(pid,j) = c / 3;
+      }
+      x(pid,2) = 0;
+    }
+  };
+  ps::parallel_for(ptcls, lamb, "setPtcls");
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <squares per side> <ptcls per elem>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const int n = atoi(argv[1]);
+  const int ppe = atoi(argv[2]);
+  p::SetTimingVerbosity(0);
+  auto full_mesh = o::build_box(lib.world(), OMEGA_H_SIMPLEX, 1, 1, 0, n, n, 0);
+  o::Write<o::LO> owner(full_mesh.nelems(), 0);
+  p::Mesh picparts(full_mesh, owner);
+  o::Mesh* mesh = picparts.mesh();
+  const int ne = mesh->nelems();
+
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  Kokkos::parallel_for(ne, KOKKOS_LAMBDA(const int& i) {
+    ptcls_per_elem(i) = ppe;
+    element_gids(i) = i;
+  });
+  const int numPtcls = ne * ppe;
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new ps::SellCSigma<Particle>(policy, INT_MAX, 1024, ne, numPtcls,
+                                           ptcls_per_elem, element_gids);
+  setPtcls(*mesh, ptcls);
+  auto x = ptcls->get<0>();
+  const o::Reals field(mesh->nverts(), 1.0);
+  printf("vertices %d particles %d execution space %s\n", mesh->nverts(), numPtcls,
+         Kokkos::DefaultExecutionSpace::name());
+  printf("rings points_per_ring build(s) scatter(s) gather(s)\n");
+
+  const int ITERS = 10;
+  const o::Real rmax = 4.0 / n;
+  const int rings[4] = {1, 2, 4, 8};
+  const int points[4] = {4, 8, 16, 32};
+  for(int r = 0; r < 4; r++) {
+    for(int k = 0; k < 4; k++) {
+      p::GyroConfig config = {rmax, rings[r], points[k], 0};
+      Kokkos::fence();
+      Kokkos::Timer timer;
+      p::GyroAverager gyro(picparts, config);
+      Kokkos::fence();
+      const double build = timer.seconds();
+      const ConstantRadius radius = {rmax * 0.6};
+      double scatter = 0;
+      double gather = 0;
+      for(int i = 0; i < ITERS; i++) {
+        timer.reset();
+        gyro.scatter(ptcls, x, radius);
+        Kokkos::fence();
+        scatter += timer.seconds();
+        timer.reset();
+        gyro.gather(field);
+        Kokkos::fence();
+        gather += timer.seconds();
+      }
+      printf("%d %d %f %f %f\n", rings[r], points[k], build,
+             scatter / ITERS, gather / ITERS);
+    }
+  }
+  delete ptcls;
+  p::SummarizeTime();
+  return 0;
+}
@@ -0,0 +1,194 @@
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_for.hpp>
+#include <Kokkos_Core.hpp>
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_adjacency.hpp"
+#include "pumipic_library.hpp"
+#include "pumipic_mesh.hpp"
+#include "pumipic_lb.hpp"
+#include "boxTestMesh.hpp"
+
+/* Compares the particles selected by the ParticleBalancer in arrival order with
+   the selection of whole elements closest to the target part.
+   Even ranks start with <ptcls per elem> particles in each core element, odd ranks
+   with none. After one repartition and migration every particle is pushed a
+   fraction of the element size for <steps> steps, each followed by a search and a
+   rebuild (migrate for particles that left the safe zone).
+   Per mode the output has the number of elements the migrated particles arrived
+   in, the padding of the particle structure (capacity / particles) and the
+   averages of the search time, the rebuild time, the fraction of particles whose
+   search walked out of their element and the fraction that left the safe zone.
+   The box of n x n squares is split into one strip of columns per rank.
+*/
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+//position, target position, id
+typedef p::MemberTypes<p::Vector3d, p::Vector3d, int> Particle;
+typedef p::ParticleStructure<Particle> PS;
+
+PS* createPtcls(p::Mesh& picparts, int ppe) {
+  const int rank = picparts.comm()->rank();
+  const int ne = picparts->nelems();
+  auto owners = picparts.entOwners(picparts.dim());
+  auto gids = picparts.globalIds(picparts.dim());
+  const int rank_ppe = rank % 2 ? 0 : ppe;
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  o::parallel_for(ne, OMEGA_H_LAMBDA(const int& e) {
+    ptcls_per_elem(e) = owners[e] == rank ? rank_ppe : 0;
+    element_gids(e) = gids[e];
+  });
+  int np = 0;
+  Kokkos::parallel_reduce(ne, KOKKOS_LAMBDA(const int& e, int& sum) {
+    sum += ptcls_per_elem(e);
+  }, np);
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  return new p::SellCSigma<Particle>(policy, INT_MAX, 1024, ne, np,
+                                     ptcls_per_elem, element_gids);
+}
+
+//Places the particles at the element centroids and pushes them by step
+void setPositions(o::Mesh& mesh, PS* ptcls, double step, int iter) {
+  const auto coords = mesh.coords();
+  const auto elm2verts = mesh.ask_elem_verts();
+  auto x = ptcls->get<0>();
+  auto xtgt = ptcls->get<1>();
+  auto pid = ptcls->get<2>();
+  auto lamb = PS_LAMBDA(const int& e, const int& ptcl, const int& mask) {
+    if (mask > 0) {
+      for (int j = 0; j < 2; ++j) {
+        double c = 0;
+        for (int i = 0; i < 3; ++i)
+          c += coords[elm2verts[e*3+i]*2+j];
+        c /= 3;
+        //pseudo random direction per particle and step
+        const unsigned int seed = ptcl * 2654435761u + (j + 2 * iter) * 40503u;
+        const double dir = (seed % 1000) / 500.0 - 1;
+        x(ptcl,j) = c;
+        xtgt(ptcl,j) = c + step * dir;
+      }
+      x(ptcl,2) = 0;
+      xtgt(ptcl,2) = 0;
+      pid(ptcl) = ptcl;
+    }
+  };
+  p::parallel_for(ptcls, lamb, "setPositions");
+}
+
+//Global sum of the values of each rank
+double globalSum(double val) {
+  double sum;
+  MPI_Allreduce(&val, &sum, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  return sum;
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  const int rank = lib.world()->rank();
+  const int comm_size = lib.world()->size();
+  if (argc != 5) {
+    if (!rank)
+      fprintf(stderr, "Usage: %s <squares per side> <ptcls per elem> <steps> "
+              "<push distance relative to element size>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const int n = atoi(argv[1]);
+  const int ppe = atoi(argv[2]);
+  const int steps = atoi(argv[3]);
+  const double step = atof(argv[4]) / n;
+  p::SetTimingVerbosity(0);
+  auto full_mesh = buildBoxMesh(lib, n);
+  o::LOs owner = stripOwners(full_mesh, comm_size);
+  p::Mesh picparts(full_mesh, owner, 3, 2);
+  o::Mesh* mesh = picparts.mesh();
+  const int ne = mesh->nelems();
+  auto safe = picparts.safeTag();
+  auto owners = picparts.entOwners(picparts.dim());
+  p::ParticleBalancer* balancer = picparts.ptclBalancer();
+
+  if (!rank)
+    printf("mode arrived_elements padding search(s) rebuild(s) moved unsafe\n");
+  const p::ParticleBalancer::SelectionMode modes[2] =
+    {p::ParticleBalancer::ARRIVAL_SELECTION, p::ParticleBalancer::ELEMENT_SELECTION};
+  const char* names[2] = {"arrival", "elements"};
+  for (int mode = 0; mode < 2; ++mode) {
+    PS* ptcls = createPtcls(picparts, ppe);
+    PS::kkLidView new_elems("new_elems", ptcls->capacity());
+    PS::kkLidView new_procs("new_procs", ptcls->capacity());
+    auto setDest = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+      new_elems(pid) = mask ? e : -1;
+      new_procs(pid) = rank;
+    };
+    p::parallel_for(ptcls, setDest, "setDest");
+    balancer->setSelectionMode(modes[mode]);
+    balancer->repartition(picparts, ptcls, 1.05, new_elems, new_procs);
+    ptcls->migrate(new_elems, new_procs);
+
+    //Elements holding particles that arrived from another rank
+    o::Write<o::LO> arrived(ne, 0);
+    auto markArrived = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+      if (mask > 0 && owners[e] != rank)
+        arrived[e] = 1;
+    };
+    p::parallel_for(ptcls, markArrived, "markArrived");
+    const double arrival_elms = globalSum(o::get_sum(o::LOs(arrived)));
+    const double padding = globalSum(ptcls->capacity()) / globalSum(ptcls->nPtcls());
+
+    double search_time = 0, rebuild_time = 0, moved = 0, unsafe = 0, total = 0;
+    for (int s = 0; s < steps; ++s) {
+      setPositions(*mesh, ptcls, step, s);
+      o::Write<o::LO> elem_ids(ptcls->capacity(), -1);
+      Kokkos::fence();
+      Kokkos::Timer timer;
+      p::search_mesh_2d(*mesh, ptcls, ptcls->get<0>(), ptcls->get<1>(), ptcls->get<2>(),
+                        elem_ids, 100, o::Write<o::LO>(), o::Write<o::Real>(),
+                        p::NoWallInteraction(), safe);
+      Kokkos::fence();
+      search_time += timer.seconds();
+      PS::kkLidView step_elems("step_elems", ptcls->capacity());
+      PS::kkLidView step_procs("step_procs", ptcls->capacity());
+      o::Write<o::LO> counts(3, 0);
+      auto setStep = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+        const o::LO elm = mask > 0 ? elem_ids[pid] : -1;
+        step_elems(pid) = elm;
+        step_procs(pid) = elm >= 0 && !safe[elm] ? owners[elm] : rank;
+        if (mask > 0) {
+          Kokkos::atomic_add(&(counts[0]), 1);
+          if (elm != e)
+            Kokkos::atomic_add(&(counts[1]), 1);
+          if (elm >= 0 && !safe[elm])
+            Kokkos::atomic_add(&(counts[2]), 1);
+        }
+      };
+      p::parallel_for(ptcls, setStep, "setStep");
+      o::HostRead<o::LO> counts_h(counts);
+      total += counts_h[0];
+      moved += counts_h[1];
+      unsafe += counts_h[2];
+      timer.reset();
+      ptcls->migrate(step_elems, step_procs);
+      Kokkos::fence();
+      rebuild_time += timer.seconds();
+    }
+    double max_search, max_rebuild;
+    MPI_Reduce(&search_time, &max_search, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&rebuild_time, &max_rebuild, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    total = globalSum(total);
+    moved = globalSum(moved);
+    unsafe = globalSum(unsafe);
+    p::RecordTime(mode ? "element selection rebuild" : "arrival selection rebuild",
+                  rebuild_time);
+    if (!rank)
+      printf("%s %.0f %.3f %f %f %.4f %.4f\n", names[mode], arrival_elms, padding,
+             max_search / steps, max_rebuild / steps, moved / total, unsafe / total);
+    delete ptcls;
+  }
+  balancer->setSelectionMode(p::ParticleBalancer::ARRIVAL_SELECTION);
+  p::SummarizeTime();
+  return 0;
+}
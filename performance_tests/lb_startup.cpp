@@ -0,0 +1,63 @@
+#include <cmath>
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_build.hpp>
+#include <Omega_h_for.hpp>
+#include <Kokkos_Core.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_library.hpp"
+#include "pumipic_mesh.hpp"
+
+/* Startup cost of the picparts and the ParticleBalancer sbar construction
+   on a box of n x n squares split into a near square grid of rank blocks.
+   Wider safe zones overlap more ranks and create more sbars per element.
+*/
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  const int rank = lib.world()->rank();
+  const int comm_size = lib.world()->size();
+  if (argc != 4) {
+    if (!rank)
+      fprintf(stderr, "Usage: %s <squares per side> <buffer layers> <safe layers>\n",
+              argv[0]);
+    return EXIT_FAILURE;
+  }
+  const int n = atoi(argv[1]);
+  const int buffer_layers = atoi(argv[2]);
+  const int safe_layers = atoi(argv[3]);
+  p::SetTimingVerbosity(0);
+  auto full_mesh = o::build_box(lib.self(), OMEGA_H_SIMPLEX, 1, 1, 0, n, n, 0);
+  int px = std::sqrt((double)comm_size);
+  while (comm_size % px)
+    --px;
+  const int py = comm_size / px;
+  const auto coords = full_mesh.coords();
+  const auto elm2verts = full_mesh.ask_elem_verts();
+  o::Write<o::LO> owner(full_mesh.nelems());
+  o::parallel_for(full_mesh.nelems(), OMEGA_H_LAMBDA(const o::LO& e) {
+    o::Real c[2] = {0, 0};
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 2; ++j)
+        c[j] += coords[elm2verts[e*3+i]*2+j] / 3;
+    const int bx = c[0] * px < px ? c[0] * px : px - 1;
+    const int by = c[1] * py < py ? c[1] * py : py - 1;
+    owner[e] = by * px + bx;
+  });
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  Kokkos::Timer timer;
+  p::Mesh picparts(full_mesh, owner, buffer_layers, safe_layers);
+  Kokkos::fence();
+  const double construct = timer.seconds();
+  double max_construct;
+  MPI_Reduce(&construct, &max_construct, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  if (!rank)
+    printf("ranks %d (%d x %d) elements %d picpart construction(s) %f\n", comm_size, px, py,
+           full_mesh.nelems(), max_construct);
+  p::SummarizeTime();
+  return 0;
+}
@@ -0,0 +1,139 @@
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_for.hpp>
+#include <Kokkos_Core.hpp>
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_library.hpp"
+#include "pumipic_mesh.hpp"
+#include "pumipic_lb.hpp"
+#include "boxTestMesh.hpp"
+
+/* Synthetic two species particle balancing
+   Every rank starts with the same number of particles, but on even ranks half
+   of them are a heavy species (e.g. subcycled electrons) that costs <heavy cost>
+   times a light particle. Balancing the counts leaves the work imbalanced,
+   balancing the per particle weights evens out the work.
+   The box of n x n squares is split into one strip of columns per rank.
+*/
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+//species (0 light, 1 heavy)
+typedef p::MemberTypes<int> Particle;
+typedef p::ParticleStructure<Particle> PS;
+
+struct SpeciesWeight {
+  PS::Slice<0> species;
+  double heavy;
+  KOKKOS_INLINE_FUNCTION double operator()(const int ptcl) const {
+    return species(ptcl) ? heavy : 1.0;
+  }
+};
+
+PS* createPtcls(p::Mesh& picparts, int ppe) {
+  const int rank = picparts.comm()->rank();
+  const int ne = picparts->nelems();
+  auto owners = picparts.entOwners(picparts.dim());
+  auto gids = picparts.globalIds(picparts.dim());
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  o::parallel_for(ne, OMEGA_H_LAMBDA(const int& e) {
+    ptcls_per_elem(e) = owners[e] == rank ? ppe : 0;
+    element_gids(e) = gids[e];
+  });
+  int np = 0;
+  Kokkos::parallel_reduce(ne, KOKKOS_LAMBDA(const int& e, int& sum) {
+    sum += ptcls_per_elem(e);
+  }, np);
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new p::SellCSigma<Particle>(policy, INT_MAX, 1024, ne, np,
+                                          ptcls_per_elem, element_gids);
+  auto species = ptcls->get<0>();
+  const bool has_heavy = rank % 2 == 0;
+  auto setSpecies = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask)
+      species(pid) = has_heavy && pid % 2;
+  };
+  p::parallel_for(ptcls, setSpecies, "setSpecies");
+  return ptcls;
+}
+
+//Global max/avg of the particle counts and of the weights
+void imbalance(PS* ptcls, double heavy, double& count_imb, double& weight_imb) {
+  o::Write<o::Real> total(1, 0);
+  SpeciesWeight weight = {ptcls->get<0>(), heavy};
+  auto sumWeight = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask)
+      Kokkos::atomic_add(&(total[0]), weight(pid));
+  };
+  p::parallel_for(ptcls, sumWeight, "sumWeight");
+  double local[2] = {(double)ptcls->nPtcls(), o::HostRead<o::Real>(total)[0]};
+  double max[2], sum[2];
+  MPI_Allreduce(local, max, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Allreduce(local, sum, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  int comm_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+  count_imb = max[0] / (sum[0] / comm_size);
+  weight_imb = max[1] / (sum[1] / comm_size);
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  const int rank = lib.world()->rank();
+  const int comm_size = lib.world()->size();
+  if (argc != 5) {
+    if (!rank)
+      fprintf(stderr, "Usage: %s <squares per side> <ptcls per elem> <heavy cost> "
+              "<steps>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const int n = atoi(argv[1]);
+  const int ppe = atoi(argv[2]);
+  const double heavy = atof(argv[3]);
+  const int steps = atoi(argv[4]);
+  p::SetTimingVerbosity(0);
+  auto full_mesh = buildBoxMesh(lib, n);
+  o::LOs owner = stripOwners(full_mesh, comm_size);
+  p::Mesh picparts(full_mesh, owner, 3, 2);
+  p::ParticleBalancer* balancer = picparts.ptclBalancer();
+
+  if (!rank)
+    printf("mode step count_imbalance weight_imbalance balance(s)\n");
+  const char* modes[2] = {"counts", "weights"};
+  for (int mode = 0; mode < 2; ++mode) {
+    PS* ptcls = createPtcls(picparts, ppe);
+    double count_imb, weight_imb;
+    imbalance(ptcls, heavy, count_imb, weight_imb);
+    if (!rank)
+      printf("%s 0 %.3f %.3f 0\n", modes[mode], count_imb, weight_imb);
+    for (int step = 1; step <= steps; ++step) {
+      PS::kkLidView new_elems("new_elems", ptcls->capacity());
+      PS::kkLidView new_procs("new_procs", ptcls->capacity());
+      auto setDest = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+        new_elems(pid) = mask ? e : -1;
+        new_procs(pid) = rank;
+      };
+      p::parallel_for(ptcls, setDest, "setDest");
+      Kokkos::Timer timer;
+      if (mode == 0)
+        balancer->repartition(picparts, ptcls, 1.05, new_elems, new_procs);
+      else {
+        SpeciesWeight weight = {ptcls->get<0>(), heavy};
+        balancer->repartition(picparts, ptcls, 1.05, new_elems, new_procs, 0.5, weight);
+      }
+      Kokkos::fence();
+      const double balance_time = timer.seconds();
+      p::RecordTime(mode ? "weighted repartition" : "count repartition", balance_time);
+      ptcls->migrate(new_elems, new_procs);
+      imbalance(ptcls, heavy, count_imb, weight_imb);
+      if (!rank)
+        printf("%s %d %.3f %.3f %f\n", modes[mode], step, count_imb, weight_imb,
+               balance_time);
+    }
+    delete ptcls;
+  }
+  p::SummarizeTime();
+  return 0;
+}
@@ -0,0 +1,90 @@
+#include <Kokkos_Core.hpp>
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_library.hpp"
+#include "pumipic_push.hpp"
+
+/* Throughput of pushBoris in particles per second. Run with the OpenMP or
+   Serial backend to measure the CPU throughput.
+*/
+
+namespace o = Omega_h;
+namespace p = pumipic;
+namespace ps = particle_structs;
+
+//position, pushed position, velocity, electric field, magnetic field, species
+typedef ps::MemberTypes<p::Vector3d, p::Vector3d, p::Vector3d, p::Vector3d,
+                        p::Vector3d, int> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+void setPtcls(PS* ptcls, int nspecies) {
+  auto x = ptcls->get<0>();
+  auto v = ptcls->get<2>();
+  auto efield = ptcls->get<3>();
+  auto bfield = ptcls->get<4>();
+  auto species = ptcls->get<5>();
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      for(int i=0; i<3; i++) {
+        x(pid,i) = e;
+        v(pid,i) = 1e4 * (i + 1);
+        efield(pid,i) = 1e2 * (i - 1);
+        bfield(pid,i) = 0.5 * (3 - i);
+      }
+      species(pid) = pid % nspecies;
+    }
+  };
+  ps::parallel_for(ptcls, lamb, "setPtcls");
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  if (argc != 4) {
+    fprintf(stderr, "Usage: %s <elements> <ptcls per elem> <species>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const int ne = atoi(argv[1]);
+  const int ppe = atoi(argv[2]);
+  const int nspecies = atoi(argv[3]);
+  p::SetTimingVerbosity(0);
+
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  Kokkos::parallel_for(ne, KOKKOS_LAMBDA(const int& i) {
+    ptcls_per_elem(i) = ppe;
+    element_gids(i) = i;
+  });
+  const int numPtcls = ne * ppe;
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new ps::SellCSigma<Particle>(policy, INT_MAX, 1024, ne, numPtcls,
+                                           ptcls_per_elem, element_gids);
+  setPtcls(ptcls, nspecies);
+  std::vector<double> charge(nspecies);
+  std::vector<double> amu(nspecies);
+  for(int s = 0; s < nspecies; s++) {
+    charge[s] = (s % 2) ? -1 : 1;
+    amu[s] = 1 + s;
+  }
+  const auto q_m = p::speciesChargeToMass(charge, amu);
+  printf("particles %d species %d execution space %s\n", numPtcls, nspecies,
+         Kokkos::DefaultExecutionSpace::name());
+
+  const int ITERS = 50;
+  const double dt = 1e-9;
+  double time = 0;
+  for(int i = 0; i < ITERS; i++) {
+    Kokkos::fence();
+    Kokkos::Timer timer;
+    p::pushBoris<0, 1, 2, 3, 4, 5>(ptcls, q_m, dt);
+    Kokkos::fence();
+    const double t = timer.seconds();
+    time += t;
+    p::RecordTime("pushBoris", t);
+  }
+  printf("pushBoris %f seconds per push, %.3e particles per second\n",
+         time / ITERS, numPtcls * (double)ITERS / time);
+  delete ptcls;
+  p::SummarizeTime();
+  return 0;
+}
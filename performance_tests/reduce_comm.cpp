@@ -0,0 +1,135 @@
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_for.hpp>
+#include <Kokkos_Core.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_library.hpp"
+#include "pumipic_mesh.hpp"
+#include "pumipic_input.hpp"
+#include "pumipic_comm_plan.hpp"
+#include "boxTestMesh.hpp"
+
+/* Per call cost of reduceCommArray on vertices, MAX_OP keeps the values
+   fixed over the repeated reductions. The first call of each nvals
+   builds the cached comm plan, later calls reuse it. The box of n x n squares
+   is split into one strip of columns per rank with one buffer layer.
+   Each nvals is run with staged (host mirror) and device direct comm plans, large
+   nvals with many squares per side show the cost of the host copies.
+   Four fields, e.g. a density, two vectors and a diagnostic, are then reduced
+   with sequential reduceCommArray calls and with one reduceCommArrays call.
+   Last, full mesh picparts with one safe layer compare the MPI_Allreduce with the
+   sparse reduce-scatter plan and print the cost model estimates.
+*/
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  const int rank = lib.world()->rank();
+  const int comm_size = lib.world()->size();
+  if (argc != 3) {
+    if (!rank)
+      fprintf(stderr, "Usage: %s <squares per side> <iterations>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const int n = atoi(argv[1]);
+  const int iters = atoi(argv[2]);
+  p::SetTimingVerbosity(0);
+  auto full_mesh = buildBoxMesh(lib, n);
+  o::LOs owner = stripOwners(full_mesh, comm_size);
+  p::Mesh picparts(full_mesh, owner, 1, 0);
+  if (!rank)
+    printf("ranks %d picpart vertices %d\nmode nvals first(s) per call(s)\n", comm_size,
+           picparts.nents(0));
+
+  //Staged plans copy through host mirrors, direct plans hand the views to MPI
+  const bool default_mode = picparts.deviceDirectComm();
+  const char* mode_names[2] = {"staged", "direct"};
+  const int nvals[4] = {1, 3, 8, 32};
+  for (int mode = 0; mode < 2; ++mode) {
+    picparts.setDeviceDirectComm(mode == 1);
+    for (int i = 0; i < 4; ++i) {
+      o::Write<o::Real> field = picparts.createCommArray(0, nvals[i], 1.0);
+      MPI_Barrier(MPI_COMM_WORLD);
+      Kokkos::Timer timer;
+      picparts.reduceCommArray(0, p::Mesh::MAX_OP, field);
+      Kokkos::fence();
+      const double first = timer.seconds();
+      MPI_Barrier(MPI_COMM_WORLD);
+      timer.reset();
+      for (int j = 0; j < iters; ++j)
+        picparts.reduceCommArray(0, p::Mesh::MAX_OP, field);
+      Kokkos::fence();
+      const double per_call = timer.seconds() / iters;
+      double max_first, max_per_call;
+      MPI_Reduce(&first, &max_first, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+      MPI_Reduce(&per_call, &max_per_call, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+      p::RecordTime(mode ? "direct reduceCommArray" : "staged reduceCommArray", per_call);
+      if (!rank)
+        printf("%s %d %f %f\n", mode_names[mode], nvals[i], max_first, max_per_call);
+    }
+  }
+  picparts.setDeviceDirectComm(default_mode);
+
+  const p::Mesh::Op ops[4] = {p::Mesh::MAX_OP, p::Mesh::MAX_OP, p::Mesh::MIN_OP,
+                              p::Mesh::BCAST_OP};
+  const int field_vals[4] = {1, 3, 3, 1};
+  std::vector<p::Mesh::Op> op_list(ops, ops + 4);
+  std::vector<o::Write<o::Real> > fields;
+  for (int i = 0; i < 4; ++i)
+    fields.push_back(picparts.createCommArray(0, field_vals[i], 1.0));
+  //build the plans before timing
+  picparts.reduceCommArrays(0, op_list, fields);
+  for (int i = 0; i < 4; ++i)
+    picparts.reduceCommArray(0, ops[i], fields[i]);
+  MPI_Barrier(MPI_COMM_WORLD);
+  Kokkos::Timer timer;
+  for (int j = 0; j < iters; ++j)
+    for (int i = 0; i < 4; ++i)
+      picparts.reduceCommArray(0, ops[i], fields[i]);
+  Kokkos::fence();
+  const double sequential = timer.seconds() / iters;
+  MPI_Barrier(MPI_COMM_WORLD);
+  timer.reset();
+  for (int j = 0; j < iters; ++j)
+    picparts.reduceCommArrays(0, op_list, fields);
+  Kokkos::fence();
+  const double batched = timer.seconds() / iters;
+  double max_sequential, max_batched;
+  MPI_Reduce(&sequential, &max_sequential, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  MPI_Reduce(&batched, &max_batched, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  p::RecordTime("sequential reductions", sequential);
+  p::RecordTime("batched reductions", batched);
+  if (!rank)
+    printf("4 fields sequential(s) %f batched(s) %f speedup %.2f\n", max_sequential,
+           max_batched, max_sequential / max_batched);
+
+  //Full mesh picparts with the same owners and a one layer safe zone
+  p::Input input(full_mesh, p::Input::PARTITION, owner, p::Input::FULL, p::Input::BFS);
+  p::Mesh full_picparts(input);
+  if (!rank)
+    printf("full mesh mode nvals per call(s) allreduce model(s) scatter model(s)\n");
+  for (int mode = 0; mode < 2; ++mode) {
+    full_picparts.setSparseFullMeshReduction(mode == 1);
+    for (int i = 0; i < 4; ++i) {
+      o::Write<o::Real> field = full_picparts.createCommArray(0, nvals[i], 1.0);
+      full_picparts.reduceCommArray(0, p::Mesh::MAX_OP, field);
+      MPI_Barrier(MPI_COMM_WORLD);
+      Kokkos::Timer timer;
+      for (int j = 0; j < iters; ++j)
+        full_picparts.reduceCommArray(0, p::Mesh::MAX_OP, field);
+      Kokkos::fence();
+      const double per_call = timer.seconds() / iters;
+      double max_per_call;
+      MPI_Reduce(&per_call, &max_per_call, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+      p::FullMeshPlan<o::Real>* plan = full_picparts.fullMeshPlan<o::Real>(0, nvals[i]);
+      if (!rank)
+        printf("%s %d %f %f %f\n", !mode ? "allreduce" : plan->scatter() ? "scatter" :
+               "fallback", nvals[i], max_per_call, plan->allreduceCost(),
+               plan->scatterCost());
+    }
+  }
+  p::SummarizeTime();
+  return 0;
+}
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_build.hpp>
+#include <Omega_h_reorder.hpp>
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_adjacency.hpp"
+#include "pumipic_deposit.hpp"
+#include "pumipic_mesh.hpp"
+
+/* Compares search and deposition on picparts in the order of the full mesh against
+   the space filling curve and reverse Cuthill-McKee numberings. The full mesh can
+   be shuffled to mimic the order of an unstructured mesh generator.
+*/
+
+namespace o = Omega_h;
+namespace p = pumipic;
+namespace ps = particle_structs;
+
+typedef ps::MemberTypes<p::Vector3d, p::Vector3d, int> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+void setPtclPositions(o::Mesh& mesh, PS* ptcls, double step) {
+  const int dim = mesh.dim();
+  const auto elm2verts = mesh.ask_elem_verts();
+  const auto coords = mesh.coords();
+  auto x_ps_d = ptcls->get<0>();
+  auto xtgt_ps_d = ptcls->get<1>();
+  auto pid_d = ptcls->get<2>();
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      for(int j=0; j<3; j++) {
+        double c = 0;
+        if(j < dim) {
+          for(int v=0; v<dim+1; v++)
+            c += coords[elm2verts[e*(dim+1)+v]*dim+j];
+          c /= dim+1;
+        }
+        x_ps_d(pid,j) = c;
+        //pseudo random direction per particle
+        const double dir = ((pid * 2654435761u + j * 40503u) % 1000) / 500.0 - 1;
+        xtgt_ps_d(pid,j) = (j < dim) ? c + step * dir : 0;
+      }
+      pid_d(pid) = pid;
+    }
+  };
+  ps::parallel_for(ptcls, lamb, "setPtclPositions");
+}
+
+//Random vertex order of the full mesh, the other entities follow their vertices
+void shuffleMesh(o::Mesh& mesh) {
+  std::vector<o::LO> order(mesh.nverts());
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(12345));
+  o::HostWrite<o::LO> new_to_old(mesh.nverts());
+  for(o::LO i = 0; i < mesh.nverts(); i++)
+    new_to_old[i] = order[i];
+  o::reorder_mesh(&mesh, o::LOs(o::Write<o::LO>(new_to_old)));
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  if (argc != 6) {
+    fprintf(stderr, "Usage: %s <dim> <elements per side> <ptcls per elem> "
+            "<push distance relative to element size> <shuffle full mesh 0/1>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const int dim = atoi(argv[1]);
+  const int n = atoi(argv[2]);
+  const int ppe = atoi(argv[3]);
+  const double relStep = atof(argv[4]);
+  const bool shuffle = atoi(argv[5]);
+  p::SetTimingVerbosity(0);
+
+  auto full_mesh = o::build_box(lib.self(), OMEGA_H_SIMPLEX, 1, 1, (dim == 3),
+                                n, n, (dim == 3) ? n : 0);
+  if(shuffle)
+    shuffleMesh(full_mesh);
+  o::Write<o::LO> owner(full_mesh.nelems(), 0);
+  p::Input input(full_mesh, p::Input::PARTITION, o::LOs(owner), p::Input::BFS,
+                 p::Input::BFS, lib.self());
+
+  const int ITERS = 20;
+  const char* names[3] = {"natural", "sfc", "rcm"};
+  const p::Input::Ordering orderings[3] = {p::Input::NATURAL_ORDER, p::Input::SFC_ORDER,
+                                           p::Input::RCM_ORDER};
+  double search_times[3] = {0, 0, 0};
+  double deposit_times[3] = {0, 0, 0};
+  o::Real total_charge[3];
+  for(int r = 0; r < 3; r++) {
+    input.ordering = orderings[r];
+    p::Mesh picparts(input);
+    o::Mesh* mesh = picparts.mesh();
+    const o::LO ne = mesh->nelems();
+    const int numPtcls = ne * ppe;
+    PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+    PS::kkGidView element_gids("element_gids", ne);
+    o::GOs mesh_element_gids = picparts.globalIds(picparts.dim());
+    o::parallel_for(ne, OMEGA_H_LAMBDA(const int& i) {
+      ptcls_per_elem(i) = ppe;
+      element_gids(i) = mesh_element_gids[i];
+    });
+    Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+    PS* ptcls = new ps::SellCSigma<Particle>(policy, INT_MAX, 1024, ne, numPtcls,
+                                             ptcls_per_elem, element_gids);
+    setPtclPositions(*mesh, ptcls, relStep / n);
+    if(!r)
+      printf("dim %d elements %d vertices %d particles %d shuffled %d\n",
+             dim, ne, mesh->nverts(), numPtcls, shuffle);
+
+    auto x = ptcls->get<0>();
+    auto xtgt = ptcls->get<1>();
+    auto pid = ptcls->get<2>();
+    o::Write<o::Real> field;
+    for(int i = 0; i < ITERS; i++) {
+      o::Write<o::LO> elem_ids(ptcls->capacity(), -1);
+      Kokkos::fence();
+      Kokkos::Timer timer;
+      if(dim == 3)
+        p::search_mesh<Particle>(*mesh, ptcls, x, xtgt, pid, elem_ids,
+                                 o::Write<o::Real>(), o::Write<o::LO>(), 100);
+      else
+        p::search_mesh_2d(*mesh, ptcls, x, xtgt, pid, elem_ids, 100);
+      Kokkos::fence();
+      double t = timer.seconds();
+      search_times[r] += t;
+      p::RecordTime(std::string("search ") + names[r], t);
+
+      timer.reset();
+      field = p::deposit_to_vertices(picparts, ptcls, x);
+      Kokkos::fence();
+      t = timer.seconds();
+      deposit_times[r] += t;
+      p::RecordTime(std::string("deposit ") + names[r], t);
+    }
+    total_charge[r] = o::get_sum(o::Reals(field));
+    delete ptcls;
+  }
+  for(int r = 1; r < 3; r++) {
+    if(fabs(total_charge[r] - total_charge[0]) > 1e-8 * total_charge[0]) {
+      fprintf(stderr, "%s ordering deposited a different charge\n", names[r]);
+      return EXIT_FAILURE;
+    }
+  }
+  for(int r = 0; r < 3; r++)
+    printf("%s search %f deposit %f (seconds per call) speedup vs natural %.2f %.2f\n",
+           names[r], search_times[r] / ITERS, deposit_times[r] / ITERS,
+           search_times[0] / search_times[r], deposit_times[0] / deposit_times[r]);
+  p::SummarizeTime();
+  return 0;
+}
@@ -12,6 +12,7 @@
 
 #include "pumipic_utils.hpp"
 #include "pumipic_constants.hpp"
+#include "pumipic_predicates.hpp"
 #include "pumipic_kktypes.hpp"
 #include "pumipic_profiling.hpp"
 
@@ -232,6 +233,381 @@ OMEGA_H_INLINE bool line_triangle_intx_simple(const Omega_h::Few<Omega_h::Vector
   return found;
 }
 
+/** \brief returns true if pos is inside or on the boundary of the tet M
+ */
+OMEGA_H_INLINE bool point_in_tet_closed(const Omega_h::Matrix<DIM, 4> &M,
+    const Omega_h::Vector<DIM> &pos)
+{
+  for(Omega_h::LO iface=0; iface<4; ++iface) {
+    const auto a = M[Omega_h::simplex_down_template(DIM, FDIM, iface, 0)];
+    const auto b = M[Omega_h::simplex_down_template(DIM, FDIM, iface, 1)];
+    const auto c = M[Omega_h::simplex_down_template(DIM, FDIM, iface, 2)];
+    const auto opp = M[Omega_h::simplex_opposite_template(DIM, FDIM, iface)];
+    const auto side = orient3d(a, b, c, pos);
+    const auto ref = orient3d(a, b, c, opp);
+    if((side > 0 && ref < 0) || (side < 0 && ref > 0))
+      return false;
+  }
+  return true;
+}
+
+/** \brief side of face iface of the tet that pos lies on
+ *  returns 1 if pos is on the same side as the vertex opposite to the face
+ *  and -1 otherwise. Points on the face plane are resolved by
+ *  symbolically perturbing the tet vertices (verts holds their mesh ids).
+ */
+OMEGA_H_INLINE int tet_face_side(const Omega_h::Matrix<DIM, 4> &M,
+    const Omega_h::Few<Omega_h::LO, 4> &verts, const Omega_h::LO iface,
+    const Omega_h::Vector<DIM> &pos)
+{
+  Omega_h::Few<Omega_h::Vector<DIM>, 4> pts;
+  Omega_h::Few<Omega_h::LO, 4> ids;
+  for(Omega_h::LO i=0; i<3; ++i) {
+    const auto v = Omega_h::simplex_down_template(DIM, FDIM, iface, i);
+    pts[i] = M[v];
+    ids[i] = verts[v];
+  }
+  pts[3] = pos;
+  ids[3] = -1;
+  const auto side = orient3d_sos(pts, ids);
+  const auto opp = M[Omega_h::simplex_opposite_template(DIM, FDIM, iface)];
+  const auto ref = orient3d(pts[0], pts[1], pts[2], opp);
+  return (ref > 0) ? side : -side;
+}
+
+/** \brief returns true if the line through orig and dest passes through
+ *  face iface of the tet. Lines through edges or vertices of the face are
+ *  resolved with the same symbolic perturbation as tet_face_side.
+ */
+OMEGA_H_INLINE bool line_crosses_tet_face(const Omega_h::Matrix<DIM, 4> &M,
+    const Omega_h::Few<Omega_h::LO, 4> &verts, const Omega_h::LO iface,
+    const Omega_h::Vector<DIM> &orig, const Omega_h::Vector<DIM> &dest)
+{
+  Omega_h::Few<Omega_h::Vector<DIM>, 4> pts;
+  Omega_h::Few<Omega_h::LO, 4> ids;
+  pts[0] = orig;
+  pts[1] = dest;
+  ids[0] = ids[1] = -1;
+  int first = 0;
+  for(Omega_h::LO i=0; i<3; ++i) {
+    const auto va = Omega_h::simplex_down_template(DIM, FDIM, iface, i);
+    const auto vb = Omega_h::simplex_down_template(DIM, FDIM, iface, (i+1)%3);
+    pts[2] = M[va];
+    pts[3] = M[vb];
+    ids[2] = verts[va];
+    ids[3] = verts[vb];
+    const int s = orient3d_sos(pts, ids);
+    if(!s)
+      return false;
+    if(i == 0)
+      first = s;
+    else if(s != first)
+      return false;
+  }
+  return true;
+}
+
+/** \brief returns the local index of the face through which the segment
+ *  orig->dest leaves the tet, or -1 if dest is in the tet
+ *
+ *  All decisions are made with exact orientation predicates and a single
+ *  symbolic perturbation of the mesh vertices. Under the perturbation the
+ *  segment never passes through an edge or vertex, so the walk visits the
+ *  tets crossed by the segment in order and cannot revisit a tet.
+ */
+OMEGA_H_INLINE Omega_h::LO find_exit_face_tet(const Omega_h::Matrix<DIM, 4> &M,
+    const Omega_h::Few<Omega_h::LO, 4> &verts,
+    const Omega_h::Vector<DIM> &orig, const Omega_h::Vector<DIM> &dest)
+{
+  Omega_h::LO beyond[4];
+  Omega_h::LO nbeyond = 0;
+  for(Omega_h::LO iface=0; iface<4; ++iface) {
+    if(tet_face_side(M, verts, iface, dest) < 0)
+      beyond[nbeyond++] = iface;
+  }
+  if(!nbeyond)
+    return -1;
+  if(nbeyond == 1)
+    return beyond[0];
+  for(Omega_h::LO i=0; i<nbeyond; ++i) {
+    if(line_crosses_tet_face(M, verts, beyond[i], orig, dest))
+      return beyond[i];
+  }
+  //The segment does not cross the tet (e.g. orig on the tet boundary),
+  //deterministically step towards dest through the lowest face index
+  return beyond[0];
+}
+
+/** \brief point where the segment orig->dest crosses the plane of face iface
+ */
+OMEGA_H_INLINE Omega_h::Vector<DIM> tet_face_intersection(
+    const Omega_h::Matrix<DIM, 4> &M, const Omega_h::LO iface,
+    const Omega_h::Vector<DIM> &orig, const Omega_h::Vector<DIM> &dest)
+{
+  const auto a = M[Omega_h::simplex_down_template(DIM, FDIM, iface, 0)];
+  const auto b = M[Omega_h::simplex_down_template(DIM, FDIM, iface, 1)];
+  const auto c = M[Omega_h::simplex_down_template(DIM, FDIM, iface, 2)];
+  const auto normv = Omega_h::cross(b - a, c - a);
+  const Omega_h::Real dorig = osh_dot(normv, orig - a);
+  const Omega_h::Real ddest = osh_dot(normv, dest - a);
+  Omega_h::Real t = 0;
+  if(dorig != ddest)
+    t = dorig / (dorig - ddest);
+  t = (t < 0) ? 0 : ((t > 1) ? 1 : t);
+  return orig + t * (dest - orig);
+}
+
+/* Single precision copy of the element geometry for the FP32 search kernels.
+   Each element stores its vertex coordinates contiguously followed by
+   - tets: the orientation of each face with respect to its opposite vertex
+   - triangles: the signed element area
+   so a walk step reads one block of floats instead of gathering doubles
+   through the vertex arrays. Build it once per mesh with
+   buildElmGeometryFP32 and pass it to search_mesh or search_mesh_2d.
+*/
+const int TET_GEOM_FP32_STRIDE = 16;
+const int TRI_GEOM_FP32_STRIDE = 7;
+struct ElmGeometryFP32 {
+  kkFp32View data;
+  int stride = 0;
+  bool exists() const { return data.size() > 0; }
+};
+
+inline ElmGeometryFP32 buildElmGeometryFP32(o::Mesh& mesh) {
+  const auto dim = mesh.dim();
+  const auto nverts = dim + 1;
+  ElmGeometryFP32 geom;
+  geom.stride = (dim == 3) ? TET_GEOM_FP32_STRIDE : TRI_GEOM_FP32_STRIDE;
+  geom.data = kkFp32View("elm_geometry_fp32", mesh.nelems() * geom.stride);
+  const auto stride = geom.stride;
+  const auto data = geom.data;
+  const auto elm2verts = mesh.ask_elem_verts();
+  const auto coords = mesh.coords();
+  const auto areas = (dim == 2) ? measure_elements_real(&mesh) : o::Reals();
+  auto fill = OMEGA_H_LAMBDA(o::LO e) {
+    for(int v=0; v<nverts; v++)
+      for(int j=0; j<dim; j++)
+        data(e*stride + v*dim + j) =
+          static_cast<float>(coords[elm2verts[e*nverts + v]*dim + j]);
+    if(dim == 3) {
+      const auto verts = o::gather_verts<4>(elm2verts, e);
+      const auto M = o::gather_vectors<4, 3>(coords, verts);
+      for(int iface=0; iface<4; iface++) {
+        const auto a = M[o::simplex_down_template(DIM, FDIM, iface, 0)];
+        const auto b = M[o::simplex_down_template(DIM, FDIM, iface, 1)];
+        const auto c = M[o::simplex_down_template(DIM, FDIM, iface, 2)];
+        const auto opp = M[o::simplex_opposite_template(DIM, FDIM, iface)];
+        data(e*stride + 12 + iface) = (orient3d(a, b, c, opp) > 0) ? 1 : -1;
+      }
+    } else {
+      data(e*stride + 6) = static_cast<float>(areas[e]);
+    }
+  };
+  o::parallel_for(mesh.nelems(), fill, "build_elm_geometry_fp32");
+  return geom;
+}
+
+/** \brief single precision tet_face_side using the cached geometry elm,
+ *  returns 0 if the side could not be certified
+ */
+OMEGA_H_INLINE int tet_face_side_fp32(const float* elm, const Omega_h::LO iface,
+    const float* pos)
+{
+  const auto a = elm + 3*Omega_h::simplex_down_template(DIM, FDIM, iface, 0);
+  const auto b = elm + 3*Omega_h::simplex_down_template(DIM, FDIM, iface, 1);
+  const auto c = elm + 3*Omega_h::simplex_down_template(DIM, FDIM, iface, 2);
+  const int side = orient3d_fp32_filter(a, b, c, pos);
+  return (elm[12 + iface] > 0) ? side : -side;
+}
+
+/** \brief single precision line_crosses_tet_face, returns 1 or 0 if the
+ *  answer is certified and -1 otherwise
+ */
+OMEGA_H_INLINE int line_crosses_tet_face_fp32(const float* elm,
+    const Omega_h::LO iface, const float* orig, const float* dest)
+{
+  int sides[3];
+  bool certified = true;
+  for(Omega_h::LO i=0; i<3; ++i) {
+    const auto va = Omega_h::simplex_down_template(DIM, FDIM, iface, i);
+    const auto vb = Omega_h::simplex_down_template(DIM, FDIM, iface, (i+1)%3);
+    sides[i] = orient3d_fp32_filter(orig, dest, elm + 3*va, elm + 3*vb);
+    certified = certified && sides[i];
+  }
+  for(Omega_h::LO i=0; i<3; ++i)
+    for(Omega_h::LO j=i+1; j<3; ++j)
+      if(sides[i] && sides[j] && sides[i] != sides[j])
+        return 0;
+  return certified ? 1 : -1;
+}
+
+/** \brief find_exit_face_tet with single precision filters
+ *
+ *  Every test is first evaluated on the cached single precision geometry elm.
+ *  Only tests that cannot be certified, i.e. for points close to the planes
+ *  of the element, are recomputed in double precision from coords. The result
+ *  is always the same as find_exit_face_tet.
+ */
+OMEGA_H_INLINE Omega_h::LO find_exit_face_tet_fp32(const float* elm,
+    const Omega_h::Reals& coords, const Omega_h::Few<Omega_h::LO, 4> &verts,
+    const Omega_h::Vector<DIM> &orig, const Omega_h::Vector<DIM> &dest)
+{
+  float origf[DIM], destf[DIM];
+  for(Omega_h::LO i=0; i<DIM; ++i) {
+    origf[i] = static_cast<float>(orig[i]);
+    destf[i] = static_cast<float>(dest[i]);
+  }
+  Omega_h::Matrix<DIM, 4> M;
+  bool haveM = false;
+  Omega_h::LO beyond[4];
+  Omega_h::LO nbeyond = 0;
+  for(Omega_h::LO iface=0; iface<4; ++iface) {
+    int side = tet_face_side_fp32(elm, iface, destf);
+    if(!side) {
+      if(!haveM) {
+        M = Omega_h::gather_vectors<4, DIM>(coords, verts);
+        haveM = true;
+      }
+      side = tet_face_side(M, verts, iface, dest);
+    }
+    if(side < 0)
+      beyond[nbeyond++] = iface;
+  }
+  if(!nbeyond)
+    return -1;
+  if(nbeyond == 1)
+    return beyond[0];
+  for(Omega_h::LO i=0; i<nbeyond; ++i) {
+    int crosses = line_crosses_tet_face_fp32(elm, beyond[i], origf, destf);
+    if(crosses < 0) {
+      if(!haveM) {
+        M = Omega_h::gather_vectors<4, DIM>(coords, verts);
+        haveM = true;
+      }
+      crosses = line_crosses_tet_face(M, verts, beyond[i], orig, dest);
+    }
+    if(crosses)
+      return beyond[i];
+  }
+  return beyond[0];
+}
+
+/** \brief single precision barycentric_tri using the cached geometry elm
+ *
+ *  err is set to a bound on the difference of each coordinate to the one
+ *  computed by barycentric_tri. It accounts for rounding the inputs to float.
+ */
+OMEGA_H_INLINE void barycentric_tri_fp32(const float* elm, const float* pos,
+    float* bcc, float* err)
+{
+  const float parent_area = elm[6];
+  for(int i=0; i<3; i++) {
+    const auto k = elm + 2*Omega_h::simplex_down_template(2, 1, i, 0);
+    const auto l = elm + 2*Omega_h::simplex_down_template(2, 1, i, 1);
+    const float cross = (l[0] - k[0]) * (pos[1] - k[1])
+                      - (l[1] - k[1]) * (pos[0] - k[0]);
+    const float permanent =
+      (std::abs(l[0]) + std::abs(k[0])) * (std::abs(pos[1]) + std::abs(k[1])) +
+      (std::abs(l[1]) + std::abs(k[1])) * (std::abs(pos[0]) + std::abs(k[0]));
+    const float area = cross / 2;
+    bcc[i] = area / parent_area;
+    err[i] = 8 * PRED_EPSILON_FP32 * (permanent + std::abs(area)) /
+             std::abs(parent_area);
+  }
+}
+
+/** \brief returns true if the directed line orig->dest leaves the triangle
+ *  through the edge a-b, where a-b is an edge of the triangle in the order
+ *  of simplex_down_template and ref is the sign of the triangle orientation.
+ *  Vertices on the line are treated as lying to its left, a symbolic
+ *  perturbation that is the same for every triangle along the line.
+ */
+OMEGA_H_INLINE bool line_leaves_tri_edge(const Omega_h::Vector<2> &a,
+    const Omega_h::Vector<2> &b, const int ref,
+    const Omega_h::Vector<2> &orig, const Omega_h::Vector<2> &dest)
+{
+  const int sa = (orient2d(orig, dest, a) >= 0) ? 1 : -1;
+  const int sb = (orient2d(orig, dest, b) >= 0) ? 1 : -1;
+  return sa == -ref && sb == ref;
+}
+
+/** \brief returns the local index of the edge through which the segment
+ *  orig->dest leaves the triangle abc, or -1 if dest is in the triangle
+ *
+ *  The 2d counterpart of find_exit_face_tet, all decisions are made with
+ *  exact orientation predicates.
+ */
+OMEGA_H_INLINE Omega_h::LO find_exit_edge_tri(
+    const Omega_h::Few<Omega_h::Vector<2>, 3> &abc,
+    const Omega_h::Vector<2> &orig, const Omega_h::Vector<2> &dest)
+{
+  const int ref = (orient2d(abc[0], abc[1], abc[2]) > 0) ? 1 : -1;
+  Omega_h::LO beyond[3];
+  Omega_h::LO nbeyond = 0;
+  for(Omega_h::LO iedge=0; iedge<3; ++iedge) {
+    const auto a = abc[Omega_h::simplex_down_template(2, 1, iedge, 0)];
+    const auto b = abc[Omega_h::simplex_down_template(2, 1, iedge, 1)];
+    const auto side = orient2d(a, b, dest);
+    if((ref > 0) ? side < 0 : side > 0)
+      beyond[nbeyond++] = iedge;
+  }
+  if(!nbeyond)
+    return -1;
+  if(nbeyond == 1)
+    return beyond[0];
+  for(Omega_h::LO i=0; i<nbeyond; ++i) {
+    const auto a = abc[Omega_h::simplex_down_template(2, 1, beyond[i], 0)];
+    const auto b = abc[Omega_h::simplex_down_template(2, 1, beyond[i], 1)];
+    if(line_leaves_tri_edge(a, b, ref, orig, dest))
+      return beyond[i];
+  }
+  //orig is not in the triangle, step towards dest through the lowest edge index
+  return beyond[0];
+}
+
+/** \brief point on the edge a-b where the line through orig and dest crosses it
+ *
+ *  The edge parameter is clamped to [0,1] so the point always lies on the
+ *  edge, also when rounding places the crossing just beyond a vertex.
+ *  The closest point on the edge to orig is returned if they are parallel.
+ */
+OMEGA_H_INLINE Omega_h::Vector<2> edge_intersection_2d(
+    const Omega_h::Vector<2> &a, const Omega_h::Vector<2> &b,
+    const Omega_h::Vector<2> &orig, const Omega_h::Vector<2> &dest)
+{
+  const auto edge = b - a;
+  const auto disp = dest - orig;
+  const Omega_h::Real denom = Omega_h::cross(edge, disp);
+  Omega_h::Real s = 0;
+  if(denom != 0)
+    s = Omega_h::cross(orig - a, disp) / denom;
+  else if(osh_dot(edge, edge) > 0)
+    s = osh_dot(orig - a, edge) / osh_dot(edge, edge);
+  s = (s < 0) ? 0 : ((s > 1) ? 1 : s);
+  return a + s * edge;
+}
+
+/* Default wall interaction for search_mesh and search_mesh_2d: particles
+   that reach an exposed side leave the domain.
+
+   A user functor is called on the device with
+     pid(in) - particle index in the particle structure
+     side(in) - id of the exposed face (3d) or edge (2d)
+     xpoint(in) - point where the particle reached the side
+     dest(in/out) - particle destination
+   and returns true if the particle should keep walking from xpoint towards
+   the, possibly modified, dest (e.g. for specular reflection).  In that case
+   the search stores xpoint and dest as the particle's current and target
+   positions.  Returning false marks the particle as leaving the domain.
+*/
+struct NoWallInteraction {
+  template <int N>
+  OMEGA_H_INLINE bool operator()(const int, const o::LO,
+      const o::Vector<N>&, o::Vector<N>&) const {
+    return false;
+  }
+};
+
 template <typename Segment>
 OMEGA_H_DEVICE o::Vector<3> makeVector3(int pid, Segment xyz) {
   o::Vector<3> v;
@@ -258,41 +634,147 @@ OMEGA_H_DEVICE o::Matrix<3, 4> gatherVectors4x3(o::Reals const& a, o::Few<o::LO,
   return o::gather_vectors<4, 3>(a, v);
 }
 
+/* Linear (barycentric) weights of pos for the vertices of the triangle v.
+   The weights sum to one and are nonnegative for points inside the element.
+*/
+OMEGA_H_INLINE o::Vector<3> linear_weights_tri(
+    const o::Few<o::Vector<2>, 3>& v, const o::Vector<2>& pos) {
+  const auto area2 = o::cross(v[1] - v[0], v[2] - v[0]);
+  o::Vector<3> w;
+  for (int i = 0; i < 3; ++i) {
+    const auto& b = v[(i + 1) % 3];
+    const auto& c = v[(i + 2) % 3];
+    w[i] = o::cross(b - pos, c - pos) / area2;
+  }
+  return w;
+}
+
+/* Linear (barycentric) weights of pos for the vertices of the tet v.
+   The weights sum to one and are nonnegative for points inside the element.
+*/
+OMEGA_H_INLINE o::Vector<4> linear_weights_tet(
+    const o::Few<o::Vector<3>, 4>& v, const o::Vector<3>& pos) {
+  const auto vol6 = o::dot(v[3] - v[0],
+                           o::cross(v[1] - v[0], v[2] - v[0]));
+  o::Vector<4> w;
+  for (int i = 0; i < 4; ++i) {
+    o::Few<o::Vector<3>, 4> t = v;
+    t[i] = pos;
+    w[i] = o::dot(t[3] - t[0], o::cross(t[1] - t[0], t[2] - t[0])) / vol6;
+  }
+  return w;
+}
+
+OMEGA_H_INLINE o::Vector<3> linear_weights(
+    const o::Few<o::Vector<2>, 3>& v, const o::Vector<2>& pos) {
+  return linear_weights_tri(v, pos);
+}
+OMEGA_H_INLINE o::Vector<4> linear_weights(
+    const o::Few<o::Vector<3>, 4>& v, const o::Vector<3>& pos) {
+  return linear_weights_tet(v, pos);
+}
+
+template <int DIM>
+OMEGA_H_INLINE o::Vector<DIM> ptcl_position(Segment3d x, const int pid) {
+  o::Vector<DIM> pos;
+  for (int j = 0; j < DIM; ++j)
+    pos[j] = x(pid, j);
+  return pos;
+}
+
+/* Stores the linear weights of the target positions in the elements found
+   by a search, see the vtx_weights argument of search_mesh/search_mesh_2d
+*/
+template <int DIM, class ParticleStruct>
+void storeVertexWeights(o::Mesh& mesh, ParticleStruct* ptcls, Segment3d xtgt_ps_d,
+                        o::LOs elem_ids, Segment4d vtx_weights) {
+  const auto elm2verts = mesh.ask_elem_verts();
+  const auto coords = mesh.coords();
+  auto storeWeights = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    const auto elm = elem_ids[pid];
+    if(mask > 0 && elm >= 0) {
+      const auto verts = o::gather_verts<DIM + 1>(elm2verts, elm);
+      const auto v = o::gather_vectors<DIM + 1, DIM>(coords, verts);
+      const auto w = linear_weights(v, ptcl_position<DIM>(xtgt_ps_d, pid));
+      for(int i=0; i<DIM+1; i++)
+        vtx_weights(pid,i) = w[i];
+    }
+  };
+  ps::parallel_for(ptcls, storeWeights, "storeVertexWeights");
+}
+
 //How to avoid redefining the MemberType? each application will define it
 //differently. Templating search_mesh with
 //template < typename ParticleType >
 //results in an error on get<> as an unresolved function.
 
-template < class ParticleType>
+/* Walks each particle along the segment from x_ps_d to xtgt_ps_d through the
+   tets it crosses. Every step is decided with exact orientation predicates
+   (see pumipic_predicates.hpp) so a walk takes exactly one step per tet
+   crossed by the segment and particles grazing edges or vertices do not
+   oscillate between elements.
+
+   xpoints_d(out) - optional, size 3*capacity, point where the particle left
+                    the domain; only set for particles with xface_id >= 0
+   xface_id(out) - optional, size capacity, exposed face the particle left
+                   the domain through or -1
+   Pass unallocated arrays (o::Write<>()) to skip either output.
+   wallHit(in) - optional functor called when a particle reaches an exposed
+                 face, see NoWallInteraction
+   safe(in) - optional, element safe tag (pumipic::Mesh::safeTag()). When
+              given, a particle stops in the first unsafe element it enters
+              and its current position is moved to the face it entered
+              through. migrate_ptcls then sends it to the element owner, which
+              finishes the walk with another search (see countUnsafePtcls).
+   geom(in) - optional, single precision element geometry from
+              buildElmGeometryFP32. The walk is then decided in single
+              precision and only tests near element boundaries are recomputed
+              in double precision; the elements found are identical.
+   vtx_weights(out) - optional, particle member that receives the linear
+                      weights of xtgt_ps_d for the vertices of the element
+                      found, for reuse by gather_from_vertices. Particles
+                      stopped at the safe zone boundary get the weights of
+                      the next search.
+*/
+template < class ParticleType, class WallFunc = NoWallInteraction>
 bool search_mesh(o::Mesh& mesh, ps::ParticleStructure< ParticleType >* ptcls,
                  Segment3d x_ps_d, Segment3d xtgt_ps_d, SegmentInt pid_d,
                  o::Write<o::LO> elem_ids, o::Write<o::Real> xpoints_d,
-                 o::Write<o::LO> xface_id, int looplimit=0) {
+                 o::Write<o::LO> xface_id, int looplimit=0,
+                 WallFunc wallHit = WallFunc(),
+                 o::LOs safe = o::LOs(),
+                 ElmGeometryFP32 geom = ElmGeometryFP32(),
+                 Segment4d vtx_weights = Segment4d()) {
   const int debug = 0;
 
-  const auto dual = mesh.ask_dual();
   const auto down_r2f = mesh.ask_down(3, 2);
+  const auto faces2elms = mesh.ask_up(2, 3);
   const auto side_is_exposed = mark_exposed_sides(&mesh);
   const auto mesh2verts = mesh.ask_elem_verts();
   const auto coords = mesh.coords();
-  const auto face_verts =  mesh.ask_verts_of(2);
   const auto down_r2fs = down_r2f.ab2b;
-  const auto dual_faces = dual.ab2b;
-  const auto dual_elems = dual.a2ab;
+  const auto f2e_offsets = faces2elms.a2ab;
+  const auto f2e_elems = faces2elms.ab2b;
 
   const auto psCapacity = ptcls->capacity();
 
   // ptcl_done[i] = 1 : particle i has hit a boundary or reached its destination
   o::Write<o::LO> ptcl_done(psCapacity, 1, "ptcl_done");
-  // particle intersection points
-  o::Write<o::Real> xpoints(3*psCapacity, 0);
+  const bool storeXpoints = xpoints_d.exists();
+  const bool storeXface = xface_id.exists();
+  const bool stopAtUnsafe = safe.exists();
+  const bool useFP32 = geom.exists();
+  const float* geom_fp32 = geom.data.data();
+  OMEGA_H_CHECK(!useFP32 || geom.stride == TET_GEOM_FP32_STRIDE);
   // store the next parent for each particle
   o::Write<o::LO> elem_ids_next(psCapacity,-1);
-  // flag to move origin if intersection fails
   auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
     if(mask > 0) {
       elem_ids[pid] = e;
+      elem_ids_next[pid] = e;
       ptcl_done[pid] = 0;
+      if(storeXface)
+        xface_id[pid] = -1;
       if (debug)
         printf("pid %3d mask %1d elem_ids %6d\n", pid, mask, elem_ids[pid]);
     } else {
@@ -309,100 +791,79 @@ bool search_mesh(o::Mesh& mesh, ps::ParticleStructure< ParticleType >* ptcls,
     }
     //pid is same for a particle between iterations in this while loop
     auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
-      //inactive particle that is still moving to its target position
+      //active particle that is still moving to its target position
       if( mask > 0 && !ptcl_done[pid] ) {
-        auto elmId = e;
-        auto ptcl = pid_d(pid);
-        if(debug)
-          printf("Elem %d ptcl: %d\n", elmId, ptcl);
-        if(elmId != elem_ids[pid]) {
-          elmId = elem_ids[pid];
-          if(debug)
-            printf("Switching: Elem %d ptcl: %d\n", elmId, ptcl);
-        }
+        const auto elmId = elem_ids[pid];
+        const auto ptcl = pid_d(pid);
         OMEGA_H_CHECK(elmId >= 0);
-        auto tetv2v = o::gather_verts<4>(mesh2verts, elmId);
-        auto M = gatherVectors4x3(coords, tetv2v);
-        auto dest = makeVector3(pid, xtgt_ps_d);
-        auto orig = makeVector3(pid, x_ps_d);
-        Omega_h::Vector<4> bcc;
+        const auto tetv2v = o::gather_verts<4>(mesh2verts, elmId);
+        const auto dest = makeVector3(pid, xtgt_ps_d);
+        const auto orig = makeVector3(pid, x_ps_d);
         if(loops == 0) {
+          const auto M = gatherVectors4x3(coords, tetv2v);
           //make sure particle origin is in initial element
-          find_barycentric_tet(M, orig, bcc);
-          if(!all_positive(bcc, 0)) {
+          //particles resumed after stopping at an unsafe element sit on a
+          //face up to roundoff
+          Omega_h::Vector<4> bcc;
+          if(!point_in_tet_closed(M, orig) &&
+             !(find_barycentric_tet(M, orig, bcc) && all_positive(bcc))) {
             printf("ptcl %d elem %d => %d orig %.3f %.3f %.3f dest %.3f %.3f %.3f\n",
               ptcl, e, elmId, orig[0], orig[1], orig[2], dest[0], dest[1], dest[2]);
             printf("Particle doesn't belong to this element at loops=0");
             OMEGA_H_CHECK(false);
           }
         }
-        //check if the destination is this element
-        find_barycentric_tet(M, dest, bcc);
-        if(all_positive(bcc, 0)) {
+        const auto exitFace = useFP32 ?
+          find_exit_face_tet_fp32(geom_fp32 + elmId*TET_GEOM_FP32_STRIDE,
+                                  coords, tetv2v, orig, dest) :
+          find_exit_face_tet(gatherVectors4x3(coords, tetv2v), tetv2v, orig, dest);
+        if(exitFace < 0) {
           if(debug)
             printf("ptcl %d is in destination elm %d\n", ptcl, elmId);
-          elem_ids_next[pid] = elem_ids[pid];
+          elem_ids_next[pid] = elmId;
           ptcl_done[pid] = 1;
         } else {
-          if(debug)
-            printf("ptcl %d checking adj elms\n", ptcl);
-          //get element ID
-          auto dface_ind = dual_elems[elmId];
-          const auto beg_face = elmId *4;
-          const auto end_face = beg_face +4;
-          o::LO f_index = 0;
-          bool detected = false;
-          for(auto iface = beg_face; iface < end_face; ++iface) {
-            const auto face_id = down_r2fs[iface];
-            auto xpoint = o::zero_vector<3>();
-            bool exposed = side_is_exposed[face_id];
-            auto fv2v = o::gather_verts<3>(face_verts, face_id);
-            const auto face = gatherVectors3x3(coords, fv2v);
-            o::LO matInd1 = getfmap(f_index*2);
-            o::LO matInd2 = getfmap(f_index*2+1);
-            bool inverse = true;
-            if(fv2v[1] == tetv2v[matInd1] && fv2v[2] == tetv2v[matInd2])
-              inverse = false;
-
-            detected = line_triangle_intx_simple(face, orig, dest, xpoint, inverse);
-            if(debug)
-              printf("\t :ptcl %d faceid %d flipped %d exposed %d detected %d\n", ptcl,
-                face_id, inverse, exposed, detected);
-
-            if(detected && exposed) {
-              ptcl_done[pid] = 1;
-              for(o::LO i=0; i<3; ++i)
-                xpoints[pid*3+i] = xpoint[i];
-              elem_ids_next[pid] = -1;
-              if(debug) {
-                printf("ptcl %d faceid %d detected and exposed, next parent elm %d\n",
-                    ptcl, face_id, elem_ids_next[pid]);
+          const auto face_id = down_r2fs[elmId*4 + exitFace];
+          if(side_is_exposed[face_id]) {
+            const auto M = gatherVectors4x3(coords, tetv2v);
+            const auto xpoint = tet_face_intersection(M, exitFace, orig, dest);
+            auto newDest = dest;
+            if(wallHit(pid, face_id, xpoint, newDest)) {
+              //continue the walk from the wall towards the new destination
+              for(o::LO i=0; i<3; ++i) {
+                x_ps_d(pid,i) = xpoint[i];
+                xtgt_ps_d(pid,i) = newDest[i];
               }
-              break;
-            } else if(detected && !exposed) {
-              auto adj_elem  = dual_faces[dface_ind];
-              elem_ids_next[pid] = adj_elem;
-              if(debug) {
-                printf("ptcl %d faceid %d detected and !exposed, next parent elm %d\n",
-                    ptcl, face_id, elem_ids_next[pid]);
+              elem_ids_next[pid] = elmId;
+            } else {
+              if(storeXpoints) {
+                for(o::LO i=0; i<3; ++i)
+                  xpoints_d[pid*3+i] = xpoint[i];
               }
-              break;
+              if(storeXface)
+                xface_id[pid] = face_id;
+              elem_ids_next[pid] = -1;
+              ptcl_done[pid] = 1;
             }
-            // no line triangle intersection found for the current face
-            // appears to be a guess at the next element based on the smallest BCC
-            if(!exposed) {
-              if(debug)
-                printf("ptcl %d faceid %d !detected and !exposed\n", pid, face_id);
-              ++dface_ind;
-              const o::LO min_ind = min_index(bcc, 4);
-              if(f_index == min_ind) {
-                elem_ids_next[pid] = dual_faces[dface_ind];
-              }
+          } else {
+            const auto first = f2e_offsets[face_id];
+            const auto elmA = f2e_elems[first];
+            const auto elmB = f2e_elems[first+1];
+            const auto nextElm = (elmA == elmId) ? elmB : elmA;
+            elem_ids_next[pid] = nextElm;
+            if(stopAtUnsafe && !safe[nextElm]) {
+              //leave the rest of the walk to the owner of nextElm
+              const auto M = gatherVectors4x3(coords, tetv2v);
+              const auto xpoint = tet_face_intersection(M, exitFace, orig, dest);
+              for(o::LO i=0; i<3; ++i)
+                x_ps_d(pid,i) = xpoint[i];
+              ptcl_done[pid] = 1;
             }
-            ++f_index;
-          } //for iface
-
-        } //else not in current element
+          }
+          if(debug)
+            printf("ptcl %d elm %d exits through face %d exposed %d next elm %d\n",
+                ptcl, elmId, face_id, side_is_exposed[face_id], elem_ids_next[pid]);
+        }
       } //if active particle
     };
 
@@ -418,7 +879,6 @@ bool search_mesh(o::Mesh& mesh, ps::ParticleStructure< ParticleType >* ptcls,
     auto minFlag = o::get_min(ptcl_done_r);
     if(minFlag == 0)
       found = false;
-    //Copy particle data from previous to next (adjacent) element
     ++loops;
 
     if(looplimit && loops > looplimit) {
@@ -427,17 +887,36 @@ bool search_mesh(o::Mesh& mesh, ps::ParticleStructure< ParticleType >* ptcls,
       break;
     }
   }
+  if(vtx_weights.exists())
+    storeVertexWeights<3>(mesh, ptcls, xtgt_ps_d, o::LOs(elem_ids), vtx_weights);
   return found;
 }
 
-template < class ParticleStruct>
+template < class ParticleStruct, class WallFunc = NoWallInteraction>
 bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
                  ParticleStruct* ptcls, // (in) particle structure
                  Segment3d x_ps_d, // (in) starting particle positions
                  Segment3d xtgt_ps_d, // (in) target particle positions
                  SegmentInt pid_d, // (in) particle ids
                  o::Write<o::LO> elem_ids, // (out) parent element ids for the target positions
-                 int looplimit=0) {
+                 int looplimit=0,
+                 // (out) optional, exposed edge the particle left the domain through or -1
+                 o::Write<o::LO> xedge_id = o::Write<o::LO>(),
+                 // (out) optional, size 2*capacity, point where the particle
+                 //       left the domain, only set when xedge_id >= 0
+                 o::Write<o::Real> xpoints = o::Write<o::Real>(),
+                 // (in) optional, called when a particle reaches an exposed
+                 //      edge, see NoWallInteraction
+                 WallFunc wallHit = WallFunc(),
+                 // (in) optional, element safe tag, stop particles in the
+                 //      first unsafe element they enter, see search_mesh
+                 o::LOs safe = o::LOs(),
+                 // (in) optional, single precision element geometry from
+                 //      buildElmGeometryFP32, see search_mesh
+                 ElmGeometryFP32 geom = ElmGeometryFP32(),
+                 // (out) optional, linear weights of the target positions,
+                 //       see search_mesh
+                 Segment4d vtx_weights = Segment4d()) {
   const auto btime = pumipic_prebarrier();
   Kokkos::Profiling::pushRegion("pumpipic_search_mesh_2d");
   Kokkos::Timer timer;
@@ -462,10 +941,18 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
   o::Write<o::LO> ptcl_done(psCapacity, 1, "ptcl_done");
   // store the last crossed edge
   o::Write<o::LO> lastEdge(psCapacity,-1);
+  const bool storeXedge = xedge_id.exists();
+  const bool storeXpoints = xpoints.exists();
+  const bool stopAtUnsafe = safe.exists();
+  const bool useFP32 = geom.exists();
+  const float* geom_fp32 = geom.data.data();
+  OMEGA_H_CHECK(!useFP32 || geom.stride == TRI_GEOM_FP32_STRIDE);
   auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
     if(mask > 0) {
       elem_ids[pid] = e;
       ptcl_done[pid] = 0;
+      if(storeXedge)
+        xedge_id[pid] = -1;
     } else {
       elem_ids[pid] = -1;
       ptcl_done[pid] = 1;
@@ -505,15 +992,57 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
         auto ptcl = pid_d(pid);
         OMEGA_H_CHECK(searchElm >= 0);
         const auto edges = o::gather_down<3>(faceEdges, searchElm);
+        const auto ptclDest = makeVector2(pid, xtgt_ps_d);
+        if(useFP32) {
+          //decide in single precision unless the destination is close to an
+          //edge of the element
+          const float destf[2] = {static_cast<float>(ptclDest[0]),
+                                  static_cast<float>(ptclDest[1])};
+          float bccf[3], errf[3];
+          barycentric_tri_fp32(geom_fp32 + searchElm*TRI_GEOM_FP32_STRIDE,
+                               destf, bccf, errf);
+          bool inside = true;
+          bool certified = true;
+          //edges the destination is certainly beyond and certainly not beyond
+          int nbeyond = 0, nwithin = 0, beyond = -1;
+          for(int i=0; i<3; i++) {
+            if(bccf[i] - errf[i] > 0)
+              ++nwithin;
+            //all_positive accepts coordinates >= -EPSILON
+            if(bccf[i] - errf[i] > -EPSILON)
+              continue;
+            if(bccf[i] + errf[i] < -EPSILON) {
+              inside = false;
+              ++nbeyond;
+              beyond = i;
+            }
+            else
+              certified = false;
+          }
+          if(certified && inside) {
+            ptcl_done[pid] = 1;
+            return;
+          }
+          //a single edge with the destination beyond it is the exit edge
+          if(nbeyond == 1 && nwithin == 2) {
+            ptcl_done[pid] = 0;
+            lastEdge[pid] = edges[beyond];
+            return;
+          }
+        }
         const auto faceVerts = o::gather_verts<3>(faces2verts, searchElm);
         const auto faceCoords = o::gather_vectors<3,2>(coords, faceVerts);
-        const auto ptclDest = makeVector2(pid, xtgt_ps_d);
-        const auto ptclOrigin = makeVector2(pid, x_ps_d);
         Omega_h::Vector<3> faceBcc;
         barycentric_tri(triArea, faceCoords, ptclDest, faceBcc, searchElm);
         auto isDestInParentElm = all_positive(faceBcc);
         ptcl_done[pid] = isDestInParentElm;
-        const int idx = min3(faceBcc);
+        if(isDestInParentElm)
+          return;
+        //leave through the edge crossed by the segment, the smallest
+        //barycentric coordinate only names an edge the destination is beyond
+        auto idx = find_exit_edge_tri(faceCoords, makeVector2(pid, x_ps_d), ptclDest);
+        if(idx < 0)
+          idx = min3(faceBcc);
         lastEdge[pid] = edges[idx];
       }
     };
@@ -526,6 +1055,29 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
         assert(lastEdge[pid] != -1);
         auto bridge = lastEdge[pid];
         auto exposed = side_is_exposed[bridge];
+        if(exposed) {
+          const auto ev = o::gather_verts<2>(edge_verts, bridge);
+          const auto ec = o::gather_vectors<2,2>(coords, ev);
+          const auto xpoint = edge_intersection_2d(ec[0], ec[1],
+              makeVector2(pid, x_ps_d), makeVector2(pid, xtgt_ps_d));
+          auto newDest = makeVector2(pid, xtgt_ps_d);
+          if(wallHit(pid, bridge, xpoint, newDest)) {
+            //continue the walk from the wall towards the new destination
+            for(int i=0; i<2; i++) {
+              x_ps_d(pid,i) = xpoint[i];
+              xtgt_ps_d(pid,i) = newDest[i];
+            }
+            //stay in the current element for the next step
+            lastEdge[pid] = -1;
+            return;
+          }
+          if(storeXedge)
+            xedge_id[pid] = bridge;
+          if(storeXpoints) {
+            xpoints[pid*2+0] = xpoint[0];
+            xpoints[pid*2+1] = xpoint[1];
+          }
+        }
         ptcl_done[pid] = exposed;
         elem_ids[pid] = exposed ? -1 : elem_ids[pid]; //leaves domain if exposed
       }
@@ -535,7 +1087,7 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
     auto e2f_vals = edges2faces.ab2b; // CSR value array
     auto e2f_offsets = edges2faces.a2ab; // CSR offset array, index by mesh edge ids
     auto setNextElm = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
-      if( mask > 0 && !ptcl_done[pid] ) {
+      if( mask > 0 && !ptcl_done[pid] && lastEdge[pid] >= 0 ) {
         auto searchElm = elem_ids[pid];
         auto ptcl = pid_d(pid);
         auto bridge = lastEdge[pid];
@@ -549,6 +1101,16 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
         assert(faceA == searchElm || faceB == searchElm);
         auto nextElm = (faceA == searchElm) ? faceB : faceA;
         elem_ids[pid] = nextElm;
+        if(stopAtUnsafe && !safe[nextElm]) {
+          //leave the rest of the walk to the owner of nextElm
+          const auto ev = o::gather_verts<2>(edge_verts, bridge);
+          const auto ec = o::gather_vectors<2,2>(coords, ev);
+          const auto xpoint = edge_intersection_2d(ec[0], ec[1],
+              makeVector2(pid, x_ps_d), makeVector2(pid, xtgt_ps_d));
+          x_ps_d(pid,0) = xpoint[0];
+          x_ps_d(pid,1) = xpoint[1];
+          ptcl_done[pid] = 1;
+        }
       }
     };
     ps::parallel_for(ptcls, setNextElm, "pumipic_setNextElm");
@@ -579,6 +1141,8 @@ bool search_mesh_2d(o::Mesh& mesh, // (in) mesh
       break;
     }
   }
+  if(vtx_weights.exists())
+    storeVertexWeights<2>(mesh, ptcls, xtgt_ps_d, o::LOs(elem_ids), vtx_weights);
 
   RecordTime("pumipic search_2d", timer.seconds(), btime);
   char buffer[1024];
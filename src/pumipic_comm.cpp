@@ -1,4 +1,9 @@
 #include "pumipic_mesh.hpp"
+#include "pumipic_comm_plan.hpp"
+#include <ViewComm.h>
+#include <typeinfo>
+#include <algorithm>
+#include <cmath>
 #include <Omega_h_for.hpp>
 #include <Omega_h_int_scan.hpp>
 #include <Omega_h_array_ops.hpp>
@@ -217,231 +222,645 @@ namespace pumipic {
     return y;
   }
 
-  //Reductions are done by a bulk fan-in fan-out through the core region of each picpart
   template <class T>
-  void Mesh::reduceCommArray(int edim, Op op, Omega_h::Write<T> comm_array) {
-    int length = comm_array.size();
-    int ne = nents(edim);
-    int nvals = length / ne;
-    if (ne*nvals != length) {
-      fprintf(stderr, "Comm array size does not match the expected size for dimension %d\n",edim);
+  OMEGA_H_INLINE T applyOp(Mesh::Op op, T x, T y) {
+    if (op == Mesh::SUM_OP)
+      return x + y;
+    if (op == Mesh::MAX_OP)
+      return maxReduce(x, y);
+    if (op == Mesh::MIN_OP)
+      return minReduce(x, y);
+    return x;
+  }
+
+  template <class T>
+  CommPlan<T>::CommPlan(Mesh& picparts, int dim, int num_vals)
+    : comm(picparts.comm()->get_impl()), direct(picparts.device_direct_comm),
+      edim(dim), nvals(num_vals), nents(picparts.nents(dim)), fan_in_active(false) {
+    const int rank = picparts.comm()->rank();
+    Omega_h::HostRead<Omega_h::LO> ent_offsets(picparts.nentsOffsets(edim));
+    own_start = ent_offsets[rank] * nvals;
+    own_size = (ent_offsets[rank+1] - ent_offsets[rank]) * nvals;
+    arr_index = picparts.commArrayIndex(edim);
+    array = Omega_h::Write<T>(nents * nvals, 0, "comm_plan_array");
+    const int num_cores = picparts.num_cores[edim];
+    auto buffered = picparts.buffered_parts[edim];
+    auto is_complete = picparts.is_complete_part[edim];
+    auto bounded_offsets = picparts.offset_bounded_per_dim[edim];
+    bounded_ids = picparts.bounded_ent_ids[edim];
+
+    //Fan-in receives: complete copies of the core from parts that buffer all of it
+    // and the bounded entities from parts that buffer some of it
+    int recv_size = 0;
+    for (int i = 0; i < num_cores; ++i) {
+      const int part = buffered[i];
+      if (ent_offsets[part+1] - ent_offsets[part] > 0 && is_complete[part] == 2) {
+        Message msg = {part, 2, recv_size, own_size};
+        fan_in_recv_msgs.push_back(msg);
+        bounded_starts.push_back(-1);
+        recv_size += own_size;
+      }
+    }
+    for (int i = 0; i < picparts.num_boundaries[edim]; ++i) {
+      const int part = picparts.boundary_parts[edim][i];
+      const int size = (bounded_offsets[part+1] - bounded_offsets[part]) * nvals;
+      Message msg = {part, 1, recv_size, size};
+      fan_in_recv_msgs.push_back(msg);
+      bounded_starts.push_back(bounded_offsets[part]);
+      recv_size += size;
+    }
+    recv_array = Omega_h::Write<T>(recv_size, "comm_plan_recv");
+
+    //Fan-in sends and fan-out receives of the buffered cores
+    for (int i = 0; i < num_cores; ++i) {
+      const int part = buffered[i];
+      const int size = (ent_offsets[part+1] - ent_offsets[part]) * nvals;
+      if (size == 0)
+        continue;
+      Message send = {part, is_complete[part], ent_offsets[part] * nvals, size};
+      fan_in_send_msgs.push_back(send);
+      Message recv = {part, 3, ent_offsets[part] * nvals, size};
+      fan_out_recv_msgs.push_back(recv);
+      if (is_complete[part] == 2) {
+        Message own = {part, 3, own_start, own_size};
+        fan_out_own_msgs.push_back(own);
+      }
+    }
+
+    //Fan-out sends of the bounded entities
+    boundary_array = Omega_h::Write<T>(bounded_ids.size() * nvals, "comm_plan_boundary");
+    for (int i = 0; i < picparts.num_boundaries[edim]; ++i) {
+      const int part = picparts.boundary_parts[edim][i];
+      const int size = bounded_offsets[part+1] - bounded_offsets[part];
+      Message msg = {part, 3, bounded_offsets[part] * nvals, size * nvals};
+      fan_out_boundary_msgs.push_back(msg);
+    }
+
+    fan_in_recvs.resize(fan_in_recv_msgs.size());
+    fan_in_sends.resize(fan_in_send_msgs.size());
+    fan_out_recvs.resize(fan_out_recv_msgs.size());
+    fan_out_own_sends.resize(fan_out_own_msgs.size());
+    fan_out_boundary_sends.resize(fan_out_boundary_msgs.size());
+    if (direct)
       return;
+    host_array = Kokkos::create_mirror_view(array.view());
+    recv_host = Kokkos::create_mirror_view(recv_array.view());
+    boundary_host = Kokkos::create_mirror_view(boundary_array.view());
+    initRequests(fan_in_recv_msgs, recv_host, false, fan_in_recvs);
+    initRequests(fan_in_send_msgs, host_array, true, fan_in_sends);
+    initRequests(fan_out_recv_msgs, host_array, false, fan_out_recvs);
+    initRequests(fan_out_own_msgs, host_array, true, fan_out_own_sends);
+    initRequests(fan_out_boundary_msgs, boundary_host, true, fan_out_boundary_sends);
+  }
+
+  template <class T>
+  CommPlan<T>::~CommPlan() {
+    int finalized;
+    MPI_Finalized(&finalized);
+    if (finalized || direct)
+      return;
+    std::vector<MPI_Request>* requests[5] = {&fan_in_sends, &fan_in_recvs, &fan_out_recvs,
+                                             &fan_out_own_sends, &fan_out_boundary_sends};
+    for (int i = 0; i < 5; ++i)
+      for (size_t j = 0; j < requests[i]->size(); ++j)
+        MPI_Request_free(&((*requests[i])[j]));
+  }
+
+  template <class T>
+  void CommPlan<T>::initRequests(const std::vector<Message>& msgs, HostView buffer,
+                                 bool send, std::vector<MPI_Request>& requests) {
+    const MPI_Datatype type = MpiTraits<T>::datatype();
+    for (size_t i = 0; i < msgs.size(); ++i) {
+      const Message& msg = msgs[i];
+      if (send)
+        MPI_Send_init(buffer.data() + msg.offset, msg.size, type, msg.rank, msg.tag,
+                      comm, &(requests[i]));
+      else
+        MPI_Recv_init(buffer.data() + msg.offset, msg.size, type, msg.rank, msg.tag,
+                      comm, &(requests[i]));
     }
-    if (commptr->size() == 1)
+  }
+
+  template <class T>
+  void CommPlan<T>::startRequests(const std::vector<Message>& msgs, Omega_h::Write<T> buffer,
+                                  bool send, std::vector<MPI_Request>& requests) {
+    if (msgs.empty())
       return;
-    //If full mesh then perform an allreduce on the array
-    if (isFullMesh() && op != BCAST_OP) {
-      Omega_h::HostWrite<T> array_host(comm_array);
-      MPI_Op mpi_op;
-      if (op == SUM_OP)
-        mpi_op = MPI_SUM;
-      else if (op == MAX_OP)
-        mpi_op = MPI_MAX;
-      else if (op == MIN_OP)
-        mpi_op = MPI_MIN;
-      MPI_Allreduce(MPI_IN_PLACE, array_host.data(), array_host.size(),
-                    MpiTraits<T>::datatype(), mpi_op, commptr->get_impl());
-      comm_array = Omega_h::Write<T>(array_host);
+    if (!direct) {
+      MPI_Startall(requests.size(), requests.data());
       return;
     }
+    for (size_t i = 0; i < msgs.size(); ++i) {
+      const Message& msg = msgs[i];
+      if (send)
+        PS_Comm_Isend(buffer.view(), msg.offset, msg.size, msg.rank, msg.tag, comm,
+                      &(requests[i]));
+      else
+        PS_Comm_Irecv(buffer.view(), msg.offset, msg.size, msg.rank, msg.tag, comm,
+                      &(requests[i]));
+    }
+  }
 
-    //Shift comm_array indexing to bulk communication ordering
-    Omega_h::Read<Omega_h::LO> arr_index = commArrayIndex(edim);
-    Omega_h::Write<T> array(length, 0);
+  template <class T>
+  void CommPlan<T>::waitAll(std::vector<MPI_Request>& requests) {
+    if (requests.empty())
+      return;
+    if (direct)
+      PS_Comm_Waitall<Kokkos::DefaultExecutionSpace>(requests.size(), requests.data(),
+                                                     MPI_STATUSES_IGNORE);
+    else
+      MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+  }
+
+  template <class T>
+  void CommPlan<T>::toCommOrder(Omega_h::Write<T> comm_array, int column) {
+    const int nv = nvals;
+    const int k = comm_array.size() / nents;
+    const auto index = arr_index;
+    const auto comm_ordered = array;
     auto convertToComm = OMEGA_H_LAMBDA(const Omega_h::LO id) {
-      for (int i = 0; i < nvals; ++i) {
-        const Omega_h::LO index = arr_index[id];
-        array[index*nvals + i] = comm_array[id*nvals + i];
-      }
+      for (int i = 0; i < k; ++i)
+        comm_ordered[index[id]*nv + column + i] = comm_array[id*k + i];
     };
-    Omega_h::parallel_for(ne, convertToComm, "convertToComm");
-
-    /***************** Fan In ******************/
-    //Move values to host
-    Omega_h::HostWrite<T> host_array(array);
-    T* data = host_array.data();
-
-    //Prepare sending and receiving data of cores to the owner of that region
-    Omega_h::HostRead<Omega_h::LO> ent_offsets(offset_ents_per_rank_per_dim[edim]);
-    int my_num_entries = ent_offsets[commptr->rank()+1] - ent_offsets[commptr->rank()];
-    int num_recvs = num_cores[edim] - num_bounds[edim] + num_boundaries[edim];
-    int num_sends = num_cores[edim];
-    MPI_Request* send_requests = new MPI_Request[num_sends];
-    MPI_Request* recv_requests = new MPI_Request[num_recvs];
-    int index = 0;
-    //Fan in is skipped for accept_op
-    if (op != BCAST_OP) {
-      Omega_h::HostWrite<T>** neighbor_arrays = new Omega_h::HostWrite<T>*[num_recvs];
-      for (int i = 0; i < num_recvs; ++i)
-        neighbor_arrays[i] = new Omega_h::HostWrite<T>(my_num_entries*nvals);
-
-      for (int i = 0; i < num_cores[edim]; ++i) {
-        int rank = buffered_parts[edim][i];
-        int num_entries = ent_offsets[rank+1] - ent_offsets[rank];
-        if (num_entries > 0) {
-          MPI_Isend(data + ent_offsets[rank]*nvals, num_entries*nvals, MpiTraits<T>::datatype(),
-                    rank, is_complete_part[edim][rank], commptr->get_impl(), send_requests + i);
-          if (is_complete_part[edim][rank] == 2) {
-            T* neighbor_data = neighbor_arrays[index]->data();
-            MPI_Irecv(neighbor_data, my_num_entries*nvals, MpiTraits<T>::datatype(), rank, 2,
-                      commptr->get_impl(), recv_requests + index++);
-          }
-        }
-      }
+    Omega_h::parallel_for(nents, convertToComm, "convertToComm");
+  }
 
-      //Recv data from bounding parts
-      for (Omega_h::LO i = 0; i < num_boundaries[edim]; ++i) {
-        int rank = boundary_parts[edim][i];
-        T* neighbor_data = neighbor_arrays[index]->data();
-        int size = offset_bounded_per_dim[edim][rank+1] - offset_bounded_per_dim[edim][rank];
-        MPI_Irecv(neighbor_data, size*nvals, MpiTraits<T>::datatype(), rank, 1,
-                  commptr->get_impl(), recv_requests + index++);
-      }
-      //Wait for recv completion
-      Omega_h::LOs bounded_ent_ids_local = bounded_ent_ids[edim];
-      for (Omega_h::LO i = 0; i < num_recvs; ++i) {
-        int finished_neighbor = -1;
-        MPI_Status status;
-        MPI_Waitany(num_recvs, recv_requests, &finished_neighbor, &status);
-        //When recv finishes copy data to the device and perform op
-        const Omega_h::LO start_index = ent_offsets[commptr->rank()]*nvals;
-        Omega_h::Write<T> recv_array(*(neighbor_arrays[finished_neighbor]));
-        if (status.MPI_TAG == 2) {
-          if (op == SUM_OP) {
-            auto reduce_op = OMEGA_H_LAMBDA(Omega_h::LO i) {
-              Kokkos::atomic_fetch_add(&(array[start_index + i]),recv_array[i]);
-            };
-            Omega_h::parallel_for(recv_array.size(), reduce_op, "reduce_op");
-          }
-          else if (op == MAX_OP) {
-            auto reduce_op = OMEGA_H_LAMBDA(Omega_h::LO i) {
-              const T x = array[start_index + i];
-              const T y = recv_array[i];
-              array[start_index + i] = maxReduce(x,y);
-            };
-            Omega_h::parallel_for(recv_array.size(), reduce_op, "reduce_op");
-          }
-          else if (op == MIN_OP) {
-            auto reduce_op = OMEGA_H_LAMBDA(Omega_h::LO i) {
-              const T x = array[start_index + i];
-              const T y = recv_array[i];
-              array[start_index + i] = minReduce(x,y);
-            };
-            Omega_h::parallel_for(recv_array.size(), reduce_op, "reduce_op");
-          }
-        }
-        else {
-          const int size = offset_bounded_per_dim[edim][finished_neighbor+1] -
-            offset_bounded_per_dim[edim][finished_neighbor];
-          const int start = offset_bounded_per_dim[edim][finished_neighbor];
-          if (op == SUM_OP) {
-            auto reduce_op = OMEGA_H_LAMBDA(Omega_h::LO i) {
-              int index = bounded_ent_ids_local[start+i];
-              for (int j = 0; j < nvals; ++j) {
-                Kokkos::atomic_fetch_add(&(array[start_index + index*nvals + j]),
-                                         recv_array[i*nvals + j]);
-              }
-            };
-            Omega_h::parallel_for(size, reduce_op, "reduce_op");
-          }
-          else if (op == MAX_OP) {
-            auto reduce_op = OMEGA_H_LAMBDA(Omega_h::LO i) {
-              int index = bounded_ent_ids_local[start+i];
-              for (int j = 0; j < nvals; ++j) {
-                const Omega_h::LO k = start_index + index*nvals + j;
-                const T x = array[k];
-                const T y = recv_array[i*nvals + j];
-                array[k] = maxReduce(x,y);
-              }
-            };
-            Omega_h::parallel_for(size, reduce_op, "reduce_op");
-          }
-          else if (op == MIN_OP) {
-            auto reduce_op = OMEGA_H_LAMBDA(Omega_h::LO i) {
-              int index = bounded_ent_ids_local[start+i];
-              for (int j = 0; j < nvals; ++j) {
-                const Omega_h::LO k = start_index + index*nvals + j;
-                const T x = array[k];
-                const T y = recv_array[i*nvals + j];
-                array[k] = minReduce(x,y);
-              }
-            };
-            Omega_h::parallel_for(size, reduce_op, "reduce_op");
-          }
-        }
-        delete neighbor_arrays[finished_neighbor];
-      }
-      MPI_Waitall(num_sends, send_requests,MPI_STATUSES_IGNORE);
-      delete [] neighbor_arrays;
-    }
-    /***************** Fan Out ******************/
-    //Flip the sizes of the request arrays
-    MPI_Request* temp = send_requests;
-    send_requests = recv_requests;
-    recv_requests = temp;
-    int tempi = num_sends;
-    num_sends = num_recvs;
-    num_recvs = tempi;
-    Omega_h::HostWrite<T> reduced_host_array(array);
-    data = reduced_host_array.data();
-    index = 0;
-    for (int i = 0; i < num_cores[edim]; ++i) {
-      int rank = buffered_parts[edim][i];
-      int num_entries = ent_offsets[rank+1] - ent_offsets[rank];
-      if (num_entries > 0) {
-        if (is_complete_part[edim][rank]==2) {
-          MPI_Isend(data + ent_offsets[commptr->rank()]*nvals, my_num_entries*nvals,
-                    MpiTraits<T>::datatype(), rank, 3,
-                    commptr->get_impl(), send_requests + index++);
-        }
-        MPI_Irecv(data + ent_offsets[rank]*nvals, num_entries*nvals, MpiTraits<T>::datatype(),
-                  rank, 3, commptr->get_impl(), recv_requests + i);
+  template <class T>
+  void CommPlan<T>::startFanIn() {
+    if (fan_in_active) {
+      fprintf(stderr, "[ERROR] fan-in of the comm plan for dimension %d with %d values "
+              "is already in flight\n", edim, nvals);
+      throw 1;
+    }
+    if (direct)
+      Kokkos::fence();
+    else
+      Kokkos::deep_copy(host_array, array.view());
+    startRequests(fan_in_recv_msgs, recv_array, false, fan_in_recvs);
+    startRequests(fan_in_send_msgs, array, true, fan_in_sends);
+    fan_in_active = true;
+  }
+
+  template <class T>
+  void CommPlan<T>::fanIn(Mesh::Op op, Omega_h::LOs column_ops) {
+    startFanIn();
+    finishFanIn(op, column_ops);
+  }
+
+  template <class T>
+  void CommPlan<T>::finishFanIn(Mesh::Op op, Omega_h::LOs column_ops) {
+    if (!fan_in_active) {
+      fprintf(stderr, "[ERROR] fan-in of the comm plan for dimension %d with %d values "
+              "was not started\n", edim, nvals);
+      throw 1;
+    }
+    const int num_recvs = fan_in_recvs.size();
+    const int nv = nvals;
+    const int start_index = own_start;
+    const auto comm_ordered = array;
+    const auto recvd = recv_array;
+    const auto bounded = bounded_ids;
+    const bool per_column = column_ops.exists();
+    for (int i = 0; i < num_recvs; ++i) {
+      int finished = -1;
+      if (direct)
+        PS_Comm_Waitany<Kokkos::DefaultExecutionSpace>(num_recvs, fan_in_recvs.data(),
+                                                       &finished, MPI_STATUS_IGNORE);
+      else
+        MPI_Waitany(num_recvs, fan_in_recvs.data(), &finished, MPI_STATUS_IGNORE);
+      //When a recv finishes perform op on its values
+      const int offset = fan_in_recv_msgs[finished].offset;
+      const int size = fan_in_recv_msgs[finished].size;
+      if (!direct) {
+        const Kokkos::pair<int, int> range(offset, offset + size);
+        Kokkos::deep_copy(Kokkos::subview(recv_array.view(), range),
+                          Kokkos::subview(recv_host, range));
       }
+      const int bounded_start = bounded_starts[finished];
+      auto reduce_op = OMEGA_H_LAMBDA(const Omega_h::LO j) {
+        Omega_h::LO k = start_index + j;
+        if (bounded_start >= 0)
+          k = start_index + bounded[bounded_start + j / nv] * nv + j % nv;
+        const Mesh::Op o = per_column ? Mesh::Op(column_ops[j % nv]) : op;
+        comm_ordered[k] = applyOp(o, comm_ordered[k], recvd[offset + j]);
+      };
+      Omega_h::parallel_for(size, reduce_op, "reduce_op");
     }
-    //Gather the boundary data to send
-    Omega_h::LOs bounded_ent_ids_local = bounded_ent_ids[edim];
-    Omega_h::Write<T> boundary_array(bounded_ent_ids_local.size()*nvals);
-    const Omega_h::LO start_index = ent_offsets[commptr->rank()]*nvals;
+    waitAll(fan_in_sends);
+    fan_in_active = false;
+  }
+
+  template <class T>
+  void CommPlan<T>::fanOut() {
+    const int nv = nvals;
+    const int start_index = own_start;
+    const auto comm_ordered = array;
+    const auto bounded = bounded_ids;
+    const auto boundary = boundary_array;
     auto gatherBoundaryData = OMEGA_H_LAMBDA(const Omega_h::LO id) {
-      const Omega_h::LO index = bounded_ent_ids_local[id];
-      for (int i = 0; i < nvals; ++i)
-        boundary_array[id*nvals + i] = array[start_index + index*nvals + i];
+      const Omega_h::LO index = bounded[id];
+      for (int i = 0; i < nv; ++i)
+        boundary[id*nv + i] = comm_ordered[start_index + index*nv + i];
     };
-    Omega_h::parallel_for(bounded_ent_ids_local.size(),gatherBoundaryData, "gatherBoundaryData");
-
-    Omega_h::HostWrite<T> boundary_array_host(boundary_array);
-    T* sending_data = boundary_array_host.data();
-    for (int i = 0; i < num_boundaries[edim]; ++i) {
-      int rank = boundary_parts[edim][i];
-      int size = offset_bounded_per_dim[edim][rank+1] - offset_bounded_per_dim[edim][rank];
-      int start = offset_bounded_per_dim[edim][rank]*nvals;
-      MPI_Isend(sending_data+start, size*nvals, MpiTraits<T>::datatype(), rank, 3,
-                commptr->get_impl(), send_requests + index++);
-    }
-    MPI_Waitall(num_recvs, recv_requests,MPI_STATUSES_IGNORE);
-    MPI_Waitall(num_sends, send_requests,MPI_STATUSES_IGNORE);
-    delete [] send_requests;
-    delete [] recv_requests;
-
-    //Copy reduced array from host to device
-    Omega_h::Write<T> reduced_array(reduced_host_array);
-    auto setArrayValues = OMEGA_H_LAMBDA(Omega_h::LO i) {
-      array[i] = reduced_array[i];
+    Omega_h::parallel_for(bounded.size(), gatherBoundaryData, "gatherBoundaryData");
+    if (direct) {
+      Kokkos::fence();
+    }
+    else {
+      //Move the owned values and the bounded entities to the host
+      const Kokkos::pair<int, int> own_range(own_start, own_start + own_size);
+      Kokkos::deep_copy(Kokkos::subview(host_array, own_range),
+                        Kokkos::subview(array.view(), own_range));
+      Kokkos::deep_copy(boundary_host, boundary_array.view());
+    }
+
+    startRequests(fan_out_recv_msgs, array, false, fan_out_recvs);
+    startRequests(fan_out_own_msgs, array, true, fan_out_own_sends);
+    startRequests(fan_out_boundary_msgs, boundary_array, true, fan_out_boundary_sends);
+    waitAll(fan_out_recvs);
+    waitAll(fan_out_own_sends);
+    waitAll(fan_out_boundary_sends);
+    if (!direct)
+      Kokkos::deep_copy(array.view(), host_array);
+  }
+
+  template <class T>
+  void CommPlan<T>::fromCommOrder(Omega_h::Write<T> comm_array, int column) {
+    const int nv = nvals;
+    const int k = comm_array.size() / nents;
+    const auto index = arr_index;
+    const auto comm_ordered = array;
+    auto convertFromComm = OMEGA_H_LAMBDA(const Omega_h::LO id) {
+      for (int i = 0; i < k; ++i)
+        comm_array[id*k + i] = comm_ordered[index[id]*nv + column + i];
     };
-    Omega_h::parallel_for(array.size(), setArrayValues, "setArrayValues");
+    Omega_h::parallel_for(nents, convertFromComm, "convertFromComm");
+  }
+
+  namespace {
+    MPI_Op mpiOp(Mesh::Op op) {
+      if (op == Mesh::MAX_OP)
+        return MPI_MAX;
+      if (op == Mesh::MIN_OP)
+        return MPI_MIN;
+      return MPI_SUM;
+    }
+    /* Rough network model for choosing the full mesh reduction
+       Time of a message (s) and time per byte (s), a tree collective takes
+       log2(comm size) messages.
+    */
+    const double message_latency = 2e-6;
+    const double byte_time = 1e-10;
+  }
+
+  template <class T>
+  FullMeshPlan<T>::FullMeshPlan(Mesh& picparts, int dim, int num_vals, bool sparse,
+                                bool force_scatter)
+    : comm(picparts.comm()->get_impl()), edim(dim), nvals(num_vals),
+      nents(picparts.nents(dim)), use_scatter(false) {
+    arr_index = picparts.commArrayIndex(edim);
+    array = Omega_h::Write<T>(nents * nvals, 0, "full_mesh_plan_array");
+    host_array = Kokkos::create_mirror_view(array.view());
+    const int comm_size = picparts.comm()->size();
+    const double values = (double)nents * nvals * sizeof(T) * (comm_size - 1) / comm_size;
+    const double tree = std::ceil(std::log2((double)comm_size));
+    //Reduce-scatter + allgather
+    allreduce_cost = 2 * (tree * message_latency + values * byte_time);
+    scatter_cost = allreduce_cost;
+    if (!sparse)
+      return;
+    setupScatter(picparts);
+    //The sparse broadcast is bound by the slowest rank
+    const size_t sparse_values = std::max(send_ids.size(), recv_ids.size()) * nvals;
+    double sparse_cost = (send_ranks.size() + recv_ranks.size()) * message_latency +
+      sparse_values * sizeof(T) * byte_time;
+    MPI_Allreduce(MPI_IN_PLACE, &sparse_cost, 1, MPI_DOUBLE, MPI_MAX, comm);
+    scatter_cost = tree * message_latency + values * byte_time + sparse_cost;
+    use_scatter = force_scatter || scatter_cost < allreduce_cost;
+  }
+
+  template <class T>
+  void FullMeshPlan<T>::setupScatter(Mesh& picparts) {
+    const int rank = picparts.comm()->rank();
+    const int comm_size = picparts.comm()->size();
+    Omega_h::Mesh* mesh = picparts.mesh();
+    const int mdim = mesh->dim();
+
+    //Mark the entities that bound the safe elements
+    Omega_h::Write<Omega_h::LO> needed(nents, 0, "full_mesh_needed");
+    auto safe = picparts.safeTag();
+    if (edim == mdim) {
+      auto markSafe = OMEGA_H_LAMBDA(const Omega_h::LO elm) {
+        needed[elm] = safe[elm];
+      };
+      Omega_h::parallel_for(nents, markSafe, "markSafe");
+    }
+    else {
+      auto elm2ents = mesh->ask_down(mdim, edim).ab2b;
+      const int deg = elm2ents.size() / mesh->nelems();
+      auto markSafeBoundary = OMEGA_H_LAMBDA(const Omega_h::LO elm) {
+        if (safe[elm])
+          for (int i = 0; i < deg; ++i)
+            needed[elm2ents[elm * deg + i]] = 1;
+      };
+      Omega_h::parallel_for(mesh->nelems(), markSafeBoundary, "markSafeBoundary");
+    }
 
+    //Request the needed entities owned by other ranks
+    Omega_h::HostRead<Omega_h::LO> offsets_host(picparts.nentsOffsets(edim));
+    std::vector<int> offsets(offsets_host.data(), offsets_host.data() + comm_size + 1);
+    Omega_h::HostRead<Omega_h::LO> needed_host(Omega_h::LOs(needed));
+    Omega_h::HostRead<Omega_h::LO> index_host(arr_index);
+    owned_counts.resize(comm_size);
+    for (int i = 0; i < comm_size; ++i)
+      owned_counts[i] = (offsets[i+1] - offsets[i]) * nvals;
+    own_start = offsets[rank] * nvals;
+    own_values.resize(owned_counts[rank]);
+    std::vector<std::vector<int> > requested(comm_size);
+    for (int i = 0; i < nents; ++i) {
+      if (!needed_host[i])
+        continue;
+      const int index = index_host[i];
+      const int owner = std::upper_bound(offsets.begin(), offsets.end(), index) -
+        offsets.begin() - 1;
+      if (owner != rank)
+        requested[owner].push_back(index);
+    }
+    std::vector<int> recv_counts(comm_size);
+    std::vector<int> send_counts(comm_size);
+    for (int i = 0; i < comm_size; ++i)
+      recv_counts[i] = requested[i].size();
+    MPI_Alltoall(recv_counts.data(), 1, MPI_INT, send_counts.data(), 1, MPI_INT, comm);
+
+    //Send the requests to the owners, the owners keep them as block local ids
+    std::vector<int> request_offsets(comm_size + 1, 0);
+    std::vector<int> owner_offsets(comm_size + 1, 0);
+    recv_offsets.push_back(0);
+    send_offsets.push_back(0);
+    for (int i = 0; i < comm_size; ++i) {
+      request_offsets[i+1] = request_offsets[i] + recv_counts[i];
+      owner_offsets[i+1] = owner_offsets[i] + send_counts[i];
+      recv_ids.insert(recv_ids.end(), requested[i].begin(), requested[i].end());
+      if (recv_counts[i] > 0) {
+        recv_ranks.push_back(i);
+        recv_offsets.push_back(recv_offsets.back() + recv_counts[i]);
+      }
+      if (send_counts[i] > 0) {
+        send_ranks.push_back(i);
+        send_offsets.push_back(send_offsets.back() + send_counts[i]);
+      }
+    }
+    send_ids.resize(owner_offsets[comm_size]);
+    MPI_Alltoallv(recv_ids.data(), recv_counts.data(), request_offsets.data(), MPI_INT,
+                  send_ids.data(), send_counts.data(), owner_offsets.data(), MPI_INT, comm);
+    for (size_t i = 0; i < send_ids.size(); ++i)
+      send_ids[i] -= offsets[rank];
+    send_buffer.resize(send_ids.size() * nvals);
+    recv_buffer.resize(recv_ids.size() * nvals);
+    requests.resize(send_ranks.size() + recv_ranks.size());
+  }
+
+  template <class T>
+  void FullMeshPlan<T>::reduce(Mesh::Op op, Omega_h::Write<T> comm_array) {
+    const int nv = nvals;
+    const auto index = arr_index;
+    const auto comm_ordered = array;
+    auto convertToComm = OMEGA_H_LAMBDA(const Omega_h::LO id) {
+      for (int i = 0; i < nv; ++i)
+        comm_ordered[index[id]*nv + i] = comm_array[id*nv + i];
+    };
+    Omega_h::parallel_for(nents, convertToComm, "convertToComm");
+    Kokkos::deep_copy(host_array, array.view());
+
+    const MPI_Datatype type = MpiTraits<T>::datatype();
+    if (!use_scatter) {
+      MPI_Allreduce(MPI_IN_PLACE, host_array.data(), host_array.size(), type, mpiOp(op), comm);
+    }
+    else {
+      MPI_Reduce_scatter(host_array.data(), own_values.data(), owned_counts.data(), type,
+                         mpiOp(op), comm);
+      const int num_recvs = recv_ranks.size();
+      for (int i = 0; i < num_recvs; ++i)
+        MPI_Irecv(recv_buffer.data() + recv_offsets[i] * nvals,
+                  (recv_offsets[i+1] - recv_offsets[i]) * nvals, type, recv_ranks[i], 4,
+                  comm, &(requests[i]));
+      for (size_t i = 0; i < send_ids.size(); ++i)
+        for (int j = 0; j < nvals; ++j)
+          send_buffer[i * nvals + j] = own_values[send_ids[i] * nvals + j];
+      for (size_t i = 0; i < send_ranks.size(); ++i)
+        MPI_Isend(send_buffer.data() + send_offsets[i] * nvals,
+                  (send_offsets[i+1] - send_offsets[i]) * nvals, type, send_ranks[i], 4,
+                  comm, &(requests[num_recvs + i]));
+      std::copy(own_values.begin(), own_values.end(), host_array.data() + own_start);
+      MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+      for (size_t i = 0; i < recv_ids.size(); ++i)
+        for (int j = 0; j < nvals; ++j)
+          host_array(recv_ids[i] * nvals + j) = recv_buffer[i * nvals + j];
+    }
+
+    Kokkos::deep_copy(array.view(), host_array);
     auto convertFromComm = OMEGA_H_LAMBDA(const Omega_h::LO id) {
-      const Omega_h::LO index = arr_index[id];
-      for (int i = 0; i < nvals; ++i)
-        comm_array[id*nvals + i] = array[index*nvals + i];
+      for (int i = 0; i < nv; ++i)
+        comm_array[id*nv + i] = comm_ordered[index[id]*nv + i];
     };
-    Omega_h::parallel_for(ne, convertFromComm, "convertFromComm");
+    Omega_h::parallel_for(nents, convertFromComm, "convertFromComm");
   }
 
+  bool Mesh::defaultDeviceDirectComm() {
+    //Staged plans keep persistent requests and their host mirrors alias host memory
+#ifdef PS_CUDA_AWARE_MPI
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void Mesh::setDeviceDirectComm(bool direct) {
+    if (direct == device_direct_comm)
+      return;
+    for (auto itr = comm_plans.begin(); itr != comm_plans.end(); ++itr) {
+      if (itr->second->inFlight()) {
+        fprintf(stderr, "[ERROR] Cannot change the comm mode while a reduction is in flight\n");
+        throw 1;
+      }
+    }
+    for (auto itr = comm_plans.begin(); itr != comm_plans.end(); ++itr)
+      delete itr->second;
+    comm_plans.clear();
+    device_direct_comm = direct;
+  }
+
+  template <class T>
+  CommPlan<T>* Mesh::commPlan(int edim, int nvals) {
+    const auto key = std::make_tuple(edim, nvals, typeid(T).hash_code());
+    auto itr = comm_plans.find(key);
+    if (itr != comm_plans.end())
+      return static_cast<CommPlan<T>*>(itr->second);
+    CommPlan<T>* plan = new CommPlan<T>(*this, edim, nvals);
+    comm_plans[key] = plan;
+    return plan;
+  }
+
+  void Mesh::setSparseFullMeshReduction(bool sparse, bool force_scatter) {
+    if (sparse == sparse_full_mesh && force_scatter == force_full_mesh_scatter)
+      return;
+    for (auto itr = full_mesh_plans.begin(); itr != full_mesh_plans.end(); ++itr)
+      delete itr->second;
+    full_mesh_plans.clear();
+    sparse_full_mesh = sparse;
+    force_full_mesh_scatter = force_scatter;
+  }
+
+  void Mesh::clearPlans() {
+    for (auto itr = comm_plans.begin(); itr != comm_plans.end(); ++itr) {
+      if (itr->second->inFlight()) {
+        fprintf(stderr, "[ERROR] Cannot drop the comm plans while a reduction is in flight\n");
+        throw 1;
+      }
+    }
+    for (auto itr = comm_plans.begin(); itr != comm_plans.end(); ++itr)
+      delete itr->second;
+    comm_plans.clear();
+    for (auto itr = full_mesh_plans.begin(); itr != full_mesh_plans.end(); ++itr)
+      delete itr->second;
+    full_mesh_plans.clear();
+  }
+
+  template <class T>
+  FullMeshPlan<T>* Mesh::fullMeshPlan(int edim, int nvals) {
+    const auto key = std::make_tuple(edim, nvals, typeid(T).hash_code());
+    auto itr = full_mesh_plans.find(key);
+    if (itr != full_mesh_plans.end())
+      return static_cast<FullMeshPlan<T>*>(itr->second);
+    FullMeshPlan<T>* plan = new FullMeshPlan<T>(*this, edim, nvals, sparse_full_mesh,
+                                               force_full_mesh_scatter);
+    full_mesh_plans[key] = plan;
+    return plan;
+  }
+
+  //Reductions are done by a bulk fan-in fan-out through the core region of each picpart
+  template <class T>
+  void Mesh::reduceCommArray(int edim, Op op, Omega_h::Write<T> comm_array) {
+    int nvals = commArrayValues(edim, comm_array.size());
+    if (nvals < 0 || commptr->size() == 1)
+      return;
+    //If full mesh then reduce the whole array or the safe zones, see FullMeshPlan
+    if (isFullMesh() && op != BCAST_OP) {
+      fullMeshPlan<T>(edim, nvals)->reduce(op, comm_array);
+      return;
+    }
+
+    reduceCommArray_begin(edim, op, comm_array);
+    reduceCommArray_end(edim, op, comm_array);
+  }
+
+  int Mesh::commArrayValues(int edim, int length) {
+    int ne = nents(edim);
+    int nvals = length / ne;
+    if (ne*nvals != length) {
+      fprintf(stderr, "Comm array size does not match the expected size for dimension %d\n",edim);
+      return -1;
+    }
+    return nvals;
+  }
+
+  template <class T>
+  void Mesh::reduceCommArray_begin(int edim, Op op, Omega_h::Write<T> comm_array) {
+    int nvals = commArrayValues(edim, comm_array.size());
+    //Full mesh reductions are done by reduceCommArray_end
+    if (nvals < 0 || commptr->size() == 1 || (isFullMesh() && op != BCAST_OP))
+      return;
+    CommPlan<T>* plan = commPlan<T>(edim, nvals);
+    if (plan->inFlight()) {
+      fprintf(stderr, "[ERROR] A reduction of dimension %d with %d values is already in flight\n",
+              edim, nvals);
+      throw 1;
+    }
+    plan->toCommOrder(comm_array);
+    //Fan in is skipped for accept_op
+    if (op != BCAST_OP)
+      plan->startFanIn();
+  }
+
+  template <class T>
+  void Mesh::reduceCommArray_end(int edim, Op op, Omega_h::Write<T> comm_array) {
+    int nvals = commArrayValues(edim, comm_array.size());
+    if (nvals < 0 || commptr->size() == 1)
+      return;
+    if (isFullMesh() && op != BCAST_OP) {
+      reduceCommArray(edim, op, comm_array);
+      return;
+    }
+    CommPlan<T>* plan = commPlan<T>(edim, nvals);
+    if (op != BCAST_OP)
+      plan->finishFanIn(op);
+    plan->fanOut();
+    plan->fromCommOrder(comm_array);
+  }
+
+  template <class T>
+  void Mesh::reduceCommArrays(int edim, const std::vector<Op>& ops,
+                              const std::vector<Omega_h::Write<T> >& arrays) {
+    if (ops.size() != arrays.size()) {
+      fprintf(stderr, "reduceCommArrays given %lu ops for %lu arrays\n",
+              ops.size(), arrays.size());
+      return;
+    }
+    int ne = nents(edim);
+    int total_vals = 0;
+    bool fan_in = false;
+    std::vector<int> columns(arrays.size());
+    for (size_t i = 0; i < arrays.size(); ++i) {
+      int nvals = arrays[i].size() / ne;
+      if (ne*nvals != arrays[i].size()) {
+        fprintf(stderr, "Comm array %lu size does not match the expected size for dimension %d\n",
+                i, edim);
+        return;
+      }
+      columns[i] = total_vals;
+      total_vals += nvals;
+      fan_in = fan_in || ops[i] != BCAST_OP;
+    }
+    if (commptr->size() == 1 || total_vals == 0)
+      return;
+    if (isFullMesh()) {
+      for (size_t i = 0; i < arrays.size(); ++i)
+        reduceCommArray(edim, ops[i], arrays[i]);
+      return;
+    }
+
+    //Pack the arrays as consecutive values of each entity and reduce them together
+    Omega_h::HostWrite<Omega_h::LO> column_ops_host(total_vals);
+    for (size_t i = 0; i < arrays.size(); ++i)
+      for (int j = columns[i]; j < columns[i] + arrays[i].size() / ne; ++j)
+        column_ops_host[j] = ops[i];
+    Omega_h::LOs column_ops(column_ops_host.write());
+    CommPlan<T>* plan = commPlan<T>(edim, total_vals);
+    if (plan->inFlight()) {
+      fprintf(stderr, "[ERROR] A reduction of dimension %d with %d values is already in flight\n",
+              edim, total_vals);
+      throw 1;
+    }
+    for (size_t i = 0; i < arrays.size(); ++i)
+      plan->toCommOrder(arrays[i], columns[i]);
+    if (fan_in)
+      plan->fanIn(SUM_OP, column_ops);
+    plan->fanOut();
+    for (size_t i = 0; i < arrays.size(); ++i)
+      plan->fromCommOrder(arrays[i], columns[i]);
+  }
 
 #define INST(T)                                                         \
   template Omega_h::Write<T> Mesh::createCommArray(int, int, T);        \
-  template void Mesh::reduceCommArray(int, Op, Omega_h::Write<T>);
+  template void Mesh::reduceCommArray(int, Op, Omega_h::Write<T>);      \
+  template void Mesh::reduceCommArray_begin(int, Op, Omega_h::Write<T>); \
+  template void Mesh::reduceCommArray_end(int, Op, Omega_h::Write<T>);  \
+  template void Mesh::reduceCommArrays(int, const std::vector<Op>&,     \
+                                       const std::vector<Omega_h::Write<T> >&); \
+  template CommPlan<T>* Mesh::commPlan<T>(int, int);                    \
+  template FullMeshPlan<T>* Mesh::fullMeshPlan<T>(int, int);            \
+  template class CommPlan<T>;                                           \
+  template class FullMeshPlan<T>;
 
   INST(Omega_h::LO)
   INST(Omega_h::Real)
@@ -0,0 +1,185 @@
+#pragma once
+#include <vector>
+#include <mpi.h>
+#include <Kokkos_Core.hpp>
+#include <Omega_h_array.hpp>
+#include "pumipic_mesh.hpp"
+
+namespace pumipic {
+
+  //Base of the cached plans so the mesh can hold plans of every value type
+  class CommPlanBase {
+  public:
+    virtual ~CommPlanBase() {}
+    virtual bool inFlight() const = 0;
+  };
+
+  /* Communication plan for reductions of comm arrays of one entity dimension
+     with nvals values per entity
+
+     The plan is built on the first reduction of its dimension, type and nvals and
+     reused by every later one. It owns the comm ordered array, the fan-in receive
+     buffer and the fan-out boundary buffer so a reduction does not allocate.
+
+     Staged plans copy the buffers to host mirrors and communicate with persistent
+     MPI requests. Device direct plans pass the views to the PS_Comm functions of
+     ViewComm.h, so MPI reads and writes the device (or host) data in place.
+  */
+  template <class T>
+  class CommPlan : public CommPlanBase {
+  public:
+    typedef typename Kokkos::View<T*>::HostMirror HostView;
+
+    CommPlan() = delete;
+    CommPlan(const CommPlan&) = delete;
+    CommPlan& operator=(const CommPlan&) = delete;
+
+    CommPlan(Mesh& picparts, int dim, int nvals);
+    ~CommPlan();
+
+    int dim() const {return edim;}
+    int numValues() const {return nvals;}
+    bool deviceDirect() const {return direct;}
+
+    /* Copies a comm array into the comm ordered array
+       The comm array has k values per entity that are stored in the values
+       [column, column+k) of each entity. Several comm arrays can be packed into
+       one plan this way.
+    */
+    void toCommOrder(Omega_h::Write<T> comm_array, int column = 0);
+    /* Reduces the copies of the owned entities from the other picparts
+       op - operation for all values
+       column_ops - (optional) operation of each of the nvals values of an entity,
+                    replaces op
+    */
+    void fanIn(Mesh::Op op, Omega_h::LOs column_ops = Omega_h::LOs());
+    //fanIn split in two, the fan-in messages are in flight between the calls
+    void startFanIn();
+    void finishFanIn(Mesh::Op op, Omega_h::LOs column_ops = Omega_h::LOs());
+    //True between startFanIn and finishFanIn
+    bool inFlight() const {return fan_in_active;}
+    //Sends the owned entities to every picpart that buffers them
+    void fanOut();
+    //Copies the values [column, column+k) of each entity back to a comm array
+    void fromCommOrder(Omega_h::Write<T> comm_array, int column = 0);
+
+  private:
+    //A message of size values starting at offset of its buffer
+    struct Message {
+      int rank;
+      int tag;
+      int offset;
+      int size;
+    };
+    //Creates the persistent requests of staged plans
+    void initRequests(const std::vector<Message>& msgs, HostView buffer, bool send,
+                      std::vector<MPI_Request>& requests);
+    //Starts the requests, posting new PS_Comm messages for device direct plans
+    void startRequests(const std::vector<Message>& msgs, Omega_h::Write<T> buffer,
+                       bool send, std::vector<MPI_Request>& requests);
+    void waitAll(std::vector<MPI_Request>& requests);
+
+    MPI_Comm comm;
+    bool direct;
+    int edim;
+    int nvals;
+    int nents;
+    bool fan_in_active;
+    //Values of the entities owned by this rank in the comm ordered array
+    int own_start;
+    int own_size;
+    Omega_h::LOs arr_index;
+    Omega_h::Write<T> array;
+
+    //Fan-in receives into recv_array
+    //bounded_starts[i] is the first entity of receive i in bounded_ids or -1 for
+    //  a complete copy of the core
+    std::vector<Message> fan_in_recv_msgs;
+    std::vector<int> bounded_starts;
+    Omega_h::LOs bounded_ids;
+    Omega_h::Write<T> recv_array;
+    //Fan-in sends of the buffered cores in array
+    std::vector<Message> fan_in_send_msgs;
+    //Fan-out receives of the buffered cores in array
+    std::vector<Message> fan_out_recv_msgs;
+    //Fan-out sends of the owned values in array to complete buffers
+    std::vector<Message> fan_out_own_msgs;
+    //Fan-out sends of boundary_array to the parts buffering some owned entities
+    std::vector<Message> fan_out_boundary_msgs;
+    Omega_h::Write<T> boundary_array;
+
+    //Host mirrors of the staged plans
+    HostView host_array;
+    HostView recv_host;
+    HostView boundary_host;
+
+    std::vector<MPI_Request> fan_in_sends;
+    std::vector<MPI_Request> fan_in_recvs;
+    std::vector<MPI_Request> fan_out_own_sends;
+    std::vector<MPI_Request> fan_out_boundary_sends;
+    std::vector<MPI_Request> fan_out_recvs;
+  };
+
+  /* Plan for the SUM, MAX and MIN reductions of comm arrays on full mesh picparts
+
+     Every rank holds the whole mesh but only uses the entities that bound its
+     safe elements. Sparse plans reduce the comm ordered array to the owners with
+     MPI_Reduce_scatter, then each owner sends the reduced values to the ranks whose
+     safe zone needs them. Entities outside the safe zone keep this rank's
+     contribution. A cost model falls back to an MPI_Allreduce of the whole array
+     when the safe zones cover most of the mesh unless force_scatter is set. Plans
+     that are not sparse always use the MPI_Allreduce.
+  */
+  template <class T>
+  class FullMeshPlan : public CommPlanBase {
+  public:
+    typedef typename Kokkos::View<T*>::HostMirror HostView;
+
+    FullMeshPlan() = delete;
+    FullMeshPlan(const FullMeshPlan&) = delete;
+    FullMeshPlan& operator=(const FullMeshPlan&) = delete;
+
+    FullMeshPlan(Mesh& picparts, int dim, int nvals, bool sparse, bool force_scatter = false);
+
+    //Full mesh reductions are blocking
+    bool inFlight() const {return false;}
+    //True if the plan uses MPI_Reduce_scatter and the sparse broadcast
+    bool scatter() const {return use_scatter;}
+    //Estimated time (s) of one reduction with the MPI_Allreduce and the sparse plan
+    double allreduceCost() const {return allreduce_cost;}
+    double scatterCost() const {return scatter_cost;}
+
+    void reduce(Mesh::Op op, Omega_h::Write<T> comm_array);
+
+  private:
+    //Finds the entities bounding the safe elements and exchanges them with the owners
+    void setupScatter(Mesh& picparts);
+
+    MPI_Comm comm;
+    int edim;
+    int nvals;
+    int nents;
+    bool use_scatter;
+    double allreduce_cost;
+    double scatter_cost;
+    Omega_h::LOs arr_index;
+    Omega_h::Write<T> array;
+    HostView host_array;
+
+    //Number of values owned by each rank for MPI_Reduce_scatter
+    std::vector<int> owned_counts;
+    int own_start;
+    std::vector<T> own_values;
+    //Sparse broadcast, send_ids are entities of this rank's block needed by send_ranks
+    // and recv_ids are the comm array indices of the entities received from recv_ranks
+    std::vector<int> send_ranks;
+    std::vector<int> send_offsets;
+    std::vector<int> send_ids;
+    std::vector<int> recv_ranks;
+    std::vector<int> recv_offsets;
+    std::vector<int> recv_ids;
+    std::vector<T> send_buffer;
+    std::vector<T> recv_buffer;
+    std::vector<MPI_Request> requests;
+  };
+}
@@ -9,5 +9,8 @@ const static Omega_h::Real SURFACE_EXCLUDE = 1e-10;
 const Omega_h::LO DIM = 3; // mesh dimension. Only 3D mesh
 const Omega_h::LO FDIM = 2; //mesh face dimension
 
+const static Omega_h::Real ELEMENTARY_CHARGE = 1.602176634e-19; // C
+const static Omega_h::Real ATOMIC_MASS_UNIT = 1.66053906660e-27; // kg
+
 
 #endif
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_shape.hpp>
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_adjacency.hpp"
+#include "pumipic_mesh.hpp"
+
+namespace pumipic {
+  /* Particle to mesh deposition */
+
+  //Charge functor that gives every particle a unit weight
+  struct UnitCharge {
+    OMEGA_H_INLINE Omega_h::Real operator()(const int) const {return 1;}
+  };
+
+  template <int DIM, class DataTypes, class Space, class ChargeFunc>
+  void deposit_atomic(Omega_h::Mesh& mesh, ParticleStructure<DataTypes, Space>* ptcls,
+                      Segment3d x, ChargeFunc charge, Omega_h::Write<Omega_h::Real> field) {
+    const auto elm2verts = mesh.ask_elem_verts();
+    const auto coords = mesh.coords();
+    auto depositPtcl = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+      if (mask > 0) {
+        const auto verts = Omega_h::gather_verts<DIM + 1>(elm2verts, e);
+        const auto v = Omega_h::gather_vectors<DIM + 1, DIM>(coords, verts);
+        const auto w = linear_weights(v, ptcl_position<DIM>(x, pid));
+        const Omega_h::Real q = charge(pid);
+        for (int i = 0; i < DIM + 1; ++i)
+          Kokkos::atomic_add(&(field[verts[i]]), q * w[i]);
+      }
+    };
+    parallel_for(ptcls, depositPtcl, "deposit_atomic");
+  }
+
+  /* Deposit the particle charges to the mesh vertices with linear weights
+     picparts - picpart mesh (triangles or tets)
+     ptcls - particle structure, each particle must be inside its element
+     x - particle positions
+     charge - (optional) functor returning the charge of particle pid,
+              Omega_h::Real operator()(int pid) const, callable on the device
+     Returns a vertex comm array with one entry per vertex holding the sum of the
+     contributions from all picparts.
+  */
+  template <class DataTypes, class Space, class ChargeFunc = UnitCharge>
+  Omega_h::Write<Omega_h::Real> deposit_to_vertices(Mesh& picparts,
+                                                    ParticleStructure<DataTypes, Space>* ptcls,
+                                                    Segment3d x,
+                                                    ChargeFunc charge = ChargeFunc()) {
+    Omega_h::Mesh& mesh = *(picparts.mesh());
+    const int dim = mesh.dim();
+    if (dim != 2 && dim != 3) {
+      fprintf(stderr, "[ERROR] deposit_to_vertices supports triangle and tet meshes\n");
+      throw 1;
+    }
+    Omega_h::Write<Omega_h::Real> field = picparts.createCommArray(0, 1, Omega_h::Real(0));
+    Kokkos::Timer timer;
+    if (dim == 2)
+      deposit_atomic<2>(mesh, ptcls, x, charge, field);
+    else
+      deposit_atomic<3>(mesh, ptcls, x, charge, field);
+    Kokkos::fence();
+    RecordTime("deposit scatter", timer.seconds());
+    Kokkos::Timer reduce_timer;
+    picparts.reduceCommArray(0, Mesh::SUM_OP, field);
+    RecordTime("deposit reduce", reduce_timer.seconds());
+    return field;
+  }
+}
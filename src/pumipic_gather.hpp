@@ -0,0 +1,103 @@
+#pragma once
+
+#include <type_traits>
+#include <Omega_h_mesh.hpp>
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_adjacency.hpp"
+
+namespace pumipic {
+  /* Mesh to particle field gather */
+
+  //Number of field components stored in a particle member of type T
+  template <class T>
+  struct FieldComponents {
+    static constexpr int value = std::rank<T>::value == 0 ? 1 : std::extent<T>::value;
+  };
+
+  template <class T>
+  OMEGA_H_INLINE typename std::enable_if<std::rank<T>::value == 0>::type
+  setComponent(const Segment<T, device_type>& out, const int pid, const int,
+               const Omega_h::Real val) {
+    out(pid) = val;
+  }
+  template <class T>
+  OMEGA_H_INLINE typename std::enable_if<std::rank<T>::value == 1>::type
+  setComponent(const Segment<T, device_type>& out, const int pid, const int comp,
+               const Omega_h::Real val) {
+    out(pid, comp) = val;
+  }
+
+  template <int DIM, class DataTypes, class Space, class FieldT>
+  void gather_from_vertices_dim(Omega_h::Mesh& mesh, ParticleStructure<DataTypes, Space>* ptcls,
+                                Segment3d x, Omega_h::Reals field,
+                                Segment<FieldT, device_type> out, Segment4d vtx_weights) {
+    constexpr int NCOMP = FieldComponents<FieldT>::value;
+    const auto elm2verts = mesh.ask_elem_verts();
+    const auto coords = mesh.coords();
+    const bool cached = vtx_weights.exists();
+    auto gatherPtcl = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+      if (mask > 0) {
+        const auto verts = Omega_h::gather_verts<DIM + 1>(elm2verts, e);
+        Omega_h::Vector<DIM + 1> w;
+        if (cached) {
+          for (int i = 0; i < DIM + 1; ++i)
+            w[i] = vtx_weights(pid, i);
+        }
+        else {
+          const auto v = Omega_h::gather_vectors<DIM + 1, DIM>(coords, verts);
+          w = linear_weights(v, ptcl_position<DIM>(x, pid));
+        }
+        Omega_h::Real val[NCOMP];
+        for (int c = 0; c < NCOMP; ++c)
+          val[c] = 0;
+        for (int i = 0; i < DIM + 1; ++i)
+          for (int c = 0; c < NCOMP; ++c)
+            val[c] += w[i] * field[verts[i] * NCOMP + c];
+        for (int c = 0; c < NCOMP; ++c)
+          setComponent(out, pid, c, val[c]);
+      }
+    };
+    parallel_for(ptcls, gatherPtcl, "gather_from_vertices");
+  }
+
+  /* Interpolate a vertex field to the particle positions with linear weights
+     mesh - triangle or tet mesh
+     ptcls - particle structure, each particle must be inside its element
+     x - particle positions, ignored when vtx_weights is given
+     field - vertex field with NCOMP components per vertex, interleaved
+     out - particle member receiving the field, a scalar for NCOMP=1 or an
+           array of NCOMP values
+     vtx_weights - (optional) linear weights of the particles stored by the last
+                   search (see search_mesh), avoids reading the element
+                   coordinates and recomputing the weights
+  */
+  template <class DataTypes, class Space, class FieldT>
+  void gather_from_vertices(Omega_h::Mesh& mesh, ParticleStructure<DataTypes, Space>* ptcls,
+                            Segment3d x, Omega_h::Reals field,
+                            Segment<FieldT, device_type> out,
+                            Segment4d vtx_weights = Segment4d()) {
+    static_assert(std::rank<FieldT>::value <= 1,
+                  "gather_from_vertices requires a scalar or array particle member");
+    const int dim = mesh.dim();
+    const int ncomp = FieldComponents<FieldT>::value;
+    if (dim != 2 && dim != 3) {
+      fprintf(stderr, "[ERROR] gather_from_vertices supports triangle and tet meshes\n");
+      throw 1;
+    }
+    if (field.size() != mesh.nverts() * ncomp) {
+      fprintf(stderr, "[ERROR] gather_from_vertices field has %d values, "
+              "expected %d vertices with %d components\n",
+              field.size(), mesh.nverts(), ncomp);
+      throw 1;
+    }
+    Kokkos::Timer timer;
+    if (dim == 2)
+      gather_from_vertices_dim<2>(mesh, ptcls, x, field, out, vtx_weights);
+    else
+      gather_from_vertices_dim<3>(mesh, ptcls, x, field, out, vtx_weights);
+    Kokkos::fence();
+    RecordTime("gather from vertices", timer.seconds());
+  }
+}
@@ -0,0 +1,250 @@
+#include "pumipic_gyro.hpp"
+
+#include <cmath>
+#include <Omega_h_for.hpp>
+#include "pumipic_adjacency.hpp"
+
+namespace pumipic {
+  typedef Omega_h::LO LO;
+  typedef Omega_h::Real Real;
+
+  //start position, ring point, point id, linear weights of the ring point
+  typedef MemberTypes<Vector3d, Vector3d, int, Vector4d> GyroPoint;
+  typedef ParticleStructure<GyroPoint> GyroPointPS;
+
+  namespace {
+    void checkConfig(Mesh& picparts, const GyroConfig& config) {
+      if (picparts.dim() != 2) {
+        fprintf(stderr, "[ERROR] GyroAverager requires a 2D mesh\n");
+        throw 1;
+      }
+      if (config.rmax <= 0 || config.num_rings < 1 || config.points_per_ring < 1) {
+        fprintf(stderr, "[ERROR] Invalid gyro configuration rmax %f rings %d points %d\n",
+                config.rmax, config.num_rings, config.points_per_ring);
+        throw 1;
+      }
+    }
+    Real ringRadius(const GyroConfig& config, LO ring) {
+      return config.rmax * (ring + 1) / config.num_rings;
+    }
+  }
+
+  GyroAverager::GyroAverager(Mesh& mesh, GyroConfig config)
+    : picparts(&mesh), cfg(config), num_searched(0) {
+    checkConfig(mesh, config);
+    rebuild();
+  }
+
+  void GyroAverager::rebuild() {
+    Kokkos::Timer timer;
+    const LO npoints = picparts->mesh()->nverts() * cfg.num_rings * cfg.points_per_ring;
+    Omega_h::Write<LO> verts(npoints * 3, -1, "gyro_map_verts");
+    Omega_h::Write<Real> weights(npoints * 3, 0, "gyro_map_weights");
+    std::vector<LO> rings(cfg.num_rings);
+    for (LO r = 0; r < cfg.num_rings; ++r)
+      rings[r] = r;
+    buildRings(rings, verts, weights);
+    map_verts = verts;
+    map_weights = weights;
+    RecordTime("gyro map build", timer.seconds());
+  }
+
+  void GyroAverager::setConfig(GyroConfig config) {
+    checkConfig(*picparts, config);
+    Kokkos::Timer timer;
+    const GyroConfig old = cfg;
+    cfg = config;
+    const LO nverts = picparts->mesh()->nverts();
+    const LO ppr = config.points_per_ring;
+    const LO nrings = config.num_rings;
+    const LO old_nrings = old.num_rings;
+    Omega_h::Write<LO> verts(nverts * nrings * ppr * 3, -1, "gyro_map_verts");
+    Omega_h::Write<Real> weights(nverts * nrings * ppr * 3, 0, "gyro_map_weights");
+    const bool samePoints = old.points_per_ring == ppr && old.theta == config.theta;
+    const auto old_verts = map_verts;
+    const auto old_weights = map_weights;
+    std::vector<LO> moved;
+    for (LO r = 0; r < nrings; ++r) {
+      const Real radius = ringRadius(config, r);
+      LO match = -1;
+      for (LO ro = 0; samePoints && ro < old_nrings && match < 0; ++ro)
+        if (std::fabs(ringRadius(old, ro) - radius) <= 1e-12 * config.rmax)
+          match = ro;
+      if (match < 0) {
+        moved.push_back(r);
+        continue;
+      }
+      //reuse the map of the old ring with the same points
+      auto copyRing = OMEGA_H_LAMBDA(const LO id) {
+        const LO v = id / ppr;
+        const LO k = id % ppr;
+        const LO dst = ((v * nrings + r) * ppr + k) * 3;
+        const LO src = ((v * old_nrings + match) * ppr + k) * 3;
+        for (int i = 0; i < 3; ++i) {
+          verts[dst + i] = old_verts[src + i];
+          weights[dst + i] = old_weights[src + i];
+        }
+      };
+      Omega_h::parallel_for(nverts * ppr, copyRing, "gyro_copyRing");
+    }
+    buildRings(moved, verts, weights);
+    map_verts = verts;
+    map_weights = weights;
+    RecordTime("gyro map update", timer.seconds());
+  }
+
+  void GyroAverager::buildRings(const std::vector<LO>& rings,
+                                Omega_h::Write<LO> verts, Omega_h::Write<Real> weights) {
+    num_searched = 0;
+    if (rings.empty())
+      return;
+    Omega_h::Mesh* mesh = picparts->mesh();
+    const LO nverts = mesh->nverts();
+    const LO nelems = mesh->nelems();
+    const LO nrings = cfg.num_rings;
+    const LO ppr = cfg.points_per_ring;
+    const LO nbuild = rings.size();
+    const LO npoints = nverts * nbuild * ppr;
+    const Real rmax = cfg.rmax;
+    const Real theta = cfg.theta;
+    const Real torad = M_PI / 180;
+    Omega_h::HostWrite<LO> rings_h(nbuild, "gyro_build_rings");
+    for (LO i = 0; i < nbuild; ++i)
+      rings_h[i] = rings[i];
+    Omega_h::LOs build_rings(rings_h.write());
+
+    //Each point starts at the centroid of the first element adjacent to its vertex
+    const auto coords = mesh->coords();
+    const auto elm2verts = mesh->ask_elem_verts();
+    const auto verts2elms = mesh->ask_up(0, 2);
+    const auto v2e_offsets = verts2elms.a2ab;
+    const auto v2e = verts2elms.ab2b;
+    GyroPointPS::kkLidView ptcls_per_elem("gyro_points_per_elem", nelems);
+    GyroPointPS::kkLidView point_element("gyro_point_element", npoints);
+    auto point_info = createMemberViews<GyroPoint>(npoints);
+    auto start_pos = getMemberView<GyroPoint, 0>(point_info);
+    auto end_pos = getMemberView<GyroPoint, 1>(point_info);
+    auto point_id = getMemberView<GyroPoint, 2>(point_info);
+    auto setPoints = OMEGA_H_LAMBDA(const LO id) {
+      const LO k = id % ppr;
+      const LO b = (id / ppr) % nbuild;
+      const LO v = id / ppr / nbuild;
+      const LO ring = build_rings[b];
+      const LO elm = v2e[v2e_offsets[v]];
+      Kokkos::atomic_add(&(ptcls_per_elem(elm)), 1);
+      point_element(id) = elm;
+      point_id(id) = id;
+      const Real radius = rmax * (ring + 1) / nrings;
+      const Real angle = (theta + ((Real)k) / ppr * 360) * torad;
+      for (int i = 0; i < 2; ++i) {
+        Real c = 0;
+        for (int j = 0; j < 3; ++j)
+          c += coords[elm2verts[elm * 3 + j] * 2 + i];
+        start_pos(id, i) = c / 3;
+      }
+      start_pos(id, 2) = 0;
+      end_pos(id, 0) = coords[v * 2] + radius * cos(angle);
+      end_pos(id, 1) = coords[v * 2 + 1] + radius * sin(angle);
+      end_pos(id, 2) = 0;
+    };
+    Omega_h::parallel_for(npoints, setPoints, "gyro_setPoints");
+
+    Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+    GyroPointPS::kkGidView empty_gids("empty_gids", 0);
+    GyroPointPS* points = new SellCSigma<GyroPoint>(policy, INT_MAX, 64, nelems, npoints,
+                                                    ptcls_per_elem, empty_gids,
+                                                    point_element, point_info);
+    destroyViews<GyroPoint>(point_info);
+    Omega_h::Write<LO> elem_ids(points->capacity(), -1, "gyro_point_elems");
+    auto pids = points->get<2>();
+    auto wts = points->get<3>();
+    bool isFound = search_mesh_2d(*mesh, points, points->get<0>(), points->get<1>(), pids,
+                                  elem_ids, 100, Omega_h::Write<LO>(),
+                                  Omega_h::Write<Real>(), NoWallInteraction(),
+                                  Omega_h::LOs(), ElmGeometryFP32(), wts);
+    if (!isFound)
+      fprintf(stderr, "[WARNING] gyro ring point search did not finish\n");
+
+    //points outside the picpart (elem_ids == -1) keep the -1 entries
+    auto setMap = PS_LAMBDA(const int&, const int& pid, const int& mask) {
+      const LO elm = elem_ids[pid];
+      if (mask > 0 && elm >= 0) {
+        const LO id = pids(pid);
+        const LO k = id % ppr;
+        const LO b = (id / ppr) % nbuild;
+        const LO v = id / ppr / nbuild;
+        const LO entry = ((v * nrings + build_rings[b]) * ppr + k) * 3;
+        for (int i = 0; i < 3; ++i) {
+          verts[entry + i] = elm2verts[elm * 3 + i];
+          weights[entry + i] = wts(pid, i);
+        }
+      }
+    };
+    parallel_for(points, setMap, "gyro_setMap");
+    delete points;
+    num_searched = npoints;
+  }
+
+  Omega_h::Write<Real> GyroAverager::ringsToVertices(Omega_h::Write<Real> rings) {
+    const LO nrings = cfg.num_rings;
+    const LO ppr = cfg.points_per_ring;
+    const auto mverts = map_verts;
+    const auto mweights = map_weights;
+    Omega_h::Write<Real> field = picparts->createCommArray(0, 1, Real(0));
+    auto scatterRings = OMEGA_H_LAMBDA(const LO v) {
+      for (LO r = 0; r < nrings; ++r) {
+        const Real val = rings[v * nrings + r] / ppr;
+        if (val == 0)
+          continue;
+        const LO first = (v * nrings + r) * ppr * 3;
+        for (LO j = 0; j < ppr * 3; ++j) {
+          const LO mapped = mverts[first + j];
+          if (mapped >= 0)
+            Kokkos::atomic_add(&(field[mapped]), val * mweights[first + j]);
+        }
+      }
+    };
+    Omega_h::parallel_for(picparts->mesh()->nverts(), scatterRings, "gyro_scatterRings");
+    return field;
+  }
+
+  void GyroAverager::scatter_end(Omega_h::Write<Real> field) {
+    Kokkos::Timer timer;
+    picparts->reduceCommArray_end(0, Mesh::SUM_OP, field);
+    RecordTime("gyro reduction", timer.seconds());
+  }
+
+  Omega_h::Reals GyroAverager::gather(Omega_h::Reals vtxField) {
+    Omega_h::Mesh* mesh = picparts->mesh();
+    const LO nverts = mesh->nverts();
+    if (vtxField.size() != nverts) {
+      fprintf(stderr, "[ERROR] GyroAverager::gather field has %d values for %d vertices\n",
+              vtxField.size(), nverts);
+      throw 1;
+    }
+    Kokkos::Timer timer;
+    const LO nrings = cfg.num_rings;
+    const LO ppr = cfg.points_per_ring;
+    const auto mverts = map_verts;
+    const auto mweights = map_weights;
+    Omega_h::Write<Real> averaged(nverts * nrings, "gyro_averaged");
+    auto gatherRings = OMEGA_H_LAMBDA(const LO v) {
+      for (LO r = 0; r < nrings; ++r) {
+        const LO first = (v * nrings + r) * ppr * 3;
+        Real sum = 0;
+        LO count = 0;
+        for (LO k = 0; k < ppr; ++k) {
+          if (mverts[first + k * 3] < 0)
+            continue;
+          for (int i = 0; i < 3; ++i)
+            sum += mweights[first + k * 3 + i] * vtxField[mverts[first + k * 3 + i]];
+          ++count;
+        }
+        averaged[v * nrings + r] = count ? sum / count : 0;
+      }
+    };
+    Omega_h::parallel_for(nverts, gatherRings, "gyro_gatherRings");
+    RecordTime("gyro gather", timer.seconds());
+    return averaged;
+  }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <vector>
+#include <Omega_h_mesh.hpp>
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_mesh.hpp"
+#include "pumipic_deposit.hpp"
+
+namespace pumipic {
+  /* Gyro-average ring configuration
+     Ring r of a vertex has the radius rmax*(r+1)/num_rings and its points are at
+     the angles theta + 360*k/points_per_ring degrees, k < points_per_ring
+  */
+  struct GyroConfig {
+    Omega_h::Real rmax;
+    Omega_h::LO num_rings;
+    Omega_h::LO points_per_ring;
+    Omega_h::Real theta;
+  };
+
+  /* Gyro-averaging on a 2D picpart
+
+     Every ring point of every vertex is mapped once to the three vertices of the
+     triangle containing it and the linear weights of the point. The map is kept
+     until the configuration or the mesh changes, and a configuration change
+     only searches for the points of rings that moved.
+
+     scatter - deposits particle charges to the rings around the vertices of
+               their element and then from every ring point to the mesh
+               vertices, followed by one reduceCommArray
+     gather - averages a vertex field over the points of each ring
+  */
+  class GyroAverager {
+  public:
+    GyroAverager() = delete;
+    GyroAverager(const GyroAverager&) = delete;
+    GyroAverager& operator=(const GyroAverager&) = delete;
+
+    GyroAverager(Mesh& picparts, GyroConfig config);
+
+    //Changes the ring configuration, rings with unchanged points keep their mapping
+    void setConfig(GyroConfig config);
+    const GyroConfig& config() const {return cfg;}
+    //Rebuilds the map of every ring, needed after the picpart mesh changes
+    void rebuild();
+    //Number of ring points searched by the last (re)build
+    Omega_h::LO numSearchedPoints() const {return num_searched;}
+
+    //Ring point (v*num_rings + r)*points_per_ring + k to 3 vertices, -1 outside the picpart
+    Omega_h::LOs mapVerts() const {return map_verts;}
+    //Linear weights of the ring points for the vertices of mapVerts
+    Omega_h::Reals mapWeights() const {return map_weights;}
+
+    /* Scatter particle charges to the mesh vertices through the gyro rings
+       ptcls - particle structure, each particle must be inside its element
+       x - particle positions
+       radius - functor returning the gyroradius of particle pid,
+                Omega_h::Real operator()(int pid) const, callable on the device
+       charge - (optional) functor returning the charge of particle pid
+       Returns a vertex comm array reduced with SUM_OP over all picparts.
+    */
+    template <class DataTypes, class Space, class RadiusFunc, class ChargeFunc = UnitCharge>
+    Omega_h::Write<Omega_h::Real> scatter(ParticleStructure<DataTypes, Space>* ptcls,
+                                          Segment3d x, RadiusFunc radius,
+                                          ChargeFunc charge = ChargeFunc());
+    /* Non-blocking scatter
+       scatter_begin deposits the local charge and starts the reduction,
+       scatter_end finishes the reduction of the returned array. The particles
+       can be pushed between the calls.
+    */
+    template <class DataTypes, class Space, class RadiusFunc, class ChargeFunc = UnitCharge>
+    Omega_h::Write<Omega_h::Real> scatter_begin(ParticleStructure<DataTypes, Space>* ptcls,
+                                                Segment3d x, RadiusFunc radius,
+                                                ChargeFunc charge = ChargeFunc());
+    void scatter_end(Omega_h::Write<Omega_h::Real> field);
+
+    /* Gyro-average a vertex field
+       Returns nverts*num_rings values, the field averaged over ring r of vertex v
+       is at v*num_rings + r. Points outside the picpart are left out.
+    */
+    Omega_h::Reals gather(Omega_h::Reals vtxField);
+
+    //Users should not run the following functions.
+    //They are meant to be private, but must be public for enclosing lambdas
+    //Accumulates the ring values to the mapped vertices, used by scatter
+    Omega_h::Write<Omega_h::Real> ringsToVertices(Omega_h::Write<Omega_h::Real> rings);
+    //Searches for the points of the rings and sets their map entries
+    void buildRings(const std::vector<Omega_h::LO>& rings,
+                    Omega_h::Write<Omega_h::LO> verts, Omega_h::Write<Omega_h::Real> weights);
+
+  private:
+    Mesh* picparts;
+    GyroConfig cfg;
+    Omega_h::LO num_searched;
+    Omega_h::LOs map_verts;
+    Omega_h::Reals map_weights;
+  };
+
+  template <class DataTypes, class Space, class RadiusFunc, class ChargeFunc>
+  Omega_h::Write<Omega_h::Real> GyroAverager::scatter(ParticleStructure<DataTypes, Space>* ptcls,
+                                                      Segment3d x, RadiusFunc radius,
+                                                      ChargeFunc charge) {
+    auto field = scatter_begin(ptcls, x, radius, charge);
+    scatter_end(field);
+    return field;
+  }
+
+  template <class DataTypes, class Space, class RadiusFunc, class ChargeFunc>
+  Omega_h::Write<Omega_h::Real>
+  GyroAverager::scatter_begin(ParticleStructure<DataTypes, Space>* ptcls, Segment3d x,
+                              RadiusFunc radius, ChargeFunc charge) {
+    Omega_h::Mesh* mesh = picparts->mesh();
+    Kokkos::Timer timer;
+    const auto elm2verts = mesh->ask_elem_verts();
+    const auto coords = mesh->coords();
+    const Omega_h::LO nrings = cfg.num_rings;
+    const Omega_h::Real ringsPerLength = cfg.num_rings / cfg.rmax;
+    Omega_h::Write<Omega_h::Real> rings(mesh->nverts() * nrings, 0, "gyro_rings");
+    auto accumulateToRings = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+      if (mask > 0) {
+        //linear interpolation between the two rings bounding the gyroradius
+        Omega_h::Real t = radius(pid) * ringsPerLength - 1;
+        t = (t < 0) ? 0 : ((t > nrings - 1) ? nrings - 1 : t);
+        const Omega_h::LO down = (t >= nrings - 1) ? nrings - 1 : Omega_h::LO(t);
+        const Omega_h::LO up = (down + 1 < nrings) ? down + 1 : down;
+        const Omega_h::Real upFrac = t - down;
+        const auto verts = Omega_h::gather_verts<3>(elm2verts, e);
+        const auto v = Omega_h::gather_vectors<3, 2>(coords, verts);
+        const auto w = linear_weights(v, ptcl_position<2>(x, pid));
+        const Omega_h::Real q = charge(pid);
+        for (int i = 0; i < 3; ++i) {
+          const Omega_h::LO first = verts[i] * nrings;
+          Kokkos::atomic_add(&(rings[first + down]), q * w[i] * (1 - upFrac));
+          if (upFrac > 0)
+            Kokkos::atomic_add(&(rings[first + up]), q * w[i] * upFrac);
+        }
+      }
+    };
+    parallel_for(ptcls, accumulateToRings, "gyro_accumulateToRings");
+    auto field = ringsToVertices(rings);
+    picparts->reduceCommArray_begin(0, Mesh::SUM_OP, field);
+    RecordTime("gyro scatter", timer.seconds());
+    return field;
+  }
+}
@@ -1,6 +1,11 @@
 #include "pumipic_input.hpp"
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
+#include <iterator>
 #include <stdexcept>
+#include <vector>
+#include <ppTiming.hpp>
 
 namespace {
   std::string getMethodString(pumipic::Input::Method m) {
@@ -15,6 +20,79 @@ namespace {
     else
       return "UNKNOWN";
   }
+
+  //Identifies binary partition files (.bptn)
+  const int BPTN_MAGIC = 0x6e747062;
+  const int BPTN_VERSION = 1;
+
+  /* Reads a text partition file
+       .ptn - the owner of each element
+       .cpn - the number of classification ids followed by a class id and owner per line
+     Returns the length of the partition vector or -1 if the file can not be read
+  */
+  int readTextPartition(const char* filename, bool classification,
+                        Omega_h::HostWrite<Omega_h::LO>& owners) {
+    std::ifstream in_str(filename, std::ios::binary);
+    if (!in_str)
+      return -1;
+    //Parse the whole file from memory instead of extracting one value at a time
+    std::string text((std::istreambuf_iterator<char>(in_str)),
+                     std::istreambuf_iterator<char>());
+    const char* pos = text.c_str();
+    char* end;
+    if (classification) {
+      const long size = strtol(pos, &end, 10);
+      if (end == pos || size < 0)
+        return -1;
+      pos = end;
+      owners = Omega_h::HostWrite<Omega_h::LO>(size + 1, "host_owners");
+      while (true) {
+        const long cid = strtol(pos, &end, 10);
+        if (end == pos)
+          break;
+        pos = end;
+        const long own = strtol(pos, &end, 10);
+        if (end == pos || cid < 0 || cid > size)
+          return -1;
+        pos = end;
+        owners[cid] = own;
+      }
+      return size + 1;
+    }
+    std::vector<Omega_h::LO> values;
+    while (true) {
+      const long own = strtol(pos, &end, 10);
+      if (end == pos)
+        break;
+      pos = end;
+      values.push_back(own);
+    }
+    owners = Omega_h::HostWrite<Omega_h::LO>(values.size(), "host_owners");
+    std::copy(values.begin(), values.end(), owners.data());
+    return values.size();
+  }
+
+  /* Reads a binary partition file with one read of the owners
+     Returns the length of the partition vector or -1 if the file can not be read
+  */
+  int readBinaryPartition(const char* filename, int& rule,
+                          Omega_h::HostWrite<Omega_h::LO>& owners) {
+    std::ifstream in_str(filename, std::ios::binary);
+    if (!in_str)
+      return -1;
+    int header[4];
+    in_str.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!in_str || header[0] != BPTN_MAGIC || header[1] != BPTN_VERSION || header[3] < 0) {
+      fprintf(stderr, "[ERROR] %s is not a binary partition file of this machine\n", filename);
+      return -1;
+    }
+    rule = header[2];
+    owners = Omega_h::HostWrite<Omega_h::LO>(header[3], "host_owners");
+    in_str.read(reinterpret_cast<char*>(owners.data()), sizeof(Omega_h::LO) * header[3]);
+    if (!in_str)
+      return -1;
+    return header[3];
+  }
 }
 
 namespace pumipic {
@@ -32,63 +110,12 @@ namespace pumipic {
 
 
     if (comm_size > 1) {
-      int dot = strlen(partition_filename) - 1;
-      while (dot >=0 && partition_filename[dot] != '.')
-        --dot;
-      if (dot < 0) {
-        fprintf(stderr, "[ERROR] Filename provided has no extension (%s)", partition_filename);
-        throw std::runtime_error("Filename has no extension");
-      }
-      char* extension = partition_filename + dot + 1;
-      if (strcmp(extension, "ptn") == 0) {
-        Omega_h::HostWrite<Omega_h::LO> partition_vector(mesh.nelems());
-        std::ifstream in_str(partition_filename);
-        if (!in_str) {
-          if (!comm_rank)
-            fprintf(stderr,"Cannot open file %s\n", partition_filename);
-          throw std::runtime_error("Cannot open file");
-        }
-        int own;
-        int index = 0;
-        while(in_str >> own)
-          partition_vector[index++] = own;
-        partition = Omega_h::LOs(Omega_h::Write<Omega_h::LO>(partition_vector));
-      }
-      else if (strcmp(extension, "cpn") == 0) {
-        ownership_rule=CLASSIFICATION;
-        int root = 0;
-        if (comm_rank == root) {
-          std::ifstream in_str(partition_filename);
-          if (!in_str) {
-            if (!comm_rank)
-              fprintf(stderr,"Cannot open file %s\n", partition_filename);
-            throw std::runtime_error("Cannot open file");
-          }
-          int size;
-          in_str>>size;
-          Omega_h::HostWrite<Omega_h::LO> host_owners(size+1, "host_owners");
-          int cid, own;
-          while(in_str >> cid >> own)
-            host_owners[cid] = own;
-          int length = host_owners.size();
-          MPI_Bcast(&length, 1, MPI_INT, root, comm->get_impl());
-          MPI_Bcast(host_owners.data(), length, MPI_INT, root, comm->get_impl());
-          partition = Omega_h::LOs(Omega_h::Write<Omega_h::LO>(host_owners));
-
-        }
-        else {
-          int length;
-          MPI_Bcast(&length, 1, MPI_INT, root, comm->get_impl());
-          Omega_h::HostWrite<Omega_h::LO> host_owners(length, "host_owners");
-          MPI_Bcast(host_owners.data(), length, MPI_INT, root, comm->get_impl());
-          partition = Omega_h::LOs(Omega_h::Write<Omega_h::LO>(host_owners));
-
-        }
-
-      }
-      else {
-        fprintf(stderr, "[ERROR] Only .ptn and .cpn partitions are supported");
-        throw std::runtime_error("Invalid partition file extension");
+      partition = readPartition(partition_filename, comm, ownership_rule);
+      if (ownership_rule == PARTITION && partition.size() != mesh.nelems()) {
+        if (!comm_rank)
+          fprintf(stderr, "[ERROR] Partition file %s has %d owners for %d elements\n",
+                  partition_filename, partition.size(), mesh.nelems());
+        throw std::runtime_error("Partition does not match the mesh");
       }
     }
     bufferMethod = bufferMethod_;
@@ -102,6 +129,7 @@ namespace pumipic {
     bridge_dim = 0;
     bufferBFSLayers = 3;
     safeBFSLayers = 1;
+    ordering = NATURAL_ORDER;
 
     if (bufferMethod == MINIMUM)
       bufferBFSLayers = 0;
@@ -128,6 +156,7 @@ namespace pumipic {
     bridge_dim = 0;
     bufferBFSLayers = 3;
     safeBFSLayers = 1;
+    ordering = NATURAL_ORDER;
 
     if (bufferMethod == MINIMUM)
       bufferBFSLayers = 0;
@@ -135,6 +164,67 @@ namespace pumipic {
       safeBFSLayers = 0;
   }
 
+  Omega_h::LOs Input::readPartition(const char* filename, Omega_h::CommPtr comm,
+                                    Ownership& rule) {
+    Kokkos::Timer timer;
+    int comm_rank = comm->rank();
+    int dot = strlen(filename) - 1;
+    while (dot >=0 && filename[dot] != '.')
+      --dot;
+    if (dot < 0) {
+      fprintf(stderr, "[ERROR] Filename provided has no extension (%s)", filename);
+      throw std::runtime_error("Filename has no extension");
+    }
+    const char* extension = filename + dot + 1;
+    const bool binary = strcmp(extension, "bptn") == 0;
+    if (!binary && strcmp(extension, "ptn") != 0 && strcmp(extension, "cpn") != 0) {
+      fprintf(stderr, "[ERROR] Only .ptn, .cpn and .bptn partitions are supported");
+      throw std::runtime_error("Invalid partition file extension");
+    }
+
+    //The root reads the file and broadcasts the owners
+    int root = 0;
+    int header[2] = {-1, strcmp(extension, "cpn") == 0 ? CLASSIFICATION : PARTITION};
+    Omega_h::HostWrite<Omega_h::LO> host_owners;
+    if (comm_rank == root) {
+      if (binary)
+        header[0] = readBinaryPartition(filename, header[1], host_owners);
+      else
+        header[0] = readTextPartition(filename, header[1] == CLASSIFICATION, host_owners);
+    }
+    MPI_Bcast(header, 2, MPI_INT, root, comm->get_impl());
+    int length = header[0];
+    if (length < 0) {
+      if (!comm_rank)
+        fprintf(stderr,"Cannot open file %s\n", filename);
+      throw std::runtime_error("Cannot open file");
+    }
+    rule = Ownership(header[1]);
+    if (comm_rank != root)
+      host_owners = Omega_h::HostWrite<Omega_h::LO>(length, "host_owners");
+    MPI_Bcast(host_owners.data(), length, MPI_INT, root, comm->get_impl());
+    RecordTime("partition loading", timer.seconds());
+    return Omega_h::LOs(Omega_h::Write<Omega_h::LO>(host_owners));
+  }
+
+  void Input::writeBinaryPartition(const char* filename, Ownership rule,
+                                   Omega_h::LOs partition_vector) {
+    std::ofstream out_str(filename, std::ios::binary);
+    if (!out_str) {
+      fprintf(stderr, "[ERROR] Cannot open file %s\n", filename);
+      throw std::runtime_error("Cannot open file");
+    }
+    Omega_h::HostRead<Omega_h::LO> owners(partition_vector);
+    const int header[4] = {BPTN_MAGIC, BPTN_VERSION, rule, owners.size()};
+    out_str.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out_str.write(reinterpret_cast<const char*>(owners.data()),
+                  sizeof(Omega_h::LO) * owners.size());
+    if (!out_str) {
+      fprintf(stderr, "[ERROR] Failed writing partition file %s\n", filename);
+      throw std::runtime_error("Cannot write file");
+    }
+  }
+
   Input::Method Input::getMethod(std::string s) {
     const char* cs = s.c_str();
     if( !strcasecmp(cs,"FULL") )
@@ -149,6 +239,16 @@ namespace pumipic {
       return Input::INVALID;
   }
 
+  Input::Ordering Input::getOrdering(std::string s) {
+    const char* cs = s.c_str();
+    if( !strcasecmp(cs,"SFC") )
+      return Input::SFC_ORDER;
+    else if( !strcasecmp(cs,"RCM") )
+      return Input::RCM_ORDER;
+    else
+      return Input::NATURAL_ORDER;
+  }
+
   void Input::printInfo() {
     std::string bname = getMethodString(bufferMethod);
     std::string sname = getMethodString(safeMethod);
@@ -1,4 +1,5 @@
 #pragma once
+#include <string>
 #include <Omega_h_mesh.hpp>
 
 namespace pumipic {
@@ -38,6 +39,20 @@ namespace pumipic {
       NONE
     };
 
+    /* Numbering of the picpart entities (not applied when the full mesh is buffered)
+
+       NATURAL_ORDER: The order of the entities in the full mesh
+       SFC_ORDER: Vertices along a Hilbert curve through their coordinates, the
+                  other entities by the new numbers of their vertices
+       RCM_ORDER: Vertices by reverse Cuthill-McKee through the edges, the other
+                  entities by the new numbers of their vertices
+     */
+    enum Ordering {
+      NATURAL_ORDER,
+      SFC_ORDER,
+      RCM_ORDER
+    };
+
     //Defines the type of info given in partition_vector
     enum Ownership {
       PARTITION, //partition vector holds ownership for each entitiy
@@ -54,6 +69,26 @@ namespace pumipic {
 
     void printInfo();
     static Method getMethod(std::string s);
+    //Returns the ordering named SFC or RCM, NATURAL_ORDER otherwise
+    static Ordering getOrdering(std::string s);
+
+    /* Reads a partition file on the root of comm and broadcasts it
+         .ptn - text file with the owner of each element
+         .cpn - text file with the number of classification ids followed by a
+                class id and owner per line
+         .bptn - binary file with the rule and the partition vector, written by
+                 writeBinaryPartition
+       rule(out) - the ownership rule of the partition vector
+       Returns the partition vector
+    */
+    static Omega_h::LOs readPartition(const char* filename, Omega_h::CommPtr comm,
+                                      Ownership& rule);
+    /* Writes a binary partition file (.bptn)
+       The owners are stored in the byte order of this machine
+       See test/convert_partition.cpp to convert .ptn and .cpn files
+    */
+    static void writeBinaryPartition(const char* filename, Ownership rule,
+                                     Omega_h::LOs partition_vector);
 
     Ownership getRule() const {return ownership_rule;}
     Omega_h::LOs getPartition() const {return partition;}
@@ -64,6 +99,15 @@ namespace pumipic {
     int bufferBFSLayers;
     //For Method = BFS, # of layers of BFS to go out for safe zone (defaults to 1)
     int safeBFSLayers;
+    //Numbering of the picpart entities for locality (defaults to NATURAL_ORDER)
+    Ordering ordering;
+    /* Directory of the picpart cache (defaults to empty, no cache)
+       The picparts are written to a subdirectory keyed by a hash of the full mesh
+       and its tag values, partition, methods, layers and number of ranks. Later runs
+       with the same inputs load the picparts from it instead of constructing them.
+       Truncated or corrupt cache files are ignored and the picparts are constructed.
+    */
+    std::string cache_dir;
 
     friend class Mesh;
   private:
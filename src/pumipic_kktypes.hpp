@@ -15,16 +15,19 @@ namespace pumipic {
   typedef float fp_t;
 #endif
   typedef fp_t Vector3d[3];
+  typedef fp_t Vector4d[4];
 
   typedef Kokkos::DefaultExecutionSpace exe_space;
   typedef exe_space::device_type device_type;
   typedef Segment<int, device_type> SegmentInt;
   typedef Segment<Vector3d, device_type> Segment3d;
+  typedef Segment<Vector4d, device_type> Segment4d;
 
   typedef Kokkos::View<lid_t*, device_type> kkLidView;
   void hostToDeviceLid(kkLidView d, lid_t *h);
   void deviceToHostLid(kkLidView d, lid_t *h);
   typedef Kokkos::View<fp_t*, device_type> kkFpView;
+  typedef Kokkos::View<float*, device_type> kkFp32View;
   /** \brief helper function to transfer a host array to a device view */
   void hostToDeviceFp(kkFpView d, fp_t* h);
   typedef Kokkos::View<Vector3d*, device_type> kkFp3View;
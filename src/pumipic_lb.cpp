@@ -3,6 +3,12 @@
 #include "pumipic_mesh.hpp"
 #include <particle_structs.hpp>
 #include <Omega_h_for.hpp>
+#include <Omega_h_int_scan.hpp>
+#include <Omega_h_sort.hpp>
+#include <Omega_h_file.hpp>
+#include <ppTiming.hpp>
+#include <cmath>
+#include <limits>
 
 namespace pumipic {
   typedef Omega_h::LO LO;
@@ -20,7 +26,10 @@ namespace pumipic {
     //Return PCU communicator to world
     PCU_Switch_Comm(MPI_COMM_WORLD);
   }
-  ParticleBalancer::ParticleBalancer(Mesh& picparts) {
+  ParticleBalancer::ParticleBalancer(Mesh& picparts)
+    : selection_mode(ARRIVAL_SELECTION), lazy_balancing(false), plan_reuse_tol(0.05), num_repartitions(0), num_balances(0),
+      num_skipped(0), num_reused(0) {
+    Kokkos::Timer total_timer;
     Omega_h::CommPtr comm = picparts.comm();
     //Change PCU communicator to the mesh communicator
     PCU_Switch_Comm(comm->get_impl());
@@ -62,10 +71,12 @@ namespace pumipic {
     MPI_Waitall(nbuffers, send_requests, MPI_STATUSES_IGNORE);
     delete [] send_requests;
 
-    //Determine the overlapping safe zones(sbars) for each element (CPU)
-    Omega_h::HostWrite<int> core_elm_sbar = buildLocalSbarMap(comm_rank, core_nents,
-                                                              buffer_ranks,
-                                                              safe_core_per_buffer);
+    //Determine the overlapping safe zones(sbars) for each element (GPU/CPU)
+    Kokkos::Timer timer;
+    Omega_h::Write<int> core_elm_sbar = buildLocalSbarMap(comm_rank, core_nents,
+                                                          buffer_ranks,
+                                                          safe_core_per_buffer);
+    RecordTime("sbar construction", timer.seconds());
 
     sendCoreSbars(comm, buffer_ranks);
 
@@ -79,6 +90,43 @@ namespace pumipic {
 
     //Build N-graph from indices (CPU)
     buildNgraph(comm);
+    RecordTime("ParticleBalancer construction", total_timer.seconds());
+  }
+
+  ParticleBalancer::ParticleBalancer(Mesh& picparts, std::istream& in)
+    : selection_mode(ARRIVAL_SELECTION), lazy_balancing(false), plan_reuse_tol(0.05), num_repartitions(0), num_balances(0),
+      num_skipped(0), num_reused(0) {
+    Kokkos::Timer timer;
+    Omega_h::CommPtr comm = picparts.comm();
+    PCU_Switch_Comm(comm->get_impl());
+    Omega_h::binary::read_value(in, max_sbar, false);
+    int nsbars;
+    Omega_h::binary::read_value(in, nsbars, false);
+    for (int i = 0; i < nsbars; ++i) {
+      int nparts, id;
+      Omega_h::binary::read_value(in, nparts, false);
+      Parts parts;
+      for (int j = 0; j < nparts; ++j) {
+        int part;
+        Omega_h::binary::read_value(in, part, false);
+        parts.insert(part);
+      }
+      Omega_h::binary::read_value(in, id, false);
+      sbar_ids[parts] = id;
+    }
+    buildNgraph(comm);
+    RecordTime("ParticleBalancer load", timer.seconds());
+  }
+
+  void ParticleBalancer::writeSbars(std::ostream& out) const {
+    Omega_h::binary::write_value(out, max_sbar, false);
+    Omega_h::binary::write_value(out, int(sbar_ids.size()), false);
+    for (auto itr = sbar_ids.begin(); itr != sbar_ids.end(); ++itr) {
+      Omega_h::binary::write_value(out, int(itr->first.size()), false);
+      for (auto pitr = itr->first.begin(); pitr != itr->first.end(); ++pitr)
+        Omega_h::binary::write_value(out, *pitr, false);
+      Omega_h::binary::write_value(out, itr->second, false);
+    }
   }
 
   ParticleBalancer::SBarUnmap::iterator ParticleBalancer::insert(Parts& p) {
@@ -89,23 +137,105 @@ namespace pumipic {
     return itr;
   }
 
-  Omega_h::HostWrite<int> ParticleBalancer::buildLocalSbarMap(int comm_rank, int nelms,
+  namespace {
+    //Mixing function of splitmix64
+    KOKKOS_INLINE_FUNCTION uint64_t mixBits(uint64_t x) {
+      x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+      x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+      return x ^ (x >> 31);
+    }
+
+    typedef Kokkos::View<uint64_t**> SbarBits;
+
+    /* Groups the elements with the same buffered ranks in their safe zone
+       Each element's set is a bitset over the buffers that is hashed on the device.
+       Sorting the elements by hash puts equal bitsets next to each other, so the
+       first element of each run of equal bitsets represents the run.
+       elm_run(out) - the run of each element
+       returns the bitset of each run
+    */
+    SbarBits sortSbars(int nelms, int nbuffers, Omega_h::LOs safe_per_buffer,
+                       Omega_h::Write<LO> elm_run) {
+      const int nwords = nbuffers / 64 + 1;
+      SbarBits bits("sbar_bits", nelms, nwords);
+      Omega_h::Write<Omega_h::GO> hashes(nelms, "sbar_hashes");
+      auto encodeSbars = OMEGA_H_LAMBDA(const LO elm) {
+        for (int w = 0; w < nwords; ++w)
+          bits(elm, w) = 0;
+        for (int j = 0; j < nbuffers; ++j)
+          if (safe_per_buffer[elm * nbuffers + j])
+            bits(elm, j / 64) |= uint64_t(1) << (j % 64);
+        uint64_t h = 0;
+        for (int w = 0; w < nwords; ++w)
+          h = mixBits(h ^ mixBits(bits(elm, w) + w));
+        hashes[elm] = static_cast<Omega_h::GO>(h);
+      };
+      Omega_h::parallel_for(nelms, encodeSbars, "encodeSbars");
+
+      //Mark the first element of each run of equal bitsets in hash order
+      Omega_h::LOs order = Omega_h::sort_by_keys(Omega_h::Read<Omega_h::GO>(hashes));
+      Omega_h::Write<LO> is_first(nelms, "sbar_is_first");
+      auto markFirst = OMEGA_H_LAMBDA(const LO i) {
+        bool first = i == 0;
+        if (!first) {
+          const LO elm = order[i];
+          const LO prev = order[i - 1];
+          first = hashes[elm] != hashes[prev];
+          for (int w = 0; w < nwords && !first; ++w)
+            first = bits(elm, w) != bits(prev, w);
+        }
+        is_first[i] = first;
+      };
+      Omega_h::parallel_for(nelms, markFirst, "markFirst");
+      Omega_h::LOs run_offsets = Omega_h::offset_scan(Omega_h::LOs(is_first));
+      Omega_h::HostRead<LO> run_offsets_host(run_offsets);
+      const LO nruns = run_offsets_host[nelms];
+
+      SbarBits run_bits("sbar_run_bits", nruns, nwords);
+      auto numberRuns = OMEGA_H_LAMBDA(const LO i) {
+        const LO run = run_offsets[i + 1] - 1;
+        elm_run[order[i]] = run;
+        if (is_first[i])
+          for (int w = 0; w < nwords; ++w)
+            run_bits(run, w) = bits(order[i], w);
+      };
+      Omega_h::parallel_for(nelms, numberRuns, "numberRuns");
+      return run_bits;
+    }
+
+    Omega_h::Write<int> runsToSbars(Omega_h::LOs elm_run, Omega_h::LOs run_sbar) {
+      Omega_h::Write<int> elm_sbar(elm_run.size(), "core_sbars");
+      auto setElmSbar = OMEGA_H_LAMBDA(const LO elm) {
+        elm_sbar[elm] = run_sbar[elm_run[elm]];
+      };
+      Omega_h::parallel_for(elm_run.size(), setElmSbar, "setElmSbar");
+      return elm_sbar;
+    }
+  }
+
+  /* The sbars are found on the device, only one representative of each distinct
+     sbar is moved to the host to fill sbar_ids. Inserting the representatives also
+     merges runs that were split by hash collisions.
+   */
+  Omega_h::Write<int> ParticleBalancer::buildLocalSbarMap(int comm_rank, int nelms,
                                            Omega_h::HostWrite<LO> buffer_ranks,
                                            Omega_h::HostWrite<LO> safe_core_per_buffer) {
-    Omega_h::HostWrite<int> core_elm_sbar = Omega_h::HostWrite<int>(nelms, "core_sbars");
-    int nbuffers = buffer_ranks.size();
-    for (int i = 0; i < nelms; ++i) {
+    const int nbuffers = buffer_ranks.size();
+    Omega_h::Write<LO> safe_per_buffer(safe_core_per_buffer);
+    Omega_h::Write<LO> elm_run(nelms, "sbar_elm_run");
+    SbarBits run_bits = sortSbars(nelms, nbuffers, Omega_h::LOs(safe_per_buffer), elm_run);
+    auto run_bits_host = Kokkos::create_mirror_view_and_copy(Kokkos::HostSpace(), run_bits);
+    const LO nruns = run_bits.extent(0);
+    Omega_h::HostWrite<LO> run_sbar(nruns, "run_sbar");
+    for (LO run = 0; run < nruns; ++run) {
       Parts parts;
       parts.insert(comm_rank);
-      for (int j = 0; j < nbuffers; ++j) {
-        int index = i * nbuffers + j;
-        if (safe_core_per_buffer[index])
+      for (int j = 0; j < nbuffers; ++j)
+        if (run_bits_host(run, j / 64) & (uint64_t(1) << (j % 64)))
           parts.insert(buffer_ranks[j]);
-      }
-      auto itr = insert(parts);
-      core_elm_sbar[i] = itr->second;
+      run_sbar[run] = insert(parts)->second;
     }
-    return core_elm_sbar;
+    return runsToSbars(Omega_h::LOs(elm_run), Omega_h::LOs(run_sbar.write()));
   }
 
   void ParticleBalancer::sendCoreSbars(Omega_h::CommPtr comm,
@@ -378,13 +508,11 @@ namespace pumipic {
     return Omega_h::LOs(elem_sbars_tag);
   }
 
-  void ParticleBalancer::numberElements(Mesh& picparts, Omega_h::HostWrite<int> local_sbar_host,
+  void ParticleBalancer::numberElements(Mesh& picparts, Omega_h::Write<int> local_sbar,
                                         std::unordered_map<int, int>& map) {
     Omega_h::CommPtr comm = picparts.comm();
     int comm_rank = comm->rank();
     int dim = picparts.dim();
-    //Transfer information to the device
-    Omega_h::Write<int> local_sbar(local_sbar_host);
     //Create UMap on device
     Kokkos::UnorderedMap<int, int> device_map(map.size());
     buildMap(map, device_map);
@@ -512,10 +640,201 @@ namespace pumipic {
       tgt_parts_host[tgt_index] = -1;
       wgts_host[tgt_index++] = 0;
     }
+    ++num_balances;
+    plan_weights = vert_weights;
+    last_sbar_index_map = sbar_index_map;
+    last_tgt_parts.resize(num_indices);
+    last_wgts.resize(num_indices);
+    for (int i = 0; i < num_indices; ++i) {
+      last_tgt_parts[i] = tgt_parts_host[i];
+      last_wgts[i] = wgts_host[i];
+    }
     return ParticlePlan(sbar_index_map, Omega_h::Write<LO>(tgt_parts_host),
                         Omega_h::Write<Omega_h::Real>(wgts_host));
   }
 
+  void ParticleBalancer::setLazyBalancing(bool lazy, double reuse_tol) {
+    lazy_balancing = lazy;
+    plan_reuse_tol = reuse_tol;
+  }
+
+  double ptclImbalance(MPI_Comm comm, double weight) {
+    double max_weight, total_weight;
+    MPI_Allreduce(&weight, &max_weight, 1, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(&weight, &total_weight, 1, MPI_DOUBLE, MPI_SUM, comm);
+    int comm_size;
+    MPI_Comm_size(comm, &comm_size);
+    if (total_weight <= 0)
+      return 1;
+    return max_weight / (total_weight / comm_size);
+  }
+
+  bool ParticleBalancer::planReusable(MPI_Comm comm) {
+    //Relative L1 change of the weights since the last balance
+    double change = std::numeric_limits<double>::max();
+    if (num_balances > 0 && plan_weights.size() == vert_weights.size()) {
+      double diff = 0;
+      double total = 0;
+      for (size_t i = 0; i < vert_weights.size(); ++i) {
+        diff += std::fabs(vert_weights[i] - plan_weights[i]);
+        total += plan_weights[i];
+      }
+      if (total > 0)
+        change = diff / total;
+      else if (diff == 0)
+        change = 0;
+    }
+    double max_change;
+    MPI_Allreduce(&change, &max_change, 1, MPI_DOUBLE, MPI_MAX, comm);
+    return max_change < plan_reuse_tol;
+  }
+
+  ParticlePlan ParticleBalancer::reusePlan() {
+    ++num_reused;
+    const int num_indices = last_tgt_parts.size();
+    Omega_h::HostWrite<LO> tgt_parts_host(num_indices, "tgt_parts_host");
+    Omega_h::HostWrite<Omega_h::Real> wgts_host(num_indices, "wgts_host");
+    for (int i = 0; i < num_indices; ++i) {
+      tgt_parts_host[i] = last_tgt_parts[i];
+      wgts_host[i] = last_wgts[i];
+    }
+    return ParticlePlan(last_sbar_index_map, Omega_h::Write<LO>(tgt_parts_host),
+                        Omega_h::Write<Omega_h::Real>(wgts_host));
+  }
+
+  namespace {
+    //The bits of a non-negative float sort in the same order as the float
+    KOKKOS_INLINE_FUNCTION uint32_t floatBits(float f) {
+      union {float f; uint32_t u;} bits;
+      bits.f = f;
+      return bits.u;
+    }
+
+    /* Sort key of each element that sends particles, the plan index of its sbar in
+       the high bits and the distance of its centroid to the centroid of the core
+       of the sbar's first target part in the low bits. Elements that stay sort last.
+       elm_start(out) - the plan index of each element's sbar or -1 if it stays
+    */
+    Omega_h::Read<Omega_h::GO> elementKeys(Omega_h::Mesh* mesh, Omega_h::LOs owners,
+                                           int comm_size, Omega_h::LOs sbars,
+                                           Kokkos::UnorderedMap<int, int> sbar_to_index,
+                                           Omega_h::LOs part_ids, Omega_h::Reals elm_wgts,
+                                           Omega_h::Write<LO> elm_start) {
+      const int dim = mesh->dim();
+      const LO nelms = mesh->nelems();
+      const auto coords = mesh->coords();
+      const auto elm2verts = mesh->ask_elem_verts();
+      Omega_h::Write<Omega_h::Real> centroids(nelms * dim, "elm_centroids");
+      Omega_h::Write<Omega_h::Real> part_sums(comm_size * dim, 0, "part_centroid_sums");
+      Omega_h::Write<LO> part_counts(comm_size, 0, "part_centroid_counts");
+      auto sumCentroids = OMEGA_H_LAMBDA(const LO elm) {
+        const int owner = owners[elm];
+        for (int d = 0; d < dim; ++d) {
+          Omega_h::Real c = 0;
+          for (int v = 0; v <= dim; ++v)
+            c += coords[elm2verts[elm * (dim + 1) + v] * dim + d];
+          c /= dim + 1;
+          centroids[elm * dim + d] = c;
+          Kokkos::atomic_add(&(part_sums[owner * dim + d]), c);
+        }
+        Kokkos::atomic_add(&(part_counts[owner]), 1);
+      };
+      Omega_h::parallel_for(nelms, sumCentroids, "sumCentroids");
+
+      const Omega_h::GO stay_key = std::numeric_limits<Omega_h::GO>::max();
+      Omega_h::Write<Omega_h::GO> keys(nelms, "elm_selection_keys");
+      auto setKeys = OMEGA_H_LAMBDA(const LO elm) {
+        LO start = -1;
+        const LO sbar = sbars[elm];
+        if (elm_wgts[elm] > 0 && sbar_to_index.exists(sbar)) {
+          start = sbar_to_index.value_at(sbar_to_index.find(sbar));
+          if (part_ids[start] < 0)
+            start = -1;
+        }
+        elm_start[elm] = start;
+        if (start < 0) {
+          keys[elm] = stay_key;
+          return;
+        }
+        const int part = part_ids[start];
+        Omega_h::Real dist2 = 0;
+        if (part_counts[part] > 0)
+          for (int d = 0; d < dim; ++d) {
+            const Omega_h::Real diff = centroids[elm * dim + d] -
+              part_sums[part * dim + d] / part_counts[part];
+            dist2 += diff * diff;
+          }
+        keys[elm] = (Omega_h::GO(start) << 32) | Omega_h::GO(floatBits(sqrt(dist2)));
+      };
+      Omega_h::parallel_for(nelms, setKeys, "setKeys");
+      return Omega_h::Read<Omega_h::GO>(keys);
+    }
+
+    /* Walks the sorted elements of each sbar, an element goes to the target whose
+       share of the plan's weight contains the weight of the elements before it.
+       Elements after the last target's share stay.
+    */
+    Omega_h::LOs elementTargets(Omega_h::Read<Omega_h::GO> keys, Omega_h::LOs elm_start,
+                                Omega_h::LOs part_ids, Omega_h::Reals send_wgts,
+                                Omega_h::Reals elm_wgts) {
+      const LO nelms = keys.size();
+      Omega_h::LOs order = Omega_h::sort_by_keys(keys);
+      //Exclusive scan of the sending elements' weights in sorted order
+      Omega_h::Write<Omega_h::Real> before(nelms, "elm_wgt_before");
+      auto scanWeights = KOKKOS_LAMBDA(const int i, Omega_h::Real& sum, const bool final) {
+        const LO elm = order[i];
+        if (final)
+          before[i] = sum;
+        if (elm_start[elm] >= 0)
+          sum += elm_wgts[elm];
+      };
+      Kokkos::parallel_scan("scanElmWeights", nelms, scanWeights);
+
+      //Weight before the first element of each sbar
+      Omega_h::Write<Omega_h::Real> sbar_base(part_ids.size(), 0, "sbar_wgt_base");
+      auto setBase = OMEGA_H_LAMBDA(const LO i) {
+        const LO start = elm_start[order[i]];
+        if (start >= 0 && (i == 0 || elm_start[order[i - 1]] != start))
+          sbar_base[start] = before[i];
+      };
+      Omega_h::parallel_for(nelms, setBase, "setBase");
+
+      Omega_h::Write<LO> elm_parts(nelms, -1, "elm_parts");
+      auto assignElements = OMEGA_H_LAMBDA(const LO i) {
+        const LO elm = order[i];
+        const LO start = elm_start[elm];
+        if (start < 0)
+          return;
+        const Omega_h::Real wgt = before[i] - sbar_base[start];
+        Omega_h::Real share = 0;
+        for (LO j = start; part_ids[j] >= 0; ++j) {
+          share += send_wgts[j];
+          if (wgt < share) {
+            elm_parts[elm] = part_ids[j];
+            break;
+          }
+        }
+      };
+      Omega_h::parallel_for(nelms, assignElements, "assignElements");
+      return Omega_h::LOs(elm_parts);
+    }
+  }
+
+  Omega_h::LOs ParticleBalancer::selectElements(Mesh& picparts, ParticlePlan& plan,
+                                                Omega_h::Reals elm_wgts) {
+    Kokkos::Timer timer;
+    const int dim = picparts.dim();
+    Omega_h::Write<LO> elm_start(picparts->nelems(), "elm_plan_start");
+    Omega_h::Read<Omega_h::GO> keys = elementKeys(picparts.mesh(), picparts.entOwners(dim),
+                                                  picparts.comm()->size(),
+                                                  getSbarIDs(picparts), plan.sbar_to_index,
+                                                  plan.part_ids, elm_wgts, elm_start);
+    Omega_h::LOs elm_parts = elementTargets(keys, Omega_h::LOs(elm_start), plan.part_ids,
+                                            Omega_h::Reals(plan.send_wgts), elm_wgts);
+    RecordTime("element selection", timer.seconds());
+    return elm_parts;
+  }
+
   ParticlePlan::ParticlePlan(std::unordered_map<LO, LO>& sbar_index_map,
                              Omega_h::Write<LO> tgt_parts, Omega_h::Write<Omega_h::Real> wgts)
     : sbar_to_index(sbar_index_map.size()), part_ids(tgt_parts), send_wgts(wgts){
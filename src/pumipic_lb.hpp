@@ -8,16 +8,19 @@
 #include <engpar_weight_input.h>
 #include <engpar.h>
 #include <particle_structs.hpp>
+#include <type_traits>
+#include <iosfwd>
 
 namespace {
   typedef std::set<int> Parts;
+  //Combines the ranks in order, xor of the ranks collides for many sbars
   class PartsHash {
   public:
     size_t operator()(const Parts& res) const {
-      int h = 0;
+      size_t h = res.size();
       std::hash<int> hasher;
       for (auto itr = res.begin(); itr != res.end(); ++itr)
-        h ^= hasher(*itr);
+        h ^= hasher(*itr) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
       return h;
     }
   };
@@ -31,10 +34,25 @@ namespace pumipic {
   class Mesh;
   class ParticlePlan;
 
+  //Default particle weight of the ParticleBalancer, every particle costs the same
+  struct UnitPtclWeight {
+    KOKKOS_INLINE_FUNCTION double operator()(const int) const {return 1.0;}
+  };
+
   class ParticleBalancer {
   public:
+    //How selectParticles chooses the particles that move to each target part
+    enum SelectionMode {
+      //Particles in the order they reach the plan's weights (default)
+      ARRIVAL_SELECTION,
+      //Whole elements of the sbar, the elements closest to the target part first
+      ELEMENT_SELECTION
+    };
+
     //Build Ngraph from sbars
     ParticleBalancer(Mesh& picparts);
+    //Build Ngraph from the sbar numbering of a picpart cache, see writeSbars
+    ParticleBalancer(Mesh& picparts, std::istream& sbars);
     ~ParticleBalancer();
 
     /* Performs particle load balancing and redistributes particles
@@ -46,29 +64,65 @@ namespace pumipic {
            will be changed to satisfy load balance
            Note: particles pushed outside the safe zone must have new process already set
        step_factor(in) - (optional) the rate of weight transfer
+       weight(in) - (optional) the cost of each particle, a device functor or view
+           called with the particle index, balances the total weight instead of the
+           number of particles
      */
-    template <class PS>
+    template <class PS, class Weight = UnitPtclWeight>
     void repartition(Mesh& picparts, PS* ps, double tol,
                      typename PS::kkLidView new_elems,
                      typename PS::kkLidView new_procs,
-                     double step_factor = 0.5);
+                     double step_factor = 0.5, Weight weight = Weight());
 
     //Access the sbar ids per element
     Omega_h::LOs getSbarIDs(Mesh& picparts) const;
+    //Writes the global sbar numbering for the picpart cache, see Input::cache_dir
+    void writeSbars(std::ostream& out) const;
 
     /* Steps of repartition, can be called on their own for customization */
 
     //adds the weight of particles in ps to graph
-    template <class PS>
+    template <class PS, class Weight = UnitPtclWeight>
     void addWeights(Mesh& picparts, PS* ps, typename PS::kkLidView new_elems,
-                    typename PS::kkLidView new_procs);
+                    typename PS::kkLidView new_procs, Weight weight = Weight());
 
     //run the weight balancer and return the plan
     ParticlePlan balance(double tol, double step_factor = 0.5);
 
-    template <class PS>
+    //send particles until the weight of the plan is moved
+    template <class PS, class Weight = UnitPtclWeight>
     void selectParticles(Mesh& picparts, PS* ps, typename PS::kkLidView new_elems,
-                         ParticlePlan plan, typename PS::kkLidView new_parts);
+                         ParticlePlan plan, typename PS::kkLidView new_parts,
+                         Weight weight = Weight());
+
+    /* Selection of the particles to send (ARRIVAL_SELECTION by default)
+       ARRIVAL_SELECTION spreads the migrated particles over the elements of the sbar.
+       ELEMENT_SELECTION moves all particles of an element together, ordering the
+         elements of each sbar by the distance of their centroid to the centroid of
+         the target part's core. The last element of a target can overshoot the
+         plan's weight by its own weight.
+    */
+    void setSelectionMode(SelectionMode mode) {selection_mode = mode;}
+    SelectionMode selectionMode() const {return selection_mode;}
+
+    /* Lazy repartitioning (off by default)
+       repartition first checks the global max/avg particle weight and returns
+         without balancing when it is at most tol
+       When the sbar weights changed by less than reuse_tol (relative to the weights
+         of the last balance, on every process) the last plan is used again instead
+         of running EnGPar
+    */
+    void setLazyBalancing(bool lazy, double reuse_tol = 0.05);
+    bool lazyBalancing() const {return lazy_balancing;}
+    //Number of calls to repartition
+    int numRepartitions() const {return num_repartitions;}
+    //Number of balance (EnGPar) runs
+    int numBalances() const {return num_balances;}
+    //Number of lazy repartitions skipped by the imbalance check
+    int numSkippedBalances() const {return num_skipped;}
+    //Number of lazy repartitions that reused the last plan
+    int numReusedPlans() const {return num_reused;}
+
   private:
     typedef std::unordered_map<Parts, int, PartsHash> SBarUnmap;
     int max_sbar;
@@ -78,20 +132,45 @@ namespace pumipic {
     std::unordered_map<agi::gid_t,int> vert_to_sbar;
     std::unordered_map<agi::gid_t, agi::part_t> vert_to_owner;
     Kokkos::UnorderedMap<int, agi::lid_t> sbar_to_vert;
+    SelectionMode selection_mode;
+
+    //Lazy balancing state
+    bool lazy_balancing;
+    double plan_reuse_tol;
+    int num_repartitions;
+    int num_balances;
+    int num_skipped;
+    int num_reused;
+    //Weights of the graph vertices set by the last addWeights and the last balance
+    std::vector<agi::wgt_t> vert_weights;
+    std::vector<agi::wgt_t> plan_weights;
+    /* Inputs of the last plan, selectParticles consumes the plan's weights so each
+       reuse builds new arrays from these copies
+    */
+    std::unordered_map<Omega_h::LO, Omega_h::LO> last_sbar_index_map;
+    std::vector<Omega_h::LO> last_tgt_parts;
+    std::vector<Omega_h::Real> last_wgts;
+
+    //True if every process' weights are within plan_reuse_tol of the last plan's
+    bool planReusable(MPI_Comm comm);
+    ParticlePlan reusePlan();
+    //Target part of each element for ELEMENT_SELECTION or -1 if the element stays
+    Omega_h::LOs selectElements(Mesh& picparts, ParticlePlan& plan,
+                                Omega_h::Reals elm_wgts);
 
     //select particles to migrate
     void makePlan();
 
     SBarUnmap::iterator insert(Parts& p);
-    Omega_h::HostWrite<int> buildLocalSbarMap(int comm_rank, int nelms,
-                                              Omega_h::HostWrite<Omega_h::LO> buffer_ranks,
-                                              Omega_h::HostWrite<Omega_h::LO> safe_per_buffer);
+    Omega_h::Write<int> buildLocalSbarMap(int comm_rank, int nelms,
+                                          Omega_h::HostWrite<Omega_h::LO> buffer_ranks,
+                                          Omega_h::HostWrite<Omega_h::LO> safe_per_buffer);
     void sendCoreSbars(Omega_h::CommPtr comm, Omega_h::HostWrite<Omega_h::LO> buffer_ranks);
     void globalNumberSbars(Omega_h::CommPtr comm,
                            std::unordered_map<int,int>& sbar_local_to_global);
     void cleanSbars(int comm_rank);
 
-    void numberElements(Mesh& picparts, Omega_h::HostWrite<int> elm_sbar,
+    void numberElements(Mesh& picparts, Omega_h::Write<int> elm_sbar,
                         std::unordered_map<int, int>& map);
     void buildNgraph(Omega_h::CommPtr comm);
   };
@@ -107,10 +186,10 @@ namespace pumipic {
     Omega_h::Write<Omega_h::Real> send_wgts;
   };
 
-  template <class PS>
+  template <class PS, class Weight>
   void ParticleBalancer::addWeights(Mesh& picparts, PS* ptcls,
                                     typename PS::kkLidView new_elems,
-                                    typename PS::kkLidView new_procs) {
+                                    typename PS::kkLidView new_procs, Weight weight) {
     MPI_Comm comm = picparts.comm()->get_impl();
     int comm_rank = picparts.comm()->rank();
     // Device map of number of particles already assigned to another process
@@ -134,13 +213,13 @@ namespace pumipic {
             if (sbar_to_vert_local.exists(sbar_index)) {
               auto index = sbar_to_vert_local.find(sbar_index);
               const agi::lid_t vert_index = sbar_to_vert_local.value_at(index);
-              Kokkos::atomic_add(&(weights[vert_index]), 1.0);
+              Kokkos::atomic_add(&(weights[vert_index]), agi::wgt_t(weight(ptcl)));
             }
           }
         }
         else {
           const auto index = forcedPtcls.find(new_rank);
-          Kokkos::atomic_add(&(forcedPtcls.value_at(index)), 1.0);
+          Kokkos::atomic_add(&(forcedPtcls.value_at(index)), agi::wgt_t(weight(ptcl)));
         }
       }
     };
@@ -180,20 +259,41 @@ namespace pumipic {
       weights_host[weights_host.size() - 1] += peer_wgts[i];
     }
 
+    vert_weights.assign(weights_host.data(), weights_host.data() + weights_host.size());
     weightGraph->setWeights(weights_host.data());
     MPI_Waitall(num_peers, send_requests, MPI_STATUSES_IGNORE);
     delete [] send_requests;
     delete [] peer_wgts;
   }
 
-  template <class PS>
+  template <class PS, class Weight>
   void ParticleBalancer::selectParticles(Mesh& picparts, PS* ptcls,
                                          typename PS::kkLidView new_elems,
                                          ParticlePlan plan,
-                                         typename PS::kkLidView new_parts) {
-
-
+                                         typename PS::kkLidView new_parts, Weight weight) {
     int comm_rank = picparts.comm()->rank();
+    if (selection_mode == ELEMENT_SELECTION) {
+      //Weight of the particles staying on this process in each element
+      Omega_h::Write<Omega_h::Real> elm_wgts(picparts->nelems(), 0, "elm_wgts");
+      auto sumElmWeights = PS_LAMBDA(const int elm, const int ptcl, const bool mask) {
+        if (mask && new_parts(ptcl) == comm_rank) {
+          const int e = new_elems(ptcl);
+          if (e != -1)
+            Kokkos::atomic_add(&(elm_wgts[e]), Omega_h::Real(weight(ptcl)));
+        }
+      };
+      parallel_for(ptcls, sumElmWeights, "sumElmWeights");
+      Omega_h::LOs elm_parts = selectElements(picparts, plan, Omega_h::Reals(elm_wgts));
+      auto selectElmPtcls = PS_LAMBDA(const int elm, const int ptcl, const bool mask) {
+        if (mask && new_parts(ptcl) == comm_rank) {
+          const int e = new_elems(ptcl);
+          if (e != -1 && elm_parts[e] >= 0)
+            new_parts(ptcl) = elm_parts[e];
+        }
+      };
+      parallel_for(ptcls, selectElmPtcls, "selectElmPtcls");
+      return;
+    }
     Omega_h::LOs sbars = getSbarIDs(picparts);
     auto send_wgts = plan.send_wgts;
     auto sbar_to_index = plan.sbar_to_index;
@@ -209,12 +309,13 @@ namespace pumipic {
               const auto map_index = sbar_to_index.find(sbar);
               const Omega_h::LO index = sbar_to_index.value_at(map_index);
               const Omega_h::LO part = part_ids[index];
-              const Omega_h::Real wgt = Kokkos::atomic_fetch_add(&(send_wgts[index]), -1);
-              if (part >= 0) {
-                if (wgt == 0)
+              const Omega_h::Real w = weight(ptcl);
+              const Omega_h::Real wgt = Kokkos::atomic_fetch_add(&(send_wgts[index]), -w);
+              if (part >= 0 && wgt > 0) {
+                //The particle that uses up the weight of a target moves to the next target
+                if (wgt <= w)
                   Kokkos::atomic_add(&(sbar_to_index.value_at(map_index)), 1);
-                if (wgt > 0)
-                  new_parts[ptcl] = part;
+                new_parts[ptcl] = part;
               }
             }
           }
@@ -224,14 +325,41 @@ namespace pumipic {
     parallel_for(ptcls, selectParticles, "selectParticles");
   }
 
-  template <class PS>
+  //Global max/avg of the particle weight of each process given this process' weight
+  double ptclImbalance(MPI_Comm comm, double weight);
+
+  //Total weight of the particles on this process
+  template <class PS, class Weight>
+  double localPtclWeight(PS* ptcls, Weight weight) {
+    if (std::is_same<Weight, UnitPtclWeight>::value)
+      return ptcls->nPtcls();
+    Omega_h::Write<Omega_h::Real> total(1, 0, "total_ptcl_weight");
+    auto sumWeights = PS_LAMBDA(const int elm, const int ptcl, const bool mask) {
+      if (mask)
+        Kokkos::atomic_add(&(total[0]), Omega_h::Real(weight(ptcl)));
+    };
+    parallel_for(ptcls, sumWeights, "sumWeights");
+    return Omega_h::HostRead<Omega_h::Real>(total)[0];
+  }
+
+  template <class PS, class Weight>
   void ParticleBalancer::repartition(Mesh& picparts, PS* ptcls, double tol,
                                      typename PS::kkLidView new_elems,
                                      typename PS::kkLidView new_parts,
-                                     double step_factor) {
-    addWeights(picparts, ptcls, new_elems, new_parts);
+                                     double step_factor, Weight weight) {
+    ++num_repartitions;
+    MPI_Comm comm = picparts.comm()->get_impl();
+    if (lazy_balancing && ptclImbalance(comm, localPtclWeight(ptcls, weight)) <= tol) {
+      ++num_skipped;
+      return;
+    }
+    addWeights(picparts, ptcls, new_elems, new_parts, weight);
+    if (lazy_balancing && planReusable(comm)) {
+      selectParticles(picparts, ptcls, new_elems, reusePlan(), new_parts, weight);
+      return;
+    }
     ParticlePlan plan = balance(tol, step_factor);
-    selectParticles(picparts, ptcls, new_elems, plan, new_parts);
+    selectParticles(picparts, ptcls, new_elems, plan, new_parts, weight);
   }
 
   //Print particle imbalance statistics
@@ -1,11 +1,16 @@
 #include "pumipic_mesh.hpp"
 #include "pumipic_lb.hpp"
+#include "pumipic_comm_plan.hpp"
 namespace pumipic {
   Mesh::~Mesh() {
     if (!isFullMesh())
       delete picpart;
     if (ptcl_balancer)
       delete ptcl_balancer;
+    for (auto itr = comm_plans.begin(); itr != comm_plans.end(); ++itr)
+      delete itr->second;
+    for (auto itr = full_mesh_plans.begin(); itr != full_mesh_plans.end(); ++itr)
+      delete itr->second;
   }
 
   bool Mesh::isFullMesh() const {
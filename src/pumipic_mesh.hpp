@@ -1,10 +1,17 @@
 #pragma once
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
 #include <Omega_h_mesh.hpp>
 #include "pumipic_library.hpp"
 #include "pumipic_input.hpp"
 
 namespace pumipic {
   class ParticleBalancer;
+  class CommPlanBase;
+  template <class T> class CommPlan;
+  template <class T> class FullMeshPlan;
 
   class Mesh {
   public:
@@ -21,6 +28,19 @@ namespace pumipic {
          int buffer_layers, int safe_layers);
     //Create picparts from input structure
     Mesh(Input&);
+    /* Constructs PIC parts from a distributed mesh without the full mesh on any rank
+       core - this rank's core region as a serial mesh with the "global" ids of its
+              vertices and classification on every dimension
+       comm - the ranks holding the core regions, one core per rank
+       Buffers all parts within buffer_layers BFS layers (through vertices) of the core
+         and marks the core and elements within safe_layers layers safe like the
+         constructor with the full mesh. The buffers grow through messages with the
+         neighboring parts, so the memory and time per rank follow the picpart size.
+       Global ids follow the order of the cores instead of the full mesh, tags other
+         than the coordinates and classification are not copied and the picparts can
+         not be repartitioned.
+    */
+    Mesh(Omega_h::Mesh& core, Omega_h::CommPtr comm, int buffer_layers, int safe_layers);
     ~Mesh();
 
     //Returns true if the full mesh is buffered
@@ -70,10 +90,82 @@ namespace pumipic {
     //Performs an MPI reduction on a communication array across all picparts
     template <class T>
     void reduceCommArray(int dim, Op op, Omega_h::Write<T> array);
+    /* Performs the reductions of several comm arrays of the same dimension
+         together with one fan-in and one fan-out message per neighbor
+       ops - operation of each array
+       arrays - comm arrays of dimension dim, each with any number of entries per entity
+       Full mesh picparts reduce the arrays one at a time.
+    */
+    template <class T>
+    void reduceCommArrays(int dim, const std::vector<Op>& ops,
+                          const std::vector<Omega_h::Write<T> >& arrays);
+    /* Non-blocking reduceCommArray
+       _begin sends this picpart's contributions and returns, _end finishes the
+       reduction and writes the result to the array. The array must not change
+       between the calls. Only one reduction per dimension, type and number of
+       entries per entity can be in flight. Full mesh picparts reduce in _end.
+    */
+    template <class T>
+    void reduceCommArray_begin(int dim, Op op, Omega_h::Write<T> array);
+    template <class T>
+    void reduceCommArray_end(int dim, Op op, Omega_h::Write<T> array);
+    //Returns the cached plan used to reduce comm arrays of T with nvals values per entity
+    template <class T>
+    CommPlan<T>* commPlan(int dim, int nvals);
+    /* Device direct reductions pass the comm arrays to MPI without host staging
+       On by default only with CUDA aware MPI, staged plans reuse persistent requests. Changing the mode drops
+       the cached comm plans and is not allowed while a reduction is in flight.
+    */
+    void setDeviceDirectComm(bool direct);
+    bool deviceDirectComm() const {return device_direct_comm;}
+    /* Sparse full mesh reductions only reduce the values on the entities that bound
+         each rank's safe elements, see FullMeshPlan. Off by default.
+       force_scatter skips the cost model and always uses the sparse plan (for testing)
+    */
+    void setSparseFullMeshReduction(bool sparse, bool force_scatter = false);
+    bool sparseFullMeshReduction() const {return sparse_full_mesh;}
+    //Returns the cached plan used for the reductions of comm arrays on full mesh picparts
+    template <class T>
+    FullMeshPlan<T>* fullMeshPlan(int dim, int nvals);
 
     //Grab the particle load balancer
     ParticleBalancer* ptclBalancer() const {return ptcl_balancer;}
 
+    /* Repartitioning of the core regions, see pumipic_repartition.hpp for moving
+         the particles. The full mesh the picparts were built from must outlive the
+         Mesh and the buffer and safe zones are rebuilt with the same methods.
+    */
+    /* Returns new element owners of the full mesh that balance the element weights
+       elm_weights - weight of the particles of this picpart in each element (sized
+                     nelems), the weights are summed over the picparts
+       tol - target max/avg of the part weights
+       max_layers - (optional) maximum number of element layers moved between parts
+       Returns an empty array if the parts are within tol
+       The weights of the full mesh are reduced to rank 0, which diffuses them serially
+         and broadcasts the new owners.
+    */
+    Omega_h::LOs balancedOwners(Omega_h::Reals elm_weights, double tol,
+                                int max_layers = 100);
+    //Flags the full mesh elements of this rank's picpart for the element owners
+    Omega_h::LOs picpartElements(Omega_h::LOs owners);
+    /* Rebuilds the picparts for new element owners of the full mesh
+       This is a full rebuild, not an incremental one: every rank recomputes the
+         buffer and safe zones from the full mesh and extracts its picpart again.
+       When this picpart has the same elements the picpart mesh is kept and only the
+         ownership, numbering and safe tags are updated. Otherwise a new picpart mesh
+         is built and the tags added to the old picpart are copied to the entities
+         that stayed, entities that entered the picpart get zeros.
+       The comm plans and the particle balancer are rebuilt.
+       Returns the new index of each old picpart element or -1 if it left the picpart
+    */
+    Omega_h::LOs repartition(Omega_h::LOs owners);
+    //Index of each picpart element in the full mesh
+    Omega_h::LOs fullMeshElements();
+    //True if the last repartition kept the picpart mesh
+    bool keptPICPart() const {return kept_picpart;}
+    //True if the picparts were loaded from the cache, see Input::cache_dir
+    bool loadedFromCache() const {return cached_picpart;}
+
     //Users should not run the following functions.
     //They are meant to be private, but must be public for enclosing lambdas
     //Picpart construction
@@ -87,10 +179,49 @@ namespace pumipic {
     void setupComm(int dim, Omega_h::LOs global_ents_per_rank,
                    Omega_h::LOs picpart_ents_per_rank,
                    Omega_h::LOs ent_owners);
+    //Number of entries per entity of a comm array, -1 if the length does not match
+    int commArrayValues(int dim, int length);
 
   private:
+    //Computes the buffered parts and the safe elements of the full mesh for owners
+    void bufferAndSafe(Omega_h::Mesh& mesh, Omega_h::CommPtr comm, Omega_h::LOs owners,
+                       Omega_h::Write<Omega_h::LO>& has_part,
+                       Omega_h::Write<Omega_h::LO>& is_safe);
+    //Deletes the cached comm plans
+    void clearPlans();
+    //Sets up the communication and the particle balancer of a new picpart
+    //  rank_offset_nents - offsets of the number of entities owned by each rank per dim
+    void finishPICPart(Omega_h::CommPtr comm, Omega_h::LOs* rank_offset_nents);
+    //Errors for picparts built without the full mesh
+    void requireFullMesh(const char* caller) const;
+
+    /* Picpart cache, see Input::cache_dir
+       Each rank's file holds the tags added to the full mesh, the picpart, the comm
+         information and the sbar numbering of the particle balancer.
+    */
+    //Returns this rank's cache file for the full mesh, owners and build methods
+    std::string cacheFile(const std::string& dir, Omega_h::Mesh& mesh,
+                          Omega_h::CommPtr comm, Omega_h::LOs owners) const;
+    //Loads the picparts if every rank has a valid cache file, returns false otherwise
+    bool readCache(Omega_h::Mesh& mesh, Omega_h::CommPtr comm, const std::string& file);
+    //Writes this rank's cache file
+    void writeCache(const std::string& file);
+
     Omega_h::CommPtr commptr;
-    Omega_h::Mesh* picpart;
+    Omega_h::Mesh* picpart = NULL;
+
+    //Full mesh and the methods the picparts were built with
+    Omega_h::Mesh* full_mesh = NULL;
+    Input::Method buffer_method;
+    Input::Method safe_method;
+    int bridge_dim;
+    int buffer_layers;
+    int safe_layers;
+    Input::Ordering ordering = Input::NATURAL_ORDER;
+    //Index of each full mesh entity in the picpart or -1
+    Omega_h::LOs picpart_ent_ids[4];
+    bool kept_picpart = false;
+    bool cached_picpart = false;
 
     bool is_full_mesh;
 
@@ -127,5 +258,14 @@ namespace pumipic {
     Omega_h::LOs bounded_ent_ids[4];
 
     ParticleBalancer* ptcl_balancer = NULL;
+
+    //Communication plans by dimension, values per entity and value type
+    template <class T> friend class CommPlan;
+    std::map<std::tuple<int, int, size_t>, CommPlanBase*> comm_plans;
+    static bool defaultDeviceDirectComm();
+    bool device_direct_comm = defaultDeviceDirectComm();
+    std::map<std::tuple<int, int, size_t>, CommPlanBase*> full_mesh_plans;
+    bool sparse_full_mesh = false;
+    bool force_full_mesh_scatter = false;
   };
 }
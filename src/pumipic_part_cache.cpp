@@ -0,0 +1,330 @@
+#include "pumipic_mesh.hpp"
+#include "pumipic_lb.hpp"
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <Omega_h_file.hpp>
+#include <Omega_h_comm.hpp>
+#include <Kokkos_Core.hpp>
+#include <ppTiming.hpp>
+
+namespace {
+  typedef Omega_h::LO LO;
+  typedef Omega_h::GO GO;
+
+  //Identifies picpart cache files, bump the version when the layout changes
+  const int CACHE_MAGIC = 0x70696370;
+  const int CACHE_VERSION = 2;
+
+  //splitmix64 finalizer, spreads every input bit over the result
+  KOKKOS_INLINE_FUNCTION uint64_t mixBits(uint64_t z) {
+    z += 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+  template <class T>
+  KOKKOS_INLINE_FUNCTION uint64_t valueBits(T val) {
+    union {T v; uint64_t u;} bits;
+    bits.u = 0;
+    bits.v = val;
+    return bits.u;
+  }
+
+  //64 bit FNV-1a hash of the inputs of the picpart construction
+  class CacheKey {
+  public:
+    void add(const void* data, size_t size) {
+      const unsigned char* bytes = static_cast<const unsigned char*>(data);
+      for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+      }
+    }
+    template <class T>
+    void add(T val) {add(&val, sizeof(T));}
+    void add(const std::string& s) {add(s.c_str(), s.size() + 1);}
+    //Arrays are hashed on the device, the mixed hash of each entry and its index is summed
+    template <class T>
+    void add(Omega_h::Read<T> arr) {
+      uint64_t sum = 0;
+      Kokkos::parallel_reduce("hashArray", arr.size(),
+                              KOKKOS_LAMBDA(const int i, uint64_t& local) {
+        local += mixBits(valueBits(arr[i]) ^ mixBits(i));
+      }, sum);
+      add(arr.size());
+      add(sum);
+    }
+    Omega_h::I64 value() const {return static_cast<Omega_h::I64>(h);}
+  private:
+    uint64_t h = 14695981039346656037ull;
+  };
+
+  //Tags added to the full mesh by the picpart construction
+  bool isPICPartTag(const std::string& name) {
+    return name == "ownership" || name == "gids" || name == "rank_lids" ||
+      name == "safe" || name == "sbar_id";
+  }
+
+  /* The cache is read on the machine that wrote it, so values are not byte swapped
+     and arrays are not compressed
+   */
+  template <class T>
+  void writeValue(std::ostream& out, T val) {
+    Omega_h::binary::write_value(out, val, false);
+  }
+  template <class T>
+  T readValue(std::istream& in) {
+    T val;
+    Omega_h::binary::read_value(in, val, false);
+    return val;
+  }
+  template <class T>
+  void writeArray(std::ostream& out, Omega_h::Read<T> arr) {
+    Omega_h::binary::write_array(out, arr, false, false);
+  }
+  template <class T>
+  Omega_h::Read<T> readArray(std::istream& in) {
+    Omega_h::Read<T> arr;
+    Omega_h::binary::read_array(in, arr, false, false);
+    return arr;
+  }
+  template <class HostArray>
+  void writeHostArray(std::ostream& out, const HostArray& arr) {
+    writeValue(out, int(arr.size()));
+    for (int i = 0; i < arr.size(); ++i)
+      writeValue(out, arr[i]);
+  }
+  Omega_h::HostWrite<LO> readHostArray(std::istream& in) {
+    const int size = readValue<int>(in);
+    Omega_h::HostWrite<LO> arr(size, "cached_host_array");
+    for (int i = 0; i < size; ++i)
+      arr[i] = readValue<LO>(in);
+    return arr;
+  }
+
+  void writeHeader(std::ostream& out, Omega_h::CommPtr comm, bool full_mesh) {
+    writeValue(out, CACHE_MAGIC);
+    writeValue(out, CACHE_VERSION);
+    writeValue(out, Omega_h::binary::latest_version);
+    writeValue(out, comm->size());
+    writeValue(out, comm->rank());
+    writeValue(out, int(full_mesh));
+  }
+  bool checkHeader(std::istream& in, Omega_h::CommPtr comm, bool full_mesh) {
+    bool valid = readValue<int>(in) == CACHE_MAGIC;
+    valid = valid && readValue<int>(in) == CACHE_VERSION;
+    valid = valid && readValue<int>(in) == Omega_h::binary::latest_version;
+    valid = valid && readValue<int>(in) == comm->size();
+    valid = valid && readValue<int>(in) == comm->rank();
+    valid = valid && readValue<int>(in) == int(full_mesh);
+    return valid && in.good();
+  }
+
+  //Hashes the values of a tag, the picpart holds copies of them
+  void addTagValues(CacheKey& key, Omega_h::Mesh& mesh, int dim,
+                    Omega_h::TagBase const* tagbase) {
+    switch (tagbase->type()) {
+    case OMEGA_H_I8:
+      key.add(mesh.get_array<Omega_h::I8>(dim, tagbase->name()));
+      break;
+    case OMEGA_H_I32:
+      key.add(mesh.get_array<Omega_h::I32>(dim, tagbase->name()));
+      break;
+    case OMEGA_H_I64:
+      key.add(mesh.get_array<Omega_h::I64>(dim, tagbase->name()));
+      break;
+    case OMEGA_H_F64:
+      key.add(mesh.get_array<Omega_h::Real>(dim, tagbase->name()));
+      break;
+    }
+  }
+
+  /* Reads the payload that follows the header, returns false if the file is shorter
+     than the payload or its checksum does not match
+  */
+  bool readPayload(std::istream& in, std::string& payload) {
+    const Omega_h::I64 size = readValue<Omega_h::I64>(in);
+    const Omega_h::I64 checksum = readValue<Omega_h::I64>(in);
+    if (!in.good())
+      return false;
+    const std::streampos start = in.tellg();
+    in.seekg(0, std::ios::end);
+    const Omega_h::I64 remaining = in.tellg() - start;
+    in.seekg(start);
+    if (size < 0 || size != remaining)
+      return false;
+    payload.resize(size);
+    in.read(&payload[0], size);
+    if (!in.good())
+      return false;
+    CacheKey sum;
+    sum.add(payload.data(), payload.size());
+    return sum.value() == checksum;
+  }
+}
+
+namespace pumipic {
+  std::string Mesh::cacheFile(const std::string& dir, Omega_h::Mesh& mesh,
+                              Omega_h::CommPtr comm, Omega_h::LOs owners) const {
+    Kokkos::Timer timer;
+    //Every rank has the same full mesh and owners, rank 0 hashes them
+    CacheKey key;
+    if (!comm->rank()) {
+      key.add(CACHE_VERSION);
+      key.add(comm->size());
+      key.add(int(buffer_method));
+      key.add(int(safe_method));
+      key.add(bridge_dim);
+      key.add(buffer_layers);
+      key.add(safe_layers);
+      key.add(int(ordering));
+      key.add(int(mesh.family()));
+      key.add(mesh.dim());
+      for (int i = 0; i <= mesh.dim(); ++i) {
+        key.add(mesh.nents(i));
+        if (i > 0)
+          key.add(mesh.ask_verts_of(i));
+        //Tags, including the coordinates and classification, are copied to the picpart
+        for (int j = 0; j < mesh.ntags(i); ++j) {
+          Omega_h::TagBase const* tagbase = mesh.get_tag(i, j);
+          if (isPICPartTag(tagbase->name()))
+            continue;
+          key.add(tagbase->name());
+          key.add(int(tagbase->type()));
+          key.add(tagbase->ncomps());
+          addTagValues(key, mesh, i, tagbase);
+        }
+      }
+      key.add(owners);
+    }
+    Omega_h::I64 hash = key.value();
+    MPI_Bcast(&hash, 1, MPI_INT64_T, 0, comm->get_impl());
+    RecordTime("picpart cache key", timer.seconds());
+    char key_dir[17];
+    snprintf(key_dir, sizeof(key_dir), "%016llx", static_cast<unsigned long long>(hash));
+    char rank_file[32];
+    snprintf(rank_file, sizeof(rank_file), "/picpart_%d.bin", comm->rank());
+    return dir + "/" + key_dir + rank_file;
+  }
+
+  bool Mesh::readCache(Omega_h::Mesh& mesh, Omega_h::CommPtr comm, const std::string& file) {
+    Kokkos::Timer timer;
+    std::ifstream file_in(file, std::ios::binary);
+    std::string payload;
+    int valid = file_in && checkHeader(file_in, comm, isFullMesh()) &&
+      readPayload(file_in, payload);
+    int all_valid;
+    MPI_Allreduce(&valid, &all_valid, 1, MPI_INT, MPI_MIN, comm->get_impl());
+    if (!all_valid)
+      return false;
+    std::istringstream in(payload);
+
+    commptr = comm;
+    const int dim = mesh.dim();
+    for (int i = 0; i <= dim; ++i) {
+      mesh.add_tag(i, "ownership", 1, readArray<LO>(in));
+      mesh.add_tag(i, "gids", 1, readArray<GO>(in));
+      mesh.add_tag(i, "rank_lids", 1, readArray<LO>(in));
+      picpart_ent_ids[i] = readArray<LO>(in);
+    }
+    mesh.add_tag(dim, "safe", 1, readArray<LO>(in));
+    if (isFullMesh()) {
+      picpart = &mesh;
+      mesh.add_tag(dim, "sbar_id", 1, readArray<LO>(in));
+    }
+    else {
+      Omega_h::Library* lib = mesh.library();
+      picpart = new Omega_h::Mesh(lib);
+      picpart->set_comm(lib->self());
+      Omega_h::binary::read(in, picpart, Omega_h::binary::latest_version);
+    }
+
+    for (int i = 0; i <= dim; ++i) {
+      num_cores[i] = readValue<int>(in);
+      num_bounds[i] = readValue<int>(in);
+      num_boundaries[i] = readValue<int>(in);
+      buffered_parts[i] = readHostArray(in);
+      offset_ents_per_rank_per_dim[i] = readArray<LO>(in);
+      ent_to_comm_arr_index_per_dim[i] = readArray<LO>(in);
+      Omega_h::Write<LO> is_complete(readHostArray(in));
+      is_complete_part[i] = Omega_h::HostRead<LO>(Omega_h::LOs(is_complete));
+      if (i == dim)
+        continue;
+      boundary_parts[i] = readHostArray(in);
+      offset_bounded_per_dim[i] = readHostArray(in);
+      bounded_ent_ids[i] = readArray<LO>(in);
+    }
+
+    ptcl_balancer = new ParticleBalancer(*this, in);
+    cached_picpart = true;
+    RecordTime("picpart cache load", timer.seconds());
+    return true;
+  }
+
+  void Mesh::writeCache(const std::string& file) {
+    Kokkos::Timer timer;
+    const std::string key_dir = file.substr(0, file.find_last_of('/'));
+    const std::string dir = key_dir.substr(0, key_dir.find_last_of('/'));
+    if (!commptr->rank()) {
+      Omega_h::safe_mkdir(dir.c_str());
+      Omega_h::safe_mkdir(key_dir.c_str());
+    }
+    commptr->barrier();
+
+    //Write to a temporary file so readers never see a partial cache
+    const std::string tmp_file = file + ".tmp";
+    std::ofstream file_out(tmp_file, std::ios::binary);
+    if (!file_out) {
+      fprintf(stderr, "[WARNING] Cannot write the picpart cache file %s\n", tmp_file.c_str());
+      return;
+    }
+    //The payload follows its size and checksum so truncated or corrupt files are detected
+    std::ostringstream out;
+    Omega_h::Mesh& mesh = *full_mesh;
+    const int dim = mesh.dim();
+    for (int i = 0; i <= dim; ++i) {
+      writeArray(out, mesh.get_array<LO>(i, "ownership"));
+      writeArray(out, mesh.get_array<GO>(i, "gids"));
+      writeArray(out, mesh.get_array<LO>(i, "rank_lids"));
+      writeArray(out, picpart_ent_ids[i]);
+    }
+    writeArray(out, mesh.get_array<LO>(dim, "safe"));
+    if (isFullMesh())
+      writeArray(out, ptcl_balancer->getSbarIDs(*this));
+    else
+      Omega_h::binary::write(out, picpart);
+
+    for (int i = 0; i <= dim; ++i) {
+      writeValue(out, num_cores[i]);
+      writeValue(out, num_bounds[i]);
+      writeValue(out, num_boundaries[i]);
+      writeHostArray(out, buffered_parts[i]);
+      writeArray(out, offset_ents_per_rank_per_dim[i]);
+      writeArray(out, ent_to_comm_arr_index_per_dim[i]);
+      writeHostArray(out, is_complete_part[i]);
+      if (i == dim)
+        continue;
+      writeHostArray(out, boundary_parts[i]);
+      writeHostArray(out, offset_bounded_per_dim[i]);
+      writeArray(out, bounded_ent_ids[i]);
+    }
+
+    ptcl_balancer->writeSbars(out);
+    const std::string payload = out.str();
+    CacheKey sum;
+    sum.add(payload.data(), payload.size());
+    writeHeader(file_out, commptr, isFullMesh());
+    writeValue(file_out, Omega_h::I64(payload.size()));
+    writeValue(file_out, sum.value());
+    file_out.write(payload.data(), payload.size());
+    file_out.close();
+    if (!file_out || std::rename(tmp_file.c_str(), file.c_str())) {
+      fprintf(stderr, "[WARNING] Cannot write the picpart cache file %s\n", file.c_str());
+      std::remove(tmp_file.c_str());
+      return;
+    }
+    RecordTime("picpart cache write", timer.seconds());
+  }
+}
@@ -6,6 +6,13 @@
 #include <Omega_h_int_scan.hpp>
 #include <Omega_h_scan.hpp>
 #include <Omega_h_file.hpp>
+#include <Omega_h_array_ops.hpp>
+#include <Omega_h_reorder.hpp>
+#include <Omega_h_map.hpp>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <ppTiming.hpp>
 #include "pumipic_lb.hpp"
 
 namespace {
@@ -34,25 +41,31 @@ namespace {
   template <class T>
   void convertTag(Omega_h::Mesh full_mesh, Omega_h::Mesh* picpart, int dim,
                   Omega_h::LOs entToEnt, Omega_h::TagBase const* tag);
+  bool sameEntities(Omega_h::LOs ent_ids, Omega_h::LOs other_ent_ids);
+  void carryTags(Omega_h::Mesh old_picpart, Omega_h::Mesh* picpart, int dim,
+                 Omega_h::LOs old_ids, Omega_h::LOs new_ids);
+  void renumberPICPart(Omega_h::Mesh* picpart, pumipic::Input::Ordering ordering,
+                       Omega_h::LOs* ent_ids);
 }
 
 namespace pumipic {
-  Mesh::Mesh(Omega_h::Mesh& mesh, Omega_h::LOs owner) {
+  Mesh::Mesh(Omega_h::Mesh& mesh, Omega_h::LOs owner)
+    : full_mesh(&mesh), buffer_method(Input::FULL), safe_method(Input::FULL),
+      bridge_dim(0), buffer_layers(0), safe_layers(0) {
     Omega_h::CommPtr comm = mesh.library()->world();
-    int rank = comm->rank();
-    int comm_size = comm->size();
 
     /*********** Set safe zone and buffer to be entire mesh****************/
-    Omega_h::Write<Omega_h::LO> is_safe(mesh.nelems(), 1);
-    Omega_h::Write<Omega_h::LO> has_part(comm_size, 1);
+    Omega_h::Write<Omega_h::LO> is_safe, has_part;
+    bufferAndSafe(mesh, comm, owner, has_part, is_safe);
     is_full_mesh = true;
     constructPICPart(mesh, comm, owner, has_part, is_safe);
   }
 
-  Mesh::Mesh(Omega_h::Mesh& mesh, Omega_h::LOs owner, int ghost_layers, int safe_layers) {
+  Mesh::Mesh(Omega_h::Mesh& mesh, Omega_h::LOs owner, int ghost_layers, int safe_layers_)
+    : full_mesh(&mesh), buffer_method(Input::BFS), safe_method(Input::BFS),
+      bridge_dim(0), buffer_layers(ghost_layers), safe_layers(safe_layers_) {
     Omega_h::CommPtr comm = mesh.library()->world();
     int rank = comm->rank();
-    int comm_size = comm->size();
     if (ghost_layers < safe_layers) {
       if (!rank)
         fprintf(stderr, "Ghost layers must be >= safe layers");
@@ -60,19 +73,18 @@ namespace pumipic {
     }
     is_full_mesh = false;
     // **********Determine safe zone and ghost region**************** //
-    Omega_h::Write<Omega_h::LO> is_safe(mesh.nelems());
-    Omega_h::Write<Omega_h::LO> has_part(comm_size);
-    int bridge_dim = 0;
-    bfsBufferLayers(mesh, bridge_dim, comm, safe_layers, ghost_layers, is_safe,
-                    owner, has_part);
+    Omega_h::Write<Omega_h::LO> is_safe, has_part;
+    bufferAndSafe(mesh, comm, owner, has_part, is_safe);
 
     constructPICPart(mesh, comm, owner, has_part, is_safe);
   }
 
-  Mesh::Mesh(Input& in) {
+  Mesh::Mesh(Input& in)
+    : full_mesh(&in.m), buffer_method(in.bufferMethod), safe_method(in.safeMethod),
+      bridge_dim(in.bridge_dim), buffer_layers(in.bufferBFSLayers),
+      safe_layers(in.safeBFSLayers), ordering(in.ordering) {
     Omega_h::CommPtr comm = in.comm;
     int rank = comm->rank();
-    int comm_size = comm->size();
 
     /*********** Set safe zone and buffer to be entire mesh****************/
     Omega_h::LOs owners = in.partition;
@@ -81,33 +93,54 @@ namespace pumipic {
       setOwnerByClassification(in.m, in.partition, rank, owns);
       owners = Omega_h::LOs(owns);
     }
-    Omega_h::Write<Omega_h::LO> is_safe(in.m.nelems(),in.safeMethod==Input::FULL, "is_safe");
-    Omega_h::Write<Omega_h::LO> has_part(comm_size,1, "has_part");
-    if ((in.safeMethod != Input::NONE && in.safeMethod != Input::FULL)
-        || in.bufferMethod != Input::FULL) {
-      Omega_h::Write<Omega_h::LO> safe(in.m.nelems(), 0, "safe");
+    if (in.bufferMethod == Input::FULL)
+      is_full_mesh = true;
+    else
+      is_full_mesh = false;
+
+    std::string cache_file;
+    if (!in.cache_dir.empty()) {
+      cache_file = cacheFile(in.cache_dir, in.m, comm, owners);
+      if (readCache(in.m, comm, cache_file))
+        return;
+    }
+
+    Kokkos::Timer timer;
+    Omega_h::Write<Omega_h::LO> is_safe, has_part;
+    bufferAndSafe(in.m, comm, owners, has_part, is_safe);
+
+    constructPICPart(in.m, in.comm, owners, has_part, is_safe);
+    //Compare with "picpart cache key" + "picpart cache load" for the saving of the cache
+    RecordTime("picpart construction", timer.seconds());
+    if (!cache_file.empty())
+      writeCache(cache_file);
+  }
+
+  void Mesh::bufferAndSafe(Omega_h::Mesh& mesh, Omega_h::CommPtr comm, Omega_h::LOs owners,
+                           Omega_h::Write<Omega_h::LO>& has_part,
+                           Omega_h::Write<Omega_h::LO>& is_safe) {
+    int comm_size = comm->size();
+    is_safe = Omega_h::Write<Omega_h::LO>(mesh.nelems(), safe_method == Input::FULL,
+                                          "is_safe");
+    has_part = Omega_h::Write<Omega_h::LO>(comm_size, 1, "has_part");
+    if ((safe_method != Input::NONE && safe_method != Input::FULL)
+        || buffer_method != Input::FULL) {
+      Omega_h::Write<Omega_h::LO> safe(mesh.nelems(), 0, "safe");
       Omega_h::Write<Omega_h::LO> part(comm_size, 0, "part");
 
-      bfsBufferLayers(in.m, in.bridge_dim, comm, in.safeBFSLayers, in.bufferBFSLayers, safe,
+      bfsBufferLayers(mesh, bridge_dim, comm, safe_layers, buffer_layers, safe,
                       owners, part);
 
-      if (in.safeMethod == Input::BFS || in.safeMethod == Input::MINIMUM)
+      if (safe_method == Input::BFS || safe_method == Input::MINIMUM)
         is_safe = safe;
-      if (in.bufferMethod == Input::BFS || in.bufferMethod == Input::MINIMUM)
+      if (buffer_method == Input::BFS || buffer_method == Input::MINIMUM)
         has_part = part;
     }
 
-    if (in.bufferMethod == Input::BFS && in.safeMethod == Input::FULL) {
-      bfsSafeInward(in.m,in.bridge_dim, comm, in.safeBFSLayers, owners, Omega_h::LOs(has_part),
+    if (buffer_method == Input::BFS && safe_method == Input::FULL) {
+      bfsSafeInward(mesh, bridge_dim, comm, safe_layers, owners, Omega_h::LOs(has_part),
                     is_safe);
     }
-
-    if (in.bufferMethod == Input::FULL)
-      is_full_mesh = true;
-    else
-      is_full_mesh = false;
-
-    constructPICPart(in.m, in.comm, owners, has_part, is_safe);
   }
 
   void Mesh::constructPICPart(Omega_h::Mesh& mesh, Omega_h::CommPtr comm,
@@ -175,13 +208,32 @@ namespace pumipic {
       ent_ids[i] = numbering;
     }
 
+    //A repartitioned picpart with the same elements keeps its mesh
+    kept_picpart = !isFullMesh() && picpart && picpart_ent_ids[dim].exists() &&
+      sameEntities(picpart_ent_ids[dim], ent_ids[dim]);
+
     //If full mesh buffer then we don't need to make new mesh for the picparts
     if (isFullMesh()) {
       //Set picpart to point to the mesh
       picpart = &mesh;
     }
+    //Only the ownership, numbering and safe tags changed
+    else if (kept_picpart) {
+      //The kept picpart may have been renumbered
+      for (int i = 0; i <= dim; ++i)
+        ent_ids[i] = picpart_ent_ids[i];
+      for (int i = 0; i <= dim; ++i) {
+        convertTag<Omega_h::LO>(mesh, picpart, i, ent_ids[i],
+                                mesh.get_tagbase(i, "ownership"));
+        convertTag<Omega_h::GO>(mesh, picpart, i, ent_ids[i], mesh.get_tagbase(i, "gids"));
+        convertTag<Omega_h::LO>(mesh, picpart, i, ent_ids[i],
+                                mesh.get_tagbase(i, "rank_lids"));
+      }
+      convertTag<Omega_h::LO>(mesh, picpart, dim, ent_ids[dim], mesh.get_tagbase(dim, "safe"));
+    }
     //************Build a new mesh as the picpart**************
     else {
+      delete picpart;
       Omega_h::Library* lib = mesh.library();
       picpart = new Omega_h::Mesh(lib);
 
@@ -219,20 +271,99 @@ namespace pumipic {
             convertTag<Omega_h::Real>(mesh, picpart, i, ent_ids[i], tagbase);
         }
       }
+      if (ordering != Input::NATURAL_ORDER) {
+        Kokkos::Timer timer;
+        renumberPICPart(picpart, ordering, ent_ids);
+        RecordTime("picpart renumbering", timer.seconds());
+      }
     }
 
     delete [] num_ents;
-    commptr = comm;
+    for (int i = 0; i <= dim; ++i)
+      picpart_ent_ids[i] = ent_ids[i];
 
+    finishPICPart(comm, rank_offset_nents);
+  }
+
+  void Mesh::finishPICPart(Omega_h::CommPtr comm, Omega_h::LOs* rank_offset_nents) {
+    commptr = comm;
     //**************** Build communication information ********************//
-    for (int i = 0; i <= dim; ++i) {
-      Omega_h::LOs picpart_offset_nents = calculateOwnerOffset(entOwners(i), comm_size);
+    for (int i = 0; i <= dim(); ++i) {
+      Omega_h::LOs picpart_offset_nents = calculateOwnerOffset(entOwners(i), comm->size());
       setupComm(i, rank_offset_nents[i], picpart_offset_nents, entOwners(i));
     }
 
     //Create load balancer
+    delete ptcl_balancer;
     ptcl_balancer = new ParticleBalancer(*this);
+  }
 
+  void Mesh::requireFullMesh(const char* caller) const {
+    if (!full_mesh) {
+      fprintf(stderr, "[ERROR] %s requires picparts built from the full mesh\n", caller);
+      throw 1;
+    }
+  }
+
+  Omega_h::LOs Mesh::picpartElements(Omega_h::LOs owners) {
+    requireFullMesh("Mesh::picpartElements");
+    Omega_h::Mesh& mesh = *full_mesh;
+    Omega_h::Write<Omega_h::LO> is_safe, has_part;
+    bufferAndSafe(mesh, commptr, owners, has_part, is_safe);
+    Omega_h::Write<Omega_h::LO> in_picpart(mesh.nelems(), 0, "in_picpart");
+    setSafeEnts(mesh, mesh.dim(), mesh.nelems(), has_part, owners, in_picpart);
+    return Omega_h::LOs(in_picpart);
+  }
+
+  Omega_h::LOs Mesh::fullMeshElements() {
+    requireFullMesh("Mesh::fullMeshElements");
+    Omega_h::LOs ent_ids = picpart_ent_ids[dim()];
+    Omega_h::Write<Omega_h::LO> full_ids(picpart->nelems(), -1, "full_mesh_elements");
+    auto invertNumbering = OMEGA_H_LAMBDA(const Omega_h::LO elm) {
+      const Omega_h::LO picpart_elm = ent_ids[elm];
+      if (picpart_elm >= 0)
+        full_ids[picpart_elm] = elm;
+    };
+    Omega_h::parallel_for(ent_ids.size(), invertNumbering, "invertNumbering");
+    return Omega_h::LOs(full_ids);
+  }
+
+  Omega_h::LOs Mesh::repartition(Omega_h::LOs owners) {
+    requireFullMesh("Mesh::repartition");
+    Omega_h::Mesh& mesh = *full_mesh;
+    if (owners.size() != mesh.nelems()) {
+      fprintf(stderr, "[ERROR] Mesh::repartition has %d owners for %d elements\n",
+              owners.size(), mesh.nelems());
+      throw 1;
+    }
+    Kokkos::Timer timer;
+    clearPlans();
+    const int dim = mesh.dim();
+    const Omega_h::LO old_nelems = picpart->nelems();
+    //Shallow copy, keeps the tags of a picpart that is replaced
+    Omega_h::Mesh old_picpart = *picpart;
+    Omega_h::LOs old_ent_ids[4];
+    for (int i = 0; i <= dim; ++i)
+      old_ent_ids[i] = picpart_ent_ids[i];
+    Omega_h::LOs old_ids = old_ent_ids[dim];
+    Omega_h::Write<Omega_h::LO> is_safe, has_part;
+    bufferAndSafe(mesh, commptr, owners, has_part, is_safe);
+    constructPICPart(mesh, commptr, owners, has_part, is_safe);
+    if (!isFullMesh() && !kept_picpart) {
+      for (int i = 0; i <= dim; ++i)
+        carryTags(old_picpart, picpart, i, old_ent_ids[i], picpart_ent_ids[i]);
+    }
+
+    Omega_h::LOs new_ids = picpart_ent_ids[dim];
+    Omega_h::Write<Omega_h::LO> elm_map(old_nelems, -1, "repartition_elm_map");
+    auto mapElements = OMEGA_H_LAMBDA(const Omega_h::LO elm) {
+      const Omega_h::LO old_elm = old_ids[elm];
+      if (old_elm >= 0)
+        elm_map[old_elm] = new_ids[elm];
+    };
+    Omega_h::parallel_for(mesh.nelems(), mapElements, "mapElements");
+    RecordTime("picpart repartition", timer.seconds());
+    return Omega_h::LOs(elm_map);
   }
 }
 
@@ -535,3 +666,128 @@ namespace {
     picpart->add_tag(dim, tagbase->name(), nvalues, Omega_h::Read<T>(new_tag));
   }
 }
+
+namespace {
+  bool sameEntities(Omega_h::LOs ent_ids, Omega_h::LOs other_ent_ids) {
+    Omega_h::Write<Omega_h::LO> differs(1, 0, "differs");
+    auto compareEntities = OMEGA_H_LAMBDA(Omega_h::LO ent_id) {
+      if ((ent_ids[ent_id] >= 0) != (other_ent_ids[ent_id] >= 0))
+        differs[0] = 1;
+    };
+    Omega_h::parallel_for(ent_ids.size(), compareEntities, "compareEntities");
+    return !Omega_h::HostRead<Omega_h::LO>(differs)[0];
+  }
+
+  template <class T>
+  void carryTag(Omega_h::Mesh& old_picpart, Omega_h::Mesh* picpart, int dim,
+                Omega_h::TagBase const* tagbase, Omega_h::LOs old_ids,
+                Omega_h::LOs new_ids) {
+    Omega_h::Read<T> tag = old_picpart.get_array<T>(dim, tagbase->name());
+    const int nvalues = tagbase->ncomps();
+    Omega_h::Write<T> new_tag(picpart->nents(dim) * nvalues, 0);
+    auto carryTagValues = OMEGA_H_LAMBDA(Omega_h::LO ent_id) {
+      const Omega_h::LO old_ent = old_ids[ent_id];
+      const Omega_h::LO new_ent = new_ids[ent_id];
+      if (old_ent >= 0 && new_ent >= 0) {
+        for (int i = 0; i < nvalues; ++i)
+          new_tag[new_ent*nvalues + i] = tag[old_ent*nvalues + i];
+      }
+    };
+    Omega_h::parallel_for(old_ids.size(), carryTagValues, "carryTagValues");
+    picpart->add_tag(dim, tagbase->name(), nvalues, Omega_h::Read<T>(new_tag));
+  }
+
+  /* Copies the tags of the old picpart that the rebuilt picpart does not have,
+     the tags added by the user, through the full mesh numbering of both picparts.
+     Entities that entered the picpart get zeros.
+  */
+  void carryTags(Omega_h::Mesh old_picpart, Omega_h::Mesh* picpart, int dim,
+                 Omega_h::LOs old_ids, Omega_h::LOs new_ids) {
+    for (int j = 0; j < old_picpart.ntags(dim); ++j) {
+      Omega_h::TagBase const* tagbase = old_picpart.get_tag(dim, j);
+      if (picpart->has_tag(dim, tagbase->name()))
+        continue;
+      if (tagbase->type() == OMEGA_H_I8)
+        carryTag<Omega_h::I8>(old_picpart, picpart, dim, tagbase, old_ids, new_ids);
+      if (tagbase->type() == OMEGA_H_I32)
+        carryTag<Omega_h::I32>(old_picpart, picpart, dim, tagbase, old_ids, new_ids);
+      if (tagbase->type() == OMEGA_H_I64)
+        carryTag<Omega_h::I64>(old_picpart, picpart, dim, tagbase, old_ids, new_ids);
+      if (tagbase->type() == OMEGA_H_F64)
+        carryTag<Omega_h::Real>(old_picpart, picpart, dim, tagbase, old_ids, new_ids);
+    }
+  }
+
+  //Returns the new to old vertex numbering of reverse Cuthill-McKee through the edges
+  Omega_h::LOs rcmVertexOrder(Omega_h::Mesh* picpart) {
+    Omega_h::Adj star = picpart->ask_star(0);
+    Omega_h::HostRead<Omega_h::LO> offsets(star.a2ab);
+    Omega_h::HostRead<Omega_h::LO> adjacent(star.ab2b);
+    const Omega_h::LO nverts = picpart->nverts();
+    auto degree = [&](Omega_h::LO v) {return offsets[v + 1] - offsets[v];};
+    auto byDegree = [&](Omega_h::LO a, Omega_h::LO b) {return degree(a) < degree(b);};
+
+    //Each connected component starts from its vertex with the lowest degree
+    std::vector<Omega_h::LO> starts(nverts);
+    std::iota(starts.begin(), starts.end(), 0);
+    std::stable_sort(starts.begin(), starts.end(), byDegree);
+    std::vector<Omega_h::LO> order;
+    order.reserve(nverts);
+    std::vector<char> visited(nverts, 0);
+    std::vector<Omega_h::LO> next;
+    for (Omega_h::LO start : starts) {
+      if (visited[start])
+        continue;
+      visited[start] = 1;
+      size_t head = order.size();
+      order.push_back(start);
+      while (head < order.size()) {
+        const Omega_h::LO v = order[head++];
+        next.clear();
+        for (Omega_h::LO j = offsets[v]; j < offsets[v + 1]; ++j) {
+          const Omega_h::LO u = adjacent[j];
+          if (!visited[u]) {
+            visited[u] = 1;
+            next.push_back(u);
+          }
+        }
+        std::stable_sort(next.begin(), next.end(), byDegree);
+        order.insert(order.end(), next.begin(), next.end());
+      }
+    }
+    Omega_h::HostWrite<Omega_h::LO> new_to_old(nverts, "rcm_order");
+    for (Omega_h::LO i = 0; i < nverts; ++i)
+      new_to_old[i] = order[nverts - 1 - i];
+    return Omega_h::LOs(Omega_h::Write<Omega_h::LO>(new_to_old));
+  }
+
+  /* Renumbers the picpart entities for the ordering
+     Omega_h reorders the vertices and numbers the other entities by their vertices,
+       the tags move with the entities.
+     ent_ids(in/out) - index of each full mesh entity in the picpart or -1
+  */
+  void renumberPICPart(Omega_h::Mesh* picpart, pumipic::Input::Ordering ordering,
+                       Omega_h::LOs* ent_ids) {
+    const int dim = picpart->dim();
+    for (int i = 0; i <= dim; ++i)
+      picpart->add_tag(i, "picpart_order", 1, Omega_h::LOs(picpart->nents(i), 0, 1));
+    if (ordering == pumipic::Input::SFC_ORDER)
+      Omega_h::reorder_by_hilbert(picpart);
+    else
+      Omega_h::reorder_mesh(picpart, rcmVertexOrder(picpart));
+
+    for (int i = 0; i <= dim; ++i) {
+      Omega_h::LOs old_to_new = Omega_h::invert_permutation(
+        picpart->get_array<Omega_h::LO>(i, "picpart_order"));
+      picpart->remove_tag(i, "picpart_order");
+      Omega_h::LOs ids = ent_ids[i];
+      Omega_h::Write<Omega_h::LO> new_ids(ids.size(), "renumbered_ent_ids");
+      auto renumberIds = OMEGA_H_LAMBDA(Omega_h::LO ent_id) {
+        const Omega_h::LO id = ids[ent_id];
+        new_ids[ent_id] = id >= 0 ? old_to_new[id] : -1;
+      };
+      Omega_h::parallel_for(ids.size(), renumberIds, "renumberIds");
+      ent_ids[i] = new_ids;
+    }
+  }
+}
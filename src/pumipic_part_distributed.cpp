@@ -0,0 +1,574 @@
+#include "pumipic_mesh.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <mpi.h>
+#include <Omega_h_build.hpp>
+#include <Omega_h_element.hpp>
+#include <ppTiming.hpp>
+
+/* Picpart construction from a distributed mesh
+
+   Each rank starts with its core region. The ranks sharing each entity of the core
+   boundaries are found through a rendezvous rank chosen by hashing the global ids
+   of the entity's vertices. The minimum sharing rank owns the entity and numbers it.
+   The buffer grows in rounds: a BFS through the cores received so far finds the
+   parts within the buffer layers, which are asked for their cores. The messages use
+   a sparse exchange, so ranks only talk to their neighbors and rendezvous ranks.
+*/
+namespace {
+  typedef Omega_h::LO LO;
+  typedef Omega_h::GO GO;
+
+  enum {
+    RENDEZVOUS_TAG = 301,
+    OWNER_TAG,
+    GID_TAG,
+    FORWARD_TAG,
+    REQUEST_TAG,
+    CORE_TAG
+  };
+
+  //Byte buffer of the messages
+  class Message {
+  public:
+    template <class T> void put(const T& val) {append(&val, sizeof(T));}
+    template <class T> void put(const std::vector<T>& vals) {
+      put<size_t>(vals.size());
+      append(vals.data(), vals.size() * sizeof(T));
+    }
+    template <class T> T get() {
+      T val;
+      read(&val, sizeof(T));
+      return val;
+    }
+    template <class T> void get(std::vector<T>& vals) {
+      vals.resize(get<size_t>());
+      read(vals.data(), vals.size() * sizeof(T));
+    }
+    bool done() const {return pos >= bytes.size();}
+
+    std::vector<char> bytes;
+  private:
+    void append(const void* data, size_t n) {
+      const char* c = static_cast<const char*>(data);
+      bytes.insert(bytes.end(), c, c + n);
+    }
+    void read(void* data, size_t n) {
+      if (n)
+        memcpy(data, bytes.data() + pos, n);
+      pos += n;
+    }
+    size_t pos = 0;
+  };
+
+  /* Sends each message to its rank and receives the messages sent to this rank
+     without knowing the senders (NBX). Synchronous sends complete once they are
+     matched, so after the barrier completes every message to this rank arrived.
+  */
+  void sparseExchange(MPI_Comm comm, int tag, std::map<int, Message>& sends,
+                      std::map<int, Message>& recvs) {
+    std::vector<MPI_Request> requests(sends.size());
+    int index = 0;
+    for (auto itr = sends.begin(); itr != sends.end(); ++itr)
+      MPI_Issend(itr->second.bytes.data(), itr->second.bytes.size(), MPI_BYTE, itr->first,
+                 tag, comm, &(requests[index++]));
+    MPI_Request barrier;
+    bool barrier_active = false;
+    int done = 0;
+    while (!done) {
+      int flag;
+      MPI_Status status;
+      MPI_Iprobe(MPI_ANY_SOURCE, tag, comm, &flag, &status);
+      if (flag) {
+        int count;
+        MPI_Get_count(&status, MPI_BYTE, &count);
+        Message& msg = recvs[status.MPI_SOURCE];
+        msg.bytes.resize(count);
+        MPI_Recv(msg.bytes.data(), count, MPI_BYTE, status.MPI_SOURCE, tag, comm,
+                 MPI_STATUS_IGNORE);
+      }
+      if (barrier_active)
+        MPI_Test(&barrier, &done, MPI_STATUS_IGNORE);
+      else {
+        int sent;
+        MPI_Testall(requests.size(), requests.data(), &sent, MPI_STATUSES_IGNORE);
+        if (sent) {
+          MPI_Ibarrier(comm, &barrier);
+          barrier_active = true;
+        }
+      }
+    }
+  }
+
+  template <class T>
+  std::vector<T> toVector(Omega_h::Read<T> arr) {
+    Omega_h::HostRead<T> host(arr);
+    std::vector<T> vec(host.size());
+    for (LO i = 0; i < host.size(); ++i)
+      vec[i] = host[i];
+    return vec;
+  }
+
+  //Host copy of a core region
+  struct Core {
+    //Number of entities per dimension
+    std::vector<LO> nents;
+    //Entities of dimension d < dim of each element in the element's local order
+    std::vector<LO> down[3];
+    //Sorted vertex "global" ids of each entity of dimension d < dim
+    std::vector<GO> keys[3];
+    std::vector<LO> owners[4];
+    std::vector<GO> gids[4];
+    std::vector<Omega_h::ClassId> class_ids[4];
+    std::vector<Omega_h::I8> class_dims[4];
+    std::vector<Omega_h::Real> coords;
+    //Ranks whose core has each bridge entity
+    std::vector<LO> sharer_offsets;
+    std::vector<LO> sharers;
+  };
+
+  Core readCore(Omega_h::Mesh& mesh) {
+    const int dim = mesh.dim();
+    Core core;
+    for (int d = 0; d <= dim; ++d) {
+      core.nents.push_back(mesh.nents(d));
+      core.class_ids[d] = toVector(mesh.get_array<Omega_h::ClassId>(d, "class_id"));
+      core.class_dims[d] = toVector(mesh.get_array<Omega_h::I8>(d, "class_dim"));
+    }
+    core.coords = toVector(mesh.coords());
+    std::vector<GO> vert_globals = toVector(mesh.get_array<GO>(0, "global"));
+    for (int d = 0; d < dim; ++d) {
+      core.down[d] = toVector(mesh.ask_down(dim, d).ab2b);
+      const int nverts = Omega_h::element_degree(mesh.family(), d, 0);
+      std::vector<LO> ent2verts;
+      if (d > 0)
+        ent2verts = toVector(mesh.ask_down(d, 0).ab2b);
+      core.keys[d].resize(core.nents[d] * nverts);
+      for (LO i = 0; i < core.nents[d]; ++i) {
+        GO* key = &(core.keys[d][i * nverts]);
+        for (int j = 0; j < nverts; ++j)
+          key[j] = vert_globals[d ? ent2verts[i * nverts + j] : i];
+        std::sort(key, key + nverts);
+      }
+    }
+    return core;
+  }
+
+  int keyRank(const GO* key, int nverts, int comm_size) {
+    unsigned long long h = 14695981039346656037ull;
+    for (int i = 0; i < nverts; ++i)
+      h = (h ^ static_cast<unsigned long long>(key[i])) * 1099511628211ull;
+    return h % comm_size;
+  }
+
+  /* Finds the owner and global id of every entity of the core
+     rank_offset_nents - offsets of the number of entities owned by each rank per dim
+  */
+  void shareEntities(MPI_Comm comm, Omega_h_Family family, int dim, int bridge_dim,
+                     Core& core, std::vector<LO>* rank_offset_nents) {
+    int rank, comm_size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &comm_size);
+    int nverts[3];
+    for (int d = 0; d < dim; ++d)
+      nverts[d] = Omega_h::element_degree(family, d, 0);
+
+    //Post every entity to its rendezvous rank
+    std::map<int, Message> posts, recvs;
+    for (int d = 0; d < dim; ++d) {
+      for (LO i = 0; i < core.nents[d]; ++i) {
+        const GO* key = &(core.keys[d][i * nverts[d]]);
+        Message& msg = posts[keyRank(key, nverts[d], comm_size)];
+        msg.put<LO>(d);
+        msg.put<LO>(i);
+        for (int j = 0; j < nverts[d]; ++j)
+          msg.put<GO>(key[j]);
+      }
+    }
+    sparseExchange(comm, RENDEZVOUS_TAG, posts, recvs);
+
+    //Rendezvous: the ranks with each entity and the entity's index on them
+    typedef std::pair<int, std::vector<GO> > Key;
+    std::map<Key, std::vector<std::pair<int, LO> > > entries;
+    for (auto itr = recvs.begin(); itr != recvs.end(); ++itr) {
+      Message& msg = itr->second;
+      while (!msg.done()) {
+        Key key;
+        key.first = msg.get<LO>();
+        const LO index = msg.get<LO>();
+        key.second.resize(nverts[key.first]);
+        for (int j = 0; j < nverts[key.first]; ++j)
+          key.second[j] = msg.get<GO>();
+        entries[key].push_back(std::make_pair(itr->first, index));
+      }
+    }
+    std::map<int, Message> replies, owner_msgs;
+    for (auto itr = entries.begin(); itr != entries.end(); ++itr) {
+      const std::vector<std::pair<int, LO> >& ranks = itr->second;
+      for (size_t i = 0; i < ranks.size(); ++i) {
+        Message& msg = replies[ranks[i].first];
+        msg.put<LO>(itr->first.first);
+        msg.put<LO>(ranks[i].second);
+        msg.put<LO>(ranks.size());
+        //recvs are in rank order, so the first rank is the minimum
+        for (size_t j = 0; j < ranks.size(); ++j)
+          msg.put<LO>(ranks[j].first);
+      }
+    }
+    sparseExchange(comm, OWNER_TAG, replies, owner_msgs);
+
+    std::vector<LO> nsharers[3];
+    std::vector<std::vector<LO> > bridge_sharers(dim > bridge_dim ? core.nents[bridge_dim] : 0);
+    for (int d = 0; d < dim; ++d) {
+      core.owners[d].resize(core.nents[d]);
+      nsharers[d].resize(core.nents[d]);
+    }
+    for (auto itr = owner_msgs.begin(); itr != owner_msgs.end(); ++itr) {
+      Message& msg = itr->second;
+      while (!msg.done()) {
+        const int d = msg.get<LO>();
+        const LO index = msg.get<LO>();
+        const LO n = msg.get<LO>();
+        nsharers[d][index] = n;
+        for (LO j = 0; j < n; ++j) {
+          const LO sharer = msg.get<LO>();
+          if (j == 0)
+            core.owners[d][index] = sharer;
+          if (d == bridge_dim)
+            bridge_sharers[index].push_back(sharer);
+        }
+      }
+    }
+    core.owners[dim].assign(core.nents[dim], rank);
+    core.sharer_offsets.assign(1, 0);
+    for (size_t i = 0; i < bridge_sharers.size(); ++i) {
+      core.sharers.insert(core.sharers.end(), bridge_sharers[i].begin(),
+                          bridge_sharers[i].end());
+      core.sharer_offsets.push_back(core.sharers.size());
+    }
+
+    //Owners number their entities after the entities of the lower ranks
+    std::vector<LO> counts(dim + 1, 0);
+    for (int d = 0; d <= dim; ++d)
+      for (LO i = 0; i < core.nents[d]; ++i)
+        counts[d] += core.owners[d][i] == rank;
+    std::vector<LO> all_counts(comm_size * (dim + 1));
+    MPI_Allgather(counts.data(), dim + 1, MPI_INT, all_counts.data(), dim + 1, MPI_INT,
+                  comm);
+    for (int d = 0; d <= dim; ++d) {
+      rank_offset_nents[d].assign(comm_size + 1, 0);
+      for (int r = 0; r < comm_size; ++r)
+        rank_offset_nents[d][r + 1] = rank_offset_nents[d][r] + all_counts[r * (dim + 1) + d];
+      core.gids[d].assign(core.nents[d], -1);
+      GO next = rank_offset_nents[d][rank];
+      for (LO i = 0; i < core.nents[d]; ++i)
+        if (core.owners[d][i] == rank)
+          core.gids[d][i] = next++;
+    }
+
+    //Owners send the ids of shared entities through the rendezvous ranks
+    std::map<int, Message> gid_posts, gid_recvs;
+    for (int d = 0; d < dim; ++d) {
+      for (LO i = 0; i < core.nents[d]; ++i) {
+        if (core.owners[d][i] != rank || nsharers[d][i] < 2)
+          continue;
+        const GO* key = &(core.keys[d][i * nverts[d]]);
+        Message& msg = gid_posts[keyRank(key, nverts[d], comm_size)];
+        msg.put<LO>(d);
+        for (int j = 0; j < nverts[d]; ++j)
+          msg.put<GO>(key[j]);
+        msg.put<GO>(core.gids[d][i]);
+      }
+    }
+    sparseExchange(comm, GID_TAG, gid_posts, gid_recvs);
+    std::map<int, Message> forwards, gid_msgs;
+    for (auto itr = gid_recvs.begin(); itr != gid_recvs.end(); ++itr) {
+      Message& msg = itr->second;
+      while (!msg.done()) {
+        Key key;
+        key.first = msg.get<LO>();
+        key.second.resize(nverts[key.first]);
+        for (int j = 0; j < nverts[key.first]; ++j)
+          key.second[j] = msg.get<GO>();
+        const GO gid = msg.get<GO>();
+        const std::vector<std::pair<int, LO> >& ranks = entries[key];
+        for (size_t j = 1; j < ranks.size(); ++j) {
+          Message& fwd = forwards[ranks[j].first];
+          fwd.put<LO>(key.first);
+          fwd.put<LO>(ranks[j].second);
+          fwd.put<GO>(gid);
+        }
+      }
+    }
+    sparseExchange(comm, FORWARD_TAG, forwards, gid_msgs);
+    for (auto itr = gid_msgs.begin(); itr != gid_msgs.end(); ++itr) {
+      Message& msg = itr->second;
+      while (!msg.done()) {
+        const int d = msg.get<LO>();
+        const LO index = msg.get<LO>();
+        core.gids[d][index] = msg.get<GO>();
+      }
+    }
+  }
+
+  Message packCore(const Core& core, int dim) {
+    Message msg;
+    msg.put(core.nents);
+    for (int d = 0; d < dim; ++d)
+      msg.put(core.down[d]);
+    for (int d = 0; d <= dim; ++d) {
+      msg.put(core.owners[d]);
+      msg.put(core.gids[d]);
+      msg.put(core.class_ids[d]);
+      msg.put(core.class_dims[d]);
+    }
+    msg.put(core.coords);
+    msg.put(core.sharer_offsets);
+    msg.put(core.sharers);
+    return msg;
+  }
+
+  Core unpackCore(Message& msg, int dim) {
+    Core core;
+    msg.get(core.nents);
+    for (int d = 0; d < dim; ++d)
+      msg.get(core.down[d]);
+    for (int d = 0; d <= dim; ++d) {
+      msg.get(core.owners[d]);
+      msg.get(core.gids[d]);
+      msg.get(core.class_ids[d]);
+      msg.get(core.class_dims[d]);
+    }
+    msg.get(core.coords);
+    msg.get(core.sharer_offsets);
+    msg.get(core.sharers);
+    return core;
+  }
+
+  /* Numbers the entities of dimension d of the union of the cores by their global ids
+     core_ids - index in the union of each entity of each core
+     Returns the core and index of the first copy of each entity in the union
+  */
+  std::vector<std::pair<int, LO> > numberUnion(const std::vector<const Core*>& cores, int d,
+                                               std::vector<std::vector<LO> >& core_ids) {
+    std::unordered_map<GO, LO> union_ids;
+    std::vector<std::pair<int, LO> > first;
+    core_ids.resize(cores.size());
+    for (size_t c = 0; c < cores.size(); ++c) {
+      const Core& core = *cores[c];
+      core_ids[c].resize(core.nents[d]);
+      for (LO i = 0; i < core.nents[d]; ++i) {
+        auto inserted = union_ids.insert(std::make_pair(core.gids[d][i], first.size()));
+        if (inserted.second)
+          first.push_back(std::make_pair(c, i));
+        core_ids[c][i] = inserted.first->second;
+      }
+    }
+    return first;
+  }
+
+  /* BFS through the bridge entities from this rank's core in the union of the cores
+     with the same layers as bfsBufferLayers of the full mesh construction
+     safe - flags the union elements within safe_layers layers of the core
+     Returns the parts with elements within buffer_layers layers missing from the union
+  */
+  std::set<int> bfsLayers(const std::vector<const Core*>& cores, int self, int dim,
+                          int bridge_dim, int buffer_layers, int safe_layers,
+                          const std::set<int>& buffered, std::vector<LO>& safe) {
+    std::vector<std::vector<LO> > bridge_ids;
+    std::vector<std::pair<int, LO> > first = numberUnion(cores, bridge_dim, bridge_ids);
+    const LO nbridges = first.size();
+    std::vector<LO> elm_offsets(1, 0);
+    for (size_t c = 0; c < cores.size(); ++c)
+      elm_offsets.push_back(elm_offsets.back() + cores[c]->nents[dim]);
+    const LO nelms = elm_offsets.back();
+
+    //Bridge entity to element adjacency of the union
+    std::vector<LO> b2e_offsets(nbridges + 1, 0);
+    for (size_t c = 0; c < cores.size(); ++c) {
+      const std::vector<LO>& down = cores[c]->down[bridge_dim];
+      for (size_t j = 0; j < down.size(); ++j)
+        ++b2e_offsets[bridge_ids[c][down[j]] + 1];
+    }
+    for (LO b = 0; b < nbridges; ++b)
+      b2e_offsets[b + 1] += b2e_offsets[b];
+    std::vector<LO> b2e(b2e_offsets.back());
+    std::vector<LO> fill(b2e_offsets.begin(), b2e_offsets.end() - 1);
+    for (size_t c = 0; c < cores.size(); ++c) {
+      const std::vector<LO>& down = cores[c]->down[bridge_dim];
+      const LO deg = down.size() / cores[c]->nents[dim];
+      for (size_t j = 0; j < down.size(); ++j)
+        b2e[fill[bridge_ids[c][down[j]]]++] = elm_offsets[c] + j / deg;
+    }
+
+    std::vector<LO> visited(nelms, 0);
+    for (LO e = elm_offsets[self]; e < elm_offsets[self + 1]; ++e)
+      visited[e] = 1;
+    safe = visited;
+    std::set<int> needed;
+    for (int i = 0; i < buffer_layers || i < safe_layers; ++i) {
+      std::vector<LO> visited_next(visited);
+      for (LO b = 0; b < nbridges; ++b) {
+        bool is_visited_here = false;
+        for (LO j = b2e_offsets[b]; j < b2e_offsets[b + 1]; ++j)
+          is_visited_here = is_visited_here || visited[b2e[j]];
+        if (!is_visited_here)
+          continue;
+        for (LO j = b2e_offsets[b]; j < b2e_offsets[b + 1]; ++j)
+          visited_next[b2e[j]] = 1;
+        if (i >= buffer_layers)
+          continue;
+        const Core& core = *cores[first[b].first];
+        for (LO j = core.sharer_offsets[first[b].second];
+             j < core.sharer_offsets[first[b].second + 1]; ++j)
+          if (!buffered.count(core.sharers[j]))
+            needed.insert(core.sharers[j]);
+      }
+      visited.swap(visited_next);
+      if (i == safe_layers - 1)
+        safe = visited;
+    }
+    return needed;
+  }
+}
+
+namespace pumipic {
+  Mesh::Mesh(Omega_h::Mesh& core_mesh, Omega_h::CommPtr comm, int ghost_layers,
+             int safe_layers_)
+    : buffer_method(Input::BFS), safe_method(Input::BFS), bridge_dim(0),
+      buffer_layers(ghost_layers), safe_layers(safe_layers_) {
+    Kokkos::Timer timer;
+    const int rank = comm->rank();
+    const int dim = core_mesh.dim();
+    MPI_Comm mpi_comm = comm->get_impl();
+    if (ghost_layers < safe_layers) {
+      if (!rank)
+        fprintf(stderr, "Ghost layers must be >= safe layers");
+      throw 1;
+    }
+    if (!core_mesh.has_tag(0, "global") || !core_mesh.has_tag(dim, "class_id")) {
+      fprintf(stderr, "[ERROR] The core region on rank %d needs the vertex \"global\" ids "
+              "and classification\n", rank);
+      throw 1;
+    }
+    is_full_mesh = false;
+
+    //**************** Owners and global ids of the core entities ****************//
+    std::map<int, Core> cores;
+    Core& core = cores[rank];
+    core = readCore(core_mesh);
+    std::vector<LO> rank_offsets[4];
+    shareEntities(mpi_comm, core_mesh.family(), dim, bridge_dim, core, rank_offsets);
+    const Message package = packCore(core, dim);
+
+    //**************** Grow the buffer by requesting the cores of the parts ****************//
+    std::set<int> buffered;
+    buffered.insert(rank);
+    std::vector<LO> safe;
+    std::vector<const Core*> core_list;
+    while (true) {
+      core_list.clear();
+      int self = 0;
+      for (auto itr = cores.begin(); itr != cores.end(); ++itr) {
+        if (itr->first == rank)
+          self = core_list.size();
+        core_list.push_back(&(itr->second));
+      }
+      std::set<int> needed = bfsLayers(core_list, self, dim, bridge_dim, buffer_layers,
+                                       safe_layers, buffered, safe);
+      int growing = !needed.empty();
+      MPI_Allreduce(MPI_IN_PLACE, &growing, 1, MPI_INT, MPI_MAX, mpi_comm);
+      if (!growing)
+        break;
+      std::map<int, Message> requests, requesters;
+      for (auto itr = needed.begin(); itr != needed.end(); ++itr)
+        requests[*itr];
+      sparseExchange(mpi_comm, REQUEST_TAG, requests, requesters);
+      std::map<int, Message> replies, packages;
+      for (auto itr = requesters.begin(); itr != requesters.end(); ++itr)
+        replies[itr->first] = package;
+      sparseExchange(mpi_comm, CORE_TAG, replies, packages);
+      for (auto itr = packages.begin(); itr != packages.end(); ++itr) {
+        cores[itr->first] = unpackCore(itr->second, dim);
+        buffered.insert(itr->first);
+      }
+    }
+
+    //**************** Build the picpart from the union of the cores ****************//
+    std::vector<std::vector<LO> > vert_ids;
+    std::vector<std::pair<int, LO> > first_verts = numberUnion(core_list, 0, vert_ids);
+    const LO nverts = first_verts.size();
+    const int nvpe = Omega_h::element_degree(core_mesh.family(), dim, 0);
+    std::vector<LO> elm_offsets(1, 0);
+    for (size_t c = 0; c < core_list.size(); ++c)
+      elm_offsets.push_back(elm_offsets.back() + core_list[c]->nents[dim]);
+    const LO nelms = elm_offsets.back();
+    Omega_h::HostWrite<LO> ev2v(nelms * nvpe, "picpart_elem_verts");
+    for (size_t c = 0; c < core_list.size(); ++c) {
+      const std::vector<LO>& elm_verts = core_list[c]->down[0];
+      for (size_t j = 0; j < elm_verts.size(); ++j)
+        ev2v[elm_offsets[c] * nvpe + j] = vert_ids[c][elm_verts[j]];
+    }
+    Omega_h::HostWrite<Omega_h::Real> coords(nverts * dim, "picpart_coords");
+    for (LO v = 0; v < nverts; ++v)
+      for (int i = 0; i < dim; ++i)
+        coords[v * dim + i] = core_list[first_verts[v].first]->coords[first_verts[v].second * dim + i];
+    picpart = new Omega_h::Mesh(core_mesh.library());
+    Omega_h::build_from_elems_and_coords(picpart, core_mesh.family(), dim,
+                                         Omega_h::LOs(ev2v.write()),
+                                         Omega_h::Reals(coords.write()));
+
+    //Entities of the picpart get the values of their copy in any core through the
+    //  element's local order
+    Omega_h::LOs rank_offset_nents[4];
+    for (int d = 0; d <= dim; ++d) {
+      const LO nents = picpart->nents(d);
+      Omega_h::HostWrite<LO> owners(nents, "ownership");
+      Omega_h::HostWrite<GO> gids(nents, "gids");
+      Omega_h::HostWrite<LO> rank_lids(nents, "rank_lids");
+      Omega_h::HostWrite<Omega_h::ClassId> class_ids(nents, "class_id");
+      Omega_h::HostWrite<Omega_h::I8> class_dims(nents, "class_dim");
+      std::vector<LO> down;
+      if (d < dim)
+        down = toVector(picpart->ask_down(dim, d).ab2b);
+      const LO deg = Omega_h::element_degree(core_mesh.family(), dim, d);
+      for (size_t c = 0; c < core_list.size(); ++c) {
+        const Core& part = *core_list[c];
+        for (LO e = 0; e < part.nents[dim]; ++e) {
+          for (LO j = 0; j < deg; ++j) {
+            const LO ent = d < dim ? down[(elm_offsets[c] + e) * deg + j] : elm_offsets[c] + e;
+            const LO core_ent = d < dim ? part.down[d][e * deg + j] : e;
+            owners[ent] = part.owners[d][core_ent];
+            gids[ent] = part.gids[d][core_ent];
+            rank_lids[ent] = gids[ent] - rank_offsets[d][owners[ent]];
+            class_ids[ent] = part.class_ids[d][core_ent];
+            class_dims[ent] = part.class_dims[d][core_ent];
+          }
+        }
+      }
+      picpart->add_tag(d, "ownership", 1, Omega_h::LOs(owners.write()));
+      picpart->add_tag(d, "gids", 1, Omega_h::GOs(gids.write()));
+      picpart->add_tag(d, "rank_lids", 1, Omega_h::LOs(rank_lids.write()));
+      picpart->add_tag(d, "class_id", 1, Omega_h::Read<Omega_h::ClassId>(class_ids.write()));
+      picpart->add_tag(d, "class_dim", 1, Omega_h::Read<Omega_h::I8>(class_dims.write()));
+      Omega_h::HostWrite<LO> offsets(rank_offsets[d].size(), "rank_offset_nents");
+      for (size_t r = 0; r < rank_offsets[d].size(); ++r)
+        offsets[r] = rank_offsets[d][r];
+      rank_offset_nents[d] = Omega_h::LOs(offsets.write());
+    }
+    Omega_h::HostWrite<LO> safe_host(nelms, "safe");
+    for (LO e = 0; e < nelms; ++e)
+      safe_host[e] = safe[e];
+    picpart->add_tag(dim, "safe", 1, Omega_h::LOs(safe_host.write()));
+
+    num_cores[dim] = buffered.size() - 1;
+    for (int i = 0; i < dim; ++i)
+      num_cores[i] = 0;
+    finishPICPart(comm, rank_offset_nents);
+    RecordTime("distributed picpart construction", timer.seconds());
+  }
+}
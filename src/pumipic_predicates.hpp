@@ -0,0 +1,409 @@
+#ifndef PUMIPIC_PREDICATES_HPP
+#define PUMIPIC_PREDICATES_HPP
+
+#include <cmath>
+
+#include "Omega_h_few.hpp"
+#include "Omega_h_vector.hpp"
+
+/*
+  Adaptive precision geometric predicates
+
+  orient2d and orient3d follow J.R. Shewchuk, "Adaptive Precision Floating-Point
+  Arithmetic and Fast Robust Geometric Predicates". The determinant is first evaluated in
+  double precision with a forward error bound. Only if the sign cannot be
+  certified it is recomputed exactly using floating point expansions.
+
+  orient3d_sos additionally resolves exactly degenerate configurations with
+  Simulation of Simplicity (Edelsbrunner and Muecke). Mesh vertices are
+  symbolically perturbed by amounts ordered by their vertex id so that every
+  query involving at least one perturbed vertex and a nonzero direction returns
+  a nonzero sign, and the answers of different queries are consistent with one
+  perturbed configuration.
+*/
+
+namespace pumipic {
+
+  //Half an ulp of 1.0, the unit roundoff of IEEE double precision
+  const Omega_h::Real PRED_EPSILON = 1.1102230246251565e-16;
+  //Forward error bound of the double precision orient2d evaluation
+  const Omega_h::Real O2D_ERRBOUND_A = (3.0 + 16.0 * PRED_EPSILON) * PRED_EPSILON;
+  //Forward error bound of the double precision orient3d evaluation
+  const Omega_h::Real O3D_ERRBOUND_A = (7.0 + 56.0 * PRED_EPSILON) * PRED_EPSILON;
+  //Maximum length of the expansion holding an exact 4x4 determinant
+  const int PRED_DET4_MAXLEN = 192;
+  //Half an ulp of 1.0f, the unit roundoff of IEEE single precision
+  const float PRED_EPSILON_FP32 = 5.9604645e-08f;
+  /* Error bound of the single precision orient3d filter relative to the
+     permanent of the coordinate magnitudes. It covers rounding the double
+     precision inputs to float (2u per difference, 6u on the determinant)
+     and the float evaluation itself (7u), with some slack.
+  */
+  const float O3D_FP32_ERRBOUND = 16.0f * PRED_EPSILON_FP32;
+  //Below this permanent underflow may spoil the single precision filter
+  const float O3D_FP32_MIN_PERMANENT = 1e-30f;
+
+  /******************** Expansion arithmetic ********************/
+  //x + y == a + b exactly, requires |a| >= |b|
+  OMEGA_H_INLINE void fast_two_sum(const Omega_h::Real a, const Omega_h::Real b,
+                                   Omega_h::Real& x, Omega_h::Real& y) {
+    x = a + b;
+    const Omega_h::Real bvirt = x - a;
+    y = b - bvirt;
+  }
+
+  //x + y == a + b exactly
+  OMEGA_H_INLINE void two_sum(const Omega_h::Real a, const Omega_h::Real b,
+                              Omega_h::Real& x, Omega_h::Real& y) {
+    x = a + b;
+    const Omega_h::Real bvirt = x - a;
+    const Omega_h::Real avirt = x - bvirt;
+    const Omega_h::Real bround = b - bvirt;
+    const Omega_h::Real around = a - avirt;
+    y = around + bround;
+  }
+
+  //x + y == a * b exactly
+  OMEGA_H_INLINE void two_product(const Omega_h::Real a, const Omega_h::Real b,
+                                  Omega_h::Real& x, Omega_h::Real& y) {
+    x = a * b;
+    y = fma(a, b, -x);
+  }
+
+  //h = e * b, returns the length of h (at most 2*elen)
+  OMEGA_H_INLINE int scale_expansion(const int elen, const Omega_h::Real* e,
+                                     const Omega_h::Real b, Omega_h::Real* h) {
+    Omega_h::Real q, hh;
+    two_product(e[0], b, q, hh);
+    int hindex = 0;
+    if (hh != 0.0)
+      h[hindex++] = hh;
+    for (int i = 1; i < elen; ++i) {
+      Omega_h::Real product1, product0, sum;
+      two_product(e[i], b, product1, product0);
+      two_sum(q, product0, sum, hh);
+      if (hh != 0.0)
+        h[hindex++] = hh;
+      fast_two_sum(product1, sum, q, hh);
+      if (hh != 0.0)
+        h[hindex++] = hh;
+    }
+    if (q != 0.0 || hindex == 0)
+      h[hindex++] = q;
+    return hindex;
+  }
+
+  //h = e + f, returns the length of h (at most elen+flen)
+  OMEGA_H_INLINE int expansion_sum(const int elen, const Omega_h::Real* e,
+                                   const int flen, const Omega_h::Real* f,
+                                   Omega_h::Real* h) {
+    int ei = 0, fi = 0, hindex = 0;
+    Omega_h::Real enow = e[0];
+    Omega_h::Real fnow = f[0];
+    Omega_h::Real q, qnew, hh;
+    if ((fnow > enow) == (fnow > -enow)) {
+      q = enow;
+      ++ei;
+      enow = ei < elen ? e[ei] : 0;
+    }
+    else {
+      q = fnow;
+      ++fi;
+      fnow = fi < flen ? f[fi] : 0;
+    }
+    if (ei < elen && fi < flen) {
+      if ((fnow > enow) == (fnow > -enow)) {
+        fast_two_sum(enow, q, qnew, hh);
+        ++ei;
+        enow = ei < elen ? e[ei] : 0;
+      }
+      else {
+        fast_two_sum(fnow, q, qnew, hh);
+        ++fi;
+        fnow = fi < flen ? f[fi] : 0;
+      }
+      q = qnew;
+      if (hh != 0.0)
+        h[hindex++] = hh;
+      while (ei < elen && fi < flen) {
+        if ((fnow > enow) == (fnow > -enow)) {
+          two_sum(q, enow, qnew, hh);
+          ++ei;
+          enow = ei < elen ? e[ei] : 0;
+        }
+        else {
+          two_sum(q, fnow, qnew, hh);
+          ++fi;
+          fnow = fi < flen ? f[fi] : 0;
+        }
+        q = qnew;
+        if (hh != 0.0)
+          h[hindex++] = hh;
+      }
+    }
+    while (ei < elen) {
+      two_sum(q, enow, qnew, hh);
+      ++ei;
+      enow = ei < elen ? e[ei] : 0;
+      q = qnew;
+      if (hh != 0.0)
+        h[hindex++] = hh;
+    }
+    while (fi < flen) {
+      two_sum(q, fnow, qnew, hh);
+      ++fi;
+      fnow = fi < flen ? f[fi] : 0;
+      q = qnew;
+      if (hh != 0.0)
+        h[hindex++] = hh;
+    }
+    if (q != 0.0 || hindex == 0)
+      h[hindex++] = q;
+    return hindex;
+  }
+
+  //The sign of an expansion is the sign of its largest component
+  OMEGA_H_INLINE int expansion_sign(const int elen, const Omega_h::Real* e) {
+    const Omega_h::Real top = e[elen - 1];
+    return (top > 0) - (top < 0);
+  }
+
+  //h = a*d - b*c exactly, returns the length of h (at most 4)
+  OMEGA_H_INLINE int exact_det2(const Omega_h::Real a, const Omega_h::Real b,
+                                const Omega_h::Real c, const Omega_h::Real d,
+                                Omega_h::Real* h) {
+    Omega_h::Real ad[2], bc[2];
+    two_product(a, d, ad[1], ad[0]);
+    two_product(-b, c, bc[1], bc[0]);
+    return expansion_sum(2, ad, 2, bc, h);
+  }
+
+  //h = det(m) exactly for a row major 3x3 matrix, returns the length of h (at most 24)
+  OMEGA_H_INLINE int exact_det3(const Omega_h::Real m[3][3], Omega_h::Real* h) {
+    Omega_h::Real minor[4], term[8], acc[24], tmp[24];
+    int acc_len = 0;
+    for (int j = 0; j < 3; ++j) {
+      const int j1 = (j == 0) ? 1 : 0;
+      const int j2 = (j == 2) ? 1 : 2;
+      const int mlen = exact_det2(m[1][j1], m[1][j2], m[2][j1], m[2][j2], minor);
+      const Omega_h::Real s = (j == 1) ? -m[0][j] : m[0][j];
+      const int tlen = scale_expansion(mlen, minor, s, term);
+      if (acc_len == 0) {
+        for (int i = 0; i < tlen; ++i)
+          acc[i] = term[i];
+        acc_len = tlen;
+      }
+      else {
+        const int len = expansion_sum(acc_len, acc, tlen, term, tmp);
+        for (int i = 0; i < len; ++i)
+          acc[i] = tmp[i];
+        acc_len = len;
+      }
+    }
+    for (int i = 0; i < acc_len; ++i)
+      h[i] = acc[i];
+    return acc_len;
+  }
+
+  //Exact sign of det(m) for a row major 4x4 matrix
+  OMEGA_H_INLINE int exact_det4_sign(const Omega_h::Real m[4][4]) {
+    Omega_h::Real minor_m[3][3];
+    Omega_h::Real minor[24], term[48];
+    Omega_h::Real acc[PRED_DET4_MAXLEN], tmp[PRED_DET4_MAXLEN];
+    int acc_len = 0;
+    for (int j = 0; j < 4; ++j) {
+      if (m[0][j] == 0)
+        continue;
+      for (int r = 0; r < 3; ++r) {
+        int c = 0;
+        for (int k = 0; k < 4; ++k)
+          if (k != j)
+            minor_m[r][c++] = m[r+1][k];
+      }
+      const int mlen = exact_det3(minor_m, minor);
+      const Omega_h::Real s = (j % 2) ? -m[0][j] : m[0][j];
+      const int tlen = scale_expansion(mlen, minor, s, term);
+      if (acc_len == 0) {
+        for (int i = 0; i < tlen; ++i)
+          acc[i] = term[i];
+        acc_len = tlen;
+      }
+      else {
+        const int len = expansion_sum(acc_len, acc, tlen, term, tmp);
+        for (int i = 0; i < len; ++i)
+          acc[i] = tmp[i];
+        acc_len = len;
+      }
+    }
+    if (acc_len == 0)
+      return 0;
+    return expansion_sign(acc_len, acc);
+  }
+
+  /******************** Predicates ********************/
+  /*
+    Returns a positive value if d lies below the plane through a, b and c, where
+    below is defined so that a, b and c appear counterclockwise when viewed from
+    above. Returns zero if the points are coplanar.
+    Equivalent to det [[a 1] [b 1] [c 1] [d 1]].
+
+    The returned magnitude is only meaningful when the double precision
+    evaluation could be certified, otherwise +-1 or 0 is returned.
+  */
+  OMEGA_H_INLINE Omega_h::Real orient3d(const Omega_h::Vector<3>& a,
+                                        const Omega_h::Vector<3>& b,
+                                        const Omega_h::Vector<3>& c,
+                                        const Omega_h::Vector<3>& d) {
+    const Omega_h::Real adx = a[0] - d[0], bdx = b[0] - d[0], cdx = c[0] - d[0];
+    const Omega_h::Real ady = a[1] - d[1], bdy = b[1] - d[1], cdy = c[1] - d[1];
+    const Omega_h::Real adz = a[2] - d[2], bdz = b[2] - d[2], cdz = c[2] - d[2];
+    const Omega_h::Real bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+    const Omega_h::Real cdxady = cdx * ady, adxcdy = adx * cdy;
+    const Omega_h::Real adxbdy = adx * bdy, bdxady = bdx * ady;
+    const Omega_h::Real det = adz * (bdxcdy - cdxbdy) + bdz * (cdxady - adxcdy)
+                            + cdz * (adxbdy - bdxady);
+    const Omega_h::Real permanent =
+      (std::abs(bdxcdy) + std::abs(cdxbdy)) * std::abs(adz) +
+      (std::abs(cdxady) + std::abs(adxcdy)) * std::abs(bdz) +
+      (std::abs(adxbdy) + std::abs(bdxady)) * std::abs(cdz);
+    const Omega_h::Real errbound = O3D_ERRBOUND_A * permanent;
+    if (det > errbound || -det > errbound)
+      return det;
+    //Fall back to exact arithmetic
+    const Omega_h::Real m[4][4] = {{a[0], a[1], a[2], 1},
+                                   {b[0], b[1], b[2], 1},
+                                   {c[0], c[1], c[2], 1},
+                                   {d[0], d[1], d[2], 1}};
+    return exact_det4_sign(m);
+  }
+
+  /*
+    Returns a positive value if a, b and c appear in counterclockwise order,
+    a negative value if they appear in clockwise order and zero if they are
+    collinear. Equivalent to det [[a 1] [b 1] [c 1]].
+
+    As for orient3d the magnitude is only meaningful when the double precision
+    evaluation could be certified.
+  */
+  OMEGA_H_INLINE Omega_h::Real orient2d(const Omega_h::Vector<2>& a,
+                                        const Omega_h::Vector<2>& b,
+                                        const Omega_h::Vector<2>& c) {
+    const Omega_h::Real detleft = (a[0] - c[0]) * (b[1] - c[1]);
+    const Omega_h::Real detright = (a[1] - c[1]) * (b[0] - c[0]);
+    const Omega_h::Real det = detleft - detright;
+    const Omega_h::Real errbound = O2D_ERRBOUND_A * (std::abs(detleft) + std::abs(detright));
+    if (det > errbound || -det > errbound)
+      return det;
+    //Fall back to exact arithmetic
+    const Omega_h::Real m[3][3] = {{a[0], a[1], 1},
+                                   {b[0], b[1], 1},
+                                   {c[0], c[1], 1}};
+    Omega_h::Real h[24];
+    const int hlen = exact_det3(m, h);
+    return expansion_sign(hlen, h);
+  }
+
+  /*
+    Single precision filter for the sign of orient3d(a, b, c, d).
+    The arguments are the double precision coordinates rounded to float.
+    Returns +-1 if the sign of the double precision orient3d of the unrounded
+    points is certified and 0 if it has to be recomputed in double precision.
+  */
+  OMEGA_H_INLINE int orient3d_fp32_filter(const float* a, const float* b,
+                                          const float* c, const float* d) {
+    const float adx = a[0] - d[0], bdx = b[0] - d[0], cdx = c[0] - d[0];
+    const float ady = a[1] - d[1], bdy = b[1] - d[1], cdy = c[1] - d[1];
+    const float adz = a[2] - d[2], bdz = b[2] - d[2], cdz = c[2] - d[2];
+    const float det = adz * (bdx * cdy - cdx * bdy) + bdz * (cdx * ady - adx * cdy)
+                    + cdz * (adx * bdy - bdx * ady);
+    //magnitudes of the coordinates, not the differences, bound the input rounding
+    float m[3][3];
+    for (int j = 0; j < 3; ++j) {
+      m[0][j] = std::abs(a[j]) + std::abs(d[j]);
+      m[1][j] = std::abs(b[j]) + std::abs(d[j]);
+      m[2][j] = std::abs(c[j]) + std::abs(d[j]);
+    }
+    const float permanent =
+      (m[1][0] * m[2][1] + m[2][0] * m[1][1]) * m[0][2] +
+      (m[2][0] * m[0][1] + m[0][0] * m[2][1]) * m[1][2] +
+      (m[0][0] * m[1][1] + m[1][0] * m[0][1]) * m[2][2];
+    if (!(permanent > O3D_FP32_MIN_PERMANENT))
+      return 0;
+    const float errbound = O3D_FP32_ERRBOUND * permanent;
+    if (det > errbound)
+      return 1;
+    if (-det > errbound)
+      return -1;
+    return 0;
+  }
+
+  /*
+    Sign of orient3d(p[0], p[1], p[2], p[3]) under Simulation of Simplicity
+
+    ids[i] is the (process local) vertex id of p[i] or -1 if p[i] is not a mesh
+    vertex and is not perturbed. The coordinate c of the vertex with the r-th
+    smallest id among the perturbed points is perturbed by eps^(2^(3r+c)).
+    Only the relative order of the ids matters, so the answers are consistent
+    with a single global perturbation of all mesh vertices.
+
+    Returns 0 only if no point is perturbed or the configuration stays
+    degenerate under every perturbation (e.g. p[0] == p[1] for unperturbed points).
+  */
+  OMEGA_H_INLINE int orient3d_sos(const Omega_h::Few<Omega_h::Vector<3>, 4>& p,
+                                  const Omega_h::Few<Omega_h::LO, 4>& ids) {
+    const Omega_h::Real det = orient3d(p[0], p[1], p[2], p[3]);
+    if (det != 0)
+      return (det > 0) ? 1 : -1;
+    //Rank the perturbed points by vertex id
+    int row_of_rank[4];
+    int nperturbed = 0;
+    for (int i = 0; i < 4; ++i) {
+      if (ids[i] < 0)
+        continue;
+      int rank = 0;
+      for (int j = 0; j < 4; ++j)
+        rank += (ids[j] >= 0 && ids[j] < ids[i]);
+      row_of_rank[rank] = i;
+      ++nperturbed;
+    }
+    /* Every monomial of the perturbed determinant is a product of eps_{r,c} with
+       distinct r and distinct c. Its exponent is the bitmask of the chosen (r,c)
+       pairs, so walking the masks in increasing order visits the monomials from
+       the most to the least significant. The coefficient of a monomial is the
+       determinant with each chosen row replaced by the unit vector e_c.
+    */
+    const int nmasks = 1 << (3 * nperturbed);
+    for (int mask = 1; mask < nmasks; ++mask) {
+      Omega_h::Real m[4][4];
+      for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 3; ++j)
+          m[i][j] = p[i][j];
+        m[i][3] = 1;
+      }
+      int used_cols = 0;
+      bool valid = true;
+      for (int r = 0; r < nperturbed && valid; ++r) {
+        const int bits = (mask >> (3 * r)) & 7;
+        if (bits == 0)
+          continue;
+        if (bits & (bits - 1) || bits & used_cols) {
+          valid = false;
+          continue;
+        }
+        used_cols |= bits;
+        const int row = row_of_rank[r];
+        for (int j = 0; j < 4; ++j)
+          m[row][j] = 0;
+        m[row][(bits == 1) ? 0 : ((bits == 2) ? 1 : 2)] = 1;
+      }
+      if (!valid)
+        continue;
+      const int sign = exact_det4_sign(m);
+      if (sign)
+        return sign;
+    }
+    return 0;
+  }
+
+} //namespace
+#endif
@@ -13,10 +13,13 @@ namespace pumipic {
      new_elems - new assignment of mesh elements for each particle
      tol - target imbalance for load balancing. (Example 5% imbalance has value 1.05)
      step_factor - (optional) The rate of diffusion for load balancer
+     weight - (optional) cost of each particle, see ParticleBalancer::repartition
+     Enable mesh.ptclBalancer()->setLazyBalancing to only balance when the particles
+       are more imbalanced than tol
   */
-  template <class PS>
+  template <class PS, class Weight = UnitPtclWeight>
   void migrate_lb_ptcls(Mesh& mesh, PS* ptcls, Omega_h::LOs new_elems,
-                  float tol, float step_factor = 0.5);
+                  float tol, float step_factor = 0.5, Weight weight = Weight());
 
   /* Migrate/rebuild particle structure
      mesh - picpart mesh
@@ -29,6 +32,32 @@ namespace pumipic {
   void migrate_ptcls(Mesh& mesh, PS* ptcls, Omega_h::LOs new_elems);
 
 
+  /* Count the particles, over all processes, that are assigned to an unsafe element
+     mesh - picpart mesh
+     ptcls - particle structure
+     elems - new assignment of mesh elements for each particle
+     Used with the safe zone stopping option of search_mesh/search_mesh_2d: while
+     the count is nonzero the particles are migrated with migrate_ptcls and the
+     search is repeated so the element owners finish the walks. Before migrating,
+     particles that already reached their destination should have their current
+     position set to the destination as the next search starts from it.
+  */
+  template <class PS>
+  long int countUnsafePtcls(Mesh& mesh, PS* ptcls, Omega_h::LOs elems) {
+    auto safe = mesh.safeTag();
+    Omega_h::Write<Omega_h::LO> is_unsafe(ptcls->capacity(), 0, "is_unsafe");
+    auto markUnsafePtcls = PS_LAMBDA(const int elm, const int ptcl, const bool mask) {
+      const int nelm = elems[ptcl];
+      if (mask && nelm != -1)
+        is_unsafe[ptcl] = !safe[nelm];
+    };
+    parallel_for(ptcls, markUnsafePtcls, "markUnsafePtcls");
+    long int local = Omega_h::get_sum(Omega_h::LOs(is_unsafe));
+    long int total;
+    MPI_Allreduce(&local, &total, 1, MPI_LONG, MPI_SUM, mesh.comm()->get_impl());
+    return total;
+  }
+
   template <class PS>
   void setUnsafeProcs(Mesh& mesh, PS* ptcls, Omega_h::LOs elems,
                       typename PS::kkLidView new_elems, typename PS::kkLidView new_procs) {
@@ -50,9 +79,9 @@ namespace pumipic {
     };
     parallel_for(ptcls, setUnsafePtcls, "setUnsafePtcls");
   }
-  template <class PS>
+  template <class PS, class Weight>
   void migrate_lb_ptcls(Mesh& mesh, PS* ptcls, Omega_h::LOs elems,
-                  float tol, float step_factor) {
+                  float tol, float step_factor, Weight weight) {
     Kokkos::Timer init_timer;
     typename PS::kkLidView new_elems("ps_element_ids", ptcls->capacity());
     typename PS::kkLidView new_procs("ps_process_ids", ptcls->capacity());
@@ -60,7 +89,7 @@ namespace pumipic {
     float init_time = init_timer.seconds();
     Kokkos::Timer balance_timer;
     ParticleBalancer* balancer = mesh.ptclBalancer();
-    balancer->repartition(mesh, ptcls, tol, new_elems, new_procs, step_factor);
+    balancer->repartition(mesh, ptcls, tol, new_elems, new_procs, step_factor, weight);
     float balance_time = balance_timer.seconds();
     Kokkos::Timer migrate_timer;
     ptcls->migrate(new_elems, new_procs);
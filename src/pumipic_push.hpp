@@ -4,74 +4,98 @@
 #include <iostream>
 #include <cmath>
 #include <utility>
+#include <vector>
 
 #include "Omega_h_adj.hpp"
 #include "Omega_h_array_ops.hpp"
 #include "Omega_h_scalar.hpp" //divide
 #include "Omega_h_fail.hpp"
 
+#include <particle_structs.hpp>
 #include "pumipic_utils.hpp"
 #include "pumipic_constants.hpp"
+#include "pumipic_kktypes.hpp"
 
 namespace pumipic
 {
-OMEGA_H_INLINE void pushBoris(Omega_h::LO nelems, Omega_h::Write<Omega_h::Real> &x,
- Omega_h::Write<Omega_h::Real> &y, Omega_h::Write<Omega_h::Real> &z, Omega_h::Write<Omega_h::Real> &xp,
- Omega_h::Write<Omega_h::Real> &yp, Omega_h::Write<Omega_h::Real> &zp, Omega_h::Write<Omega_h::Real> &vx,
- Omega_h::Write<Omega_h::Real> &vy, Omega_h::Write<Omega_h::Real> &vz, Omega_h::Write<Omega_h::Real> &eFld0x,
- Omega_h::Write<Omega_h::Real> &eFld0y, Omega_h::Write<Omega_h::Real> &eFld0z,
- Omega_h::Write<Omega_h::Real> &bFld0r, Omega_h::Write<Omega_h::Real> &bFld0t,
- Omega_h::Write<Omega_h::Real> &bFld0z, Omega_h::Write<Omega_h::LO> &part_flags, Omega_h::Real dt)
+/* Charge to mass ratio (C/kg) of each species for pushBoris
+   charge - charge of each species in units of the elementary charge
+   amu - mass of each species in atomic mass units
+*/
+inline Omega_h::Reals speciesChargeToMass(const std::vector<Omega_h::Real>& charge,
+                                          const std::vector<Omega_h::Real>& amu)
 {
-  auto pushPtcl = OMEGA_H_LAMBDA( Omega_h::LO ielem)
-  {
-    Omega_h::LO pid = ielem; //TODO Replace by ptcl loop
-
-    Omega_h::Vector<3> vel{vx[pid], vy[pid], vz[pid]}; //current
-    Omega_h::Vector<3> eField{eFld0x[pid], eFld0y[pid], eFld0z[pid]}; //previous
-    Omega_h::Vector<3> bField{bFld0r[pid], bFld0t[pid], bFld0z[pid]}; //previous
-
-    Omega_h::Real charge = 1; //TODO get using speciesID using enum
-    Omega_h::Real amu = 10; //TODO "
-
-    OMEGA_H_CHECK(amu >0 && dt>0);
-    Omega_h::Real bFieldMag = osh_mag(bField);
-    Omega_h::Real qPrime = charge*1.60217662e-19/(amu*1.6737236e-27) *dt*0.5;
-    Omega_h::Real coeff = 2.0*qPrime/(1.0+(qPrime*bFieldMag)*(qPrime*bFieldMag));
-
-      //v_minus = v + q_prime*E;
-    Omega_h::Vector<3> qpE = qPrime*eField;
-    Omega_h::Vector<3> vMinus = vel - qpE;
-
-    //v_prime = v_minus + q_prime*(v_minus x B)
-    Omega_h::Vector<3> vmxB = Omega_h::cross(vMinus,bField);
-    Omega_h::Vector<3> qpVmxB = qPrime*vmxB;
-    Omega_h::Vector<3> vPrime = vMinus + qpVmxB;
-
-    //v = v_minus + coeff*(v_prime x B)
-    Omega_h::Vector<3> vpxB = Omega_h::cross(vPrime, bField);
-    Omega_h::Vector<3> cVpxB = coeff*vpxB;
-    vel = vMinus + cVpxB;
-
-    //v = v + q_prime*E
-    vel = vel + qpE;
-
-    //write
-    Omega_h::Vector<3> pre = {xp[pid], yp[pid], zp[pid]}; //prev pos
-    xp[pid] = x[pid];
-    yp[pid] = y[pid];
-    zp[pid] = z[pid];
+  if (charge.size() != amu.size()) {
+    fprintf(stderr, "[ERROR] speciesChargeToMass given %lu charges and %lu masses\n",
+            charge.size(), amu.size());
+    throw 1;
+  }
+  Omega_h::HostWrite<Omega_h::Real> q_m(charge.size(), "species_charge_to_mass");
+  for (size_t i = 0; i < charge.size(); ++i) {
+    if (amu[i] <= 0) {
+      fprintf(stderr, "[ERROR] species %lu has mass %f\n", i, amu[i]);
+      throw 1;
+    }
+    q_m[i] = charge[i] * ELEMENTARY_CHARGE / (amu[i] * ATOMIC_MASS_UNIT);
+  }
+  return Omega_h::Reals(q_m.write());
+}
 
-    // Next position and velocity
-    x[pid] = pre[0] + vel[0] * dt;
-    y[pid] = pre[1] + vel[1] * dt;
-    z[pid] = pre[2] + vel[2] * dt;
-    vx[pid] = vel[0];
-    vy[pid] = vel[1];
-    vz[pid] = vel[2];
+/* Advances the particles one time step with the Boris scheme
+   The template parameters are the indices of the particle members
+     XIdx - current position (Vector3d)
+     XtgtIdx - (out) position after the push (Vector3d), together with the
+               current position it is the segment walked by search_mesh
+     VIdx - (in/out) velocity (Vector3d)
+     EIdx, BIdx - electric and magnetic field at the particle (Vector3d), for
+                  example from gather_from_vertices
+     SpeciesIdx - species of the particle (int), index into chargeToMass
+   ptcls - particle structure
+   chargeToMass - charge to mass ratio of each species, see speciesChargeToMass
+   dt - time step
+*/
+template <int XIdx, int XtgtIdx, int VIdx, int EIdx, int BIdx, int SpeciesIdx,
+          class ParticleStruct>
+void pushBoris(ParticleStruct* ptcls, Omega_h::Reals chargeToMass, Omega_h::Real dt)
+{
+  auto x_ps = ptcls->template get<XIdx>();
+  auto xtgt_ps = ptcls->template get<XtgtIdx>();
+  auto v_ps = ptcls->template get<VIdx>();
+  auto e_ps = ptcls->template get<EIdx>();
+  auto b_ps = ptcls->template get<BIdx>();
+  auto species_ps = ptcls->template get<SpeciesIdx>();
+  const Omega_h::Real halfDt = 0.5 * dt;
+  auto pushPtcl = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if (mask > 0) {
+      const Omega_h::Real qPrime = chargeToMass[species_ps(pid)] * halfDt;
+      //v_minus = v + q_prime*E
+      Omega_h::Real vMinus[3], t[3];
+      Omega_h::Real tMag2 = 0;
+      for (int i = 0; i < 3; ++i) {
+        vMinus[i] = v_ps(pid, i) + qPrime * e_ps(pid, i);
+        t[i] = qPrime * b_ps(pid, i);
+        tMag2 += t[i] * t[i];
+      }
+      //v_prime = v_minus + v_minus x t
+      const Omega_h::Real vPrime[3] = {
+        vMinus[0] + vMinus[1] * t[2] - vMinus[2] * t[1],
+        vMinus[1] + vMinus[2] * t[0] - vMinus[0] * t[2],
+        vMinus[2] + vMinus[0] * t[1] - vMinus[1] * t[0]};
+      //v_plus = v_minus + v_prime x s, s = 2t/(1+|t|^2)
+      const Omega_h::Real sFactor = 2 / (1 + tMag2);
+      const Omega_h::Real vPlus[3] = {
+        vMinus[0] + sFactor * (vPrime[1] * t[2] - vPrime[2] * t[1]),
+        vMinus[1] + sFactor * (vPrime[2] * t[0] - vPrime[0] * t[2]),
+        vMinus[2] + sFactor * (vPrime[0] * t[1] - vPrime[1] * t[0])};
+      //v = v_plus + q_prime*E, x_tgt = x + v*dt
+      for (int i = 0; i < 3; ++i) {
+        const Omega_h::Real vel = vPlus[i] + qPrime * e_ps(pid, i);
+        v_ps(pid, i) = vel;
+        xtgt_ps(pid, i) = x_ps(pid, i) + vel * dt;
+      }
+    }
   };
-
-  Omega_h::parallel_for(1,  pushPtcl, "push");
+  parallel_for(ptcls, pushPtcl, "pushBoris");
 }
 
 } //namespace
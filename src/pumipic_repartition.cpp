@@ -0,0 +1,166 @@
+#include "pumipic_repartition.hpp"
+
+#include <cmath>
+#include <Omega_h_for.hpp>
+#include <Omega_h_array_ops.hpp>
+#include <Omega_h_scalar.hpp>
+#include <ppTiming.hpp>
+
+namespace pumipic {
+  typedef Omega_h::LO LO;
+  typedef Omega_h::Real Real;
+
+  namespace {
+    /* Diffuses the element weights from the heavy parts to their lighter neighbors
+       Each layer moves elements on the boundary of a part to the lightest neighboring
+       part that is lighter. A part gives at most a quarter of the difference to its
+       lightest neighbor and takes at most a quarter of the difference to its heaviest
+       neighbor, so weight passes through the parts between a heavy and a light part.
+       Parts keep at least one element and elements without weight do not move.
+    */
+    Omega_h::LOs diffuseWeights(Omega_h::Adj dual, Omega_h::LOs owners, Omega_h::Reals weights,
+                                int comm_size, double tol, int max_layers) {
+      const LO nelms = owners.size();
+      const Real step = 0.25;
+      for (int layer = 0; layer < max_layers; ++layer) {
+        Omega_h::Write<Real> part_wgts(comm_size, 0, "part_weights");
+        Omega_h::Write<LO> part_elms(comm_size, 0, "part_elements");
+        auto sumParts = OMEGA_H_LAMBDA(const LO elm) {
+          Kokkos::atomic_add(&(part_wgts[owners[elm]]), weights[elm]);
+          Kokkos::atomic_add(&(part_elms[owners[elm]]), 1);
+        };
+        Omega_h::parallel_for(nelms, sumParts, "sumParts");
+        Omega_h::HostRead<Real> part_wgts_host(part_wgts);
+        Real total = 0, max = 0;
+        for (int i = 0; i < comm_size; ++i) {
+          total += part_wgts_host[i];
+          max = std::max(max, part_wgts_host[i]);
+        }
+        const Real avg = total / comm_size;
+        if (avg <= 0 || max <= tol * avg)
+          break;
+        //Lightest and heaviest neighboring part of each part
+        Omega_h::Write<Real> nbr_min(comm_size, max, "neighbor_min");
+        Omega_h::Write<Real> nbr_max(comm_size, 0, "neighbor_max");
+        auto neighborWeights = OMEGA_H_LAMBDA(const LO elm) {
+          const int part = owners[elm];
+          for (LO j = dual.a2ab[elm]; j < dual.a2ab[elm + 1]; ++j) {
+            const int nbr = owners[dual.ab2b[j]];
+            if (nbr != part) {
+              Kokkos::atomic_fetch_min(&(nbr_min[part]), part_wgts[nbr]);
+              Kokkos::atomic_fetch_max(&(nbr_max[part]), part_wgts[nbr]);
+            }
+          }
+        };
+        Omega_h::parallel_for(nelms, neighborWeights, "neighborWeights");
+        Omega_h::Write<Real> send(comm_size, "part_send");
+        Omega_h::Write<Real> recv(comm_size, "part_recv");
+        auto setQuotas = OMEGA_H_LAMBDA(const LO part) {
+          send[part] = step * Omega_h::max2(part_wgts[part] - nbr_min[part], 0.0);
+          recv[part] = step * Omega_h::max2(nbr_max[part] - part_wgts[part], 0.0);
+        };
+        Omega_h::parallel_for(comm_size, setQuotas, "setQuotas");
+        Omega_h::Write<LO> new_owners(nelms, "new_owners");
+        Omega_h::Write<LO> moved(1, 0, "moved");
+        auto moveElements = OMEGA_H_LAMBDA(const LO elm) {
+          const int part = owners[elm];
+          new_owners[elm] = part;
+          const Real w = weights[elm];
+          if (w <= 0 || send[part] <= 0)
+            return;
+          int target = -1;
+          Real target_wgt = part_wgts[part];
+          for (LO j = dual.a2ab[elm]; j < dual.a2ab[elm + 1]; ++j) {
+            const int nbr = owners[dual.ab2b[j]];
+            if (nbr != part && part_wgts[nbr] < target_wgt) {
+              target = nbr;
+              target_wgt = part_wgts[nbr];
+            }
+          }
+          if (target < 0)
+            return;
+          //Reserve the quotas, a rejected move gives back the ones it took
+          if (Kokkos::atomic_fetch_add(&(recv[target]), -w) <= 0) {
+            Kokkos::atomic_add(&(recv[target]), w);
+            return;
+          }
+          if (Kokkos::atomic_fetch_add(&(send[part]), -w) <= 0) {
+            Kokkos::atomic_add(&(send[part]), w);
+            Kokkos::atomic_add(&(recv[target]), w);
+            return;
+          }
+          if (Kokkos::atomic_fetch_add(&(part_elms[part]), -1) <= 1) {
+            Kokkos::atomic_add(&(part_elms[part]), 1);
+            Kokkos::atomic_add(&(send[part]), w);
+            Kokkos::atomic_add(&(recv[target]), w);
+            return;
+          }
+          new_owners[elm] = target;
+          Kokkos::atomic_add(&(moved[0]), 1);
+        };
+        Omega_h::parallel_for(nelms, moveElements, "moveElements");
+        owners = Omega_h::LOs(new_owners);
+        if (Omega_h::HostRead<LO>(moved)[0] == 0)
+          break;
+      }
+      return owners;
+    }
+  }
+
+  /* The weights are reduced to rank 0, which diffuses them over the parts and
+     broadcasts the new owners so every rank has the same partition
+   */
+  Omega_h::LOs Mesh::balancedOwners(Omega_h::Reals elm_weights, double tol, int max_layers) {
+    requireFullMesh("Mesh::balancedOwners");
+    if (elm_weights.size() != nelems()) {
+      fprintf(stderr, "[ERROR] Mesh::balancedOwners has %d weights for %d elements\n",
+              elm_weights.size(), nelems());
+      throw 1;
+    }
+    Kokkos::Timer timer;
+    Omega_h::Mesh& mesh = *full_mesh;
+    const LO full_nelms = mesh.nelems();
+    const int comm_rank = commptr->rank();
+    const int comm_size = commptr->size();
+    MPI_Comm comm = commptr->get_impl();
+
+    Omega_h::LOs full_ids = fullMeshElements();
+    Omega_h::Write<Real> full_wgts(full_nelms, 0, "full_mesh_weights");
+    auto gatherWeights = OMEGA_H_LAMBDA(const LO elm) {
+      full_wgts[full_ids[elm]] = elm_weights[elm];
+    };
+    Omega_h::parallel_for(elm_weights.size(), gatherWeights, "gatherWeights");
+    Omega_h::HostWrite<Real> full_wgts_host(full_wgts);
+    MPI_Reduce(comm_rank ? full_wgts_host.data() : MPI_IN_PLACE, full_wgts_host.data(),
+               full_nelms, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+    Omega_h::LOs owners = mesh.get_array<LO>(mesh.dim(), "ownership");
+    Omega_h::HostWrite<LO> new_owners_host(full_nelms, "new_owners_host");
+    int changed = 0;
+    if (!comm_rank) {
+      Omega_h::Reals weights(Omega_h::Write<Real>(full_wgts_host));
+      Omega_h::LOs new_owners = diffuseWeights(mesh.ask_dual(), owners, weights, comm_size,
+                                               tol, max_layers);
+      changed = !(new_owners == owners);
+      Omega_h::HostRead<LO> new_owners_read(new_owners);
+      for (LO i = 0; i < full_nelms; ++i)
+        new_owners_host[i] = new_owners_read[i];
+    }
+    MPI_Bcast(&changed, 1, MPI_INT, 0, comm);
+    if (!changed)
+      return Omega_h::LOs();
+    MPI_Bcast(new_owners_host.data(), full_nelms, MPI_INT, 0, comm);
+    RecordTime("balanced owners", timer.seconds());
+    return Omega_h::LOs(Omega_h::Write<LO>(new_owners_host));
+  }
+
+  MeshRepartitioner::MeshRepartitioner(double tol, int steps, double target)
+    : trigger_tol(tol), trigger_steps(steps), target_tol(target), steps_above(0),
+      num_repartitions(0) {
+    if (steps < 1 || tol < 1 || target < 1) {
+      fprintf(stderr, "[ERROR] Invalid MeshRepartitioner tolerance %f steps %d target %f\n",
+              tol, steps, target);
+      throw 1;
+    }
+  }
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <type_traits>
+#include <vector>
+#include <mpi.h>
+#include <Omega_h_for.hpp>
+#include <particle_structs.hpp>
+#include <ppTiming.hpp>
+#include "pumipic_mesh.hpp"
+#include "pumipic_lb.hpp"
+
+namespace pumipic {
+
+  //Copies one particle's value of a member type with rank R into a member view
+  template <class T, int R = std::rank<T>::value> struct CopyPtclMember;
+  template <class T> struct CopyPtclMember<T, 0> {
+    template <class Seg, class View>
+    PP_INLINE static void copy(const Seg& src, int ptcl, const View& dst, int index) {
+      dst(index) = src(ptcl);
+    }
+  };
+  template <class T> struct CopyPtclMember<T, 1> {
+    template <class Seg, class View>
+    PP_INLINE static void copy(const Seg& src, int ptcl, const View& dst, int index) {
+      for (int i = 0; i < (int)std::extent<T, 0>::value; ++i)
+        dst(index, i) = src(ptcl, i);
+    }
+  };
+  template <class T> struct CopyPtclMember<T, 2> {
+    template <class Seg, class View>
+    PP_INLINE static void copy(const Seg& src, int ptcl, const View& dst, int index) {
+      for (int i = 0; i < (int)std::extent<T, 0>::value; ++i)
+        for (int j = 0; j < (int)std::extent<T, 1>::value; ++j)
+          dst(index, i, j) = src(ptcl, i, j);
+    }
+  };
+  template <class T> struct CopyPtclMember<T, 3> {
+    template <class Seg, class View>
+    PP_INLINE static void copy(const Seg& src, int ptcl, const View& dst, int index) {
+      for (int i = 0; i < (int)std::extent<T, 0>::value; ++i)
+        for (int j = 0; j < (int)std::extent<T, 1>::value; ++j)
+          for (int k = 0; k < (int)std::extent<T, 2>::value; ++k)
+            dst(index, i, j, k) = src(ptcl, i, j, k);
+    }
+  };
+
+  /* CopyPtclData<ParticleStructure> - copies the particle info to member views
+       Usage: CopyPtclData<ParticleStructure>(ParticleStructure,
+                                              DestinationMemberTypeViews,
+                                              DestinationIndexForParticle);
+       Particles with a negative destination index are skipped.
+  */
+  template <class PS, std::size_t N = 0, bool Done = N == PS::Types::size>
+  struct CopyPtclData {
+    CopyPtclData(PS* ptcls, MemberTypeViews dsts, typename PS::kkLidView indices) {
+      typedef typename PS::template DataType<N> T;
+      auto src = ptcls->template get<N>();
+      auto dst = getMemberView<typename PS::Types, N>(dsts);
+      auto copyMember = PS_LAMBDA(const int&, const int& ptcl, const bool& mask) {
+        const int index = indices(ptcl);
+        if (mask && index >= 0)
+          CopyPtclMember<T>::copy(src, ptcl, dst, index);
+      };
+      parallel_for(ptcls, copyMember, "copyMember");
+      CopyPtclData<PS, N + 1>(ptcls, dsts, indices);
+    }
+  };
+  template <class PS, std::size_t N> struct CopyPtclData<PS, N, true> {
+    CopyPtclData(PS*, MemberTypeViews, typename PS::kkLidView) {}
+  };
+
+  /* Sends particles to other processes outside of the particle structure
+     dest_procs - destination of each particle or -1 if it is not sent, particles
+                  are never sent to the calling process
+     dest_elems - value sent with each particle, e.g. its full mesh element
+     recv_elems(out) - the values of the received particles
+     recv_info(out) - the member views of the received particles
+     Note: This is a collective call and must be called by every process
+  */
+  template <class PS>
+  void exchangePtcls(PS* ptcls, MPI_Comm comm, typename PS::kkLidView dest_procs,
+                     typename PS::kkLidView dest_elems, typename PS::kkLidView& recv_elems,
+                     MemberTypeViews& recv_info) {
+    typedef typename PS::kkLidView kkLidView;
+    typedef typename PS::Types Types;
+    typedef typename DefaultMemSpace::device_type device_type;
+    int comm_rank, comm_size;
+    MPI_Comm_rank(comm, &comm_rank);
+    MPI_Comm_size(comm, &comm_size);
+
+    kkLidView send_counts("send_counts", comm_size);
+    auto countSends = PS_LAMBDA(const int&, const int& ptcl, const bool& mask) {
+      if (mask && dest_procs(ptcl) >= 0)
+        Kokkos::atomic_add(&(send_counts(dest_procs(ptcl))), 1);
+    };
+    parallel_for(ptcls, countSends, "countSends");
+    typename kkLidView::HostMirror send_counts_host = Kokkos::create_mirror_view(send_counts);
+    Kokkos::deep_copy(send_counts_host, send_counts);
+    std::vector<int> send_offsets(comm_size + 1, 0), recv_offsets(comm_size + 1, 0);
+    std::vector<int> recv_counts(comm_size);
+    MPI_Alltoall(send_counts_host.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+    for (int i = 0; i < comm_size; ++i) {
+      send_offsets[i + 1] = send_offsets[i] + send_counts_host(i);
+      recv_offsets[i + 1] = recv_offsets[i] + recv_counts[i];
+    }
+
+    //Pack the sent particles by destination
+    const int nsend = send_offsets[comm_size];
+    for (int i = 0; i < comm_size; ++i)
+      send_counts_host(i) = send_offsets[i];
+    kkLidView send_next("send_next", comm_size);
+    Kokkos::deep_copy(send_next, send_counts_host);
+    kkLidView send_index("send_index", ptcls->capacity());
+    kkLidView send_elems("send_elems", nsend);
+    auto packSends = PS_LAMBDA(const int&, const int& ptcl, const bool& mask) {
+      const int dest = mask ? dest_procs(ptcl) : -1;
+      send_index(ptcl) = -1;
+      if (dest >= 0) {
+        const int index = Kokkos::atomic_fetch_add(&(send_next(dest)), 1);
+        send_index(ptcl) = index;
+        send_elems(index) = dest_elems(ptcl);
+      }
+    };
+    parallel_for(ptcls, packSends, "packSends");
+    MemberTypeViews send_info = createMemberViews<Types>(nsend);
+    CopyPtclData<PS>(ptcls, send_info, send_index);
+
+    const int nrecv = recv_offsets[comm_size];
+    recv_elems = kkLidView("recv_elems", nrecv);
+    recv_info = createMemberViews<Types>(nrecv);
+    const int num_types = Types::size;
+    std::vector<MPI_Request> requests;
+    for (int i = 0; i < comm_size; ++i) {
+      if (i == comm_rank)
+        continue;
+      const int num_send = send_offsets[i + 1] - send_offsets[i];
+      if (num_send > 0) {
+        const size_t req = requests.size();
+        requests.resize(req + num_types + 1);
+        PS_Comm_Isend(send_elems, send_offsets[i], num_send, i, 0, comm, &requests[req]);
+        SendViews<device_type, Types>(send_info, send_offsets[i], num_send, i, 1, comm,
+                                      &requests[req + 1]);
+      }
+      const int num_recv = recv_offsets[i + 1] - recv_offsets[i];
+      if (num_recv > 0) {
+        const size_t req = requests.size();
+        requests.resize(req + num_types + 1);
+        PS_Comm_Irecv(recv_elems, recv_offsets[i], num_recv, i, 0, comm, &requests[req]);
+        RecvViews<device_type, Types>(recv_info, recv_offsets[i], num_recv, i, 1, comm,
+                                      &requests[req + 1]);
+      }
+    }
+    PS_Comm_Waitall<device_type>(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+    destroyViews<Types>(send_info);
+  }
+
+  /* Repartitions the picparts for new element owners and moves the particles
+
+     A particle structure is built on the element numbering of one picpart layout,
+     so the particles are copied into a new structure for the new picparts.
+       1. Mesh::repartition rebuilds the picparts
+       2. Particles in elements that are not in the new picpart are sent to the new
+          owner of their element with the element's full mesh index, the new owner
+          has the element in its core
+       3. The kept and received particles are copied into the structure returned by
+            create(num_elems, num_ptcls, ptcls_per_elem, element_gids,
+                   particle_elements, particle_info)
+          with the arguments of the SellCSigma constructor and ptcls is deleted.
+       4. Particles outside the new safe zone migrate to the new owners
+     owners - new owner of each full mesh element, see Mesh::balancedOwners
+     Returns the new particle structure
+  */
+  template <class PS, class Create>
+  PS* repartitionPtcls(Mesh& picparts, PS* ptcls, Omega_h::LOs owners, Create create);
+
+  /* Triggers repartitions of the core regions from the particle load
+
+     step computes the max/avg of the particle weight per rank and counts the
+     consecutive steps above tol. After steps such steps the element weights are
+     balanced to the target imbalance with Mesh::balancedOwners and the particles
+     are moved with repartitionPtcls. Steps within tol reset the count.
+  */
+  class MeshRepartitioner {
+  public:
+    /* tol - max/avg particle weight that triggers a repartition
+       steps - number of consecutive steps above tol before repartitioning
+       target - (optional) max/avg of the element weights of the new partition
+    */
+    MeshRepartitioner(double tol, int steps, double target = 1.05);
+
+    /* Checks the particle load and repartitions if needed
+       create - functor building the new particle structure, see repartitionPtcls
+       weight - (optional) cost of each particle, indexed by particle
+       Returns the particle structure, ptcls is deleted on a repartition
+    */
+    template <class PS, class Create, class Weight = UnitPtclWeight>
+    PS* step(Mesh& picparts, PS* ptcls, Create create, Weight weight = Weight());
+
+    int numRepartitions() const {return num_repartitions;}
+    int stepsAboveTolerance() const {return steps_above;}
+    //max/avg of the particle weight at the last step
+    double lastImbalance() const {return last_imbalance;}
+
+  private:
+    double trigger_tol;
+    int trigger_steps;
+    double target_tol;
+    int steps_above;
+    int num_repartitions;
+    double last_imbalance = 1;
+  };
+
+  template <class PS, class Create>
+  PS* repartitionPtcls(Mesh& picparts, PS* ptcls, Omega_h::LOs owners, Create create) {
+    typedef typename PS::kkLidView kkLidView;
+    typedef typename PS::kkGidView kkGidView;
+    typedef typename PS::Types Types;
+    Kokkos::Timer timer;
+    const int rank = picparts.comm()->rank();
+    const int dim = picparts.dim();
+
+    Omega_h::LOs old_full_ids = picparts.fullMeshElements();
+    Omega_h::LOs elm_map = picparts.repartition(owners);
+    const int ne = picparts->nelems();
+
+    //Index of each kept particle in the new structure, the others go to the new owner
+    kkLidView ptcl_index("ptcl_index", ptcls->capacity());
+    kkLidView ptcl_count("ptcl_count", 1);
+    kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+    kkLidView dest_procs("dest_procs", ptcls->capacity());
+    kkLidView dest_elems("dest_elems", ptcls->capacity());
+    auto countPtcls = PS_LAMBDA(const int& e, const int& ptcl, const bool& mask) {
+      const Omega_h::LO elm = mask ? elm_map[e] : -1;
+      ptcl_index(ptcl) = -1;
+      dest_procs(ptcl) = -1;
+      if (elm >= 0) {
+        ptcl_index(ptcl) = Kokkos::atomic_fetch_add(&(ptcl_count(0)), 1);
+        Kokkos::atomic_add(&(ptcls_per_elem(elm)), 1);
+      }
+      else if (mask) {
+        dest_elems(ptcl) = old_full_ids[e];
+        dest_procs(ptcl) = owners[old_full_ids[e]];
+      }
+    };
+    parallel_for(ptcls, countPtcls, "countPtcls");
+    typename kkLidView::HostMirror ptcl_count_host = Kokkos::create_mirror_view(ptcl_count);
+    Kokkos::deep_copy(ptcl_count_host, ptcl_count);
+    const int nkept = ptcl_count_host(0);
+    kkLidView recv_elems;
+    MemberTypeViews recv_info;
+    exchangePtcls(ptcls, picparts.comm()->get_impl(), dest_procs, dest_elems, recv_elems,
+                  recv_info);
+    const int nrecv = recv_elems.size();
+    const int np = nkept + nrecv;
+
+    kkLidView particle_elements("particle_elements", np);
+    auto setElements = PS_LAMBDA(const int& e, const int& ptcl, const bool& mask) {
+      const int index = ptcl_index(ptcl);
+      if (mask && index >= 0)
+        particle_elements(index) = elm_map[e];
+    };
+    parallel_for(ptcls, setElements, "setElements");
+    MemberTypeViews particle_info = createMemberViews<Types>(np);
+    CopyPtclData<PS>(ptcls, particle_info, ptcl_index);
+    delete ptcls;
+
+    //Received particles are in the core of the new picpart
+    Omega_h::LOs full_ids = picparts.fullMeshElements();
+    Omega_h::Write<Omega_h::LO> full_to_new(owners.size(), -1, "full_to_new");
+    auto setFullToNew = OMEGA_H_LAMBDA(const Omega_h::LO elm) {
+      full_to_new[full_ids[elm]] = elm;
+    };
+    Omega_h::parallel_for(ne, setFullToNew, "setFullToNew");
+    kkLidView recv_index("recv_index", nrecv);
+    kkLidView missing("missing", 1);
+    Kokkos::parallel_for("setRecvElements", nrecv, KOKKOS_LAMBDA(const int& i) {
+      const Omega_h::LO elm = full_to_new[recv_elems(i)];
+      recv_index(i) = nkept + i;
+      particle_elements(nkept + i) = elm;
+      if (elm >= 0)
+        Kokkos::atomic_add(&(ptcls_per_elem(elm)), 1);
+      else
+        Kokkos::atomic_add(&(missing(0)), 1);
+    });
+    typename kkLidView::HostMirror missing_host = Kokkos::create_mirror_view(missing);
+    Kokkos::deep_copy(missing_host, missing);
+    if (missing_host(0) > 0) {
+      fprintf(stderr, "[ERROR] repartitionPtcls received %d particles in elements outside "
+              "the picpart of rank %d\n", missing_host(0), rank);
+      throw 1;
+    }
+    CopyViewsToViews<kkLidView, Types>(particle_info, recv_info, recv_index);
+    destroyViews<Types>(recv_info);
+
+    Omega_h::GOs gids = picparts.globalIds(dim);
+    kkGidView element_gids("element_gids", ne);
+    auto setGids = OMEGA_H_LAMBDA(const Omega_h::LO elm) {
+      element_gids(elm) = gids[elm];
+    };
+    Omega_h::parallel_for(ne, setGids, "setGids");
+    PS* new_ptcls = create(ne, np, ptcls_per_elem, element_gids, particle_elements,
+                           particle_info);
+    destroyViews<Types>(particle_info);
+
+    //Particles outside the new safe zone go to the new owners
+    Omega_h::LOs safe = picparts.safeTag();
+    Omega_h::LOs new_owners = picparts.entOwners(dim);
+    kkLidView new_elems("new_elems", new_ptcls->capacity());
+    kkLidView new_procs("new_procs", new_ptcls->capacity());
+    auto setOwners = PS_LAMBDA(const int& e, const int& ptcl, const bool& mask) {
+      new_elems(ptcl) = mask ? e : -1;
+      new_procs(ptcl) = safe[e] ? rank : new_owners[e];
+    };
+    parallel_for(new_ptcls, setOwners, "setOwners");
+    new_ptcls->migrate(new_elems, new_procs);
+    RecordTime("particle repartition", timer.seconds());
+    return new_ptcls;
+  }
+
+  template <class PS, class Create, class Weight>
+  PS* MeshRepartitioner::step(Mesh& picparts, PS* ptcls, Create create, Weight weight) {
+    MPI_Comm comm = picparts.comm()->get_impl();
+    last_imbalance = ptclImbalance(comm, localPtclWeight(ptcls, weight));
+    if (last_imbalance <= trigger_tol) {
+      steps_above = 0;
+      return ptcls;
+    }
+    if (++steps_above < trigger_steps)
+      return ptcls;
+    steps_above = 0;
+
+    Omega_h::Write<Omega_h::Real> elm_wgts(picparts->nelems(), 0, "elm_ptcl_weights");
+    auto sumElmWeights = PS_LAMBDA(const int& e, const int& ptcl, const bool& mask) {
+      if (mask)
+        Kokkos::atomic_add(&(elm_wgts[e]), Omega_h::Real(weight(ptcl)));
+    };
+    parallel_for(ptcls, sumElmWeights, "sumElmWeights");
+    Omega_h::LOs owners = picparts.balancedOwners(Omega_h::Reals(elm_wgts), target_tol);
+    if (!owners.exists())
+      return ptcls;
+    ++num_repartitions;
+    return repartitionPtcls(picparts, ptcls, owners, create);
+  }
+}
@@ -9,7 +9,6 @@ namespace pumipic {
      MPI_Allgather/NCCL
      MPI_Broadcast/NCCL
      MPI_Alltoallv
-     MPI_Waitany
   */
 
 #if false //These function headers are for documentation purposes only
@@ -179,6 +178,33 @@ namespace pumipic {
   template <typename Space>
   int PS_Comm_Waitall(int num_requests, MPI_Request* requests, MPI_Status* statuses);
 
+  /*!
+    \brief Wrapper around MPI_Waitany
+
+    \tparam Space The memory space where the sends/recvs occurred
+
+    \param num_requests The number of requests
+
+    \param requests The array of requests sized `num_requests`
+
+    \param[out] index The index of the request that completed or MPI_UNDEFINED
+
+    \param[out] status A status filled by the MPI_Waitany
+
+    \return The error value returned by the call to MPI
+
+    \note The function call is equivalent to
+    MPI_Waitany(num_requests, requests, index, status);
+
+    \note PS_Comm_Waitany must be used instead of MPI_Waitany if using the
+    PS_Comm_Isend/Irecv functions on the device in order to finish copying the data
+    of the completed request.
+
+  */
+  template <typename Space>
+  int PS_Comm_Waitany(int num_requests, MPI_Request* requests, int* index,
+                      MPI_Status* status);
+
   /*!
     \brief Wrapper around MPI_Alltoall for views
 
@@ -138,6 +138,21 @@ bool checkCudaAwareMPI();
 
   }
 
+  //Waitany
+  template <typename Space>
+  IsCuda<Space> PS_Comm_Waitany(int num_reqs, MPI_Request* reqs, int* index,
+                                MPI_Status* stat) {
+    int ret = MPI_Waitany(num_reqs, reqs, index, stat);
+    if (*index == MPI_UNDEFINED)
+      return ret;
+    Irecv_Map::iterator itr = get_map().find(reqs + *index);
+    if (itr != get_map().end()) {
+      (itr->second)();
+      get_map().erase(itr);
+    }
+    return ret;
+  }
+
   //Alltoall
   template <typename ViewT>
   IsCuda<ViewSpace<ViewT> > PS_Comm_Alltoall(ViewT send, int send_size,
@@ -47,6 +47,12 @@ template <typename Space>
 IsHost<Space> PS_Comm_Waitall(int num_reqs, MPI_Request* reqs, MPI_Status* stats) {
   return MPI_Waitall(num_reqs, reqs, stats);
 }
+//Waitany
+template <typename Space>
+IsHost<Space> PS_Comm_Waitany(int num_reqs, MPI_Request* reqs, int* index,
+                              MPI_Status* stat) {
+  return MPI_Waitany(num_reqs, reqs, index, stat);
+}
 //Alltoall
 template <typename ViewT>
 IsHost<ViewSpace<ViewT> > PS_Comm_Alltoall(ViewT send, int send_size,
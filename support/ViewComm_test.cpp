@@ -8,6 +8,8 @@ int iSendRecvWaitTest(const char* name, int msg_size);
 template <typename Space>
 int iSendRecvWaitAllTest(const char* name);
 template <typename Space>
+int iSendRecvWaitAnyTest(const char* name);
+template <typename Space>
 int allToAllTest(const char* name, int msg_size);
 template <typename Space>
 int allReduceTest(const char* name);
@@ -25,6 +27,7 @@ int runTests() {
   fails += iSendRecvWaitTest<Space>("Large Isend/Irecv + Wait", 10000);
 
   fails += iSendRecvWaitAllTest<Space>("Isend/Irecv + Waitall");
+  fails += iSendRecvWaitAnyTest<Space>("Isend/Irecv + Waitany");
 
   fails += reduceTest<Space>("Reduce");
   fails += allReduceTest<Space>("Allreduce");
@@ -421,6 +424,74 @@ int iSendRecvWaitAllTest(const char* name) {
   return final_fail > 0;
 }
 
+template <typename Space>
+int iSendRecvWaitAnyTest(const char* name) {
+  //Setup
+  if (!comm_rank)
+    printf("Beginning Test %s_%s\n", name, Space::name());
+  int fails = 0;
+  Kokkos::View<int*, Space> device_fails("failures", 1);
+  int local_rank = comm_rank;
+  int local_size = comm_size;
+  typedef Kokkos::RangePolicy<typename Space::execution_space> ExecPolicy;
+  typename Space::execution_space exec;
+
+  //Send 2^comm_rank to every other rank and complete the receives in any order
+  MPI_Request* send_requests = new MPI_Request[comm_size];
+  MPI_Request* recv_requests = new MPI_Request[comm_size];
+  Kokkos::View<unsigned long int*, Space> send_view("send_view", local_size);
+  Kokkos::View<unsigned long int*, Space> recv_view("recv_view", local_size);
+  Kokkos::parallel_for(ExecPolicy(exec,0, local_size), KOKKOS_LAMBDA(const int i) {
+    send_view(i) = pow(2, local_rank);
+  });
+  for (int i = 0; i < local_size; ++i) {
+    pumipic::PS_Comm_Irecv(recv_view, i, 1, i, 0, MPI_COMM_WORLD, recv_requests + i);
+    pumipic::PS_Comm_Isend(send_view, i, 1, i, 0, MPI_COMM_WORLD, send_requests + i);
+  }
+  bool* finished = new bool[comm_size];
+  for (int i = 0; i < comm_size; ++i)
+    finished[i] = false;
+  for (int i = 0; i < comm_size; ++i) {
+    int index;
+    int ret = pumipic::PS_Comm_Waitany<Space>(comm_size, recv_requests, &index,
+                                              MPI_STATUS_IGNORE);
+    if (ret != MPI_SUCCESS || index < 0 || index >= comm_size || finished[index]) {
+      fprintf(stderr, "[ERROR] Rank %d: PS_Comm_Waitany returned error code %d with "
+              "index %d\n", comm_rank, ret, index);
+      ++fails;
+      break;
+    }
+    finished[index] = true;
+  }
+  //Every request is complete so there is no request left to wait on
+  int index;
+  pumipic::PS_Comm_Waitany<Space>(comm_size, recv_requests, &index, MPI_STATUS_IGNORE);
+  if (index != MPI_UNDEFINED) {
+    fprintf(stderr, "[ERROR] Rank %d: PS_Comm_Waitany on completed requests returned "
+            "index %d\n", comm_rank, index);
+    ++fails;
+  }
+  pumipic::PS_Comm_Waitall<Space>(comm_size, send_requests, MPI_STATUSES_IGNORE);
+  Kokkos::parallel_for(ExecPolicy(exec, 0, local_size), KOKKOS_LAMBDA(const int i) {
+      unsigned long int p = pow(2, i);
+    if (recv_view(i) != p) {
+      printf("[ERROR] Rank %d: has incorrect value on element %d"
+             "[(actual) %lu != %lu (should be)]\n", local_rank, i, recv_view(i), p);
+      Kokkos::atomic_add(&(device_fails(0)), 1);
+    }
+  });
+  delete [] finished;
+  delete [] send_requests;
+  delete [] recv_requests;
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  //Closing
+  fails += pumipic::getLastValue<int>(device_fails);
+  int final_fail;
+  MPI_Allreduce(&fails, &final_fail, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  return final_fail > 0;
+}
+
 template <typename Space>
 int reduceTest(const char* name) {
   //Setup
@@ -1,6 +1,11 @@
 #include "ppTiming.hpp"
 #include <unordered_map>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
 #include <mpi.h>
 
 namespace {
@@ -9,9 +14,17 @@ namespace {
   std::unordered_map<std::string, int> timing_index;
 
   const double PREBARRIER_TOL = .000001;
+  /*
+    `str` is the full path of the operation, `name` is the operation name without the
+    enclosing scopes and `depth` is the number of enclosing scopes
+  */
   struct TimeInfo {
-    TimeInfo(std::string s) : str(s), time(0), hasPrebarrier(false), prebarrier(0), count(0) {}
+    TimeInfo(std::string s, std::string n, int d) : str(s), name(n), depth(d), time(0),
+                                                    count(0), hasPrebarrier(false),
+                                                    prebarrier(0) {}
     std::string str;
+    std::string name;
+    int depth;
     double time;
     int count;
     bool hasPrebarrier;
@@ -19,11 +32,300 @@ namespace {
   };
   std::vector<TimeInfo> time_per_op;
 
+  //Paths of the open ScopedTimers from the outermost to the innermost
+  std::vector<std::string> scopes;
+
+  //Every process records unless it disabled timing
   bool isTiming() {
+    return enable_timing >= 0;
+  }
+
+  //Process 0 prints unless it disabled timing, other processes print if they enabled it
+  bool isPrinting() {
     int comm_rank;
     MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
     return enable_timing > 0 || (enable_timing == 0 && comm_rank == 0);
   }
+
+  //Path of the operation `str` in the innermost open scope
+  std::string scopedPath(const std::string& str) {
+    if (scopes.empty())
+      return str;
+    return scopes.back() + "/" + str;
+  }
+
+  //Index of the operation in time_per_op, adds the operation if it is new
+  int findOp(const std::string& path, const std::string& name, int depth) {
+    auto itr = timing_index.find(path);
+    if (itr == timing_index.end()) {
+      itr = (timing_index.insert(std::make_pair(path, time_per_op.size()))).first;
+      time_per_op.push_back(TimeInfo(path, name, depth));
+    }
+    return itr->second;
+  }
+
+  void addTime(const std::string& str, double seconds, double prebarrierTime) {
+    if (!isTiming() || verbosity < 0)
+      return;
+    const std::string path = scopedPath(str);
+    int index = findOp(path, str, scopes.size());
+    time_per_op[index].time += seconds;
+    ++(time_per_op[index].count);
+    if (prebarrierTime >= PREBARRIER_TOL) {
+      time_per_op[index].hasPrebarrier = true;
+      time_per_op[index].prebarrier += prebarrierTime;
+    }
+    if (verbosity >= 1 && isPrinting()) {
+      int comm_rank;
+      MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+      if (prebarrierTime >= PREBARRIER_TOL)
+        fprintf(stderr, "%d %s (seconds) %f pre-barrier (seconds) %f\n", comm_rank,
+                path.c_str(), seconds, prebarrierTime);
+      else
+        fprintf(stderr, "%d %s (seconds) %f\n", comm_rank, path.c_str(), seconds);
+    }
+  }
+
+  //Appends printf style formatted output to `out`
+  void appendf(std::string& out, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list args_copy;
+    va_copy(args_copy, args);
+    const int len = vsnprintf(NULL, 0, format, args_copy);
+    va_end(args_copy);
+    if (len > 0) {
+      const std::size_t old_size = out.size();
+      out.resize(old_size + len + 1);
+      vsnprintf(&out[old_size], len + 1, format, args);
+      out.resize(old_size + len);
+    }
+    va_end(args);
+  }
+
+  //Number of characters to print `val` with `precision` decimal places
+  int printLength(double val, int precision) {
+    if (val < 1)
+      return precision + 2;
+    return static_cast<int>(log10(val)) + precision + 2;
+  }
+
+  //Operation name indented by its depth
+  std::string indentedName(const std::string& name, int depth) {
+    return std::string(2 * depth, ' ') + name;
+  }
+
+  //Timing of an operation reduced over the ranks that recorded it
+  struct ReducedTime {
+    std::string str;
+    std::string name;
+    int depth;
+    int ranks;
+    double count;
+    double min;
+    double max;
+    double avg;
+    double p50;
+    double p90;
+    double p99;
+    double imbalance;
+    bool hasPrebarrier;
+    double prebarrier;
+  };
+
+  //Serializes the depth, name and path of each operation, one operation per line
+  std::string packOps(const std::vector<ReducedTime>& ops) {
+    std::string packed;
+    for (std::size_t i = 0; i < ops.size(); ++i)
+      appendf(packed, "%d\t%s\t%s\n", ops[i].depth, ops[i].name.c_str(), ops[i].str.c_str());
+    return packed;
+  }
+
+  //Appends the operations in `packed` that are not in `index` to `ops`
+  void unpackOps(const char* packed, int length, std::vector<ReducedTime>& ops,
+                 std::unordered_map<std::string, int>& index) {
+    const std::string str(packed, length);
+    std::size_t start = 0;
+    while (start < str.size()) {
+      std::size_t end = str.find('\n', start);
+      const std::size_t name_start = str.find('\t', start) + 1;
+      const std::size_t path_start = str.rfind('\t', end) + 1;
+      ReducedTime op = ReducedTime();
+      op.depth = atoi(str.c_str() + start);
+      op.name = str.substr(name_start, path_start - 1 - name_start);
+      op.str = str.substr(path_start, end - path_start);
+      if (index.find(op.str) == index.end()) {
+        index[op.str] = ops.size();
+        ops.push_back(op);
+      }
+      start = end + 1;
+    }
+  }
+
+  //Nearest-rank percentile of the sorted values
+  double percentile(const std::vector<double>& sorted, int p) {
+    int rank = static_cast<int>(ceil(p / 100.0 * sorted.size())) - 1;
+    if (rank < 0)
+      rank = 0;
+    return sorted[rank];
+  }
+
+  /*
+    Reduces the timing of every operation recorded by any rank
+
+    Operations are ordered by their first appearance on rank 0, 1, ... so a scope is before
+    the operations it contains. The result and `total_timing`, the number of recording
+    ranks, are only set on process 0
+
+    Note: This is a collective call and must be called by every process
+  */
+  std::vector<ReducedTime> reduceTime(int& total_timing) {
+    int comm_rank, comm_size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    int is_timing = isTiming();
+    total_timing = 0;
+    MPI_Reduce(&is_timing, &total_timing, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    //Gather the operations of every rank on process 0
+    std::vector<ReducedTime> ops;
+    for (std::size_t i = 0; i < time_per_op.size(); ++i) {
+      ReducedTime op = ReducedTime();
+      op.str = time_per_op[i].str;
+      op.name = time_per_op[i].name;
+      op.depth = time_per_op[i].depth;
+      ops.push_back(op);
+    }
+    std::string packed = packOps(ops);
+    int length = packed.size();
+    std::vector<int> lengths(comm_size, 0);
+    MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    std::vector<int> offsets(comm_size + 1, 0);
+    for (int i = 0; i < comm_size; ++i)
+      offsets[i + 1] = offsets[i] + lengths[i];
+    std::vector<char> all_packed(offsets[comm_size] + 1);
+    MPI_Gatherv(&packed[0], length, MPI_CHAR, all_packed.data(), lengths.data(),
+                offsets.data(), MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    //Broadcast the union of the operations
+    ops.clear();
+    std::unordered_map<std::string, int> index;
+    if (comm_rank == 0) {
+      for (int i = 0; i < comm_size; ++i)
+        unpackOps(all_packed.data() + offsets[i], lengths[i], ops, index);
+      packed = packOps(ops);
+      length = packed.size();
+    }
+    MPI_Bcast(&length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    packed.resize(length);
+    MPI_Bcast(&packed[0], length, MPI_CHAR, 0, MPI_COMM_WORLD);
+    if (comm_rank != 0)
+      unpackOps(packed.c_str(), length, ops, index);
+
+    //Gather the time, count and prebarrier of each operation, -1 if it was not recorded
+    const int nops = ops.size();
+    std::vector<double> vals(3 * nops + 1, -1);
+    for (std::size_t i = 0; i < time_per_op.size(); ++i) {
+      const int op = index[time_per_op[i].str];
+      vals[3 * op] = time_per_op[i].time;
+      vals[3 * op + 1] = time_per_op[i].count;
+      vals[3 * op + 2] = time_per_op[i].prebarrier;
+    }
+    std::vector<double> all_vals(comm_rank == 0 ? 3 * nops * comm_size + 1 : 1);
+    MPI_Gather(vals.data(), 3 * nops, MPI_DOUBLE, all_vals.data(), 3 * nops, MPI_DOUBLE, 0,
+               MPI_COMM_WORLD);
+    if (comm_rank != 0)
+      return ops;
+
+    std::vector<double> times;
+    for (int i = 0; i < nops; ++i) {
+      ReducedTime& op = ops[i];
+      times.clear();
+      for (int r = 0; r < comm_size; ++r) {
+        const double* rank_vals = all_vals.data() + 3 * (nops * r + i);
+        if (rank_vals[0] < 0)
+          continue;
+        times.push_back(rank_vals[0]);
+        op.count += rank_vals[1];
+        op.prebarrier += rank_vals[2];
+        op.hasPrebarrier = op.hasPrebarrier || rank_vals[2] >= PREBARRIER_TOL;
+      }
+      op.ranks = times.size();
+      if (op.ranks == 0)
+        continue;
+      std::sort(times.begin(), times.end());
+      double sum = 0;
+      for (std::size_t j = 0; j < times.size(); ++j)
+        sum += times[j];
+      op.count /= op.ranks;
+      op.prebarrier /= op.ranks;
+      op.min = times.front();
+      op.max = times.back();
+      op.avg = sum / op.ranks;
+      op.p50 = percentile(times, 50);
+      op.p90 = percentile(times, 90);
+      op.p99 = percentile(times, 99);
+      op.imbalance = op.avg > 0 ? op.max / op.avg : 1;
+    }
+    return ops;
+  }
+
+  //Writes `str` as a JSON string
+  void writeJSONString(FILE* out, const std::string& str) {
+    fputc('"', out);
+    for (std::size_t i = 0; i < str.size(); ++i) {
+      const unsigned char c = str[i];
+      if (c == '"' || c == '\\')
+        fprintf(out, "\\%c", c);
+      else if (c < 0x20)
+        fprintf(out, "\\u%04x", c);
+      else
+        fputc(c, out);
+    }
+    fputc('"', out);
+  }
+
+  //Writes `str` as a CSV field, quoted if it contains a separator or quote
+  void writeCSVField(FILE* out, const std::string& str) {
+    if (str.find_first_of(",\"\n") == std::string::npos) {
+      fputs(str.c_str(), out);
+      return;
+    }
+    fputc('"', out);
+    for (std::size_t i = 0; i < str.size(); ++i) {
+      if (str[i] == '"')
+        fputc('"', out);
+      fputc(str[i], out);
+    }
+    fputc('"', out);
+  }
+
+  void writeJSON(FILE* out, const std::vector<ReducedTime>& ops, int total_timing) {
+    fprintf(out, "{\n  \"num_ranks\": %d,\n  \"operations\": [", total_timing);
+    for (std::size_t i = 0; i < ops.size(); ++i) {
+      const ReducedTime& op = ops[i];
+      fprintf(out, "%s\n    {\"path\": ", i ? "," : "");
+      writeJSONString(out, op.str);
+      fprintf(out, ", \"name\": ");
+      writeJSONString(out, op.name);
+      fprintf(out, ", \"depth\": %d, \"ranks\": %d, \"avg_count\": %.9g, \"min\": %.9g, "
+              "\"max\": %.9g, \"avg\": %.9g, \"p50\": %.9g, \"p90\": %.9g, \"p99\": %.9g, "
+              "\"imbalance\": %.9g, \"avg_prebarrier\": %.9g}", op.depth, op.ranks, op.count,
+              op.min, op.max, op.avg, op.p50, op.p90, op.p99, op.imbalance, op.prebarrier);
+    }
+    fprintf(out, "\n  ]\n}\n");
+  }
+
+  void writeCSV(FILE* out, const std::vector<ReducedTime>& ops) {
+    fprintf(out, "path,depth,ranks,avg_count,min,max,avg,p50,p90,p99,imbalance,avg_prebarrier\n");
+    for (std::size_t i = 0; i < ops.size(); ++i) {
+      const ReducedTime& op = ops[i];
+      writeCSVField(out, op.str);
+      fprintf(out, ",%d,%d,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n", op.depth,
+              op.ranks, op.count, op.min, op.max, op.avg, op.p50, op.p90, op.p99,
+              op.imbalance, op.prebarrier);
+    }
+  }
 }
 
 namespace pumipic {
@@ -52,37 +354,36 @@ namespace pumipic {
   }
 
   void RecordTime(std::string str, double seconds, double prebarrierTime) {
-    int comm_rank;
-    MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
-    if (isTiming()) {
-      if (verbosity >= 0) {
-        auto itr = timing_index.find(str);
-        if (itr == timing_index.end()) {
-          itr = (timing_index.insert(std::make_pair(str, time_per_op.size()))).first;
-          time_per_op.push_back(TimeInfo(str));
-        }
-        int index = itr->second;
-        time_per_op[index].time += seconds;
-        ++(time_per_op[index].count);
-        if (prebarrierTime >= PREBARRIER_TOL) {
-          time_per_op[index].hasPrebarrier = true;
-          time_per_op[index].prebarrier += prebarrierTime;
-        }
-        if (verbosity >= 1) {
-          char buffer[1024];
-          char* ptr = buffer + sprintf(buffer, "%d %s (seconds) %f", comm_rank, str.c_str(),
-                                       seconds);
-          if (prebarrierTime >= PREBARRIER_TOL) {
-            ptr += sprintf(ptr, " pre-brarrier (seconds) %f", prebarrierTime);
-          }
-          fprintf(stderr, "%s\n", buffer);
-        }
-      }
+    addTime(str, seconds, prebarrierTime);
+  }
+
+  ScopedTimer::ScopedTimer(std::string str, double prebarrierTime)
+    : name(str), prebarrier(prebarrierTime) {
+    const std::string path = scopedPath(str);
+    //Add the operation now so it is summarized before the operations inside of it
+    if (isTiming() && verbosity >= 0)
+      findOp(path, str, scopes.size());
+    scopes.push_back(path);
+    start = MPI_Wtime();
+  }
+
+  ScopedTimer::~ScopedTimer() {
+    const double time = seconds();
+    const std::string path = scopes.back();
+    scopes.pop_back();
+    if (scopedPath(name) != path) {
+      fprintf(stderr, "[ERROR] ScopedTimer %s destroyed while %s is open\n", name.c_str(),
+              path.c_str());
     }
+    addTime(name, time, prebarrier);
+  }
+
+  double ScopedTimer::seconds() const {
+    return MPI_Wtime() - start;
   }
 
   void PrintAdditionalTimeInfo(char* str, int v) {
-    if (isTiming() && verbosity >= v) {
+    if (isPrinting() && verbosity >= v) {
       fprintf(stderr, "%s\n", str);
     }
   }
@@ -90,78 +391,99 @@ namespace pumipic {
   void SummarizeTime() {
     int comm_rank;
     MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
-    if (isTiming()) {
+    if (isPrinting()) {
       if (verbosity >= 0) {
         int name_length = 9;
         int tt_length = 10;
         int cc_length = 10;
         int at_length = 12;
         for (std::size_t index = 0; index < time_per_op.size(); ++index) {
-          if (time_per_op[index].str.size() > name_length)
-            name_length = time_per_op[index].str.size();
-          int len = log10(time_per_op[index].time) + 8;
-          if (len > tt_length)
-            tt_length = len;
-          len = log10(time_per_op[index].count) + 1;
-          if (len > cc_length)
-            cc_length = len;
-          len = log10(time_per_op[index].time / time_per_op[index].count) + 8;
-          if (len > at_length)
-            len = at_length;
+          const TimeInfo& op = time_per_op[index];
+          const int len = indentedName(op.name, op.depth).size();
+          name_length = std::max(name_length, len);
+          tt_length = std::max(tt_length, printLength(op.time, 6));
+          cc_length = std::max(cc_length, printLength(op.count, 0) - 1);
+          if (op.count > 0)
+            at_length = std::max(at_length, printLength(op.time / op.count, 6));
         }
-        char buffer[8192];
-        char* ptr = buffer + sprintf(buffer, "Timing Summary %d\n", comm_rank);
-        ptr += sprintf(ptr, "Operation   %*sTotal Time   %*sCall Count   %*sAverage Time\n",
-                       name_length - 9 , "", tt_length - 10, "",
-                       cc_length - 10, "");
-        for (int index = 0; index < time_per_op.size(); ++index) {
-          ptr += sprintf(ptr, "%s   %*s%*.6f   %*d   %*.6f",
-                         time_per_op[index].str.c_str(),
-                         (int)(name_length - time_per_op[index].str.size()), "",
-                         tt_length, time_per_op[index].time,
-                         cc_length, time_per_op[index].count,
-                         at_length, time_per_op[index].time / time_per_op[index].count);
-          if (time_per_op[index].hasPrebarrier) {
-            ptr += sprintf(ptr, "  Total Prebarrier=%f", time_per_op[index].prebarrier);
+        std::string buffer;
+        appendf(buffer, "Timing Summary %d\n", comm_rank);
+        appendf(buffer, "Operation   %*sTotal Time   %*sCall Count   %*sAverage Time\n",
+                name_length - 9 , "", tt_length - 10, "",
+                cc_length - 10, "");
+        for (std::size_t index = 0; index < time_per_op.size(); ++index) {
+          const TimeInfo& op = time_per_op[index];
+          const std::string name = indentedName(op.name, op.depth);
+          appendf(buffer, "%s   %*s%*.6f   %*d   %*.6f",
+                  name.c_str(), (int)(name_length - name.size()), "",
+                  tt_length, op.time,
+                  cc_length, op.count,
+                  at_length, op.count > 0 ? op.time / op.count : 0.0);
+          if (op.hasPrebarrier) {
+            appendf(buffer, "  Total Prebarrier=%f", op.prebarrier);
           }
-          ptr += sprintf(ptr, "\n");
+          appendf(buffer, "\n");
         }
-        fprintf(stderr, "%s\n", buffer);
+        fprintf(stderr, "%s\n", buffer.c_str());
       }
     }
   }
 
-  /*
-    Print a summary of all recorded timing reduced by all ranks that enable recording
-
-    Note: This is a collective call and must be called by every process
-  */
   void SummarizeTimeAcrossProcesses() {
     int comm_rank;
     MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
 
-    int total_timing = 0;
-    int is_timing = isTiming();
-    MPI_Reduce(&is_timing, &total_timing, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    if (verbosity >= 0) {
-      char buffer[8192];
-      char* ptr = buffer + sprintf(buffer, "Reduced Timing Summary\nNot Implemented Yet");
-      //TODO
-      // for (int index = 0; index < time_per_op.size(); ++index) {
-      //   float input_vals[4];
-      //   float output_vals[4];
-      //   MPI_Reduce(&(time_per_op[index].time), &total_time
-      //   if (comm_rank == 0) {
-      //     ptr += sprintf(ptr, "%s: Average Total Time=%f  Average Call Count=%d",
-      //     if (time_per_op[index].hasPrebarrier) {
-      //       float totalPrebarrier = 0;
-      //       ptr += sprintf(ptr, "  Average Prebarrier=%f", time_per_op[index].prebarrier);
-      //     }
-      //     ptr += sprintf(ptr, "\n");
-      //   }
-      // }
-      if (comm_rank == 0)
-        fprintf(stderr, "%s\n", buffer);
+    int total_timing;
+    std::vector<ReducedTime> ops = reduceTime(total_timing);
+    if (verbosity >= 0 && comm_rank == 0) {
+      int name_length = 9;
+      int val_length = 10;
+      for (std::size_t index = 0; index < ops.size(); ++index) {
+        const int len = indentedName(ops[index].name, ops[index].depth).size();
+        name_length = std::max(name_length, len);
+        val_length = std::max(val_length, printLength(ops[index].max, 6));
+      }
+      std::string buffer;
+      appendf(buffer, "Reduced Timing Summary over %d processes\n", total_timing);
+      appendf(buffer, "Operation%*s   Ranks   Avg Count", name_length - 9, "");
+      const char* columns[] = {"Min", "Max", "Average", "P50", "P90", "P99"};
+      for (int i = 0; i < 6; ++i)
+        appendf(buffer, "   %*s", val_length, columns[i]);
+      appendf(buffer, "   Imbalance\n");
+      for (std::size_t index = 0; index < ops.size(); ++index) {
+        const ReducedTime& op = ops[index];
+        const std::string name = indentedName(op.name, op.depth);
+        appendf(buffer, "%-*s   %5d   %9.1f", name_length, name.c_str(), op.ranks, op.count);
+        const double vals[] = {op.min, op.max, op.avg, op.p50, op.p90, op.p99};
+        for (int i = 0; i < 6; ++i)
+          appendf(buffer, "   %*.6f", val_length, vals[i]);
+        appendf(buffer, "   %9.3f", op.imbalance);
+        if (op.hasPrebarrier) {
+          appendf(buffer, "  Average Prebarrier=%f", op.prebarrier);
+        }
+        appendf(buffer, "\n");
+      }
+      fprintf(stderr, "%s\n", buffer.c_str());
+    }
+  }
+
+  void WriteTimeAcrossProcesses(const char* filename, TimeFormat format) {
+    int comm_rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+
+    int total_timing;
+    std::vector<ReducedTime> ops = reduceTime(total_timing);
+    if (comm_rank != 0)
+      return;
+    FILE* out = fopen(filename, "w");
+    if (!out) {
+      fprintf(stderr, "[ERROR] Cannot open timing file %s\n", filename);
+      return;
     }
+    if (format == TIME_JSON)
+      writeJSON(out, ops, total_timing);
+    else
+      writeCSV(out, ops);
+    fclose(out);
   }
 }
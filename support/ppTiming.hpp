@@ -1,4 +1,5 @@
 #pragma once
+#include <string>
 
 /*
   Provides a timing utility to record and output timing of operations.
@@ -7,18 +8,23 @@
     SetTimingVerbosity(verbosity)
   Details of each level of verbosity can be found below
 
-  By default the timing functions record on process 0 of MPI_COMM_WORLD.
-  Recording can be enabled and disabled on each process using these functions:
-    EnableTiming() - enable calling process to record timing
-    DisableTiming() - disable calling process to record timing
+  By default every process of MPI_COMM_WORLD records timing and only process 0 prints
+  its messages and summary. This can be changed on each process using these functions:
+    EnableTiming() - the calling process records and prints timing
+    DisableTiming() - the calling process neither records nor prints timing
 
   To record timing of an operation use:
     RecordTime(string, seconds, prebarrierTime (optional))
   This will accumulate all calls with the same `string` and if verbosity is set high enough print a message with the provided timing
 
+  To time a scope and nest the operations recorded inside of it use:
+    ScopedTimer timer(string)
+
   To print the accumulated timing information you can call either:
-    SummarizeTime() - prints timing info for enabled processes
-    SummarizeTimeAcrossProcesses() - prints averaged timing info over all enabled processes
+    SummarizeTime() - prints timing info for printing processes
+    SummarizeTimeAcrossProcesses() - prints min/max/average timing info over all recording processes
+  The reduced timing info can be written in a machine readable format with:
+    WriteTimeAcrossProcesses(filename, format)
 */
 
 namespace pumipic {
@@ -31,9 +37,9 @@ namespace pumipic {
    */
   void SetTimingVerbosity(int verbosity);
 
-  //Turns on time recording on the calling process
+  //Turns on time recording and printing on the calling process
   void EnableTiming();
-  //Turns off time recording on the calling process
+  //Turns off time recording and printing on the calling process
   void DisableTiming();
 
   /*
@@ -46,6 +52,39 @@ namespace pumipic {
   */
   void RecordTime(std::string str, double seconds, double prebarrierTime = 0.0);
 
+  /*
+    Records the time between construction and destruction as the operation `str` with
+    optional prebarrier time in: `prebarrierTime`
+
+    Operations recorded while the timer is alive, including by nested ScopedTimers, are
+    recorded as `str/<operation>` and are printed below `str` in the summaries:
+      {
+        ScopedTimer migrate("migrate");
+        {
+          ScopedTimer pack("pack");
+          ...
+        }
+        RecordTime("exchange", seconds);
+      }
+    records `migrate`, `migrate/pack` and `migrate/exchange`.
+
+    Note: ScopedTimers must be destroyed in the reverse order of their construction
+  */
+  class ScopedTimer {
+  public:
+    ScopedTimer(std::string str, double prebarrierTime = 0.0);
+    ~ScopedTimer();
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    //Seconds since construction
+    double seconds() const;
+  private:
+    std::string name;
+    double prebarrier;
+    double start;
+  };
+
   /*
     Allows printing additional info using the timing verbosity. `str` will only be printed if
     verbosity was set greater than or equal to the passed in `verbosity`
@@ -53,14 +92,34 @@ namespace pumipic {
   void PrintAdditionalTimeInfo(char* str, int verbosity);
 
   /*
-    Print a summary of all recorded timing on each process that enabled recording
+    Print a summary of all recorded timing on each printing process
   */
   void SummarizeTime();
 
   /*
-    Print a summary of all recorded timing reduced by all ranks that enable recording
+    Print a summary of all recorded timing reduced over all recording processes
+
+    For each operation the number of ranks that recorded it, the minimum, maximum, average
+    and 50/90/99th percentile of the total time on those ranks and the imbalance
+    (maximum / average) are printed on process 0
 
     Note: This is a collective call and must be called by every process
   */
   void SummarizeTimeAcrossProcesses();
+
+  enum TimeFormat {
+    TIME_JSON,
+    TIME_CSV
+  };
+
+  /*
+    Write the timing reduced over all recording processes to `filename` on process 0
+
+    TIME_JSON writes an object with the number of timing ranks and a list of operations
+    TIME_CSV writes one row per operation with the header:
+      path,depth,ranks,avg_count,min,max,avg,p50,p90,p99,imbalance,avg_prebarrier
+
+    Note: This is a collective call and must be called by every process
+  */
+  void WriteTimeAcrossProcesses(const char* filename, TimeFormat format);
 }
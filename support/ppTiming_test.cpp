@@ -0,0 +1,120 @@
+#include "ppTiming.hpp"
+#include <mpi.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/* Nested scoped timers are recorded below their scope and the reduced timing written
+   to CSV has one row per operation with the statistics over every rank, which all
+   record by default
+*/
+
+int comm_rank, comm_size;
+
+int check(bool passed, const char* what) {
+  if (!passed) {
+    fprintf(stderr, "[ERROR] Rank %d %s\n", comm_rank, what);
+    return 1;
+  }
+  return 0;
+}
+
+//Reads the fields of each row of a reduced timing CSV file without the header
+std::vector<std::vector<std::string> > readRows(const char* filename) {
+  std::vector<std::vector<std::string> > rows;
+  FILE* in = fopen(filename, "r");
+  if (!in)
+    return rows;
+  char line[1024];
+  while (fgets(line, sizeof(line), in)) {
+    std::vector<std::string> fields;
+    for (char* field = strtok(line, ",\n"); field; field = strtok(NULL, ",\n"))
+      fields.push_back(field);
+    rows.push_back(fields);
+  }
+  fclose(in);
+  if (!rows.empty())
+    rows.erase(rows.begin());
+  return rows;
+}
+
+int checkValue(const std::vector<std::string>& row, int column, double expected,
+               const char* what) {
+  const double val = atof(row[column].c_str());
+  if (std::fabs(val - expected) > 1e-6 * std::fabs(expected)) {
+    fprintf(stderr, "[ERROR] %s %s is %f instead of %f\n", row[0].c_str(), what, val,
+            expected);
+    return 1;
+  }
+  return 0;
+}
+
+//Total time of a rank with nearest-rank percentile p
+double percentileTime(int p) {
+  const int rank = static_cast<int>(ceil(p / 100.0 * comm_size));
+  return 0.002 * rank;
+}
+
+int main(int argc, char* argv[]) {
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+
+  int fails = 0;
+  for (int i = 0; i < 2; ++i) {
+    pumipic::ScopedTimer migrate("migrate");
+    {
+      pumipic::ScopedTimer count("count");
+    }
+    pumipic::RecordTime("exchange", 0.001 * (comm_rank + 1));
+    fails += check(migrate.seconds() >= 0, "negative scoped time");
+  }
+  pumipic::RecordTime("output", 0.5);
+  pumipic::SummarizeTime();
+  pumipic::SummarizeTimeAcrossProcesses();
+
+  const char* csv_file = "timing_test.csv";
+  pumipic::WriteTimeAcrossProcesses(csv_file, pumipic::TIME_CSV);
+  pumipic::WriteTimeAcrossProcesses("timing_test.json", pumipic::TIME_JSON);
+  if (!comm_rank) {
+    std::vector<std::vector<std::string> > rows = readRows(csv_file);
+    const char* paths[4] = {"migrate", "migrate/count", "migrate/exchange", "output"};
+    const char* depths[4] = {"0", "1", "1", "0"};
+    const bool sizes_match = rows.size() == 4 &&
+      rows[0].size() == 12 && rows[1].size() == 12 && rows[2].size() == 12 &&
+      rows[3].size() == 12;
+    fails += check(sizes_match, "wrong number of operations or columns");
+    if (sizes_match) {
+      for (int i = 0; i < 4; ++i) {
+        fails += check(rows[i][0] == paths[i], "operations out of order");
+        fails += check(rows[i][1] == depths[i], "wrong operation depth");
+        fails += check(atoi(rows[i][2].c_str()) == comm_size, "operation missing on ranks");
+      }
+      //Each rank records 0.001 * (rank + 1) twice
+      const std::vector<std::string>& exchange = rows[2];
+      const double avg = 0.001 * (comm_size + 1);
+      fails += checkValue(exchange, 3, 2, "avg_count");
+      fails += checkValue(exchange, 4, 0.002, "min");
+      fails += checkValue(exchange, 5, 0.002 * comm_size, "max");
+      fails += checkValue(exchange, 6, avg, "avg");
+      fails += checkValue(exchange, 7, percentileTime(50), "p50");
+      fails += checkValue(exchange, 8, percentileTime(90), "p90");
+      fails += checkValue(exchange, 9, percentileTime(99), "p99");
+      fails += checkValue(exchange, 10, 0.002 * comm_size / avg, "imbalance");
+      const std::vector<std::string>& output = rows[3];
+      fails += checkValue(output, 4, 0.5, "min");
+      fails += checkValue(output, 5, 0.5, "max");
+      fails += checkValue(output, 10, 1, "imbalance");
+    }
+  }
+
+  int total_fails;
+  MPI_Reduce(&fails, &total_fails, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (!comm_rank && !total_fails)
+    printf("All tests passed\n");
+  MPI_Finalize();
+  return total_fails;
+}
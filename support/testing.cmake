@@ -8,3 +8,5 @@ endfunction(mpi_test)
 mpi_test(viewComm_1 1 ./ViewCommTests)
 mpi_test(viewComm_2 2 ./ViewCommTests)
 mpi_test(viewComm_4 4 ./ViewCommTests)
+mpi_test(timing_1 1 ./TimingTests)
+mpi_test(timing_4 4 ./TimingTests)
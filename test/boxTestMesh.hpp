@@ -0,0 +1,53 @@
+#ifndef BOX_TEST_MESH_H
+#define BOX_TEST_MESH_H
+
+#include <cstdio>
+#include <mpi.h>
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_build.hpp>
+#include <Omega_h_for.hpp>
+#include <Omega_h_array_ops.hpp>
+#include "pumipic_mesh.hpp"
+
+/* Box mesh, strip partition and picpart comparison helpers shared by the tests and
+   performance tests that build their mesh instead of reading test data
+*/
+
+//Unit square of n by n quads split into triangles, built on every rank
+inline Omega_h::Mesh buildBoxMesh(Omega_h::Library& lib, int n) {
+  return Omega_h::build_box(lib.self(), OMEGA_H_SIMPLEX, 1, 1, 0, n, n, 0);
+}
+
+//Owner of each element of a 2D mesh in nparts strips of equal width in x
+inline Omega_h::LOs stripOwners(Omega_h::Mesh& mesh, int nparts) {
+  const auto coords = mesh.coords();
+  const auto elm2verts = mesh.ask_elem_verts();
+  Omega_h::Write<Omega_h::LO> owner(mesh.nelems());
+  Omega_h::parallel_for(mesh.nelems(), OMEGA_H_LAMBDA(const Omega_h::LO& e) {
+    const Omega_h::Real x = (coords[elm2verts[e*3]*2] + coords[elm2verts[e*3+1]*2] +
+                             coords[elm2verts[e*3+2]*2]) / 3;
+    const int part = x * nparts;
+    owner[e] = part < nparts ? part : nparts - 1;
+  });
+  return Omega_h::LOs(owner);
+}
+
+//Sum over the picpart of the number of picparts holding each vertex
+inline Omega_h::Real vertexSharing(pumipic::Mesh& picparts) {
+  Omega_h::Write<Omega_h::Real> count = picparts.createCommArray(0, 1, 1.0);
+  picparts.reduceCommArray(0, pumipic::Mesh::SUM_OP, count);
+  return Omega_h::get_sum(Omega_h::Reals(count));
+}
+
+//Returns 1 and prints an error if value differs from expected
+inline int compare(const char* what, double value, double expected) {
+  if (value != expected) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    fprintf(stderr, "[ERROR] Rank %d %s is %f instead of %f\n", rank, what, value, expected);
+    return 1;
+  }
+  return 0;
+}
+
+#endif
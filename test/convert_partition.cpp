@@ -0,0 +1,24 @@
+#include <pumipic_library.hpp>
+#include <pumipic_input.hpp>
+
+/* Converts a .ptn or .cpn partition file to the binary partition format (.bptn)
+   that pumipic::Input reads with one read on the root rank
+*/
+int main(int argc, char** argv) {
+  pumipic::Library pic_lib(&argc, &argv);
+  Omega_h::Library& lib = pic_lib.omega_h_lib();
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (argc != 3) {
+    if (!rank)
+      fprintf(stderr, "Usage: %s <.ptn or .cpn partition> <.bptn output>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (rank == 0) {
+    pumipic::Input::Ownership rule;
+    Omega_h::LOs partition = pumipic::Input::readPartition(argv[1], lib.self(), rule);
+    pumipic::Input::writeBinaryPartition(argv[2], rule, partition);
+    printf("Wrote %d owners of %s to %s\n", partition.size(), argv[1], argv[2]);
+  }
+  return EXIT_SUCCESS;
+}
@@ -4,8 +4,8 @@
 #include "pumipic_mesh.hpp"
 #include "pumipic_ptcl_ops.hpp"
 #include "pumipic_profiling.hpp"
+#include "pumipic_gyro.hpp"
 #include "pseudoXGCmTypes.hpp"
-#include "gyroScatter.hpp"
 #include <fstream>
 #include "ellipticalPush.hpp"
 #include <random>
@@ -13,6 +13,12 @@
 #define ELEMENT_SEED 1024*1024
 #define PARTICLE_SEED 512*512
 
+//Every particle uses the same gyroradius between the first and second ring
+struct ConstantGyroRadius {
+  o::Real radius;
+  OMEGA_H_INLINE o::Real operator()(const int&) const { return radius; }
+};
+
 void getMemImbalance(int hasptcls) {
 #ifdef PP_USE_CUDA
   int comm_rank, comm_size;
@@ -146,13 +152,37 @@ void search(p::Mesh& picparts, PS* ptcls, p::Distributor<>& dist, bool output) {
   o::Mesh* mesh = picparts.mesh();
   assert(ptcls->nElems() == mesh->nelems());
   Omega_h::LO maxLoops = 200;
-  const auto psCapacity = ptcls->capacity();
-  o::Write<o::LO> elem_ids(psCapacity,-1);
-  auto x = ptcls->get<0>();
-  auto xtgt = ptcls->get<1>();
-  auto pid = ptcls->get<2>();
-  bool isFound = p::search_mesh_2d(*mesh, ptcls, x, xtgt, pid, elem_ids, maxLoops);
-  assert(isFound);
+  //stop walks at the safe zone boundary and let the element owners finish them
+  auto safe = picparts.safeTag();
+  o::Write<o::LO> elem_ids;
+  int rounds = 0;
+  while(true) {
+    const auto psCapacity = ptcls->capacity();
+    elem_ids = o::Write<o::LO>(psCapacity,-1);
+    auto x = ptcls->get<0>();
+    auto xtgt = ptcls->get<1>();
+    auto pid = ptcls->get<2>();
+    bool isFound = p::search_mesh_2d(*mesh, ptcls, x, xtgt, pid, elem_ids, maxLoops,
+                                     o::Write<o::LO>(), o::Write<o::Real>(),
+                                     p::NoWallInteraction(), safe);
+    assert(isFound);
+    ++rounds;
+    if(!p::countUnsafePtcls(picparts, ptcls, o::LOs(elem_ids)))
+      break;
+    //particles that reached their destination start the next round there
+    auto elems = o::LOs(elem_ids);
+    auto finishPtcls = PS_LAMBDA(const int& e, const int& ptcl, const int& mask) {
+      const auto elm = elems[ptcl];
+      if(mask > 0 && elm != -1 && safe[elm]) {
+        for(int i=0; i<3; i++)
+          x(ptcl,i) = xtgt(ptcl,i);
+      }
+    };
+    ps::parallel_for(ptcls, finishPtcls, "finishPtcls");
+    p::migrate_ptcls(picparts, ptcls, elems);
+  }
+  if(!comm_rank)
+    fprintf(stderr, "search rounds %d\n", rounds);
   //rebuild the PS to set the new element-to-particle lists
   rebuild(picparts, ptcls, dist, elem_ids, output);
 }
@@ -388,6 +418,8 @@ int main(int argc, char** argv) {
   p::Mesh picparts(input);
   o::Mesh* mesh = picparts.mesh();
   mesh->ask_elem_verts(); //caching adjacency info
+  //Only run the particle balancer when the particles are out of balance
+  picparts.ptclBalancer()->setLazyBalancing(true);
 
   int nBuffers = picparts.numBuffers(picparts.dim());
   int* buffered_ranks = new int[nBuffers];
@@ -403,11 +435,12 @@ int main(int argc, char** argv) {
   const auto numRings = 3;
   const auto ptsPerRing = 8;
   const auto theta = 0.0;
-  setGyroConfig(rmax,numRings,ptsPerRing,theta);
-  if (!comm_rank) printGyroConfig();
-  Omega_h::LOs forward_map;
-  Omega_h::LOs backward_map;
-  createGyroRingMappings(mesh, forward_map, backward_map);
+  p::GyroConfig gyroConfig = {rmax, numRings, ptsPerRing, theta};
+  if (!comm_rank)
+    fprintf(stderr, "gyro rmax num_rings points_per_ring theta %f %d %d %f\n",
+            rmax, numRings, ptsPerRing, theta);
+  p::GyroAverager gyro(picparts, gyroConfig);
+  const ConstantGyroRadius gyroRadius = {rmax / numRings * 1.125};
 
   /* Particle data */
   const long int numPtcls = atol(argv[3]);
@@ -482,12 +515,8 @@ int main(int argc, char** argv) {
     o::LOs elmTags(ne, -1, "elmTagVals");
     mesh->add_tag(o::FACE, "has_particles", 1, elmTags);
     mesh->add_tag(o::VERT, "avg_density", 1, o::Reals(mesh->nverts(), 0));
-    const auto fwdTagName = "ptclToMeshScatterFwd";
-    mesh->add_tag(o::VERT, fwdTagName, 1, o::Reals(mesh->nverts(), 0));
-    const auto bkwdTagName = "ptclToMeshScatterBkwd";
-    mesh->add_tag(o::VERT, bkwdTagName, 1, o::Reals(mesh->nverts(), 0));
-    const auto syncTagName = "ptclToMeshSync";
-    mesh->add_tag(o::VERT, syncTagName, 2, o::Reals(mesh->nverts()*2, 0));
+    const auto scatterTagName = "ptclToMeshScatter";
+    mesh->add_tag(o::VERT, scatterTagName, 1, o::Reals(mesh->nverts(), 0));
     tagParentElements(picparts, ptcls, 0);
 
     const auto enable_prebarrier = atoi(argv[9]);
@@ -502,6 +531,10 @@ int main(int argc, char** argv) {
     int iter;
     long int totNp;
     long int ps_np;
+    //The gyro scatter reduction of an iteration is in flight during the next push
+    o::Write<o::Real> scattered;
+    double overlapTime = 0;
+    double reduceEndTime = 0;
     for(iter=1; iter<=maxIter; iter++) {
       if(!comm_rank || (comm_rank == comm_size/2))
         ptcls->printMetrics();
@@ -517,6 +550,15 @@ int main(int argc, char** argv) {
       getPtclImbalance(ps_np);
       timer.reset();
       ellipticalPush::push(ptcls, *mesh, degPerPush, iter);
+      if (scattered.exists()) {
+        Kokkos::fence();
+        overlapTime += timer.seconds();
+        timer.reset();
+        gyro.scatter_end(scattered);
+        reduceEndTime += timer.seconds();
+        mesh->set_tag(o::VERT, scatterTagName, o::Reals(scattered));
+        scattered = o::Write<o::Real>();
+      }
       MPI_Barrier(MPI_COMM_WORLD);
       timer.reset();
       search(picparts,ptcls, dist, output);
@@ -529,18 +571,34 @@ int main(int argc, char** argv) {
       tagParentElements(picparts,ptcls,iter);
       if(output && !(iter%100))
         render(picparts,iter, comm_rank);
-      gyroScatter(mesh,ptcls,forward_map,fwdTagName);
-      gyroScatter(mesh,ptcls,backward_map,bkwdTagName);
-      gyroSync(picparts,fwdTagName,bkwdTagName,syncTagName);
+      scattered = gyro.scatter_begin(ptcls, ptcls->get<0>(), gyroRadius);
+    }
+    if (scattered.exists()) {
+      timer.reset();
+      gyro.scatter_end(scattered);
+      reduceEndTime += timer.seconds();
+      mesh->set_tag(o::VERT, scatterTagName, o::Reals(scattered));
     }
     if (comm_rank == 0)
       fprintf(stderr, "%d iterations of pseudopush (seconds) %f\n", iter, fullTimer.seconds());
+    double maxOverlap, maxReduceEnd;
+    MPI_Reduce(&overlapTime, &maxOverlap, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&reduceEndTime, &maxReduceEnd, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (comm_rank == 0)
+      fprintf(stderr, "gyro reduction overlapped with push (seconds) %f, "
+              "remaining in scatter_end %f\n", maxOverlap, maxReduceEnd);
+    p::ParticleBalancer* balancer = picparts.ptclBalancer();
+    if (comm_rank == 0)
+      fprintf(stderr, "particle balancer ran %d of %d repartitions, skipped %d, "
+              "reused %d plans\n", balancer->numBalances(), balancer->numRepartitions(),
+              balancer->numSkippedBalances(), balancer->numReusedPlans());
 
     //cleanup
     delete ptcls;
 
   }
   pumipic::SummarizeTime();
+  pumipic::SummarizeTimeAcrossProcesses();
   if (!comm_rank)
     fprintf(stderr, "done\n");
   return 0;
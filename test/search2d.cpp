@@ -5,6 +5,7 @@
 #include <Kokkos_Core.hpp>
 #include "pumipic_mesh.hpp"
 #include <fstream>
+#include <type_traits>
 
 using particle_structs::lid_t;
 using particle_structs::SellCSigma;
@@ -87,7 +88,28 @@ void rebuild(p::Mesh& picparts, PS* ptcls, o::LOs elem_ids, const bool output) {
   }
 }
 
-void search(p::Mesh& picparts, PS* ptcls, bool output=false) {
+//specular reflection off the exposed edges of the mesh
+struct SpecularReflection {
+  o::LOs edge_verts;
+  o::Reals coords;
+  SpecularReflection(o::Mesh* mesh) :
+    edge_verts(mesh->ask_verts_of(o::EDGE)), coords(mesh->coords()) {}
+  OMEGA_H_INLINE bool operator()(const int, const o::LO edge,
+      const o::Vector<2>& xpoint, o::Vector<2>& dest) const {
+    const auto ev = o::gather_verts<2>(edge_verts, edge);
+    const auto ec = o::gather_vectors<2,2>(coords, ev);
+    const auto tangent = o::normalize(ec[1] - ec[0]);
+    const auto disp = dest - xpoint;
+    dest = xpoint + 2 * (disp * tangent) * tangent - disp;
+    return true;
+  }
+};
+
+template <class WallFunc = p::NoWallInteraction>
+void search(p::Mesh& picparts, PS* ptcls, bool output=false,
+    o::Write<o::LO> xedge_id = o::Write<o::LO>(),
+    o::Write<o::Real> xpoints = o::Write<o::Real>(),
+    WallFunc wallHit = WallFunc()) {
   o::Mesh* mesh = picparts.mesh();
   assert(ptcls->nElems() == mesh->nelems());
   Omega_h::LO maxLoops = 100;
@@ -97,8 +119,18 @@ void search(p::Mesh& picparts, PS* ptcls, bool output=false) {
   auto x = ptcls->get<0>();
   auto xtgt = ptcls->get<1>();
   auto pid = ptcls->get<2>();
-  o::Write<o::LO> xface_id(psCapacity, "intersection faces");
-  bool isFound = p::search_mesh_2d(*mesh, ptcls, x, xtgt, pid, elem_ids, maxLoops);
+  o::Write<o::LO> elem_ids_fp32(psCapacity,-1);
+  const bool checkFP32 = std::is_same<WallFunc, p::NoWallInteraction>::value;
+  if(checkFP32) {
+    const auto geom = p::buildElmGeometryFP32(*mesh);
+    p::search_mesh_2d(*mesh, ptcls, x, xtgt, pid, elem_ids_fp32, maxLoops,
+                      o::Write<o::LO>(), o::Write<o::Real>(),
+                      p::NoWallInteraction(), o::LOs(), geom);
+  }
+  bool isFound = p::search_mesh_2d(*mesh, ptcls, x, xtgt, pid, elem_ids, maxLoops,
+                                   xedge_id, xpoints, wallHit);
+  //the single precision walk must find exactly the same elements
+  assert(!checkFP32 || o::LOs(elem_ids) == o::LOs(elem_ids_fp32));
   fprintf(stderr, "search_mesh (seconds) %f\n", timer.seconds());
   assert(isFound);
   //rebuild the PS to set the new element-to-particle lists
@@ -122,9 +154,11 @@ o::Mesh readMesh(const char* meshFile, o::Library& lib) {
   }
 }
 
+template <class WallFunc = p::NoWallInteraction>
 void particleSearch(p::Mesh& picparts,
     const int parentElm, const double* start, const double* end,
-    const int destElm, const int altDestElm=-1) {
+    const int destElm, const int altDestElm=-1, const double* exitPt=NULL,
+    WallFunc wallHit = WallFunc()) {
   o::Mesh* mesh = picparts.mesh();
   Omega_h::GOs mesh_element_gids = picparts.globalIds(picparts.dim());
 
@@ -167,7 +201,29 @@ void particleSearch(p::Mesh& picparts,
   };
   ps::parallel_for(ptcls, lamb);
   setPtclIds(ptcls);
-  search(picparts,ptcls);
+  const auto psCapacity = ptcls->capacity();
+  o::Write<o::LO> xedge_id(psCapacity, -1, "exit edges");
+  o::Write<o::Real> xpoints(2*psCapacity, 0, "exit points");
+  search(picparts,ptcls,false,xedge_id,xpoints,wallHit);
+  if(exitPt) {
+    //the particle left the domain, check where
+    const auto side_is_exposed = o::mark_exposed_sides(mesh);
+    o::HostRead<o::I8> exposed_h(side_is_exposed);
+    o::HostRead<o::LO> xedge_h(xedge_id);
+    o::HostRead<o::Real> xpoints_h(xpoints);
+    printf("exit edge %d point %f %f\n", xedge_h[0], xpoints_h[0], xpoints_h[1]);
+    assert(xedge_h[0] >= 0 && exposed_h[xedge_h[0]]);
+    assert(fabs(xpoints_h[0] - exitPt[0]) < 1e-12);
+    assert(fabs(xpoints_h[1] - exitPt[1]) < 1e-12);
+    //the exit point lies on the reported edge
+    o::HostRead<o::LO> edge_verts_h(mesh->ask_verts_of(o::EDGE));
+    o::HostRead<o::Real> coords_h(mesh->coords());
+    const o::Real* ea = &coords_h[2*edge_verts_h[2*xedge_h[0]]];
+    const o::Real* eb = &coords_h[2*edge_verts_h[2*xedge_h[0]+1]];
+    const o::Real cross = (eb[0] - ea[0]) * (xpoints_h[1] - ea[1]) -
+                          (eb[1] - ea[1]) * (xpoints_h[0] - ea[0]);
+    assert(fabs(cross) < 1e-12);
+  }
   auto printPtclElm = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
     if(mask) {
       assert(e == destElm || e == altDestElm);
@@ -305,6 +361,31 @@ void testTri8(Omega_h::Library& lib, std::string meshDir) {
     const double end[2]  = {.20,.80};
     particleSearch(picparts,parentElm,start,end,destElm);
   }
+  printf("\n\n");
+  { printf("start within a triangle and leave through the top edge\n");
+    const auto parentElm = 5;
+    const double start[2] = {.60,.80};
+    const double end[2]  = {.60,1.20};
+    const double exitPt[2]  = {.60,1.0};
+    particleSearch(picparts,parentElm,start,end,-1,-1,exitPt);
+  }
+  printf("\n\n");
+  { printf("start within a triangle and leave through the top edge "
+      "towards a destination beyond the right edge\n");
+    const auto parentElm = 5;
+    const double start[2] = {.60,.80};
+    const double end[2]  = {1.50,1.30};
+    const double exitPt[2]  = {.96,1.0};
+    particleSearch(picparts,parentElm,start,end,-1,-1,exitPt);
+  }
+  printf("\n\n");
+  { printf("start within a triangle and reflect off the top edge\n");
+    const auto parentElm = 5;
+    const double start[2] = {.60,.80};
+    const double end[2]  = {.60,1.05};
+    particleSearch(picparts,parentElm,start,end,parentElm,-1,NULL,
+                   SpecularReflection(mesh));
+  }
 }
 
 void testItg24k(Omega_h::Library& lib, std::string meshDir) {
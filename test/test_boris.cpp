@@ -0,0 +1,126 @@
+#include <Kokkos_Core.hpp>
+#include <particle_structs.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_library.hpp"
+#include "pumipic_push.hpp"
+
+using particle_structs::SellCSigma;
+using particle_structs::MemberTypes;
+using pumipic::Vector3d;
+
+namespace o = Omega_h;
+namespace p = pumipic;
+namespace ps = particle_structs;
+
+//position, pushed position, velocity, electric field, magnetic field, species
+typedef MemberTypes<Vector3d, Vector3d, Vector3d, Vector3d, Vector3d, int> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+const double tol = 1e-12;
+
+//Particles alternate between the species, all start with velocity (1e4,2e4,3e4)
+void setPtcls(PS* ptcls, const double* E, const double* B) {
+  auto x = ptcls->get<0>();
+  auto v = ptcls->get<2>();
+  auto efield = ptcls->get<3>();
+  auto bfield = ptcls->get<4>();
+  auto species = ptcls->get<5>();
+  const double E0 = E[0], E1 = E[1], E2 = E[2];
+  const double B0 = B[0], B1 = B[1], B2 = B[2];
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      const double Ev[3] = {E0, E1, E2};
+      const double Bv[3] = {B0, B1, B2};
+      for(int i=0; i<3; i++) {
+        x(pid,i) = 0;
+        v(pid,i) = 1e4 * (i + 1);
+        efield(pid,i) = Ev[i];
+        bfield(pid,i) = Bv[i];
+      }
+      species(pid) = pid % 2;
+    }
+  };
+  ps::parallel_for(ptcls, lamb, "setPtcls");
+}
+
+//Checks the speed after a push against the expected speed
+int checkSpeed(PS* ptcls, o::Reals q_m, double dt, const double* E, bool magnetic) {
+  auto x = ptcls->get<0>();
+  auto xtgt = ptcls->get<1>();
+  auto v = ptcls->get<2>();
+  auto species = ptcls->get<5>();
+  const double E0 = E[0];
+  o::Write<o::LO> failures(1, 0);
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      double speed2 = 0;
+      double expected2 = 0;
+      bool ok = true;
+      for(int i=0; i<3; i++) {
+        double v0 = 1e4 * (i + 1);
+        //without a magnetic field E = (E0,0,0) accelerates along x only
+        if(!magnetic && i == 0)
+          v0 += q_m[species(pid)] * E0 * dt;
+        speed2 += v(pid,i) * v(pid,i);
+        expected2 += v0 * v0;
+        if(!magnetic)
+          ok = ok && fabs(v(pid,i) - v0) <= tol * fabs(v0);
+        ok = ok && fabs(xtgt(pid,i) - (x(pid,i) + v(pid,i) * dt)) <= tol * fabs(v(pid,i) * dt);
+      }
+      ok = ok && fabs(speed2 - expected2) <= tol * expected2;
+      if(!ok)
+        Kokkos::atomic_fetch_add(&(failures[0]), 1);
+    }
+  };
+  ps::parallel_for(ptcls, lamb, "checkSpeed");
+  return o::HostRead<o::LO>(failures)[0];
+}
+
+int main(int argc, char** argv) {
+  pumipic::Library pic_lib(&argc, &argv);
+  int comm_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  const int ne = 100;
+  const int ppe = 10;
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  Kokkos::parallel_for(ne, KOKKOS_LAMBDA(const int& i) {
+    ptcls_per_elem(i) = ppe;
+    element_gids(i) = i;
+  });
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new SellCSigma<Particle>(policy, INT_MAX, 1024, ne, ne * ppe,
+                                       ptcls_per_elem, element_gids);
+  //two species with opposite charges and different masses
+  std::vector<double> charge = {1, -1};
+  std::vector<double> amu = {1.007276, 4.002602};
+  const auto q_m = p::speciesChargeToMass(charge, amu);
+  const double dt = 1e-9;
+  int fails = 0;
+
+  //a magnetic field rotates the velocity without changing the speed
+  const double zero[3] = {0, 0, 0};
+  const double B[3] = {0.3, -1.2, 2};
+  setPtcls(ptcls, zero, B);
+  for(int i=0; i<100; i++)
+    p::pushBoris<0, 1, 2, 3, 4, 5>(ptcls, q_m, dt);
+  if(checkSpeed(ptcls, q_m, dt, zero, true)) {
+    fprintf(stderr, "pushBoris changed the speed in a magnetic field\n");
+    ++fails;
+  }
+
+  //an electric field alone accelerates by q/m E dt
+  const double E[3] = {1e3, 0, 0};
+  setPtcls(ptcls, E, zero);
+  p::pushBoris<0, 1, 2, 3, 4, 5>(ptcls, q_m, dt);
+  if(checkSpeed(ptcls, q_m, dt, E, false)) {
+    fprintf(stderr, "pushBoris acceleration in an electric field is wrong\n");
+    ++fails;
+  }
+  delete ptcls;
+  if(fails)
+    return EXIT_FAILURE;
+  if(!comm_rank)
+    printf("boris push tests passed\n");
+  return EXIT_SUCCESS;
+}
@@ -3,12 +3,107 @@
 #include <Omega_h_for.hpp>
 #include <Omega_h_file.hpp>
 #include <pumipic_mesh.hpp>
+#include <pumipic_comm_plan.hpp>
 #include <Kokkos_Core.hpp>
 
 
 bool minOwnership(pumipic::Mesh& picparts, int dim);
 bool sumEntities(pumipic::Mesh& picparts, int dim);
+bool repeatedSum(pumipic::Mesh& picparts, int dim);
+bool batchedReduction(pumipic::Mesh& picparts, int dim);
+bool nonBlockingSum(pumipic::Mesh& picparts, int dim);
+//Reductions reusing the cached comm plan give the same result every time
+bool repeatedSum(pumipic::Mesh& picparts, int dim) {
+  Omega_h::Write<Omega_h::Real> first = picparts.createCommArray(dim, 2, 1.0);
+  picparts.reduceCommArray(dim, pumipic::Mesh::SUM_OP, first);
+  Omega_h::Write<Omega_h::LO> fail(1, 0);
+  for (int iter = 0; iter < 3; ++iter) {
+    Omega_h::Write<Omega_h::Real> again = picparts.createCommArray(dim, 2, 1.0);
+    picparts.reduceCommArray(dim, pumipic::Mesh::SUM_OP, again);
+    auto checkSame = OMEGA_H_LAMBDA(Omega_h::LO id) {
+      if (again[id] != first[id])
+        fail[0] = 1;
+    };
+    Omega_h::parallel_for(again.size(), checkSame);
+  }
+  Omega_h::HostWrite<Omega_h::LO> fail_host(fail);
+  return !fail_host[0];
+}
+
+/* A reduction started with reduceCommArray_begin matches the blocking reduction when
+   other data is changed while it is in flight, and a second reduction of the same
+   dimension, values and type cannot begin before it ends
+*/
+bool nonBlockingSum(pumipic::Mesh& picparts, int dim) {
+  const double value = picparts.comm()->rank() + 1;
+  Omega_h::Write<Omega_h::Real> blocking = picparts.createCommArray(dim, 2, value);
+  picparts.reduceCommArray(dim, pumipic::Mesh::SUM_OP, blocking);
+
+  Omega_h::Write<Omega_h::Real> async = picparts.createCommArray(dim, 2, value);
+  Omega_h::Write<Omega_h::Real> other = picparts.createCommArray(dim, 2, value);
+  picparts.reduceCommArray_begin(dim, pumipic::Mesh::SUM_OP, async);
+  auto changeOther = OMEGA_H_LAMBDA(Omega_h::LO id) {
+    other[id] = -1;
+  };
+  Omega_h::parallel_for(other.size(), changeOther);
+  bool rejected = false;
+  try {
+    picparts.reduceCommArray_begin(dim, pumipic::Mesh::SUM_OP, other);
+  }
+  catch (int) {
+    rejected = true;
+  }
+  picparts.reduceCommArray_end(dim, pumipic::Mesh::SUM_OP, async);
+
+  Omega_h::Write<Omega_h::LO> fail(1, 0);
+  auto checkSums = OMEGA_H_LAMBDA(Omega_h::LO id) {
+    if (async[id] != blocking[id] || other[id] != -1)
+      fail[0] = 1;
+  };
+  Omega_h::parallel_for(async.size(), checkSums);
+  Omega_h::HostWrite<Omega_h::LO> fail_host(fail);
+  if (!rejected && picparts.comm()->size() > 1) {
+    fprintf(stderr, "[ERROR] Second reduction of dimension %d began while one was in flight\n",
+            dim);
+    return false;
+  }
+  return !fail_host[0];
+}
+
+//Reducing several arrays together matches reducing them one at a time
+bool batchedReduction(pumipic::Mesh& picparts, int dim) {
+  typedef pumipic::Mesh PM;
+  const double rank = picparts.comm()->rank();
+  const PM::Op ops[4] = {PM::SUM_OP, PM::MAX_OP, PM::MIN_OP, PM::BCAST_OP};
+  const int nvals[4] = {1, 2, 1, 3};
+  std::vector<PM::Op> op_list;
+  std::vector<Omega_h::Write<Omega_h::Real> > batched;
+  std::vector<Omega_h::Write<Omega_h::Real> > sequential;
+  for (int i = 0; i < 4; ++i) {
+    const double value = (ops[i] == PM::SUM_OP) ? 1.0 : rank;
+    op_list.push_back(ops[i]);
+    batched.push_back(picparts.createCommArray(dim, nvals[i], value));
+    sequential.push_back(picparts.createCommArray(dim, nvals[i], value));
+    picparts.reduceCommArray(dim, ops[i], sequential[i]);
+  }
+  picparts.reduceCommArrays(dim, op_list, batched);
+  Omega_h::Write<Omega_h::LO> fail(1, 0);
+  for (int i = 0; i < 4; ++i) {
+    Omega_h::Write<Omega_h::Real> b = batched[i];
+    Omega_h::Write<Omega_h::Real> s = sequential[i];
+    auto checkSame = OMEGA_H_LAMBDA(Omega_h::LO id) {
+      if (b[id] != s[id])
+        fail[0] = 1;
+    };
+    Omega_h::parallel_for(b.size(), checkSame);
+  }
+  Omega_h::HostWrite<Omega_h::LO> fail_host(fail);
+  return !fail_host[0];
+}
+
 bool fullBufferTest(Omega_h::Mesh& mesh, Omega_h::Write<Omega_h::LO> owner, int dim);
+bool sparseFullBufferTest(Omega_h::Mesh& mesh, Omega_h::Write<Omega_h::LO> owner, int dim,
+                          bool force_scatter);
 
 int main(int argc, char** argv) {
   pumipic::Library pic_lib(&argc, &argv);
@@ -48,6 +143,11 @@ int main(int argc, char** argv) {
   for (int i = 0; i <= mesh.dim(); ++i) {
     if (!fullBufferTest(mesh, owner, i))
       printf("fullBufferTest on dimension %d failed on rank %d\n", i, rank);
+    if (!sparseFullBufferTest(mesh, owner, i, false))
+      printf("sparseFullBufferTest on dimension %d failed on rank %d\n", i, rank);
+    if (!sparseFullBufferTest(mesh, owner, i, true))
+      printf("sparseFullBufferTest with forced scatter on dimension %d failed on rank %d\n",
+             i, rank);
   }
   MPI_Barrier(MPI_COMM_WORLD);
 
@@ -69,6 +169,31 @@ int main(int argc, char** argv) {
 
   MPI_Barrier(MPI_COMM_WORLD);
 
+  for (int i = 0; i <= picparts.dim(); ++i) {
+    if (!repeatedSum(picparts, i))
+      printf("repeatedSum on dimension %d failed on rank %d\n", i, rank);
+    if (!batchedReduction(picparts, i))
+      printf("batchedReduction on dimension %d failed on rank %d\n", i, rank);
+    if (!nonBlockingSum(picparts, i))
+      printf("nonBlockingSum on dimension %d failed on rank %d\n", i, rank);
+  }
+
+  MPI_Barrier(MPI_COMM_WORLD);
+
+  //Repeat the reductions with the other comm mode
+  picparts.setDeviceDirectComm(!picparts.deviceDirectComm());
+  for (int i = 0; i <= picparts.dim(); ++i) {
+    if (!repeatedSum(picparts, i))
+      printf("repeatedSum with device direct comm %d on dimension %d failed on rank %d\n",
+             picparts.deviceDirectComm(), i, rank);
+    if (!batchedReduction(picparts, i))
+      printf("batchedReduction with device direct comm %d on dimension %d failed on rank %d\n",
+             picparts.deviceDirectComm(), i, rank);
+  }
+  picparts.setDeviceDirectComm(!picparts.deviceDirectComm());
+
+  MPI_Barrier(MPI_COMM_WORLD);
+
   Omega_h::Write<Omega_h::Real> max_comm = picparts.createCommArray(0, 1, 0.0);
   auto setLIDVtx = OMEGA_H_LAMBDA(Omega_h::LO vtx_id) {
     max_comm[vtx_id] = vtx_id;
@@ -202,3 +327,47 @@ bool fullBufferTest(Omega_h::Mesh& mesh, Omega_h::Write<Omega_h::LO> owner, int
 
   return true;
 }
+
+/* Sparse full mesh reductions are correct on the entities bounding the safe zone
+   force_scatter uses MPI_Reduce_scatter and the sparse broadcast whatever the cost model picks
+*/
+bool sparseFullBufferTest(Omega_h::Mesh& mesh, Omega_h::Write<Omega_h::LO> owner, int dim,
+                          bool force_scatter) {
+  pumipic::Input input(mesh, pumipic::Input::PARTITION, owner, pumipic::Input::FULL,
+                       pumipic::Input::BFS);
+  pumipic::Mesh picparts(input);
+  picparts.setSparseFullMeshReduction(true, force_scatter);
+
+  Omega_h::Write<Omega_h::LO> comm_arr = picparts.createCommArray(dim, 2, 1);
+  picparts.reduceCommArray(dim, pumipic::Mesh::SUM_OP, comm_arr);
+
+  int comm_size;
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+  if (force_scatter && comm_size > 1 &&
+      !picparts.fullMeshPlan<Omega_h::LO>(dim, 2)->scatter()) {
+    fprintf(stderr, "[ERROR] Forced sparse full mesh plan of dimension %d does not scatter\n",
+            dim);
+    return false;
+  }
+  Omega_h::Mesh* m = picparts.mesh();
+  const int mdim = m->dim();
+  auto safe = picparts.safeTag();
+  Omega_h::LOs elm2ents;
+  if (dim < mdim)
+    elm2ents = m->ask_down(mdim, dim).ab2b;
+  const int deg = dim < mdim ? elm2ents.size() / m->nelems() : 1;
+  Omega_h::Write<Omega_h::LO> fail(1, 0);
+  auto checkSafeEnts = OMEGA_H_LAMBDA(const Omega_h::LO& elm) {
+    if (!safe[elm])
+      return;
+    for (int i = 0; i < deg; ++i) {
+      const Omega_h::LO id = dim < mdim ? elm2ents[elm * deg + i] : elm;
+      if (comm_arr[id*2] != comm_size || comm_arr[id*2+1] != comm_size)
+        fail[0] = 1;
+    }
+  };
+  Omega_h::parallel_for(m->nelems(), checkSafeEnts);
+
+  Omega_h::HostWrite<Omega_h::LO> fail_host(fail);
+  return !fail_host[0];
+}
@@ -0,0 +1,137 @@
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_build.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_deposit.hpp"
+#include <particle_structs.hpp>
+#include <Kokkos_Core.hpp>
+#include "pumipic_mesh.hpp"
+
+using particle_structs::SellCSigma;
+using particle_structs::MemberTypes;
+using pumipic::Vector3d;
+
+namespace o = Omega_h;
+namespace p = pumipic;
+namespace ps = particle_structs;
+
+//position, charge
+typedef MemberTypes<Vector3d, double> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+const int ptclsPerElm = 3;
+const double tol = 1e-10;
+
+//Places particles at the element centroid or, when centroid is false, at the
+//point with barycentric weights (1+k, 2, ..., 2)/sum where k = pid % ptclsPerElm
+void setPtcls(o::Mesh& mesh, PS* ptcls, bool centroid) {
+  const int dim = mesh.dim();
+  const auto elm2verts = mesh.ask_elem_verts();
+  const auto coords = mesh.coords();
+  auto x_ps_d = ptcls->get<0>();
+  auto q_ps_d = ptcls->get<1>();
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      const int k = pid % ptclsPerElm;
+      double wsum = 0;
+      double c[3] = {0, 0, 0};
+      for(int v=0; v<dim+1; v++) {
+        const double w = centroid ? 1 : ((v == 0) ? 1 + k : 2);
+        wsum += w;
+        for(int j=0; j<dim; j++)
+          c[j] += w * coords[elm2verts[e*(dim+1)+v]*dim+j];
+      }
+      for(int j=0; j<3; j++)
+        x_ps_d(pid,j) = c[j] / wsum;
+      q_ps_d(pid) = 1 + pid % 3;
+    }
+  };
+  ps::parallel_for(ptcls, lamb, "setPtcls");
+}
+
+struct PtclCharge {
+  p::Segment<double, p::device_type> q;
+  OMEGA_H_INLINE o::Real operator()(const int pid) const {return q(pid);}
+};
+
+double totalCharge(PS* ptcls) {
+  auto q_ps_d = ptcls->get<1>();
+  o::Write<o::Real> q(ptcls->capacity(), 0);
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0)
+      q[pid] = q_ps_d(pid);
+  };
+  ps::parallel_for(ptcls, lamb, "totalCharge");
+  return o::get_sum(o::Reals(q));
+}
+
+double maxDiff(o::Reals a, o::Reals b) {
+  o::Write<o::Real> diff(a.size());
+  o::parallel_for(a.size(), OMEGA_H_LAMBDA(const int& i) {
+    diff[i] = fabs(a[i] - b[i]);
+  });
+  return o::get_max(o::Reals(diff));
+}
+
+int testDeposit(o::Library& lib, int dim) {
+  auto full_mesh = o::build_box(lib.world(), OMEGA_H_SIMPLEX, 1, 1, (dim == 3),
+                                4, 4, (dim == 3) ? 4 : 0);
+  o::Write<o::LO> owner(full_mesh.nelems(), 0);
+  p::Mesh picparts(full_mesh, owner);
+  o::Mesh* mesh = picparts.mesh();
+  const o::LO ne = mesh->nelems();
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  o::GOs mesh_element_gids = picparts.globalIds(picparts.dim());
+  o::parallel_for(ne, OMEGA_H_LAMBDA(const int& i) {
+    ptcls_per_elem(i) = ptclsPerElm;
+    element_gids(i) = mesh_element_gids[i];
+  });
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new SellCSigma<Particle>(policy, INT_MAX, 1024, ne, ne * ptclsPerElm,
+                                       ptcls_per_elem, element_gids);
+  int fails = 0;
+
+  //unit charges at the centroids give each vertex ptclsPerElm/(dim+1) per element
+  setPtcls(*mesh, ptcls, true);
+  const auto v2e = mesh->ask_up(0, dim).a2ab;
+  o::Write<o::Real> expected(mesh->nverts());
+  o::parallel_for(mesh->nverts(), OMEGA_H_LAMBDA(const int& v) {
+    expected[v] = (v2e[v+1] - v2e[v]) * ptclsPerElm / (dim + 1.0);
+  });
+  auto x = ptcls->get<0>();
+  auto field = p::deposit_to_vertices(picparts, ptcls, x);
+  const double diff = maxDiff(o::Reals(field), o::Reals(expected));
+  if(diff > tol) {
+    fprintf(stderr, "dim %d centroid deposit is off by %e\n", dim, diff);
+    ++fails;
+  }
+
+  //off center particles with varying charge, the total charge is conserved
+  setPtcls(*mesh, ptcls, false);
+  PtclCharge charge;
+  charge.q = ptcls->get<1>();
+  auto charged = p::deposit_to_vertices(picparts, ptcls, x, charge);
+  const double total = totalCharge(ptcls);
+  const double deposited = o::get_sum(o::Reals(charged));
+  if(fabs(total - deposited) > tol * total) {
+    fprintf(stderr, "dim %d deposited charge %f does not match %f\n", dim, deposited, total);
+    ++fails;
+  }
+  delete ptcls;
+  return fails;
+}
+
+int main(int argc, char** argv) {
+  pumipic::Library pic_lib(&argc, &argv);
+  Omega_h::Library& lib = pic_lib.omega_h_lib();
+  int comm_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  int fails = 0;
+  for(int dim=2; dim<=3; dim++)
+    fails += testDeposit(lib, dim);
+  if(fails)
+    return EXIT_FAILURE;
+  if(!comm_rank)
+    printf("deposit tests passed\n");
+  return EXIT_SUCCESS;
+}
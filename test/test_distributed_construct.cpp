@@ -0,0 +1,71 @@
+#include <Kokkos_Core.hpp>
+#include "pumipic_library.hpp"
+#include "pumipic_mesh.hpp"
+#include "boxTestMesh.hpp"
+
+/* Picparts built from the core regions of a distributed mesh match the picparts
+   built from the full mesh with the same partition. The core regions are the
+   picparts of the full mesh without buffer layers.
+*/
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+const int meshSize = 12;
+
+//Number of entities of dimension dim owned by this rank
+int countOwned(p::Mesh& picparts, int dim) {
+  const int rank = picparts.comm()->rank();
+  o::LOs owners = picparts.entOwners(dim);
+  int owned = 0;
+  Kokkos::parallel_reduce(owners.size(), KOKKOS_LAMBDA(const int& i, int& sum) {
+    sum += owners[i] == rank;
+  }, owned);
+  return owned;
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  const int rank = lib.world()->rank();
+  const int comm_size = lib.world()->size();
+  auto full_mesh = buildBoxMesh(lib, meshSize);
+  const auto coords = full_mesh.coords();
+  const auto elm2verts = full_mesh.ask_elem_verts();
+  o::Write<o::LO> owner(full_mesh.nelems());
+  //Columns of rank strips split in half by y to give each part up to 6 neighbors
+  const int ncols = (comm_size + 1) / 2;
+  o::parallel_for(full_mesh.nelems(), OMEGA_H_LAMBDA(const o::LO& e) {
+    o::Real c[2] = {0, 0};
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 2; ++j)
+        c[j] += coords[elm2verts[e*3+i]*2+j] / 3;
+    int col = c[0] * ncols;
+    col = col < ncols ? col : ncols - 1;
+    const int part = col * 2 + (c[1] >= 0.5);
+    owner[e] = part < comm_size ? part : comm_size - 1;
+  });
+
+  p::Mesh full_picparts(full_mesh, owner, 2, 1);
+  p::Mesh core_parts(full_mesh, owner, 0, 0);
+  o::Mesh* core = core_parts.mesh();
+  core->add_tag(0, "global", 1, core_parts.globalIds(0));
+  p::Mesh picparts(*core, lib.world(), 2, 1);
+
+  int fails = 0;
+  const int dim = picparts.dim();
+  for (int d = 0; d <= dim; ++d)
+    fails += compare("entities", picparts.nents(d), full_picparts.nents(d));
+  fails += compare("buffered parts", picparts.numBuffers(dim), full_picparts.numBuffers(dim));
+  fails += compare("safe elements", o::get_sum(picparts.safeTag()),
+                   o::get_sum(full_picparts.safeTag()));
+  for (int d = 0; d <= dim; ++d)
+    fails += compare("owned entities", countOwned(picparts, d), countOwned(full_picparts, d));
+  fails += compare("vertex sharing", vertexSharing(picparts), vertexSharing(full_picparts));
+
+  int total_fails;
+  MPI_Reduce(&fails, &total_fails, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (!rank && !total_fails)
+    printf("All tests passed\n");
+  return total_fails;
+}
@@ -0,0 +1,179 @@
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_build.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_adjacency.hpp"
+#include "pumipic_gather.hpp"
+#include <particle_structs.hpp>
+#include <Kokkos_Core.hpp>
+#include "pumipic_mesh.hpp"
+#include "pumipic_ptcl_ops.hpp"
+
+using particle_structs::SellCSigma;
+using particle_structs::MemberTypes;
+using pumipic::Vector3d;
+using pumipic::Vector4d;
+
+namespace o = Omega_h;
+namespace p = pumipic;
+namespace ps = particle_structs;
+
+//current position, target position, particle id, vertex weights, vector field,
+//scalar field
+typedef MemberTypes<Vector3d, Vector3d, int, Vector4d, Vector3d, double> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+const int ptclsPerElm = 3;
+const double tol = 1e-10;
+
+//Linear fields are interpolated exactly
+OMEGA_H_INLINE double linearField(const double* x, const int comp) {
+  return (comp + 1) * x[0] + 2 * x[1] - x[2] + comp;
+}
+
+//Particles start at the element centroid and move to the point with
+//barycentric weights (1+k, 2, ..., 2)/sum of element e+k, where
+//k = pid % ptclsPerElm
+void setPtcls(o::Mesh& mesh, PS* ptcls) {
+  const int dim = mesh.dim();
+  const o::LO ne = mesh.nelems();
+  const auto elm2verts = mesh.ask_elem_verts();
+  const auto coords = mesh.coords();
+  auto x_ps_d = ptcls->get<0>();
+  auto xtgt_ps_d = ptcls->get<1>();
+  auto pid_d = ptcls->get<2>();
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      const int k = pid % ptclsPerElm;
+      const int tgt = (e + k) % ne;
+      double c[3] = {0, 0, 0};
+      double t[3] = {0, 0, 0};
+      double wsum = 0;
+      for(int v=0; v<dim+1; v++) {
+        const double w = (v == 0) ? 1 + k : 2;
+        wsum += w;
+        for(int j=0; j<dim; j++) {
+          c[j] += coords[elm2verts[e*(dim+1)+v]*dim+j] / (dim + 1);
+          t[j] += w * coords[elm2verts[tgt*(dim+1)+v]*dim+j];
+        }
+      }
+      for(int j=0; j<3; j++) {
+        x_ps_d(pid,j) = c[j];
+        xtgt_ps_d(pid,j) = t[j] / wsum;
+      }
+      pid_d(pid) = pid;
+    }
+  };
+  ps::parallel_for(ptcls, lamb, "setPtcls");
+}
+
+int checkFields(o::Mesh& mesh, PS* ptcls, const char* label) {
+  auto xtgt_ps_d = ptcls->get<1>();
+  auto vec_ps_d = ptcls->get<4>();
+  auto scalar_ps_d = ptcls->get<5>();
+  o::Write<o::LO> failures(1, 0);
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      double x[3];
+      for(int j=0; j<3; j++)
+        x[j] = xtgt_ps_d(pid,j);
+      bool ok = fabs(scalar_ps_d(pid) - linearField(x, 0)) < tol;
+      for(int c=0; c<3; c++)
+        ok = ok && fabs(vec_ps_d(pid,c) - linearField(x, c)) < tol;
+      if(!ok)
+        Kokkos::atomic_fetch_add(&(failures[0]), 1);
+    }
+  };
+  ps::parallel_for(ptcls, lamb, "checkFields");
+  const int fails = o::HostRead<o::LO>(failures)[0];
+  if(fails)
+    fprintf(stderr, "%s gather was wrong for %d particles\n", label, fails);
+  return fails;
+}
+
+int testGather(o::Library& lib, int dim) {
+  auto full_mesh = o::build_box(lib.world(), OMEGA_H_SIMPLEX, 1, 1, (dim == 3),
+                                4, 4, (dim == 3) ? 4 : 0);
+  o::Write<o::LO> owner(full_mesh.nelems(), 0);
+  p::Mesh picparts(full_mesh, owner);
+  o::Mesh* mesh = picparts.mesh();
+  const o::LO ne = mesh->nelems();
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  o::GOs mesh_element_gids = picparts.globalIds(picparts.dim());
+  o::parallel_for(ne, OMEGA_H_LAMBDA(const int& i) {
+    ptcls_per_elem(i) = ptclsPerElm;
+    element_gids(i) = mesh_element_gids[i];
+  });
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new SellCSigma<Particle>(policy, INT_MAX, 1024, ne, ne * ptclsPerElm,
+                                       ptcls_per_elem, element_gids);
+  setPtcls(*mesh, ptcls);
+
+  //vertex fields
+  const auto coords = mesh->coords();
+  o::Write<o::Real> vecField(mesh->nverts() * 3);
+  o::Write<o::Real> scalarField(mesh->nverts());
+  o::parallel_for(mesh->nverts(), OMEGA_H_LAMBDA(const int& v) {
+    double x[3] = {0, 0, 0};
+    for(int j=0; j<dim; j++)
+      x[j] = coords[v*dim+j];
+    for(int c=0; c<3; c++)
+      vecField[v*3+c] = linearField(x, c);
+    scalarField[v] = linearField(x, 0);
+  });
+
+  //search and store the weights of the target positions
+  const auto psCapacity = ptcls->capacity();
+  o::Write<o::LO> elem_ids(psCapacity, -1);
+  auto x = ptcls->get<0>();
+  auto xtgt = ptcls->get<1>();
+  auto pid = ptcls->get<2>();
+  auto weights = ptcls->get<3>();
+  bool isFound;
+  if(dim == 3)
+    isFound = p::search_mesh<Particle>(*mesh, ptcls, x, xtgt, pid, elem_ids,
+                                       o::Write<o::Real>(), o::Write<o::LO>(), 100,
+                                       p::NoWallInteraction(), o::LOs(),
+                                       p::ElmGeometryFP32(), weights);
+  else
+    isFound = p::search_mesh_2d(*mesh, ptcls, x, xtgt, pid, elem_ids, 100,
+                                o::Write<o::LO>(), o::Write<o::Real>(),
+                                p::NoWallInteraction(), o::LOs(), p::ElmGeometryFP32(),
+                                weights);
+  if(!isFound) {
+    fprintf(stderr, "dim %d search failed\n", dim);
+    return 1;
+  }
+  p::migrate_ptcls(picparts, ptcls, o::LOs(elem_ids));
+  //migration moves the particles, refresh the segments
+  xtgt = ptcls->get<1>();
+  weights = ptcls->get<3>();
+
+  //the cached weights are used first as the field members start zeroed
+  int fails = 0;
+  p::gather_from_vertices(*mesh, ptcls, xtgt, o::Reals(vecField), ptcls->get<4>(),
+                          weights);
+  p::gather_from_vertices(*mesh, ptcls, xtgt, o::Reals(scalarField), ptcls->get<5>(),
+                          weights);
+  fails += checkFields(*mesh, ptcls, dim == 3 ? "3d cached" : "2d cached");
+  p::gather_from_vertices(*mesh, ptcls, xtgt, o::Reals(vecField), ptcls->get<4>());
+  p::gather_from_vertices(*mesh, ptcls, xtgt, o::Reals(scalarField), ptcls->get<5>());
+  fails += checkFields(*mesh, ptcls, dim == 3 ? "3d computed" : "2d computed");
+  delete ptcls;
+  return fails;
+}
+
+int main(int argc, char** argv) {
+  pumipic::Library pic_lib(&argc, &argv);
+  Omega_h::Library& lib = pic_lib.omega_h_lib();
+  int comm_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  int fails = 0;
+  for(int dim=2; dim<=3; dim++)
+    fails += testGather(lib, dim);
+  if(fails)
+    return EXIT_FAILURE;
+  if(!comm_rank)
+    printf("gather tests passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,176 @@
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_build.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_gyro.hpp"
+#include <particle_structs.hpp>
+#include <Kokkos_Core.hpp>
+#include "pumipic_mesh.hpp"
+#include "pumipic_library.hpp"
+
+using particle_structs::SellCSigma;
+using particle_structs::MemberTypes;
+using pumipic::Vector3d;
+
+namespace o = Omega_h;
+namespace p = pumipic;
+namespace ps = particle_structs;
+
+//position
+typedef MemberTypes<Vector3d> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+const double tol = 1e-10;
+const int meshSize = 8;
+
+OMEGA_H_INLINE double linearField(const double x, const double y) {
+  return 2 * x + 3 * y + 1;
+}
+
+struct ConstantRadius {
+  o::Real radius;
+  OMEGA_H_INLINE o::Real operator()(const int&) const {return radius;}
+};
+
+//Rings with all points inside the mesh average a linear field to its value at the vertex
+int testGather(p::Mesh& picparts, p::GyroAverager& gyro) {
+  o::Mesh* mesh = picparts.mesh();
+  const auto coords = mesh->coords();
+  o::Write<o::Real> field(mesh->nverts());
+  o::parallel_for(mesh->nverts(), OMEGA_H_LAMBDA(const int& v) {
+    field[v] = linearField(coords[v*2], coords[v*2+1]);
+  });
+  auto averaged = gyro.gather(o::Reals(field));
+  const o::LO nrings = gyro.config().num_rings;
+  const o::LO ppr = gyro.config().points_per_ring;
+  const auto map = gyro.mapVerts();
+  o::Write<o::LO> failures(1, 0);
+  o::Write<o::LO> complete(1, 0);
+  o::parallel_for(mesh->nverts(), OMEGA_H_LAMBDA(const int& v) {
+    for(int r=0; r<nrings; r++) {
+      bool inside = true;
+      for(int k=0; k<ppr; k++)
+        inside = inside && map[((v*nrings + r)*ppr + k)*3] >= 0;
+      if(!inside)
+        continue;
+      Kokkos::atomic_fetch_add(&(complete[0]), 1);
+      if(fabs(averaged[v*nrings + r] - field[v]) > tol)
+        Kokkos::atomic_fetch_add(&(failures[0]), 1);
+    }
+  });
+  int fails = 0;
+  if(o::HostRead<o::LO>(complete)[0] == 0) {
+    fprintf(stderr, "no gyro ring is inside the mesh\n");
+    ++fails;
+  }
+  if(o::HostRead<o::LO>(failures)[0]) {
+    fprintf(stderr, "%d gyro averages of a linear field are wrong\n",
+            o::HostRead<o::LO>(failures)[0]);
+    ++fails;
+  }
+  return fails;
+}
+
+//Changing the number of rings only searches for the new rings
+int testIncremental(p::Mesh& picparts) {
+  const o::LO nverts = picparts.mesh()->nverts();
+  p::GyroConfig config = {0.1, 2, 8, 0};
+  p::GyroAverager gyro(picparts, config);
+  int fails = 0;
+  config.num_rings = 4;
+  gyro.setConfig(config);
+  if(gyro.numSearchedPoints() != nverts * 2 * config.points_per_ring) {
+    fprintf(stderr, "incremental rebuild searched %d points\n", gyro.numSearchedPoints());
+    ++fails;
+  }
+  p::GyroAverager fresh(picparts, config);
+  const auto verts = gyro.mapVerts();
+  const auto freshVerts = fresh.mapVerts();
+  const auto weights = gyro.mapWeights();
+  const auto freshWeights = fresh.mapWeights();
+  o::Write<o::LO> failures(1, 0);
+  o::parallel_for(verts.size(), OMEGA_H_LAMBDA(const int& i) {
+    if(verts[i] != freshVerts[i] || fabs(weights[i] - freshWeights[i]) > tol)
+      Kokkos::atomic_fetch_add(&(failures[0]), 1);
+  });
+  if(o::HostRead<o::LO>(failures)[0]) {
+    fprintf(stderr, "incremental map differs from a full rebuild\n");
+    ++fails;
+  }
+  fails += testGather(picparts, gyro);
+  return fails;
+}
+
+//Charges deposited around interior vertices are conserved by the scatter
+int testScatter(p::Mesh& picparts) {
+  o::Mesh* mesh = picparts.mesh();
+  const o::LO ne = mesh->nelems();
+  const auto coords = mesh->coords();
+  const auto elm2verts = mesh->ask_elem_verts();
+  const double margin = 1.0 / meshSize - 1e-8;
+  const int ppe = 2;
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  o::GOs mesh_element_gids = picparts.globalIds(picparts.dim());
+  o::parallel_for(ne, OMEGA_H_LAMBDA(const int& e) {
+    bool interior = true;
+    for(int i=0; i<3; i++)
+      for(int j=0; j<2; j++) {
+        const double c = coords[elm2verts[e*3+i]*2+j];
+        interior = interior && c > margin && c < 1 - margin;
+      }
+    ptcls_per_elem(e) = interior ? ppe : 0;
+    element_gids(e) = mesh_element_gids[e];
+  });
+  o::LO np = 0;
+  Kokkos::parallel_reduce(ne, KOKKOS_LAMBDA(const int& e, o::LO& sum) {
+    sum += ptcls_per_elem(e);
+  }, np);
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new SellCSigma<Particle>(policy, INT_MAX, 1024, ne, np,
+                                       ptcls_per_elem, element_gids);
+  auto x = ptcls->get<0>();
+  auto setPtcls = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      for(int j=0; j<2; j++) {
+        double c = 0;
+        for(int i=0; i<3; i++)
+          c += coords[elm2verts[e*3+i]*2+j];
+        x(pid,j) = c / 3;
+      }
+      x(pid,2) = 0;
+    }
+  };
+  ps::parallel_for(ptcls, setPtcls, "setPtcls");
+
+  int fails = 0;
+  p::GyroConfig config = {0.05, 2, 8, 0};
+  p::GyroAverager gyro(picparts, config);
+  const ConstantRadius radius = {0.03};
+  auto field = gyro.scatter(ptcls, x, radius);
+  const double deposited = o::get_sum(o::Reals(field));
+  if(fabs(deposited - np) > tol * np) {
+    fprintf(stderr, "gyro scatter deposited %f of %d\n", deposited, np);
+    ++fails;
+  }
+  delete ptcls;
+  return fails;
+}
+
+int main(int argc, char** argv) {
+  pumipic::Library pic_lib(&argc, &argv);
+  Omega_h::Library& lib = pic_lib.omega_h_lib();
+  int comm_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  auto full_mesh = o::build_box(lib.world(), OMEGA_H_SIMPLEX, 1, 1, 0,
+                                meshSize, meshSize, 0);
+  o::Write<o::LO> owner(full_mesh.nelems(), 0);
+  p::Mesh picparts(full_mesh, owner);
+  int fails = 0;
+  fails += testIncremental(picparts);
+  fails += testScatter(picparts);
+  if(fails)
+    return EXIT_FAILURE;
+  if(!comm_rank)
+    printf("gyro tests passed\n");
+  return EXIT_SUCCESS;
+}
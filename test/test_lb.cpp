@@ -1,4 +1,5 @@
 #include <fstream>
+#include <vector>
 
 #include <particle_structs.hpp>
 #include <Omega_h_file.hpp>  //gmsh
@@ -11,7 +12,11 @@ typedef pumipic::MemberTypes<int> Particle;
 typedef pumipic::ParticleStructure<Particle> PS;
 
 void printImb(PS* ptcls);
+PS* createPtcls(pumipic::Mesh& picparts);
+std::vector<int> countTargets(PS* ptcls, PS::kkLidView new_parts, int comm_size);
 void balancePtcls(pumipic::Mesh& picparts, PS* ptcls, pumipic::ParticleBalancer& balancer);
+int lazyBalance(pumipic::Mesh& picparts, PS* ptcls, pumipic::ParticleBalancer& balancer);
+int elementSelection(pumipic::Mesh& picparts, pumipic::ParticleBalancer& balancer);
 
 
 int main(int argc, char** argv) {
@@ -59,34 +64,7 @@ int main(int argc, char** argv) {
   //Build Particle Balancer
   pumipic::ParticleBalancer balancer(picparts);
 
-  //Create 100 particles/elem on even ranks only
-  int num_ptcls = 0;
-  PS::kkLidView ptcls_per_elem("ptcls_per_elem", picparts->nelems());
-  PS::kkGidView element_gids("element_gids", picparts->nelems());
-  Omega_h::GOs mesh_element_gids = picparts.globalIds(picparts.dim());
-  if (rank % 2 == 0) {
-    const int ppe = 100;
-    Omega_h::parallel_for(picparts->nelems(), OMEGA_H_LAMBDA(const int& i) {
-      ptcls_per_elem(i) = ppe;
-      element_gids(i) = mesh_element_gids[i];
-    });
-    num_ptcls = ppe * picparts->nelems();
-  }
-  else {
-    Omega_h::parallel_for(picparts->nelems(), OMEGA_H_LAMBDA(const int& i) {
-      ptcls_per_elem(i) = 0;
-      element_gids(i) = mesh_element_gids[i];
-    });
-
-  }
-
-  const int sigma = INT_MAX; // full sorting
-  const int V = 1024;
-  const int C = 32;
-  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, C);
-
-  PS* ptcls = new pumipic::SellCSigma<Particle>(policy, sigma, V, picparts->nelems(),
-                                                num_ptcls, ptcls_per_elem, element_gids);
+  PS* ptcls = createPtcls(picparts);
 
   printImb(ptcls);
 
@@ -96,6 +74,10 @@ int main(int argc, char** argv) {
 
   balancePtcls(picparts, ptcls, balancer);
 
+  fail += lazyBalance(picparts, ptcls, balancer);
+
+  fail += elementSelection(picparts, balancer);
+
   auto globalIds = picparts.globalIds(picparts->dim());
   picparts->add_tag<Omega_h::GO>(picparts->dim(), "global_ids", 1, globalIds);
   char render_name[128];
@@ -137,6 +119,161 @@ void balancePtcls(pumipic::Mesh& picparts, PS* ptcls, pumipic::ParticleBalancer&
   printImb(ptcls);
 }
 
+//Same weight for every particle of a process, heavier on higher ranks
+struct RankWeight {
+  double w;
+  KOKKOS_INLINE_FUNCTION double operator()(const int) const {return w;}
+};
+
+//Lazy repartitions skip balanced particles and reuse the plan of unchanged weights
+int lazyBalance(pumipic::Mesh& picparts, PS* ptcls, pumipic::ParticleBalancer& balancer) {
+  int comm_rank = picparts.comm()->rank();
+  const int comm_size = picparts.comm()->size();
+  if (comm_size < 2) {
+    if (!comm_rank)
+      printf("Lazy balancing needs at least 2 processes, skipping\n");
+    return 0;
+  }
+  const int ps_capacity = ptcls->capacity();
+  PS::kkLidView new_elems("ps_elem_ids", ps_capacity);
+  PS::kkLidView new_parts("ps_process_ids", ps_capacity);
+  auto setValues = PS_LAMBDA(const int elm, const int ptcl, const bool mask) {
+    new_elems(ptcl) = mask ? elm : -1;
+    new_parts(ptcl) = comm_rank;
+  };
+  int fail = 0;
+  balancer.setLazyBalancing(true);
+  pumipic::parallel_for(ptcls, setValues);
+  const int balances = balancer.numBalances();
+  balancer.repartition(picparts, ptcls, 1e6, new_elems, new_parts);
+  if (balancer.numSkippedBalances() != 1 || balancer.numBalances() != balances) {
+    fprintf(stderr, "[ERROR] Lazy repartition under tolerance ran the balancer\n");
+    ++fail;
+  }
+
+  /* Weighting the particles by rank makes the processes imbalanced so tol 1.0 cannot
+     be met, and changes the sbar weights from the last unit weight balance so the
+     first repartition runs EnGPar. Balancing twice with the same particles then
+     reuses the first plan
+  */
+  RankWeight weight = {comm_rank + 1.0};
+  std::vector<int> targets[2];
+  for (int i = 0; i < 2; ++i) {
+    pumipic::parallel_for(ptcls, setValues);
+    balancer.repartition(picparts, ptcls, 1.0, new_elems, new_parts, 0.5, weight);
+    targets[i] = countTargets(ptcls, new_parts, comm_size);
+  }
+  const int ran = balancer.numBalances() - balances;
+  if (balancer.numSkippedBalances() != 1 || ran != 1 || balancer.numReusedPlans() != 1) {
+    fprintf(stderr, "[ERROR] Lazy repartition skipped %d, ran the balancer %d times and "
+            "reused %d plans instead of 1, 1 and 1\n", balancer.numSkippedBalances(), ran,
+            balancer.numReusedPlans());
+    ++fail;
+  }
+  if (targets[0] != targets[1]) {
+    fprintf(stderr, "[ERROR] Rank %d reused plan moved different particles than the first plan\n",
+            comm_rank);
+    ++fail;
+  }
+  if (!comm_rank)
+    printf("Repartitions %d balances %d skipped %d reused %d\n", balancer.numRepartitions(),
+           balancer.numBalances(), balancer.numSkippedBalances(), balancer.numReusedPlans());
+  balancer.setLazyBalancing(false);
+  return fail;
+}
+
+/* Element selection sends all particles of an element to the same process
+   Runs on a new copy of the initial, unbalanced, particles so the plan has weight to move
+*/
+int elementSelection(pumipic::Mesh& picparts, pumipic::ParticleBalancer& balancer) {
+  int comm_rank = picparts.comm()->rank();
+  if (picparts.comm()->size() < 2) {
+    if (!comm_rank)
+      printf("Element selection needs at least 2 processes, skipping\n");
+    return 0;
+  }
+  PS* ptcls = createPtcls(picparts);
+  const int ps_capacity = ptcls->capacity();
+  PS::kkLidView new_elems("ps_elem_ids", ps_capacity);
+  PS::kkLidView new_parts("ps_process_ids", ps_capacity);
+  auto setValues = PS_LAMBDA(const int elm, const int ptcl, const bool mask) {
+    new_elems(ptcl) = mask ? elm : -1;
+    new_parts(ptcl) = comm_rank;
+  };
+  pumipic::parallel_for(ptcls, setValues);
+  balancer.setSelectionMode(pumipic::ParticleBalancer::ELEMENT_SELECTION);
+  balancer.repartition(picparts, ptcls, 1.05, new_elems, new_parts);
+  balancer.setSelectionMode(pumipic::ParticleBalancer::ARRIVAL_SELECTION);
+
+  const int ne = picparts->nelems();
+  Omega_h::Write<Omega_h::LO> min_part(ne, INT_MAX);
+  Omega_h::Write<Omega_h::LO> max_part(ne, -1);
+  auto elementParts = PS_LAMBDA(const int elm, const int ptcl, const bool mask) {
+    if (mask) {
+      Kokkos::atomic_min(&(min_part[elm]), new_parts(ptcl));
+      Kokkos::atomic_max(&(max_part[elm]), new_parts(ptcl));
+    }
+  };
+  pumipic::parallel_for(ptcls, elementParts);
+  Omega_h::Write<Omega_h::LO> split(1, 0);
+  Omega_h::Write<Omega_h::LO> sent(1, 0);
+  Omega_h::parallel_for(ne, OMEGA_H_LAMBDA(const int& e) {
+    if (max_part[e] >= 0 && min_part[e] != max_part[e])
+      Kokkos::atomic_add(&(split[0]), 1);
+    if (max_part[e] >= 0 && min_part[e] != comm_rank)
+      Kokkos::atomic_add(&(sent[0]), 1);
+  });
+  const int local[2] = {Omega_h::HostRead<Omega_h::LO>(split)[0],
+                        Omega_h::HostRead<Omega_h::LO>(sent)[0]};
+  int total[2];
+  MPI_Allreduce(local, total, 2, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  int fail = 0;
+  if (total[0]) {
+    fprintf(stderr, "[ERROR] Element selection split %d elements\n", total[0]);
+    ++fail;
+  }
+  if (!total[1]) {
+    fprintf(stderr, "[ERROR] Element selection did not send any elements\n");
+    ++fail;
+  }
+  if (!comm_rank)
+    printf("Element selection sent %d elements\n", total[1]);
+  delete ptcls;
+  return fail;
+}
+
+//Create 100 particles/elem on even ranks only
+PS* createPtcls(pumipic::Mesh& picparts) {
+  int rank = picparts.comm()->rank();
+  int num_ptcls = 0;
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", picparts->nelems());
+  PS::kkGidView element_gids("element_gids", picparts->nelems());
+  Omega_h::GOs mesh_element_gids = picparts.globalIds(picparts.dim());
+  if (rank % 2 == 0) {
+    const int ppe = 100;
+    Omega_h::parallel_for(picparts->nelems(), OMEGA_H_LAMBDA(const int& i) {
+      ptcls_per_elem(i) = ppe;
+      element_gids(i) = mesh_element_gids[i];
+    });
+    num_ptcls = ppe * picparts->nelems();
+  }
+  else {
+    Omega_h::parallel_for(picparts->nelems(), OMEGA_H_LAMBDA(const int& i) {
+      ptcls_per_elem(i) = 0;
+      element_gids(i) = mesh_element_gids[i];
+    });
+
+  }
+
+  const int sigma = INT_MAX; // full sorting
+  const int V = 1024;
+  const int C = 32;
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, C);
+
+  return new pumipic::SellCSigma<Particle>(policy, sigma, V, picparts->nelems(),
+                                           num_ptcls, ptcls_per_elem, element_gids);
+}
+
 void printImb(PS* ptcls) {
   int np = ptcls->nPtcls();
   int min_p, max_p, tot_p;
@@ -154,3 +291,19 @@ void printImb(PS* ptcls) {
     printf("Ptcl LB <max, min, avg, imb>: %d %d %.3f %.3f\n", max_p, min_p, avg, imb);
   }
 }
+
+//Number of particles sent to each process, the particles that stay are not counted
+std::vector<int> countTargets(PS* ptcls, PS::kkLidView new_parts, int comm_size) {
+  int comm_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+  Kokkos::View<int*> counts("target_counts", comm_size);
+  auto countParts = PS_LAMBDA(const int elm, const int ptcl, const bool mask) {
+    if (mask && new_parts(ptcl) != comm_rank)
+      Kokkos::atomic_add(&(counts(new_parts(ptcl))), 1);
+  };
+  pumipic::parallel_for(ptcls, countParts);
+  auto counts_host = Kokkos::create_mirror_view(counts);
+  Kokkos::deep_copy(counts_host, counts);
+  std::vector<int> targets(counts_host.data(), counts_host.data() + comm_size);
+  return targets;
+}
@@ -0,0 +1,44 @@
+#include <Omega_h_file.hpp>  //gmsh
+#include <Omega_h_array_ops.hpp>
+#include <pumipic_mesh.hpp>
+
+/* The binary partition file gives the same partition vector as the text file */
+int main(int argc, char** argv) {
+  pumipic::Library pic_lib(&argc, &argv);
+  Omega_h::Library& lib = pic_lib.omega_h_lib();
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+  if (argc != 4) {
+    if (!rank)
+      fprintf(stderr, "Usage: %s <mesh> <.ptn or .cpn partition> <.bptn partition>\n",
+              argv[0]);
+    return EXIT_FAILURE;
+  }
+  Omega_h::Mesh mesh = Omega_h::read_mesh_file(argv[1], lib.self());
+
+  Kokkos::Timer timer;
+  pumipic::Input text_input(mesh, argv[2], pumipic::Input::FULL, pumipic::Input::FULL);
+  const double text_time = timer.seconds();
+  timer.reset();
+  pumipic::Input binary_input(mesh, argv[3], pumipic::Input::FULL, pumipic::Input::FULL);
+  const double binary_time = timer.seconds();
+  if (!rank)
+    printf("Partition loading text %.6f s binary %.6f s\n", text_time, binary_time);
+
+  int fail = 0;
+  if (text_input.getRule() != binary_input.getRule()) {
+    fprintf(stderr, "[ERROR] Rank %d binary partition has a different ownership rule\n",
+            rank);
+    ++fail;
+  }
+  else if (!(text_input.getPartition() == binary_input.getPartition())) {
+    fprintf(stderr, "[ERROR] Rank %d binary partition has different owners\n", rank);
+    ++fail;
+  }
+
+  int total_fail;
+  MPI_Reduce(&fail, &total_fail, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (!rank && !total_fail)
+    printf("All tests passed\n");
+  return total_fail;
+}
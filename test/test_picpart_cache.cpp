@@ -0,0 +1,100 @@
+#include <Kokkos_Core.hpp>
+#include "pumipic_library.hpp"
+#include "pumipic_mesh.hpp"
+#include "pumipic_lb.hpp"
+#include "boxTestMesh.hpp"
+
+/* Picparts loaded from the cache match the picparts constructed from the full mesh.
+   The first construction with the cache may load or write it, the second must load it.
+*/
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+const int meshSize = 12;
+
+int compareParts(p::Mesh& cached, p::Mesh& picparts) {
+  int fails = 0;
+  const int dim = picparts.dim();
+  for (int d = 0; d <= dim; ++d) {
+    fails += compare("entities", cached.nents(d), picparts.nents(d));
+    fails += compare("buffered parts", cached.numBuffers(d), picparts.numBuffers(d));
+    fails += compare("global ids", o::get_sum(cached.globalIds(d)),
+                     o::get_sum(picparts.globalIds(d)));
+    fails += compare("comm array indices", o::get_sum(cached.commArrayIndex(d)),
+                     o::get_sum(picparts.commArrayIndex(d)));
+  }
+  fails += compare("safe elements", o::get_sum(cached.safeTag()),
+                   o::get_sum(picparts.safeTag()));
+  fails += compare("sbar ids", o::get_sum(cached.ptclBalancer()->getSbarIDs(cached)),
+                   o::get_sum(picparts.ptclBalancer()->getSbarIDs(picparts)));
+  fails += compare("vertex sharing", vertexSharing(cached), vertexSharing(picparts));
+  return fails;
+}
+
+int testCache(o::Mesh& mesh, o::LOs owner, p::Input::Method method, const char* cache_dir) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  p::Input input(mesh, p::Input::PARTITION, owner, method, method);
+  Kokkos::Timer timer;
+  p::Mesh picparts(input);
+  const double construct = timer.seconds();
+  input.cache_dir = cache_dir;
+  p::Mesh first(input);
+  timer.reset();
+  p::Mesh second(input);
+  const double load = timer.seconds();
+  int fails = compareParts(first, picparts) + compareParts(second, picparts);
+  if (!second.loadedFromCache()) {
+    fprintf(stderr, "[ERROR] Rank %d did not load the picparts from the cache\n", rank);
+    ++fails;
+  }
+  if (!rank)
+    printf("Method %d first construction loaded from the cache %d, construction %f s, "
+           "cache key and load %f s\n", method, first.loadedFromCache(), construct, load);
+  return fails;
+}
+
+//Changing the values of a tag on the full mesh does not load the stale picparts
+int testTagChange(o::Mesh& mesh, o::LOs owner, const char* cache_dir) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  p::Input input(mesh, p::Input::PARTITION, owner, p::Input::BFS, p::Input::BFS);
+  input.cache_dir = cache_dir;
+  mesh.add_tag(mesh.dim(), "field", 1, o::Reals(mesh.nelems(), 1.0));
+  p::Mesh first(input);
+  mesh.set_tag(mesh.dim(), "field", o::Reals(mesh.nelems(), 2.0));
+  p::Mesh changed(input);
+  int fails = 0;
+  if (changed.loadedFromCache()) {
+    fprintf(stderr, "[ERROR] Rank %d loaded the picparts of different tag values\n", rank);
+    ++fails;
+  }
+  else if (o::get_sum(changed->get_array<o::Real>(changed.dim(), "field")) !=
+           2.0 * changed.nelems()) {
+    fprintf(stderr, "[ERROR] Rank %d picpart has stale tag values\n", rank);
+    ++fails;
+  }
+  mesh.remove_tag(mesh.dim(), "field");
+  return fails;
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  const int rank = lib.world()->rank();
+  const int comm_size = lib.world()->size();
+  const char* cache_dir = argc > 1 ? argv[1] : "picpart_cache";
+  auto mesh = buildBoxMesh(lib, meshSize);
+  o::LOs owner = stripOwners(mesh, comm_size);
+
+  int fails = testCache(mesh, owner, p::Input::BFS, cache_dir);
+  fails += testCache(mesh, owner, p::Input::FULL, cache_dir);
+  fails += testTagChange(mesh, owner, cache_dir);
+
+  int total_fails;
+  MPI_Reduce(&fails, &total_fails, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (!rank && !total_fails)
+    printf("All tests passed\n");
+  return total_fails;
+}
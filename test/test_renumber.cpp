@@ -0,0 +1,87 @@
+#include <Kokkos_Core.hpp>
+#include "pumipic_library.hpp"
+#include "pumipic_mesh.hpp"
+#include "pumipic_lb.hpp"
+#include "boxTestMesh.hpp"
+
+/* Renumbered picparts have the same entities, tags and communication as the
+   picparts in the order of the full mesh
+*/
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+const int meshSize = 12;
+
+//Vertices whose owner's global id, reduced to every copy, differs from their own
+int vertexGidMismatches(p::Mesh& picparts) {
+  const int rank = picparts.comm()->rank();
+  o::LOs owners = picparts.entOwners(0);
+  o::GOs gids = picparts.globalIds(0);
+  o::Write<o::Real> vals = picparts.createCommArray(0, 1, 0.0);
+  o::LOs comm_index = picparts.commArrayIndex(0);
+  o::parallel_for(picparts->nverts(), OMEGA_H_LAMBDA(const o::LO v) {
+    if (owners[v] == rank)
+      vals[comm_index[v]] = gids[v];
+  });
+  picparts.reduceCommArray(0, p::Mesh::SUM_OP, vals);
+  o::Write<o::LO> mismatches(1, 0);
+  o::parallel_for(picparts->nverts(), OMEGA_H_LAMBDA(const o::LO v) {
+    if (vals[comm_index[v]] != gids[v])
+      Kokkos::atomic_add(&(mismatches[0]), 1);
+  });
+  return o::HostRead<o::LO>(mismatches)[0];
+}
+
+//Elements whose full mesh element has a different global id
+int mismatchedElements(p::Mesh& picparts, o::Mesh& full_mesh) {
+  o::LOs full_ids = picparts.fullMeshElements();
+  o::GOs gids = picparts.globalIds(picparts.dim());
+  o::GOs full_gids = full_mesh.get_array<o::GO>(full_mesh.dim(), "gids");
+  o::Write<o::LO> mismatches(1, 0);
+  o::parallel_for(picparts->nelems(), OMEGA_H_LAMBDA(const o::LO e) {
+    if (full_gids[full_ids[e]] != gids[e])
+      Kokkos::atomic_add(&(mismatches[0]), 1);
+  });
+  return o::HostRead<o::LO>(mismatches)[0];
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  const int rank = lib.world()->rank();
+  const int comm_size = lib.world()->size();
+  auto mesh = buildBoxMesh(lib, meshSize);
+  o::LOs owner = stripOwners(mesh, comm_size);
+
+  p::Input input(mesh, p::Input::PARTITION, owner, p::Input::BFS, p::Input::BFS);
+  p::Mesh natural(input);
+  const int dim = natural.dim();
+  int fails = 0;
+  const p::Input::Ordering orderings[2] = {p::Input::SFC_ORDER, p::Input::RCM_ORDER};
+  for (int i = 0; i < 2; ++i) {
+    input.ordering = orderings[i];
+    p::Mesh picparts(input);
+    for (int d = 0; d <= dim; ++d) {
+      fails += compare("entities", picparts.nents(d), natural.nents(d));
+      fails += compare("buffered parts", picparts.numBuffers(d), natural.numBuffers(d));
+      fails += compare("global ids", o::get_sum(picparts.globalIds(d)),
+                       o::get_sum(natural.globalIds(d)));
+      fails += compare("rank local ids", o::get_sum(picparts.rankLocalIndex(d)),
+                       o::get_sum(natural.rankLocalIndex(d)));
+    }
+    fails += compare("safe elements", o::get_sum(picparts.safeTag()),
+                     o::get_sum(natural.safeTag()));
+    fails += compare("sbar ids", o::get_sum(picparts.ptclBalancer()->getSbarIDs(picparts)),
+                     o::get_sum(natural.ptclBalancer()->getSbarIDs(natural)));
+    fails += compare("vertex sharing", vertexSharing(picparts), vertexSharing(natural));
+    fails += compare("vertex gid mismatches", vertexGidMismatches(picparts), 0);
+    fails += compare("full mesh element mismatches", mismatchedElements(picparts, mesh), 0);
+  }
+
+  int total_fails;
+  MPI_Reduce(&fails, &total_fails, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (!rank && !total_fails)
+    printf("All tests passed\n");
+  return total_fails;
+}
@@ -0,0 +1,153 @@
+#include <Kokkos_Core.hpp>
+#include <particle_structs.hpp>
+#include "pumipic_library.hpp"
+#include "pumipic_mesh.hpp"
+#include "pumipic_repartition.hpp"
+#include "boxTestMesh.hpp"
+
+namespace o = Omega_h;
+namespace p = pumipic;
+
+//global id of the element the particle was created in
+typedef p::MemberTypes<int> Particle;
+typedef p::ParticleStructure<Particle> PS;
+
+const int meshSize = 16;
+
+struct CreatePtcls {
+  PS* operator()(int ne, int np, PS::kkLidView ptcls_per_elem, PS::kkGidView element_gids,
+                 PS::kkLidView particle_elements, p::MemberTypeViews particle_info) const {
+    Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+    return new p::SellCSigma<Particle>(policy, INT_MAX, 1024, ne, np, ptcls_per_elem,
+                                       element_gids, particle_elements, particle_info);
+  }
+};
+
+//Every core element has one particle, the elements of rank 0 have eight
+PS* createPtcls(p::Mesh& picparts) {
+  const int rank = picparts.comm()->rank();
+  const int ne = picparts->nelems();
+  auto owners = picparts.entOwners(picparts.dim());
+  auto gids = picparts.globalIds(picparts.dim());
+  const int ppe = rank ? 1 : 8;
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  o::parallel_for(ne, OMEGA_H_LAMBDA(const int& e) {
+    ptcls_per_elem(e) = owners[e] == rank ? ppe : 0;
+    element_gids(e) = gids[e];
+  });
+  int np = 0;
+  Kokkos::parallel_reduce(ne, KOKKOS_LAMBDA(const int& e, int& sum) {
+    sum += ptcls_per_elem(e);
+  }, np);
+  PS* ptcls = CreatePtcls()(ne, np, ptcls_per_elem, element_gids, PS::kkLidView(), NULL);
+  auto origin = ptcls->get<0>();
+  auto setOrigin = PS_LAMBDA(const int& e, const int& ptcl, const bool& mask) {
+    if (mask)
+      origin(ptcl) = gids[e];
+  };
+  p::parallel_for(ptcls, setOrigin, "setOrigin");
+  return ptcls;
+}
+
+//Counts the particles outside their starting element or the safe zone
+int checkPtcls(p::Mesh& picparts, PS* ptcls) {
+  auto gids = picparts.globalIds(picparts.dim());
+  auto safe = picparts.safeTag();
+  auto origin = ptcls->get<0>();
+  o::Write<o::LO> failures(1, 0);
+  auto checkElements = PS_LAMBDA(const int& e, const int& ptcl, const bool& mask) {
+    if (mask && (origin(ptcl) != gids[e] || !safe[e]))
+      Kokkos::atomic_add(&(failures[0]), 1);
+  };
+  p::parallel_for(ptcls, checkElements, "checkElements");
+  return o::HostRead<o::LO>(failures)[0];
+}
+
+//Counts the elements whose user tag is not their full mesh index or zero for new elements
+int checkUserTag(p::Mesh& picparts) {
+  auto full_ids = picparts.fullMeshElements();
+  auto tag = picparts->get_array<o::LO>(picparts.dim(), "user_full_ids");
+  o::Write<o::LO> failures(1, 0);
+  o::parallel_for(picparts->nelems(), OMEGA_H_LAMBDA(const int& e) {
+    if (tag[e] != full_ids[e] && tag[e] != 0)
+      Kokkos::atomic_add(&(failures[0]), 1);
+  });
+  return o::HostRead<o::LO>(failures)[0];
+}
+
+int main(int argc, char** argv) {
+  p::Library pic_lib(&argc, &argv);
+  o::Library& lib = pic_lib.omega_h_lib();
+  const int rank = lib.world()->rank();
+  const int comm_size = lib.world()->size();
+  auto full_mesh = buildBoxMesh(lib, meshSize);
+  o::LOs owner = stripOwners(full_mesh, comm_size);
+  p::Mesh picparts(full_mesh, owner, 3, 2);
+  picparts->add_tag<o::LO>(picparts.dim(), "user_full_ids", 1, picparts.fullMeshElements());
+
+  PS* ptcls = createPtcls(picparts);
+  int fails = 0;
+  int np = ptcls->nPtcls();
+  int total_np;
+  MPI_Allreduce(&np, &total_np, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  const double start_imb = p::ptclImbalance(MPI_COMM_WORLD, np);
+
+  p::MeshRepartitioner repartitioner(1.2, 2);
+  ptcls = repartitioner.step(picparts, ptcls, CreatePtcls());
+  if (comm_size > 1 && (repartitioner.numRepartitions() != 0 ||
+                        repartitioner.stepsAboveTolerance() != 1)) {
+    fprintf(stderr, "[ERROR] Repartitioned before two steps above the tolerance\n");
+    ++fails;
+  }
+  ptcls = repartitioner.step(picparts, ptcls, CreatePtcls());
+  if (comm_size > 1 && repartitioner.numRepartitions() != 1) {
+    fprintf(stderr, "[ERROR] No repartition after two steps above the tolerance\n");
+    ++fails;
+  }
+
+  np = ptcls->nPtcls();
+  int new_total_np;
+  MPI_Allreduce(&np, &new_total_np, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (new_total_np != total_np) {
+    if (!rank)
+      fprintf(stderr, "[ERROR] Repartition changed the number of particles from %d to %d\n",
+              total_np, new_total_np);
+    ++fails;
+  }
+  const int bad_ptcls = checkPtcls(picparts, ptcls);
+  if (bad_ptcls) {
+    fprintf(stderr, "[ERROR] Rank %d has %d particles outside their element or the safe "
+            "zone\n", rank, bad_ptcls);
+    ++fails;
+  }
+  if (!picparts->has_tag(picparts.dim(), "user_full_ids")) {
+    fprintf(stderr, "[ERROR] Rank %d lost the user tag in the repartition\n", rank);
+    ++fails;
+  }
+  else {
+    const int bad_tags = checkUserTag(picparts);
+    if (bad_tags) {
+      fprintf(stderr, "[ERROR] Rank %d has %d elements with a wrong user tag\n", rank,
+              bad_tags);
+      ++fails;
+    }
+  }
+  const double end_imb = p::ptclImbalance(MPI_COMM_WORLD, np);
+  if (comm_size > 1 && end_imb >= start_imb) {
+    if (!rank)
+      fprintf(stderr, "[ERROR] Repartition did not reduce the imbalance %.3f -> %.3f\n",
+              start_imb, end_imb);
+    ++fails;
+  }
+  if (!rank)
+    printf("Particle imbalance %.3f -> %.3f, picpart kept %d\n", start_imb, end_imb,
+           picparts.keptPICPart());
+  delete ptcls;
+
+  int total_fails;
+  MPI_Reduce(&fails, &total_fails, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+  if (!rank && !total_fails)
+    printf("All tests passed\n");
+  return total_fails;
+}
@@ -0,0 +1,159 @@
+#include <Omega_h_mesh.hpp>
+#include <Omega_h_build.hpp>
+#include "pumipic_kktypes.hpp"
+#include "pumipic_adjacency.hpp"
+#include <particle_structs.hpp>
+#include <Kokkos_Core.hpp>
+#include "pumipic_mesh.hpp"
+
+using particle_structs::SellCSigma;
+using particle_structs::MemberTypes;
+using pumipic::fp_t;
+using pumipic::Vector3d;
+
+namespace o = Omega_h;
+namespace p = pumipic;
+namespace ps = particle_structs;
+
+//current position, target position, particle id
+typedef MemberTypes<Vector3d, Vector3d, int> Particle;
+typedef ps::ParticleStructure<Particle> PS;
+
+//Each element gets one particle per vertex plus one extra.  All particles
+//start at the element centroid.  Particle k<4 is pushed along the line from
+//the centroid through vertex k of the element, so the trajectory passes
+//exactly through a mesh vertex and typically continues along faces and edges
+//of neighboring elements.  The extra particle stops exactly on vertex 0.
+//The box mesh has coordinates that are exact binary fractions so all of these
+//positions are computed without roundoff.
+const int ptclsPerElm = 5;
+const int looplimit = 64;
+
+OMEGA_H_DEVICE o::Vector<3> tetCentroid(o::Matrix<3, 4> M) {
+  o::Vector<3> c;
+  for(int i=0; i<3; i++)
+    c[i] = (M[0][i] + M[1][i] + M[2][i] + M[3][i]) / 4;
+  return c;
+}
+
+void setPtclPositions(o::Mesh& mesh, PS* ptcls) {
+  const auto elm2verts = mesh.ask_elem_verts();
+  const auto coords = mesh.coords();
+  auto x_ps_d = ptcls->get<0>();
+  auto xtgt_ps_d = ptcls->get<1>();
+  auto pid_d = ptcls->get<2>();
+  o::Write<o::LO> elm_count(mesh.nelems(), 0);
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      const auto k = Kokkos::atomic_fetch_add(&(elm_count[e]), 1);
+      const auto verts = o::gather_verts<4>(elm2verts, e);
+      const auto M = p::gatherVectors4x3(coords, verts);
+      const auto c = tetCentroid(M);
+      for(int i=0; i<3; i++) {
+        x_ps_d(pid,i) = c[i];
+        if(k < 4)
+          xtgt_ps_d(pid,i) = 2*M[k][i] - c[i];
+        else
+          xtgt_ps_d(pid,i) = M[0][i];
+      }
+      pid_d(pid) = pid;
+    }
+  };
+  ps::parallel_for(ptcls, lamb, "setPtclPositions");
+}
+
+int checkPtclElements(o::Mesh& mesh, PS* ptcls, o::LOs elem_ids) {
+  const auto elm2verts = mesh.ask_elem_verts();
+  const auto coords = mesh.coords();
+  auto xtgt_ps_d = ptcls->get<1>();
+  auto pid_d = ptcls->get<2>();
+  o::Write<o::LO> failures(1, 0);
+  auto lamb = PS_LAMBDA(const int& e, const int& pid, const int& mask) {
+    if(mask > 0) {
+      const auto dest = p::makeVector3(pid, xtgt_ps_d);
+      const auto elm = elem_ids[pid];
+      bool ok;
+      if(elm >= 0) {
+        const auto verts = o::gather_verts<4>(elm2verts, elm);
+        const auto M = p::gatherVectors4x3(coords, verts);
+        ok = p::point_in_tet_closed(M, dest);
+      } else {
+        //particles that left the domain must have a destination outside
+        //the unit box
+        ok = false;
+        for(int i=0; i<3; i++)
+          ok = ok || dest[i] < 0 || dest[i] > 1;
+      }
+      if(!ok) {
+        printf("ptcl %d dest %f %f %f assigned to elm %d\n",
+               pid_d(pid), dest[0], dest[1], dest[2], elm);
+        Kokkos::atomic_fetch_add(&(failures[0]), 1);
+      }
+    }
+  };
+  ps::parallel_for(ptcls, lamb, "checkPtclElements");
+  return o::HostRead<o::LO>(failures)[0];
+}
+
+int main(int argc, char** argv) {
+  pumipic::Library pic_lib(&argc, &argv);
+  Omega_h::Library& lib = pic_lib.omega_h_lib();
+  int comm_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &comm_rank);
+
+  auto full_mesh = Omega_h::build_box(lib.world(), OMEGA_H_SIMPLEX,
+                                      1, 1, 1, 4, 4, 4);
+  Omega_h::Write<Omega_h::LO> owner(full_mesh.nelems(), 0);
+  p::Mesh picparts(full_mesh, owner);
+  o::Mesh* mesh = picparts.mesh();
+
+  const o::LO ne = mesh->nelems();
+  int numPtcls = ne * ptclsPerElm;
+  PS::kkLidView ptcls_per_elem("ptcls_per_elem", ne);
+  PS::kkGidView element_gids("element_gids", ne);
+  Omega_h::GOs mesh_element_gids = picparts.globalIds(picparts.dim());
+  Omega_h::parallel_for(ne, OMEGA_H_LAMBDA(const int& i) {
+    ptcls_per_elem(i) = ptclsPerElm;
+    element_gids(i) = mesh_element_gids[i];
+  });
+  const int sigma = INT_MAX;
+  const int V = 1024;
+  Kokkos::TeamPolicy<Kokkos::DefaultExecutionSpace> policy(10000, 32);
+  PS* ptcls = new SellCSigma<Particle>(policy, sigma, V, ne, numPtcls,
+                                       ptcls_per_elem, element_gids);
+  setPtclPositions(*mesh, ptcls);
+
+  const auto psCapacity = ptcls->capacity();
+  o::Write<o::LO> elem_ids(psCapacity, -1);
+  o::Write<o::Real> xpoints_d(3 * psCapacity, "intersection points");
+  o::Write<o::LO> xface_id(psCapacity, "intersection faces");
+  auto x = ptcls->get<0>();
+  auto xtgt = ptcls->get<1>();
+  auto pid = ptcls->get<2>();
+  bool isFound = p::search_mesh<Particle>(*mesh, ptcls, x, xtgt, pid, elem_ids,
+                                          xpoints_d, xface_id, looplimit);
+  if(!isFound) {
+    fprintf(stderr, "search_mesh did not finish within %d steps\n", looplimit);
+    return EXIT_FAILURE;
+  }
+  const int failures = checkPtclElements(*mesh, ptcls, o::LOs(elem_ids));
+  if(failures) {
+    fprintf(stderr, "%d particles were assigned to the wrong element\n", failures);
+    return EXIT_FAILURE;
+  }
+  //the single precision walk must find exactly the same elements
+  const auto geom = p::buildElmGeometryFP32(*mesh);
+  o::Write<o::LO> elem_ids_fp32(psCapacity, -1);
+  isFound = p::search_mesh<Particle>(*mesh, ptcls, x, xtgt, pid, elem_ids_fp32,
+                                     o::Write<o::Real>(), o::Write<o::LO>(),
+                                     looplimit, p::NoWallInteraction(), o::LOs(),
+                                     geom);
+  if(!isFound || !(o::LOs(elem_ids) == o::LOs(elem_ids_fp32))) {
+    fprintf(stderr, "single precision search found different elements\n");
+    return EXIT_FAILURE;
+  }
+  if(!comm_rank)
+    printf("robust search of %d particles passed\n", numPtcls);
+  delete ptcls;
+  return EXIT_SUCCESS;
+}
@@ -31,6 +31,24 @@ mpi_test(pseudoPushAndSearch_cube_t2 1
   ./pseudoPushAndSearch --kokkos-threads=2
   ${TEST_DATA_DIR}/cube/7k.osh ignored 200 156 0 0 1)
 
+mpi_test(robust_search 1 ./robust_search --kokkos-threads=1)
+
+mpi_test(deposit 1 ./test_deposit --kokkos-threads=1)
+
+mpi_test(gather 1 ./test_gather --kokkos-threads=1)
+
+mpi_test(gyro 1 ./test_gyro --kokkos-threads=1)
+
+mpi_test(boris 1 ./boris --kokkos-threads=1)
+
+mpi_test(repartition_4 4 ./repartition --kokkos-threads=1)
+
+mpi_test(distributed_construct_4 4 ./distributed_construct --kokkos-threads=1)
+
+mpi_test(picpart_cache_4 4 ./picpart_cache --kokkos-threads=1)
+
+mpi_test(renumber_4 4 ./test_renumber --kokkos-threads=1)
+
 mpi_test(search2d 1 ./search2d
   ${TEST_DATA_DIR})
 
@@ -63,6 +81,9 @@ mpi_test(ptn_loading_cube 2 ./ptn_loading ${TEST_DATA_DIR}/cube.msh testing_cube
 
 mpi_test(print_partition_cube_4 4 ./print_partition ${TEST_DATA_DIR}/cube.msh testing_cube)
 mpi_test(ptn_loading_cube_4 4 ./ptn_loading ${TEST_DATA_DIR}/cube.msh testing_cube_4.ptn 1 3)
+mpi_test(convert_partition_cube_4 1 ./convert_partition testing_cube_4.ptn testing_cube_4.bptn)
+mpi_test(partition_loading_cube_4 4
+         ./partition_loading ${TEST_DATA_DIR}/cube.msh testing_cube_4.ptn testing_cube_4.bptn)
 
 mpi_test(print_partition_pisces_4 4
          ./print_partition ${TEST_DATA_DIR}/pisces/gitr.msh testing_pisces)